@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+/*
+ * HTTP压测工具：多个并发客户端循环“建连-发请求-读到对端关闭”，
+ * 统计吞吐和延迟分位数。服务端每个请求后关闭连接，这里每次都重新建连。
+ *
+ * 用法：trust_chain_http_bench [-h 地址] [-p 端口] [-c 并发数] [-d 秒数] [路径]
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+struct client {
+    pthread_t thread;
+    uint64_t *lat_ns;           /* 每个成功请求的延迟 */
+    size_t count;
+    size_t cap;
+    unsigned long errors;
+};
+
+static struct sockaddr_in server;
+static char request[2048];
+static size_t request_len;
+static volatile int stop;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* 完成一次请求，返回0表示收到了以"HTTP/1.1 2"或"HTTP/1.1 3"开头的响应 */
+static int one_request(void) {
+    char buf[4096];
+    size_t got = 0;
+    char status = 0;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+
+    if (fd < 0) {
+        return -1;
+    }
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(fd, (struct sockaddr *)&server, sizeof(server)) != 0 ||
+        send(fd, request, request_len, MSG_NOSIGNAL) != (ssize_t)request_len) {
+        close(fd);
+        return -1;
+    }
+    for (;;) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        if (got < 10 && got + (size_t)n >= 10) {
+            status = buf[9 - got];
+        }
+        got += (size_t)n;
+    }
+    close(fd);
+    return (status == '2' || status == '3') ? 0 : -1;
+}
+
+static void *client_thread(void *arg) {
+    struct client *c = arg;
+
+    while (!stop) {
+        uint64_t start = now_ns();
+        if (one_request() != 0) {
+            c->errors++;
+            continue;
+        }
+        if (c->count == c->cap) {
+            size_t cap = c->cap ? c->cap * 2 : 4096;
+            uint64_t *grown = realloc(c->lat_ns, cap * sizeof(*grown));
+            if (grown == NULL) {
+                break;
+            }
+            c->lat_ns = grown;
+            c->cap = cap;
+        }
+        c->lat_ns[c->count++] = now_ns() - start;
+    }
+    return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentile_us(const uint64_t *sorted, size_t n, double p) {
+    size_t idx = (size_t)(p * (double)(n - 1));
+    return (double)sorted[idx] / 1000.0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *host = "127.0.0.1";
+    const char *path = "/tee-pubkey?format=der";
+    int port = 8080;
+    int conns = 64;
+    int seconds = 10;
+    int opt;
+    struct client *clients;
+    uint64_t *all;
+    size_t total = 0;
+    unsigned long errors = 0;
+    uint64_t start, elapsed;
+
+    while ((opt = getopt(argc, argv, "h:p:c:d:")) != -1) {
+        switch (opt) {
+        case 'h': host = optarg; break;
+        case 'p': port = atoi(optarg); break;
+        case 'c': conns = atoi(optarg); break;
+        case 'd': seconds = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-h host] [-p port] [-c conns] [-d seconds] [path]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind < argc) {
+        path = argv[optind];
+    }
+    if (conns < 1 || seconds < 1) {
+        fprintf(stderr, "conns and seconds must be positive\n");
+        return 1;
+    }
+
+    memset(&server, 0, sizeof(server));
+    server.sin_family = AF_INET;
+    server.sin_port = htons((uint16_t)port);
+    if (inet_pton(AF_INET, host, &server.sin_addr) != 1) {
+        fprintf(stderr, "invalid address: %s\n", host);
+        return 1;
+    }
+    request_len = (size_t)snprintf(request, sizeof(request),
+                                   "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n",
+                                   path, host);
+
+    clients = calloc((size_t)conns, sizeof(*clients));
+    if (clients == NULL) {
+        return 1;
+    }
+    start = now_ns();
+    for (int i = 0; i < conns; i++) {
+        if (pthread_create(&clients[i].thread, NULL, client_thread, &clients[i]) != 0) {
+            fprintf(stderr, "could not create client thread\n");
+            return 1;
+        }
+    }
+    sleep((unsigned int)seconds);
+    stop = 1;
+    for (int i = 0; i < conns; i++) {
+        pthread_join(clients[i].thread, NULL);
+        total += clients[i].count;
+        errors += clients[i].errors;
+    }
+    elapsed = now_ns() - start;
+
+    all = malloc((total ? total : 1) * sizeof(*all));
+    if (all == NULL) {
+        return 1;
+    }
+    total = 0;
+    for (int i = 0; i < conns; i++) {
+        memcpy(all + total, clients[i].lat_ns, clients[i].count * sizeof(*all));
+        total += clients[i].count;
+        free(clients[i].lat_ns);
+    }
+    free(clients);
+
+    printf("path: %s  connections: %d  duration: %.1fs\n", path, conns, (double)elapsed / 1e9);
+    printf("requests: %zu  errors: %lu  throughput: %.0f req/s\n",
+           total, errors, (double)total * 1e9 / (double)elapsed);
+    if (total > 0) {
+        qsort(all, total, sizeof(*all), cmp_u64);
+        printf("latency us: p50 %.0f  p90 %.0f  p99 %.0f  p99.9 %.0f  max %.0f\n",
+               percentile_us(all, total, 0.50), percentile_us(all, total, 0.90),
+               percentile_us(all, total, 0.99), percentile_us(all, total, 0.999),
+               (double)all[total - 1] / 1000.0);
+    }
+    free(all);
+    return 0;
+}
@@ -0,0 +1,39 @@
+#!/bin/bash
+# 对比两种网络后端：分别用TRUST_CHAIN_NET=threads和uring启动服务，
+# 压测期间用perf统计服务进程的系统调用次数，并输出延迟分位数。
+# 需在能访问TEE的目标机上运行；压测默认请求只在首次访问TA的/tee-pubkey。
+#
+# 用法：bench/net_bench.sh <服务程序> <压测程序> [并发数] [秒数] [路径]
+
+set -e
+
+SERVER=${1:?server binary}
+BENCH=${2:?bench binary}
+CONNS=${3:-64}
+SECONDS_PER_RUN=${4:-10}
+URL_PATH=${5:-/tee-pubkey?format=der}
+PORT=8080
+
+for backend in threads uring; do
+    echo "=== backend: $backend ==="
+    TRUST_CHAIN_NET=$backend "$SERVER" > "/tmp/trust_chain_$backend.log" 2>&1 &
+    pid=$!
+    sleep 2
+
+    # 预热，使公钥缓存就绪
+    "$BENCH" -p $PORT -c 1 -d 1 "$URL_PATH" > /dev/null
+
+    if command -v perf > /dev/null; then
+        perf stat -e raw_syscalls:sys_enter -p $pid -- sleep "$SECONDS_PER_RUN" 2>&1 \
+            | grep raw_syscalls &
+        perf_pid=$!
+    fi
+    "$BENCH" -p $PORT -c "$CONNS" -d "$SECONDS_PER_RUN" "$URL_PATH"
+    if [ -n "$perf_pid" ]; then
+        wait $perf_pid || true
+        perf_pid=
+    fi
+
+    kill $pid
+    wait $pid 2> /dev/null || true
+done
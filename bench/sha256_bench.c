@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+/*
+ * CA侧SHA256压测：对每种CPU支持的实现和几种典型消息长度（叶子、Merkle
+ * 节点、区块），分别逐条调用tc_sha256和一次调用tc_sha256_many，输出每秒
+ * 哈希数，以及相对标量逐条计算的倍数。
+ *
+ * 用法：trust_chain_sha256_bench [消息数]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "tc_sha256.h"
+
+static const char *const impl_names[] = { "scalar", "shani", "avx2", "neon" };
+
+/* 33字节：带前缀的叶子；65字节：Merkle内部节点；其余为常见区块长度 */
+static const size_t msg_sizes[] = { 33, 65, 300, 1024 };
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double run_single(const struct tc_sha256_msg *msgs, size_t count,
+                         uint8_t (*digests)[TC_SHA256_DIGEST_SIZE]) {
+    double start = now_sec();
+    for (size_t i = 0; i < count; i++) {
+        tc_sha256(msgs[i].data, msgs[i].len, digests[i]);
+    }
+    return now_sec() - start;
+}
+
+static double run_many(const struct tc_sha256_msg *msgs, size_t count,
+                       uint8_t (*digests)[TC_SHA256_DIGEST_SIZE]) {
+    double start = now_sec();
+    tc_sha256_many(msgs, count, digests);
+    return now_sec() - start;
+}
+
+int main(int argc, char *argv[]) {
+    size_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+    struct tc_sha256_msg *msgs;
+    uint8_t *data;
+    uint8_t (*digests)[TC_SHA256_DIGEST_SIZE];
+    uint8_t (*expect)[TC_SHA256_DIGEST_SIZE];
+
+    if (count == 0) {
+        fprintf(stderr, "usage: %s [messages]\n", argv[0]);
+        return 1;
+    }
+    msgs = calloc(count, sizeof(*msgs));
+    data = malloc(count * msg_sizes[sizeof(msg_sizes) / sizeof(msg_sizes[0]) - 1]);
+    digests = malloc(count * sizeof(*digests));
+    expect = malloc(count * sizeof(*expect));
+    if (msgs == NULL || data == NULL || digests == NULL || expect == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    srand(1);
+    for (size_t i = 0; i < count * msg_sizes[sizeof(msg_sizes) / sizeof(msg_sizes[0]) - 1]; i++) {
+        data[i] = (uint8_t)rand();
+    }
+
+    printf("%-8s %6s %14s %14s %10s\n", "impl", "bytes", "single/s", "batch/s", "vs scalar");
+    for (size_t s = 0; s < sizeof(msg_sizes) / sizeof(msg_sizes[0]); s++) {
+        double base = 0;
+
+        for (size_t i = 0; i < count; i++) {
+            msgs[i].data = data + i * msg_sizes[s];
+            msgs[i].len = msg_sizes[s];
+        }
+        for (size_t k = 0; k < sizeof(impl_names) / sizeof(impl_names[0]); k++) {
+            double single, batch;
+
+            if (tc_sha256_select(impl_names[k]) != 0) {
+                continue;
+            }
+            single = run_single(msgs, count, expect);
+            batch = run_many(msgs, count, digests);
+            if (memcmp(digests, expect, count * sizeof(*digests)) != 0) {
+                printf("%-8s %6zu batch digests differ from single\n", impl_names[k], msg_sizes[s]);
+                return 1;
+            }
+            if (k == 0) {
+                base = single;
+            }
+            printf("%-8s %6zu %14.0f %14.0f %9.2fx\n", impl_names[k], msg_sizes[s],
+                   count / single, count / batch, base / batch);
+        }
+    }
+
+    free(msgs);
+    free(data);
+    free(digests);
+    free(expect);
+    return 0;
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+/*
+ * TEE签名压测工具：对每种签名算法，让TA构造并签发N个contri_block，
+ * 输出每秒签发的区块数和签名长度。TA需以CFG_TC_BENCH=y编译。
+ *
+ * 用法：trust_chain_sign_bench [区块数]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <tee_client_api.h>
+#include <trust_chain_ta.h>
+#include <trust_chain_abi.h>
+
+static const struct {
+    uint32_t alg;
+    const char *name;
+} algs[] = {
+    { TC_SIG_ALG_RSA_PKCS1_SHA256,  "rsa-pkcs1-sha256" },
+    { TC_SIG_ALG_ECDSA_P256_SHA256, "ecdsa-p256-sha256" },
+    { TC_SIG_ALG_ED25519,           "ed25519" },
+};
+
+int main(int argc, char *argv[]) {
+    TEEC_Context ctx;
+    TEEC_Session sess;
+    TEEC_UUID uuid = TA_TRUST_CHAIN_UUID;
+    TEEC_Operation op;
+    TEEC_Result res;
+    uint32_t err_origin;
+    uint32_t count = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 10) : 1000;
+
+    if (count == 0) {
+        fprintf(stderr, "usage: %s [blocks]\n", argv[0]);
+        return 1;
+    }
+    res = TEEC_InitializeContext(NULL, &ctx);
+    if (res != TEEC_SUCCESS) {
+        fprintf(stderr, "TEEC_InitializeContext failed with code 0x%x\n", res);
+        return 1;
+    }
+    res = TEEC_OpenSession(&ctx, &sess, &uuid, TEEC_LOGIN_PUBLIC, NULL, NULL, &err_origin);
+    if (res != TEEC_SUCCESS) {
+        fprintf(stderr, "TEEC_OpenSession failed with code 0x%x origin 0x%x\n", res, err_origin);
+        TEEC_FinalizeContext(&ctx);
+        return 1;
+    }
+
+    printf("%-20s %10s %12s %10s\n", "algorithm", "blocks", "blocks/s", "sig bytes");
+    for (size_t i = 0; i < sizeof(algs) / sizeof(algs[0]); i++) {
+        memset(&op, 0, sizeof(op));
+        op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_VALUE_OUTPUT,
+                                         TEEC_NONE, TEEC_NONE);
+        op.params[0].value.a = algs[i].alg;
+        op.params[0].value.b = count;
+        res = TEEC_InvokeCommand(&sess, TA_TRUST_CHAIN_CMD_BENCH_SIGN, &op, &err_origin);
+        if (res != TEEC_SUCCESS) {
+            // 平台不支持该算法，或TA未以CFG_TC_BENCH=y编译
+            printf("%-20s failed with code 0x%x origin 0x%x\n", algs[i].name, res, err_origin);
+            continue;
+        }
+        printf("%-20s %10u %12.0f %10u\n", algs[i].name, count,
+               op.params[1].value.a ? count * 1000.0 / op.params[1].value.a : 0.0,
+               op.params[1].value.b);
+    }
+
+    TEEC_CloseSession(&sess);
+    TEEC_FinalizeContext(&ctx);
+    return 0;
+}
@@ -6,9 +6,15 @@
 #include <err.h>
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <sys/random.h>
 #include <netinet/in.h>
 #include <pthread.h>
 
@@ -18,118 +24,261 @@
 /* OP-TEE TEE client API (built by optee_client) */
 #include <tee_client_api.h>
 
-/* For the UUID (found in the TA's h-file(s)) */
+/* For the UUID, commands, operation/role codes and the wire format */
 #include <trust_chain_ta.h>
+#include <trust_chain_abi.h>
 
-// 定义常量
-#define MAX_HASH_LENGTH 64
-#define MAX_KEY_LENGTH 512
-#define MAX_SIGNATURE_LENGTH 512
-
-#define MAX_BLOCK_LENGTH 
-
-// 操作类型常量（与TA端保持一致）
-#define OP_ADD     0
-#define OP_DELETE  1
-#define OP_PUSH    2
-
-// 角色类型常量（与TA端保持一致）
-#define ROLE_ADMIN 0
-#define ROLE_WRITER 1
-
-// 定义结构体（与TA端保持一致）
-struct base_block {
-    uint32_t block_height;
-    char parent_hash[MAX_HASH_LENGTH];
-    uint32_t op;
-    char sigkey[MAX_KEY_LENGTH];
-    char signature[MAX_SIGNATURE_LENGTH];
-    uint64_t trust_timestamp;  // 简化为uint64_t
-    char tee_sig[MAX_SIGNATURE_LENGTH];
-};
-
-struct access_block {
-    struct base_block base;
-    uint32_t role;
-    char pubkey[MAX_KEY_LENGTH];
-};
-
-// 访问控制消息结构体（与TA端保持一致）
-struct access_control_message {
-    uint32_t rep_id;
-    uint32_t op;
-    uint32_t role;
-    char pubkey[MAX_KEY_LENGTH];
-    char sigkey[MAX_KEY_LENGTH];
-    char signature[MAX_SIGNATURE_LENGTH];
-};
-
-/* Contribution区块结构体 */
-struct contribution_block {
-    struct base_block base;          // 继承基础区块
-    char commit_hash[MAX_HASH_LENGTH]; // 提交哈希
-};
+#include "tc_codec.h"
+#include "tc_shard.h"
+#include "tc_view.h"
+#include "tc_sha256.h"
+#include "tc_events.h"
+#include "tc_blocklog.h"
+#include "tc_audit.h"
+#include "tc_pubkey.h"
+#include "tc_push.h"
+#include "tc_acl.h"
+#include "tc_members.h"
+#include "tc_heads.h"
+#include "tc_metrics.h"
+#include "tc_uring.h"
 
 #define PORT 8080
 #define BUFFER_SIZE 4096
+// 请求体的上限，推送区块的commit列表可能远大于一次recv
+#define MAX_REQUEST_SIZE (4 << 20)
 
-// 全局TEE会话
-static TEEC_Context ctx;
-static TEEC_Session sess;
-static int tee_initialized = 0;
-
-// 初始化TEE连接
-int init_tee_connection() {
-    if (tee_initialized) return 0;
-    
-	TEEC_Result res;
-	TEEC_UUID uuid = TA_TRUST_CHAIN_UUID;
-	uint32_t err_origin;
+// TEE分片数：环境变量TRUST_CHAIN_SHARDS，默认取在线CPU数，不超过TC_MAX_SHARDS
+static unsigned int configured_shard_count(void) {
+    const char *env = getenv("TRUST_CHAIN_SHARDS");
+    long count = env ? strtol(env, NULL, 10) : sysconf(_SC_NPROCESSORS_ONLN);
+    if (count < 1) {
+        count = 1;
+    }
+    if (count > TC_MAX_SHARDS) {
+        count = TC_MAX_SHARDS;
+    }
+    return (unsigned int)count;
+}
 
-	res = TEEC_InitializeContext(NULL, &ctx);
-    if (res != TEEC_SUCCESS) {
-        printf("TEEC_InitializeContext failed with code 0x%x\n", res);
+// TEE签名密钥首次生成时的算法：环境变量TRUST_CHAIN_SIGN_ALG，
+// 取rsa-pkcs1-sha256、ecdsa-p256-sha256或ed25519，未设置时由TA决定（RSA）
+static int configured_sign_alg(uint32_t *alg) {
+    const char *env = getenv("TRUST_CHAIN_SIGN_ALG");
+    *alg = 0;
+    if (env == NULL || *env == '\0') {
+        return 0;
+    }
+    *alg = tc_sig_alg_from_name(env);
+    if (*alg == 0) {
+        printf("Unknown TRUST_CHAIN_SIGN_ALG: %s\n", env);
         return -1;
     }
+    return 0;
+}
 
-	res = TEEC_OpenSession(&ctx, &sess, &uuid,
-			       TEEC_LOGIN_PUBLIC, NULL, NULL, &err_origin);
-    if (res != TEEC_SUCCESS) {
-        printf("TEEC_OpenSession failed with code 0x%x origin 0x%x\n", res, err_origin);
-        TEEC_FinalizeContext(&ctx);
-        return -1;
+// 聚合签名窗口：环境变量TRUST_CHAIN_SIGN_BATCH，每个窗口最多签发的区块数，
+// 0（默认）为逐块签名
+static uint32_t configured_sign_batch(void) {
+    const char *env = getenv("TRUST_CHAIN_SIGN_BATCH");
+    long window = env ? strtol(env, NULL, 10) : 0;
+    return window > 0 ? (uint32_t)window : 0;
+}
+
+// 链头树纪元间隔：环境变量TRUST_CHAIN_HEAD_EPOCH_MS，默认1000毫秒，0为不签发
+static unsigned int configured_head_epoch_ms(void) {
+    const char *env = getenv("TRUST_CHAIN_HEAD_EPOCH_MS");
+    long ms = env ? strtol(env, NULL, 10) : 1000;
+    return ms > 0 ? (unsigned int)ms : 0;
+}
+
+// CA侧SHA256实现：环境变量TRUST_CHAIN_SHA256取scalar、shani、avx2或neon，
+// 未设置时按CPU自动选择
+static void configure_sha256(void) {
+    const char *env = getenv("TRUST_CHAIN_SHA256");
+    if (env != NULL && *env != '\0' && tc_sha256_select(env) != 0) {
+        printf("SHA256 implementation %s unavailable, keeping the default\n", env);
+    }
+    printf("SHA256 implementation: %s\n", tc_sha256_impl_name());
+}
+
+// 区块日志目录与批量刷盘间隔：环境变量TRUST_CHAIN_DATA_DIR、TRUST_CHAIN_FSYNC_MS
+// 审计索引放在区块日志目录下的audit子目录，依赖区块日志
+static void init_block_log(void) {
+    const char *dir = getenv("TRUST_CHAIN_DATA_DIR");
+    const char *fsync_env = getenv("TRUST_CHAIN_FSYNC_MS");
+    long fsync_ms = fsync_env ? strtol(fsync_env, NULL, 10) : 10;
+    char audit_dir[PATH_MAX];
+    char push_dir[PATH_MAX];
+    char acl_dir[PATH_MAX];
+
+    if (dir == NULL) {
+        dir = "trust_chain_blocks";
+    }
+    if (fsync_ms < 0) {
+        fsync_ms = 0;
     }
+    if (tc_blocklog_init(dir, (unsigned int)fsync_ms) != 0) {
+        printf("Block log disabled\n");
+        return;
+    }
+    // 推送区块的commit列表，审计索引重建时也要读取，先于审计索引打开
+    snprintf(push_dir, sizeof(push_dir), "%s/pushes", dir);
+    if (tc_push_init(push_dir) != 0) {
+        printf("Push commit lists disabled\n");
+    }
+    snprintf(audit_dir, sizeof(audit_dir), "%s/audit", dir);
+    if (tc_audit_init(audit_dir) != 0) {
+        printf("Audit index disabled\n");
+    }
+    snprintf(acl_dir, sizeof(acl_dir), "%s/acl", dir);
+    if (tc_acl_init(acl_dir) != 0) {
+        printf("ACL checkpoint store disabled\n");
+    }
+}
 
-    tee_initialized = 1;
+// 初始化TEE连接：每个分片一个会话（即一个TA实例）和一个工作线程
+int init_tee_connection() {
+    uint32_t sign_alg;
+    if (configured_sign_alg(&sign_alg) != 0 ||
+        tc_shards_init(configured_shard_count(), sign_alg, configured_sign_batch()) != 0) {
+        return -1;
+    }
+    if (tc_heads_init(configured_head_epoch_ms()) != 0) {
+        printf("Head tree epochs disabled\n");
+    }
     printf("TEE connection initialized successfully\n");
     return 0;
 }
 
 // 关闭TEE连接
 void close_tee_connection() {
-    if (tee_initialized) {
-        TEEC_CloseSession(&sess);
-        TEEC_FinalizeContext(&ctx);
-        tee_initialized = 0;
-        printf("TEE connection closed\n");
+    tc_heads_close();
+    tc_shards_close();
+    printf("TEE connection closed\n");
+}
+
+// HTTP状态码对应的原因短语
+static const char *http_reason(int status_code) {
+    switch (status_code) {
+    case 200: return "OK";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 409: return "Conflict";
+    case 413: return "Payload Too Large";
+    case 416: return "Range Not Satisfiable";
+    case 503: return "Service Unavailable";
+    default:  return "Internal Server Error";
     }
 }
 
-// 发送JSON响应
-void send_json_response(int client_socket, int status_code, const char *json_response) {
-    char response[2048];
-    snprintf(response, sizeof(response),
-             "HTTP/1.1 %d OK\r\n"
-             "Content-Type: application/json\r\n"
+// 写出响应数据；io_uring后端的工作线程中先缓存，处理完由事件循环发送
+static void send_raw(int client_socket, const void *data, size_t len) {
+    if (!tc_uring_capture(data, len)) {
+        (void)write(client_socket, data, len);
+    }
+}
+
+// 发送HTTP响应，extra_headers为空或以\r\n结尾的若干行
+static void send_http_response(int client_socket, int status_code, const char *content_type,
+                               const char *extra_headers, const void *body, size_t body_len) {
+    char header[1024];
+    int header_len = snprintf(header, sizeof(header),
+             "HTTP/1.1 %d %s\r\n"
+             "Content-Type: %s\r\n"
              "Access-Control-Allow-Origin: *\r\n"
              "Access-Control-Allow-Methods: GET, POST, OPTIONS\r\n"
-             "Access-Control-Allow-Headers: Content-Type\r\n"
+             "Access-Control-Allow-Headers: Content-Type, If-None-Match\r\n"
+             "%s"
              "Content-Length: %zu\r\n"
-             "\r\n"
-             "%s",
-             status_code, strlen(json_response), json_response);
+             "\r\n",
+             status_code, http_reason(status_code), content_type,
+             extra_headers ? extra_headers : "", body_len);
     
-    (void)write(client_socket, response, strlen(response));
+    send_raw(client_socket, header, header_len);
+    send_raw(client_socket, body, body_len);
+}
+
+// 发送带附加响应头的JSON响应
+static void send_response_with_headers(int client_socket, int status_code,
+                                       const char *extra_headers, const char *json_response) {
+    send_http_response(client_socket, status_code, "application/json",
+                       extra_headers, json_response, strlen(json_response));
+}
+
+// 发送JSON响应
+void send_json_response(int client_socket, int status_code, const char *json_response) {
+    send_response_with_headers(client_socket, status_code, NULL, json_response);
+}
+
+// 发送JSON对象响应，并释放该对象
+static void send_json_object(int client_socket, int status_code, json_t *obj) {
+    char *text = json_dumps(obj, JSON_COMPACT);
+    json_decref(obj);
+    if (text == NULL) {
+        send_json_response(client_socket, 500, "{\"error\":\"Failed to encode response\"}");
+        return;
+    }
+    send_json_response(client_socket, status_code, text);
+    free(text);
+}
+
+// 将TA返回的错误码映射为HTTP状态码
+static int tee_error_status(TEEC_Result res) {
+    switch (res) {
+    case TEEC_ERROR_BAD_PARAMETERS:
+        return 400;
+    case TEEC_ERROR_ACCESS_DENIED:
+    case TEEC_ERROR_SECURITY:
+        return 403;
+    case TEEC_ERROR_ITEM_NOT_FOUND:
+        return 404;
+    case TC_ERROR_STALE_PARENT:
+        return 409;
+    case TC_ERROR_KEY_SESSION_EXPIRED:
+        return 401;
+    case TEEC_ERROR_BUSY:
+    case TC_ERROR_PREPARE_FAILED:
+        return 503;
+    default:
+        return 500;
+    }
+}
+
+// 分片队列已满时建议客户端等待的时间
+#define OVERLOAD_RETRY_AFTER "Retry-After: 1\r\n"
+
+// 发送TA调用失败的响应；分片队列已满（准入控制拒绝）或成员树正在重建时返回503和Retry-After
+static void send_tee_error(int client_socket, TEEC_Result res, const char *message) {
+    json_t *obj = json_object();
+    char code[16];
+    char *text;
+    snprintf(code, sizeof(code), "0x%08x", res);
+    if (res == TEEC_ERROR_BUSY) {
+        message = "Server overloaded, retry later";
+    } else if (res == TC_ERROR_PREPARE_FAILED) {
+        // 成员树正在从区块日志重建，见README
+        message = "Membership tree of the repository is being rebuilt, retry later";
+    }
+    json_object_set_new(obj, "error", json_string(message));
+    json_object_set_new(obj, "tee_result", json_string(code));
+    if (res != TEEC_ERROR_BUSY && res != TC_ERROR_PREPARE_FAILED) {
+        send_json_object(client_socket, tee_error_status(res), obj);
+        return;
+    }
+
+    text = json_dumps(obj, JSON_COMPACT);
+    json_decref(obj);
+    if (text == NULL) {
+        send_json_response(client_socket, 500, "{\"error\":\"Failed to encode response\"}");
+        return;
+    }
+    send_response_with_headers(client_socket, 503, OVERLOAD_RETRY_AFTER, text);
+    free(text);
 }
 
 // 解析JSON请求
@@ -143,6 +292,17 @@ json_t* parse_json_request(const char *body) {
     return root;
 }
 
+// 构造成功响应：{"status":"success", "<block_name>": 区块}
+static json_t *block_response(const char *block_name, const uint8_t *blk, size_t len) {
+    json_t *obj = json_object();
+    json_object_set_new(obj, "status", json_string("success"));
+    json_t *block_json = tc_block_to_json(blk, len);
+    if (block_json != NULL) {
+        json_object_set_new(obj, block_name, block_json);
+    }
+    return obj;
+}
+
 // 处理初始化仓库请求
 void handle_init_repo(int client_socket, const char *body) {
     printf("Handling init-repo request\n");
@@ -165,10 +325,21 @@ void handle_init_repo(int client_socket, const char *body) {
     
     printf("Initializing repository with admin_key: %s\n", admin_key);
     
+    struct tc_msg_builder msg;
+    tc_msg_begin(&msg, TC_MSG_INIT_REPO, 0, OP_ADD, ROLE_ADMIN);
+    tc_msg_put_str(&msg, TC_TAG_PUBKEY, admin_key);
+    size_t msg_len = tc_msg_finish(&msg);
+    json_decref(root);
+    if (msg_len == 0) {
+        send_json_response(client_socket, 400, "{\"error\":\"Request too large\"}");
+        return;
+    }
+    
     // 调用OP-TEE TA
     TEEC_Operation op;
     TEEC_Result res;
     uint32_t err_origin;
+    uint8_t genesis_block[TC_MAX_BLOCK_SIZE];
 
 	memset(&op, 0, sizeof(op));
 	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
@@ -176,62 +347,127 @@ void handle_init_repo(int client_socket, const char *body) {
 					 TEEC_MEMREF_TEMP_OUTPUT,
 					 TEEC_NONE);
 
-    op.params[0].tmpref.buffer = (void *)admin_key;
-    op.params[0].tmpref.size = strlen(admin_key) + 1;
-    
-    // 为输出参数分配内存
-    uint32_t repo_id;
-    struct access_block genesis_block;
+    op.params[0].tmpref.buffer = msg.buf;
+    op.params[0].tmpref.size = msg_len;
     op.params[1].value.a = 0; // 输出仓库ID
-    op.params[2].tmpref.buffer = &genesis_block;
-    op.params[2].tmpref.size = sizeof(struct access_block);
+    op.params[2].tmpref.buffer = genesis_block;
+    op.params[2].tmpref.size = sizeof(genesis_block);
 
-    res = TEEC_InvokeCommand(&sess, TA_TRUST_CHAIN_CMD_INIT_REPO, &op, &err_origin);
-    
-    json_decref(root);
+    // 新仓库轮转分配到各分片，仓库ID中记录分片号
+    res = tc_shard_invoke(tc_shard_for_new_repo(), TA_TRUST_CHAIN_CMD_INIT_REPO, &op, &err_origin);
 
     if (res != TEEC_SUCCESS) {
         printf("Failed to initialize repository: 0x%x origin 0x%x\n", res, err_origin);
-        send_json_response(client_socket, 500, "{\"error\":\"Failed to initialize repository\"}");
+        send_tee_error(client_socket, res, "Failed to initialize repository");
         return;
     }
 
-    repo_id = op.params[1].value.a;
+    uint32_t repo_id = op.params[1].value.a;
     printf("Repository initialized successfully with ID: %u\n", repo_id);
+    tc_blocklog_sync();
     
-    // 使用已分配的genesis_block结构体
-    
-    // 构建包含access_block信息的JSON响应
-    char response[2048];
-    snprintf(response, sizeof(response), 
-            "{\"status\":\"success\","
-            "\"repository_id\":%u,"
-            "\"genesis_block\":{"
-            "\"block_height\":%u,"
-            "\"parent_hash\":\"%s\","
-            "\"op\":%u,"
-            "\"sigkey\":\"%s\","
-            "\"signature\":\"%s\","
-            "\"trust_timestamp\":%llu,"
-            "\"tee_sig\":\"%s\","
-            "\"role\":%u,"
-            "\"pubkey\":\"%s\""
-            "}}", 
-            repo_id,
-            genesis_block.base.block_height,
-            genesis_block.base.parent_hash,
-            genesis_block.base.op,
-            genesis_block.base.sigkey,
-            genesis_block.base.signature,
-            (unsigned long long)genesis_block.base.trust_timestamp,
-            genesis_block.base.tee_sig,
-            genesis_block.role,
-            genesis_block.pubkey);
-    
-    send_json_response(client_socket, 200, response);
+    // 构建包含创世区块信息的JSON响应
+    json_t *response = block_response("genesis_block", genesis_block, op.params[2].tmpref.size);
+    json_object_set_new(response, "repository_id", json_integer(repo_id));
+    send_json_object(client_socket, 200, response);
+}
+
+// 处理删除仓库请求
+void handle_delete_repo(int client_socket, const char *body) {
+    printf("Handling delete-repo request\n");
+
+    json_t *root = parse_json_request(body);
+    if (!root) {
+        send_json_response(client_socket, 400, "{\"error\":\"Invalid JSON\"}");
+        return;
+    }
+
+    json_t *repo_id_json = json_object_get(root, "repo_id");
+    json_t *signature_key_json = json_object_get(root, "signature_key");
+    json_t *signature_json = json_object_get(root, "signature");
+
+    if (!json_is_integer(repo_id_json) || !json_is_string(signature_key_json) ||
+        !json_is_string(signature_json)) {
+        json_decref(root);
+        send_json_response(client_socket, 400, "{\"error\":\"Missing required fields: repo_id, signature_key, signature\"}");
+        return;
+    }
+
+    // 签名内容为"repo_id:OP_DELETE_REPO"
+    uint32_t repo_id = json_integer_value(repo_id_json);
+    struct tc_msg_builder msg;
+    tc_msg_begin(&msg, TC_MSG_DELETE_REPO, repo_id, OP_DELETE_REPO, 0);
+    tc_msg_put_str(&msg, TC_TAG_SIGKEY, json_string_value(signature_key_json));
+    int bad_hex = tc_msg_put_hex(&msg, TC_TAG_SIGNATURE, json_string_value(signature_json));
+    size_t msg_len = tc_msg_finish(&msg);
+    json_decref(root);
+    if (bad_hex || msg_len == 0) {
+        send_json_response(client_socket, 400, "{\"error\":\"Invalid signature or request too large\"}");
+        return;
+    }
+
+    printf("Deleting repository %u\n", repo_id);
+
+    TEEC_Operation op;
+    TEEC_Result res;
+    uint32_t err_origin;
+    uint8_t tombstone_block[TC_MAX_BLOCK_SIZE];
+
+    memset(&op, 0, sizeof(op));
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
+                                     TEEC_MEMREF_TEMP_OUTPUT,
+                                     TEEC_NONE,
+                                     TEEC_NONE);
+    op.params[0].tmpref.buffer = msg.buf;
+    op.params[0].tmpref.size = msg_len;
+    op.params[1].tmpref.buffer = tombstone_block;
+    op.params[1].tmpref.size = sizeof(tombstone_block);
+
+    res = tc_repo_invoke(repo_id, TA_TRUST_CHAIN_CMD_DELETE_REPO, &op, &err_origin);
+
+    if (res != TEEC_SUCCESS) {
+        printf("Failed to delete repository: 0x%x origin 0x%x\n", res, err_origin);
+        send_tee_error(client_socket, res, "Failed to delete repository");
+        return;
+    }
+
+    printf("Repository %u deleted\n", repo_id);
+    tc_blocklog_sync();
+
+    json_t *response = block_response("tombstone_block", tombstone_block, op.params[1].tmpref.size);
+    json_object_set_new(response, "repository_id", json_integer(repo_id));
+    send_json_object(client_socket, 200, response);
 }
 
 // 处理提交请求
+// 推送的commit列表：十六进制commit ID数组，按推送顺序（最早的在前），长度须一致
+static int parse_push_commits(json_t *commits, struct tc_push *push) {
+    size_t count = json_array_size(commits);
+
+    memset(push, 0, sizeof(*push));
+    if (count == 0 || count > TC_MAX_PUSH_COMMITS) {
+        return -1;
+    }
+    push->ids = malloc(count * TC_HASH_SIZE);
+    if (push->ids == NULL) {
+        return -1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        const char *hex = json_string_value(json_array_get(commits, i));
+        uint8_t id[TC_HASH_SIZE];
+        size_t len;
+        if (hex == NULL || tc_hex_decode(hex, id, sizeof(id), &len) != 0 || len == 0 ||
+            (i > 0 && len != push->id_len)) {
+            tc_push_free(push);
+            return -1;
+        }
+        push->id_len = (uint32_t)len;
+        memcpy(push->ids + i * len, id, len);
+    }
+    push->count = (uint32_t)count;
+    return 0;
+}
+
 void handle_commit(int client_socket, const char *body) {
     printf("Handling commit request\n");
     
@@ -242,50 +478,216 @@ void handle_commit(int client_socket, const char *body) {
     }
     
     json_t *repo_id_json = json_object_get(root, "repo_id");
-    json_t *pubkey_json = json_object_get(root, "pubkey");
+    json_t *operation_json = json_object_get(root, "operation");
+    json_t *commit_hash_json = json_object_get(root, "commit_hash");
+    json_t *signature_key_json = json_object_get(root, "signature_key");
+    json_t *signature_json = json_object_get(root, "signature");
+    json_t *enc_key_json = json_object_get(root, "enc_key");
+    json_t *key_session_json = json_object_get(root, "key_session");
+    json_t *wrapped_key_json = json_object_get(root, "wrapped_key");
     json_t *branch_json = json_object_get(root, "branch");
+    json_t *expected_parent_json = json_object_get(root, "expected_parent");
+    json_t *commits_json = json_object_get(root, "commits");
+    json_t *old_tip_json = json_object_get(root, "old_tip");
+    int is_push = json_is_array(commits_json);
     
-    if (!json_is_integer(repo_id_json) || !json_is_string(pubkey_json) || !json_is_string(branch_json)) {
+    if (!json_is_integer(repo_id_json) || (!is_push && !json_is_string(commit_hash_json)) ||
+        !json_is_string(signature_key_json) || !json_is_string(signature_json)) {
         json_decref(root);
-        send_json_response(client_socket, 400, "{\"error\":\"Missing required fields: repo_id, pubkey, branch\"}");
+        send_json_response(client_socket, 400, "{\"error\":\"Missing required fields: repo_id, commit_hash or commits, signature_key, signature\"}");
         return;
     }
     
     uint32_t repo_id = json_integer_value(repo_id_json);
-    const char *pubkey = json_string_value(pubkey_json);
-    const char *branch = json_string_value(branch_json);
+    uint32_t operation = OP_PUSH;
+    if (json_is_string(operation_json) && strcmp(json_string_value(operation_json), "PR") == 0) {
+        operation = OP_PR;
+    }
     
-    printf("Committing to repository %u, pubkey: %s, branch: %s\n", repo_id, pubkey, branch);
+    // 推送区块：CA按列表算出Merkle根交给TA，列表先按根持久化，供逐个commit的包含证明
+    struct tc_push push;
+    uint8_t push_root[TC_HASH_SIZE];
+    if (is_push) {
+        if (parse_push_commits(commits_json, &push) != 0) {
+            json_decref(root);
+            send_json_response(client_socket, 400, "{\"error\":\"Invalid commits list\"}");
+            return;
+        }
+        tc_push_root(&push, push_root);
+        printf("Committing a push of %u commits to repository %u\n", push.count, repo_id);
+    } else {
+        printf("Committing to repository %u, commit: %s\n", repo_id, json_string_value(commit_hash_json));
+    }
+    
+    // 签名内容为"repo_id:op:commit_hash"（推送区块见README），哈希与签名以原始字节传入TA
+    struct tc_msg_builder msg;
+    int bad_hex = 0;
+    tc_msg_begin(&msg, TC_MSG_COMMIT, repo_id, operation, 0);
+    if (is_push) {
+        tc_msg_put(&msg, TC_TAG_PUSH_ROOT, push_root, TC_HASH_SIZE);
+        tc_msg_put(&msg, TC_TAG_PUSH_COUNT, &push.count, sizeof(push.count));
+        if (json_is_string(old_tip_json) && json_string_value(old_tip_json)[0] != '\0') {
+            bad_hex |= tc_msg_put_hex(&msg, TC_TAG_OLD_TIP, json_string_value(old_tip_json));
+        }
+        tc_msg_put(&msg, TC_TAG_NEW_TIP,
+                   push.ids + (size_t)(push.count - 1) * push.id_len, push.id_len);
+    } else {
+        bad_hex |= tc_msg_put_hex(&msg, TC_TAG_COMMIT_HASH, json_string_value(commit_hash_json));
+    }
+    tc_msg_put_str(&msg, TC_TAG_SIGKEY, json_string_value(signature_key_json));
+    bad_hex |= tc_msg_put_hex(&msg, TC_TAG_SIGNATURE, json_string_value(signature_json));
+    if (json_is_string(enc_key_json)) {
+        bad_hex |= tc_msg_put_hex(&msg, TC_TAG_ENC_KEY, json_string_value(enc_key_json));
+    }
+    // 内容密钥会话：wrapped_key为会话密钥AES-GCM封装的内容密钥，会话过期时返回401
+    if (json_is_string(key_session_json) && json_is_string(wrapped_key_json)) {
+        bad_hex |= tc_msg_put_hex(&msg, TC_TAG_KEY_SESSION, json_string_value(key_session_json));
+        bad_hex |= tc_msg_put_hex(&msg, TC_TAG_WRAPPED_KEY, json_string_value(wrapped_key_json));
+    }
+    if (json_is_string(branch_json)) {
+        tc_msg_put_str(&msg, TC_TAG_BRANCH, json_string_value(branch_json));
+    }
+    // 可选的期望父哈希，链头已被推进时TA返回TC_ERROR_STALE_PARENT（HTTP 409）
+    if (json_is_string(expected_parent_json)) {
+        bad_hex |= tc_msg_put_hex(&msg, TC_TAG_EXPECTED_PARENT, json_string_value(expected_parent_json));
+    }
+    size_t msg_len = tc_msg_finish(&msg);
+    json_decref(root);
+    if (bad_hex || msg_len == 0) {
+        if (is_push) {
+            tc_push_free(&push);
+        }
+        send_json_response(client_socket, 400, "{\"error\":\"Invalid hex field or request too large\"}");
+        return;
+    }
+    // 列表在TA验签之前只登记在内存中，结果线程把区块交给审计索引时从这里读取
+    if (is_push && tc_push_hold(&push, push_root) != 0) {
+        tc_push_free(&push);
+        send_json_response(client_socket, 500, "{\"error\":\"Out of memory\"}");
+        return;
+    }
     
     // 调用OP-TEE TA
     TEEC_Operation op;
     TEEC_Result res;
     uint32_t err_origin;
+    uint8_t content_key[TC_MAX_BLOCK_SIZE / 8];
+    uint8_t block[TC_MAX_COMMIT_OUTPUT];
 
     memset(&op, 0, sizeof(op));
-    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT,
-                                     TEEC_VALUE_INPUT,
-                                     TEEC_MEMREF_TEMP_INPUT,
-                                     TEEC_MEMREF_TEMP_INPUT);
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
+                                     TEEC_MEMREF_TEMP_OUTPUT,
+                                     TEEC_MEMREF_TEMP_OUTPUT,
+                                     TEEC_NONE);
 
-    op.params[0].value.a = repo_id;
-    op.params[0].value.b = OP_PUSH;
-    op.params[2].tmpref.buffer = (void *)pubkey;
-    op.params[2].tmpref.size = strlen(pubkey) + 1;
-    op.params[3].tmpref.buffer = (void *)branch;
-    op.params[3].tmpref.size = strlen(branch) + 1;
+    op.params[0].tmpref.buffer = msg.buf;
+    op.params[0].tmpref.size = msg_len;
+    op.params[1].tmpref.buffer = content_key;
+    op.params[1].tmpref.size = sizeof(content_key);
+    op.params[2].tmpref.buffer = block;
+    op.params[2].tmpref.size = sizeof(block);
 
-    res = TEEC_InvokeCommand(&sess, TA_TRUST_CHAIN_CMD_COMMIT, &op, &err_origin);
-    
-    json_decref(root);
+    res = tc_repo_invoke(repo_id, TA_TRUST_CHAIN_CMD_COMMIT, &op, &err_origin);
+
+    // TA接受推送区块后才把列表写盘，在响应之前落盘
+    int push_saved = 0;
+    if (is_push) {
+        if (res == TEEC_SUCCESS) {
+            push_saved = tc_push_save(&push, push_root) == 0;
+        }
+        tc_push_release(&push);
+        tc_push_free(&push);
+    }
     
-    if (res == TEEC_SUCCESS) {
-        printf("Commit successful\n");
-        send_json_response(client_socket, 200, "{\"status\":\"success\"}");
-    } else {
+    if (res != TEEC_SUCCESS) {
         printf("Failed to commit: 0x%x origin 0x%x\n", res, err_origin);
-        send_json_response(client_socket, 500, "{\"error\":\"Failed to commit\"}");
+        send_tee_error(client_socket, res, "Failed to commit");
+        return;
+    }
+
+    printf("Commit successful\n");
+    tc_blocklog_sync();
+    if (is_push && !push_saved) {
+        printf("Push block committed to repository %u but its commit list could not be stored\n", repo_id);
+        send_json_response(client_socket, 500, "{\"error\":\"Push committed but its commit list could not be stored\"}");
+        return;
+    }
+    // 分支提交累计到阈值时，TA在贡献区块之后追加一个主链检查点区块
+    size_t out_len = op.params[2].tmpref.size;
+    size_t first_len = tc_block_total_len(block, out_len);
+    json_t *response = block_response("contribution_block", block, first_len);
+    if (first_len > 0 && first_len < out_len) {
+        json_t *checkpoint = tc_block_to_json(block + first_len, out_len - first_len);
+        if (checkpoint != NULL) {
+            json_object_set_new(response, "checkpoint_block", checkpoint);
+        }
+    }
+    if (op.params[1].tmpref.size > 0) {
+        char key_hex[sizeof(content_key) * 2 + 1];
+        tc_hex_encode(content_key, op.params[1].tmpref.size, key_hex);
+        json_object_set_new(response, "key", json_string(key_hex));
+    }
+    send_json_object(client_socket, 200, response);
+}
+
+// 内容密钥会话握手：TEE解密一次会话密钥，各分片缓存到过期为止
+void handle_key_session(int client_socket, const char *body) {
+    json_t *root = parse_json_request(body);
+    if (!root) {
+        send_json_response(client_socket, 400, "{\"error\":\"Invalid JSON\"}");
+        return;
+    }
+
+    json_t *enc_key_json = json_object_get(root, "enc_session_key");
+    json_t *ttl_json = json_object_get(root, "ttl");
+    uint8_t enc_key[TC_MAX_TEE_SIG_SIZE];  /* RSA-2048密文 */
+    size_t enc_len;
+    if (!json_is_string(enc_key_json) ||
+        tc_hex_decode(json_string_value(enc_key_json), enc_key, sizeof(enc_key), &enc_len) != 0) {
+        json_decref(root);
+        send_json_response(client_socket, 400, "{\"error\":\"Missing or invalid enc_session_key\"}");
+        return;
+    }
+    uint32_t ttl = json_is_integer(ttl_json) && json_integer_value(ttl_json) > 0 ?
+                   (uint32_t)json_integer_value(ttl_json) : 0;
+    json_decref(root);
+
+    // 会话ID由CA随机生成，同一会话在每个分片上各登记一次
+    uint64_t session_id;
+    if (getrandom(&session_id, sizeof(session_id), 0) != sizeof(session_id)) {
+        send_json_response(client_socket, 500, "{\"error\":\"Could not generate session id\"}");
+        return;
+    }
+
+    TEEC_Operation ops[TC_MAX_SHARDS];
+    unsigned int count = tc_shard_count();
+    uint32_t err_origin;
+    memset(ops, 0, sizeof(ops));
+    for (unsigned int i = 0; i < count; i++) {
+        ops[i].paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
+                                             TEEC_VALUE_INPUT,
+                                             TEEC_VALUE_INOUT,
+                                             TEEC_NONE);
+        ops[i].params[0].tmpref.buffer = enc_key;
+        ops[i].params[0].tmpref.size = enc_len;
+        ops[i].params[1].value.a = (uint32_t)session_id;
+        ops[i].params[1].value.b = (uint32_t)(session_id >> 32);
+        ops[i].params[2].value.a = ttl;
     }
+    TEEC_Result res = tc_shards_invoke_all(TA_TRUST_CHAIN_CMD_OPEN_KEY_SESSION, ops, &err_origin);
+    if (res != TEEC_SUCCESS) {
+        printf("Failed to open key session: 0x%x origin 0x%x\n", res, err_origin);
+        send_tee_error(client_socket, res, "Failed to open key session");
+        return;
+    }
+
+    char id_hex[sizeof(session_id) * 2 + 1];
+    tc_hex_encode((const uint8_t *)&session_id, sizeof(session_id), id_hex);
+    json_t *response = json_object();
+    json_object_set_new(response, "status", json_string("success"));
+    json_object_set_new(response, "session_id", json_string(id_hex));
+    json_object_set_new(response, "ttl", json_integer(ops[0].params[2].value.a));
+    send_json_object(client_socket, 200, response);
 }
 
 // 处理访问控制请求
@@ -304,6 +706,7 @@ void handle_access_control(int client_socket, const char *body) {
     json_t *public_key_json = json_object_get(root, "public_key");
     json_t *signature_key_json = json_object_get(root, "signature_key");
     json_t *signature_json = json_object_get(root, "signature");
+    json_t *expected_parent_json = json_object_get(root, "expected_parent");
     
     if (!json_is_integer(repo_id_json) || !json_is_string(operation_json) || 
         !json_is_string(role_json) || !json_is_string(public_key_json) ||
@@ -317,16 +720,34 @@ void handle_access_control(int client_socket, const char *body) {
     const char *operation = json_string_value(operation_json);
     const char *role = json_string_value(role_json);
     const char *public_key = json_string_value(public_key_json);
-    const char *signature_key = json_string_value(signature_key_json);
-    const char *signature = json_string_value(signature_json);
     
     printf("Access control: repo_id=%u, operation=%s, role=%s, public_key=%s\n", 
            repo_id, operation, role, public_key);
     
+    uint32_t op_code = (strcmp(operation, "ADD") == 0) ? OP_ADD : OP_DELETE;
+    uint32_t role_code = (strcmp(role, "ADMIN") == 0) ? ROLE_ADMIN : ROLE_WRITER;
+    
+    // 签名内容为"repo_id:op:role:public_key"
+    struct tc_msg_builder msg;
+    tc_msg_begin(&msg, TC_MSG_ACCESS_CONTROL, repo_id, op_code, role_code);
+    tc_msg_put_str(&msg, TC_TAG_PUBKEY, public_key);
+    tc_msg_put_str(&msg, TC_TAG_SIGKEY, json_string_value(signature_key_json));
+    int bad_hex = tc_msg_put_hex(&msg, TC_TAG_SIGNATURE, json_string_value(signature_json));
+    if (json_is_string(expected_parent_json)) {
+        bad_hex |= tc_msg_put_hex(&msg, TC_TAG_EXPECTED_PARENT, json_string_value(expected_parent_json));
+    }
+    size_t msg_len = tc_msg_finish(&msg);
+    json_decref(root);
+    if (bad_hex || msg_len == 0) {
+        send_json_response(client_socket, 400, "{\"error\":\"Invalid hex field or request too large\"}");
+        return;
+    }
+    
     // 调用OP-TEE TA
     TEEC_Operation op;
     TEEC_Result res;
     uint32_t err_origin;
+    uint8_t block[TC_MAX_COMMIT_OUTPUT];
 	
 	memset(&op, 0, sizeof(op));
 	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
@@ -334,77 +755,761 @@ void handle_access_control(int client_socket, const char *body) {
 					 TEEC_NONE,
 					 TEEC_NONE);
 
-    // 构造access_control_message结构体
-    struct access_control_message ac_msg;
-    ac_msg.rep_id = repo_id;
-    ac_msg.op = (strcmp(operation, "ADD") == 0) ? OP_ADD : OP_DELETE;
-    ac_msg.role = (strcmp(role, "ADMIN") == 0) ? ROLE_ADMIN : ROLE_WRITER;
-    strncpy(ac_msg.pubkey, public_key, MAX_KEY_LENGTH - 1);
-    ac_msg.pubkey[MAX_KEY_LENGTH - 1] = '\0';  // 确保字符串结束
-    strncpy(ac_msg.sigkey, signature_key, MAX_KEY_LENGTH - 1);
-    ac_msg.pubkey[MAX_KEY_LENGTH - 1] = '\0';  // 确保字符串结束
-    strncpy(ac_msg.signature, signature, MAX_SIGNATURE_LENGTH - 1);
-    ac_msg.pubkey[MAX_SIGNATURE_LENGTH - 1] = '\0';  // 确保字符串结束
-    
-    op.params[0].tmpref.buffer = &ac_msg;
-    op.params[0].tmpref.size = sizeof(struct access_control_message);
-    
-    // 为输出参数分配内存（虽然当前未使用，但需要符合TA的参数要求）
-    char output_buffer[256];
-    op.params[1].tmpref.buffer = output_buffer;
-    op.params[1].tmpref.size = sizeof(output_buffer);
+    op.params[0].tmpref.buffer = msg.buf;
+    op.params[0].tmpref.size = msg_len;
+    op.params[1].tmpref.buffer = block;
+    op.params[1].tmpref.size = sizeof(block);
 
-    res = TEEC_InvokeCommand(&sess, TA_TRUST_CHAIN_CMD_ACCESS_CONTROL, &op, &err_origin);
-    
-    json_decref(root);
+    res = tc_repo_invoke(repo_id, TA_TRUST_CHAIN_CMD_ACCESS_CONTROL, &op, &err_origin);
     
-    if (res == TEEC_SUCCESS) {
-        printf("Access control successful\n");
-        send_json_response(client_socket, 200, "{\"status\":\"success\"}");
-    } else {
+    if (res != TEEC_SUCCESS) {
         printf("Failed to perform access control: 0x%x origin 0x%x\n", res, err_origin);
-        send_json_response(client_socket, 500, "{\"error\":\"Failed to perform access control\"}");
+        send_tee_error(client_socket, res, "Failed to perform access control");
+        return;
+    }
+
+    printf("Access control successful\n");
+    tc_blocklog_sync();
+    // 权限变更累计到阈值时，TA在Access区块之后追加一个ACL检查点区块
+    size_t out_len = op.params[1].tmpref.size;
+    size_t first_len = tc_block_total_len(block, out_len);
+    json_t *response = block_response("access_block", block, first_len);
+    if (first_len > 0 && first_len < out_len) {
+        json_t *checkpoint = tc_block_to_json(block + first_len, out_len - first_len);
+        if (checkpoint != NULL) {
+            json_object_set_new(response, "acl_checkpoint_block", checkpoint);
+        }
+    }
+    send_json_object(client_socket, 200, response);
+}
+
+// 按需生成ACL检查点：POST /acl-checkpoint {"repo_id"}，上次检查点之后没有权限变更时返回409
+void handle_acl_checkpoint(int client_socket, const char *body) {
+    json_t *root = parse_json_request(body);
+    if (!root) {
+        send_json_response(client_socket, 400, "{\"error\":\"Invalid JSON\"}");
+        return;
+    }
+
+    json_t *repo_id_json = json_object_get(root, "repo_id");
+    if (!json_is_integer(repo_id_json)) {
+        json_decref(root);
+        send_json_response(client_socket, 400, "{\"error\":\"Missing required field: repo_id\"}");
+        return;
+    }
+    uint32_t repo_id = json_integer_value(repo_id_json);
+    json_decref(root);
+
+    // 检查点只记录TA中已有的状态，请求不需要签名
+    struct tc_msg_builder msg;
+    tc_msg_begin(&msg, TC_MSG_ACL_CHECKPOINT, repo_id, OP_ACL_CHECKPOINT, 0);
+    size_t msg_len = tc_msg_finish(&msg);
+
+    TEEC_Operation op;
+    TEEC_Result res;
+    uint32_t err_origin;
+    uint8_t block[TC_MAX_BLOCK_SIZE];
+
+    memset(&op, 0, sizeof(op));
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
+                                     TEEC_MEMREF_TEMP_OUTPUT,
+                                     TEEC_NONE,
+                                     TEEC_NONE);
+    op.params[0].tmpref.buffer = msg.buf;
+    op.params[0].tmpref.size = msg_len;
+    op.params[1].tmpref.buffer = block;
+    op.params[1].tmpref.size = sizeof(block);
+
+    res = tc_repo_invoke(repo_id, TA_TRUST_CHAIN_CMD_ACL_CHECKPOINT, &op, &err_origin);
+    if (res == TEEC_ERROR_BAD_STATE) {
+        send_json_response(client_socket, 409, "{\"error\":\"No access changes since the last ACL checkpoint\"}");
+        return;
     }
+    if (res != TEEC_SUCCESS) {
+        printf("Failed to create ACL checkpoint: 0x%x origin 0x%x\n", res, err_origin);
+        send_tee_error(client_socket, res, "Failed to create ACL checkpoint");
+        return;
+    }
+
+    tc_blocklog_sync();
+    send_json_object(client_socket, 200, block_response("acl_checkpoint_block", block, op.params[1].tmpref.size));
 }
 
 // 处理获取最新哈希请求
-void handle_get_latest_hash(int client_socket, uint32_t repo_id) {
+void handle_get_latest_hash(int client_socket, uint32_t repo_id, uint32_t nonce) {
     printf("Getting latest hash for repository %u\n", repo_id);
     
     TEEC_Operation op;
     TEEC_Result res;
     uint32_t err_origin;
+    struct tc_latest_hash_msg msg;
+    uint8_t tee_sig[MAX_SIGNATURE_LENGTH];
 	
 	memset(&op, 0, sizeof(op));
 	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT,
+					 TEEC_VALUE_INPUT,
 					 TEEC_MEMREF_TEMP_OUTPUT,
-					 TEEC_NONE,
-					 TEEC_NONE);
+					 TEEC_MEMREF_TEMP_OUTPUT);
 
     op.params[0].value.a = repo_id;
-	
-	char hash_output[256];
-	op.params[1].tmpref.buffer = hash_output;
-	op.params[1].tmpref.size = sizeof(hash_output);
-
-    res = TEEC_InvokeCommand(&sess, TA_TRUST_CHAIN_CMD_GET_LATEST_HASH, &op, &err_origin);
-    
-    if (res == TEEC_SUCCESS) {
-        char response[512];
-        snprintf(response, sizeof(response), 
-                "{\"status\":\"success\",\"latest_hash\":\"%s\"}", 
-                (char *)op.params[1].tmpref.buffer);
-        send_json_response(client_socket, 200, response);
-    } else {
+    op.params[1].value.a = nonce;
+	op.params[2].tmpref.buffer = &msg;
+	op.params[2].tmpref.size = sizeof(msg);
+	op.params[3].tmpref.buffer = tee_sig;
+	op.params[3].tmpref.size = sizeof(tee_sig);
+
+    res = tc_repo_invoke(repo_id, TA_TRUST_CHAIN_CMD_GET_LATEST_HASH, &op, &err_origin);
+    
+    if (res != TEEC_SUCCESS) {
         printf("Failed to get latest hash: 0x%x origin 0x%x\n", res, err_origin);
-        send_json_response(client_socket, 500, "{\"error\":\"Failed to get latest hash\"}");
+        send_tee_error(client_socket, res, "Failed to get latest hash");
+        return;
     }
+
+    // tee_sig是TEE对整个tc_latest_hash_msg结构的签名
+    char hash_hex[TC_HASH_SIZE * 2 + 1];
+    char sig_hex[sizeof(tee_sig) * 2 + 1];
+    tc_hex_encode(msg.latest_hash, TC_HASH_SIZE, hash_hex);
+    tc_hex_encode(tee_sig, op.params[3].tmpref.size, sig_hex);
+
+    json_t *response = json_object();
+    json_object_set_new(response, "status", json_string("success"));
+    json_object_set_new(response, "nonce", json_integer(msg.nonce));
+    json_object_set_new(response, "block_height", json_integer(msg.block_height));
+    json_object_set_new(response, "latest_hash", json_string(hash_hex));
+    json_object_set_new(response, "tee_sig", json_string(sig_hex));
+    send_json_object(client_socket, 200, response);
+}
+
+// 处理获取分支链头请求
+void handle_get_branch_head(int client_socket, uint32_t repo_id, uint32_t nonce, const char *branch) {
+    printf("Getting head of branch %s in repository %u\n", branch, repo_id);
+
+    TEEC_Operation op;
+    TEEC_Result res;
+    uint32_t err_origin;
+    struct tc_branch_head_msg msg;
+    uint8_t tee_sig[MAX_SIGNATURE_LENGTH];
+
+    memset(&op, 0, sizeof(op));
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT,
+                                     TEEC_MEMREF_TEMP_INPUT,
+                                     TEEC_MEMREF_TEMP_OUTPUT,
+                                     TEEC_MEMREF_TEMP_OUTPUT);
+
+    op.params[0].value.a = repo_id;
+    op.params[0].value.b = nonce;
+    op.params[1].tmpref.buffer = (void *)branch;
+    op.params[1].tmpref.size = strlen(branch);
+    op.params[2].tmpref.buffer = &msg;
+    op.params[2].tmpref.size = sizeof(msg);
+    op.params[3].tmpref.buffer = tee_sig;
+    op.params[3].tmpref.size = sizeof(tee_sig);
+
+    res = tc_repo_invoke(repo_id, TA_TRUST_CHAIN_CMD_GET_BRANCH_HEAD, &op, &err_origin);
+
+    if (res != TEEC_SUCCESS) {
+        printf("Failed to get branch head: 0x%x origin 0x%x\n", res, err_origin);
+        send_tee_error(client_socket, res, "Failed to get branch head");
+        return;
+    }
+
+    // tee_sig是TEE对整个tc_branch_head_msg结构的签名
+    char sig_hex[sizeof(tee_sig) * 2 + 1];
+    tc_hex_encode(tee_sig, op.params[3].tmpref.size, sig_hex);
+
+    json_t *response = json_object();
+    json_object_set_new(response, "status", json_string("success"));
+    json_object_set_new(response, "nonce", json_integer(msg.nonce));
+    json_object_set_new(response, "branch", json_string(branch));
+    json_object_set_new(response, "branch_head", tc_branch_head_to_json(&msg.branch));
+    json_object_set_new(response, "tee_sig", json_string(sig_hex));
+    send_json_object(client_socket, 200, response);
+}
+
+// 从路径的查询串中读取字符串参数（URL解码），存在返回1
+static int query_param_str(const char *path, const char *name, char *out, size_t cap) {
+    const char *query = strchr(path, '?');
+    size_t name_len = strlen(name);
+    while (query != NULL) {
+        query++;
+        if (strncmp(query, name, name_len) == 0 && query[name_len] == '=') {
+            const char *p = query + name_len + 1;
+            size_t n = 0;
+            while (*p != '\0' && *p != '&' && n + 1 < cap) {
+                unsigned int c;
+                if (*p == '%' && sscanf(p + 1, "%2x", &c) == 1) {
+                    out[n++] = (char)c;
+                    p += 3;
+                } else {
+                    out[n++] = (*p == '+') ? ' ' : *p;
+                    p++;
+                }
+            }
+            out[n] = '\0';
+            return 1;
+        }
+        query = strchr(query, '&');
+    }
+    return 0;
+}
+
+// 从路径的查询串中读取无符号整数参数，不存在时返回默认值
+static uint32_t query_param_u32(const char *path, const char *name, uint32_t def) {
+    const char *query = strchr(path, '?');
+    size_t name_len = strlen(name);
+    while (query != NULL) {
+        query++;
+        if (strncmp(query, name, name_len) == 0 && query[name_len] == '=') {
+            return (uint32_t)strtoul(query + name_len + 1, NULL, 10);
+        }
+        query = strchr(query, '&');
+    }
+    return def;
+}
+
+// 读取请求头的值（不区分大小写），存在返回1
+static int request_header(const char *request, const char *name, char *out, size_t cap) {
+    size_t name_len = strlen(name);
+    const char *line = strstr(request, "\r\n");
+    while (line != NULL && strncmp(line, "\r\n\r\n", 4) != 0) {
+        line += 2;
+        if (strncasecmp(line, name, name_len) == 0 && line[name_len] == ':') {
+            const char *value = line + name_len + 1;
+            const char *end = strstr(value, "\r\n");
+            size_t n;
+            while (*value == ' ') {
+                value++;
+            }
+            n = end ? (size_t)(end - value) : strlen(value);
+            if (n >= cap) {
+                n = cap - 1;
+            }
+            memcpy(out, value, n);
+            out[n] = '\0';
+            return 1;
+        }
+        line = strstr(line, "\r\n");
+    }
+    return 0;
+}
+
+// 订阅流每次最多取出的帧数，以及无新区块时的心跳间隔
+#define EVENTS_BATCH 16
+#define EVENTS_HEARTBEAT_MS 15000
+// 发送阻塞超过该时间的订阅者视为过慢，断开连接
+#define EVENTS_SEND_TIMEOUT_SEC 5
+
+// 完整发送iov中的全部数据，失败返回-1
+static int send_iov(int client_socket, struct iovec *iov, int iovcnt) {
+    struct msghdr msg;
+
+    while (iovcnt > 0) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovcnt;
+        ssize_t n = sendmsg(client_socket, &msg, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return -1;
+        }
+        while (iovcnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+static int send_text(int client_socket, const char *text) {
+    struct iovec iov = { .iov_base = (void *)text, .iov_len = strlen(text) };
+    return send_iov(client_socket, &iov, 1);
+}
+
+// 处理新区块订阅：GET /repos/{id}/events，以Server-Sent Events推送该仓库的新区块
+// 连接线程一直阻塞在这里，直到客户端断开、订阅者过慢被丢弃或仓库被删除
+static void handle_repo_events(int client_socket, const char *request, uint32_t repo_id) {
+    char etag[TC_VIEW_ETAG_SIZE];
+    char last_event_id[32];
+    uint64_t last_id = 0;
+    struct tc_event *events[EVENTS_BATCH];
+    struct iovec iov[EVENTS_BATCH];
+    struct timeval timeout = { .tv_sec = EVENTS_SEND_TIMEOUT_SEC };
+    int resync = 0;
+
+    if (tc_view_etag(repo_id, etag) != 0) {
+        send_json_response(client_socket, 404, "{\"error\":\"Repository not found\"}");
+        return;
+    }
+    if (request_header(request, "Last-Event-ID", last_event_id, sizeof(last_event_id))) {
+        last_id = strtoull(last_event_id, NULL, 10);
+    }
+
+    struct tc_subscription *sub = tc_events_subscribe(repo_id, last_id, &resync);
+    if (sub == NULL) {
+        send_json_response(client_socket, 500, "{\"error\":\"Out of memory\"}");
+        return;
+    }
+
+    setsockopt(client_socket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    int ok = send_text(client_socket,
+                       "HTTP/1.1 200 OK\r\n"
+                       "Content-Type: text/event-stream\r\n"
+                       "Cache-Control: no-cache\r\n"
+                       "Connection: keep-alive\r\n"
+                       "Access-Control-Allow-Origin: *\r\n"
+                       "\r\n"
+                       "retry: 3000\n\n") == 0;
+    // 重连时遗漏的区块已不在环中，通知客户端重新读取仓库视图
+    if (ok && resync) {
+        ok = send_text(client_socket, "event: resync\ndata: {}\n\n") == 0;
+    }
+
+    while (ok) {
+        int n = tc_events_next(sub, events, EVENTS_BATCH, EVENTS_HEARTBEAT_MS);
+        if (n == TC_EVENTS_TIMEOUT) {
+            // 心跳注释行，同时用来发现已断开的客户端
+            ok = send_text(client_socket, ": keepalive\n\n") == 0;
+        } else if (n == TC_EVENTS_DROPPED) {
+            send_text(client_socket, "event: dropped\ndata: {}\n\n");
+            break;
+        } else if (n == TC_EVENTS_CLOSED) {
+            send_text(client_socket, "event: deleted\ndata: {}\n\n");
+            break;
+        } else {
+            // 共享的帧直接聚合发送，不复制
+            for (int i = 0; i < n; i++) {
+                iov[i].iov_base = events[i]->data;
+                iov[i].iov_len = events[i]->len;
+            }
+            ok = send_iov(client_socket, iov, n) == 0;
+            for (int i = 0; i < n; i++) {
+                tc_event_put(events[i]);
+            }
+        }
+    }
+    tc_events_unsubscribe(sub);
+}
+
+// 处理区块导出：GET /repos/{id}/blocks?from=&to=，日志序号从1开始，含两端
+// 响应体是TA签发的原始区块首尾相接，直接从日志文件sendfile，不经过TEE
+static void handle_repo_blocks(int client_socket, const char *path, uint32_t repo_id) {
+    struct tc_blocklog_range range;
+    char headers[256];
+    uint32_t from = query_param_u32(path, "from", 1);
+    uint32_t to = query_param_u32(path, "to", UINT32_MAX);
+
+    int ret = tc_blocklog_open_range(repo_id, from, to, &range);
+    if (ret == -1) {
+        send_json_response(client_socket, 404, "{\"error\":\"Repository not found\"}");
+        return;
+    }
+    if (ret == -2) {
+        snprintf(headers, sizeof(headers), "X-Block-Total: %u\r\n", range.total);
+        send_response_with_headers(client_socket, 416, headers, "{\"error\":\"Block range out of bounds\"}");
+        return;
+    }
+
+    char header[512];
+    snprintf(header, sizeof(header),
+             "HTTP/1.1 200 OK\r\n"
+             "Content-Type: application/octet-stream\r\n"
+             "Access-Control-Allow-Origin: *\r\n"
+             "Access-Control-Expose-Headers: X-Block-First, X-Block-Count, X-Block-Total\r\n"
+             "X-Block-First: %u\r\n"
+             "X-Block-Count: %u\r\n"
+             "X-Block-Total: %u\r\n"
+             "Content-Length: %llu\r\n"
+             "\r\n",
+             range.first, range.count, range.total, (unsigned long long)range.len);
+    if (send_text(client_socket, header) == 0) {
+        off_t offset = (off_t)range.offset;
+        uint64_t remaining = range.len;
+        while (remaining > 0) {
+            ssize_t n = sendfile(client_socket, range.fd, &offset, remaining);
+            if (n <= 0) {
+                break;
+            }
+            remaining -= n;
+        }
+    }
+    close(range.fd);
+}
+
+// 处理仓库只读视图查询：GET /repos/{id}[/members|/height|/role?key=...]
+// 结果来自CA内存中的视图，不进入TEE；支持ETag/If-None-Match
+static void handle_repo_view(int client_socket, const char *request, const char *path) {
+    char *end;
+    uint32_t repo_id = strtoul(path + 7, &end, 10);
+    enum tc_view_query query;
+    char key[MAX_KEY_LENGTH + 1];
+    const char *key_arg = NULL;
+    char etag[TC_VIEW_ETAG_SIZE];
+    char if_none_match[TC_VIEW_ETAG_SIZE * 4];
+    char headers[128];
+    json_t *result;
+
+    if (end == path + 7) {
+        send_json_response(client_socket, 400, "{\"error\":\"Invalid repository id\"}");
+        return;
+    }
+    if (*end == '\0' || *end == '?') {
+        query = TC_VIEW_SUMMARY;
+    } else if (strncmp(end, "/members", 8) == 0) {
+        query = TC_VIEW_MEMBERS;
+    } else if (strncmp(end, "/height", 7) == 0) {
+        query = TC_VIEW_HEIGHT;
+    } else if (strcmp(end, "/blocks") == 0 || strncmp(end, "/blocks?", 8) == 0) {
+        handle_repo_blocks(client_socket, path, repo_id);
+        return;
+    } else if (strcmp(end, "/events") == 0 || strncmp(end, "/events?", 8) == 0) {
+        handle_repo_events(client_socket, request, repo_id);
+        return;
+    } else if (strncmp(end, "/member-proof?", 14) == 0) {
+        // 成员树中单个公钥的成员（或非成员）证明，不进入TEE
+        uint8_t fp[TC_HASH_SIZE];
+        size_t fp_len;
+        if (query_param_str(path, "key", key, sizeof(key))) {
+            tc_pubkey_id(key, strlen(key), fp);
+        } else if (!query_param_str(path, "fp", key, sizeof(key)) ||
+                   tc_hex_decode(key, fp, sizeof(fp), &fp_len) != 0 || fp_len != TC_HASH_SIZE) {
+            send_json_response(client_socket, 400, "{\"error\":\"Missing or invalid query parameter: key or fp\"}");
+            return;
+        }
+        result = tc_members_proof(repo_id, fp);
+        if (result == NULL) {
+            send_json_response(client_socket, 404, "{\"error\":\"Repository not found\"}");
+            return;
+        }
+        send_json_object(client_socket, 200, result);
+        return;
+    } else if (strcmp(end, "/acl-checkpoint") == 0) {
+        // 最新的ACL检查点区块及其完整成员集合，不进入TEE
+        result = tc_acl_latest(repo_id);
+        if (result == NULL) {
+            send_json_response(client_socket, 404, "{\"error\":\"No ACL checkpoint stored for repository\"}");
+            return;
+        }
+        send_json_object(client_socket, 200, result);
+        return;
+    } else if (strcmp(end, "/head-proof") == 0) {
+        // 最新纪元中的链头与包含证明，不进入TEE
+        result = tc_heads_proof(repo_id);
+        if (result == NULL) {
+            send_json_response(client_socket, 404, "{\"error\":\"Repository not in the latest head tree epoch\"}");
+            return;
+        }
+        send_json_object(client_socket, 200, result);
+        return;
+    } else if (strncmp(end, "/role", 5) == 0) {
+        query = TC_VIEW_ROLE;
+        if (!query_param_str(path, "key", key, sizeof(key))) {
+            send_json_response(client_socket, 400, "{\"error\":\"Missing query parameter: key\"}");
+            return;
+        }
+        key_arg = key;
+    } else {
+        send_json_response(client_socket, 404, "{\"error\":\"Endpoint not found\"}");
+        return;
+    }
+
+    // ETag未变时直接返回304，不构造响应体；角色查询的结果依赖key，同样只随视图版本变化
+    if (request_header(request, "If-None-Match", if_none_match, sizeof(if_none_match)) &&
+        tc_view_etag(repo_id, etag) == 0 && strstr(if_none_match, etag) != NULL) {
+        snprintf(headers, sizeof(headers), "ETag: %s\r\nCache-Control: no-cache\r\n", etag);
+        send_response_with_headers(client_socket, 304, headers, "");
+        return;
+    }
+
+    if (tc_view_query(repo_id, query, key_arg, &result, etag) != 0) {
+        send_json_response(client_socket, 404, "{\"error\":\"Repository not found\"}");
+        return;
+    }
+    char *text = json_dumps(result, JSON_COMPACT);
+    json_decref(result);
+    if (text == NULL) {
+        send_json_response(client_socket, 500, "{\"error\":\"Failed to encode response\"}");
+        return;
+    }
+    snprintf(headers, sizeof(headers), "ETag: %s\r\nCache-Control: no-cache\r\n", etag);
+    send_response_with_headers(client_socket, 200, headers, text);
+    free(text);
+}
+
+// TEE公钥缓存：密钥在其生命周期内不变，PEM、DER只从TA取一次，ETag为DER的SHA256
+static pthread_mutex_t tee_pubkey_lock = PTHREAD_MUTEX_INITIALIZER;
+static int tee_pubkey_loaded = 0;
+static char tee_pubkey_pem[1024];
+static size_t tee_pubkey_pem_len;
+static uint8_t tee_pubkey_der[512];
+static size_t tee_pubkey_der_len;
+static uint32_t tee_pubkey_alg;
+static uint8_t tee_enc_pubkey_der[512];     // 客户端加密内容密钥用的RSA公钥
+static size_t tee_enc_pubkey_der_len;
+static char tee_pubkey_etag[TC_HASH_SIZE * 2 + 3];
+
+static TEEC_Result load_tee_pubkey(void) {
+    TEEC_Operation op;
+    TEEC_Result res = TEEC_SUCCESS;
+    uint32_t err_origin;
+
+    if (__atomic_load_n(&tee_pubkey_loaded, __ATOMIC_ACQUIRE)) {
+        return TEEC_SUCCESS;
+    }
+
+    pthread_mutex_lock(&tee_pubkey_lock);
+    if (!tee_pubkey_loaded) {
+        memset(&op, 0, sizeof(op));
+        op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_OUTPUT,
+                                         TEEC_VALUE_OUTPUT,
+                                         TEEC_MEMREF_TEMP_OUTPUT,
+                                         TEEC_MEMREF_TEMP_OUTPUT);
+        op.params[0].tmpref.buffer = tee_pubkey_pem;
+        op.params[0].tmpref.size = sizeof(tee_pubkey_pem);
+        op.params[2].tmpref.buffer = tee_pubkey_der;
+        op.params[2].tmpref.size = sizeof(tee_pubkey_der);
+        op.params[3].tmpref.buffer = tee_enc_pubkey_der;
+        op.params[3].tmpref.size = sizeof(tee_enc_pubkey_der);
+
+        // 所有分片共用同一把TEE密钥，从0号分片取
+        res = tc_shard_invoke(0, TA_TRUST_CHAIN_CMD_GET_TEE_PUBKEY, &op, &err_origin);
+        if (res == TEEC_SUCCESS) {
+            uint8_t key_id[TC_HASH_SIZE];
+            tee_pubkey_pem_len = op.params[1].value.a;
+            tee_pubkey_der_len = op.params[2].tmpref.size;
+            tee_pubkey_alg = op.params[1].value.b;
+            tee_enc_pubkey_der_len = op.params[3].tmpref.size;
+            tc_sha256(tee_pubkey_der, tee_pubkey_der_len, key_id);
+            tee_pubkey_etag[0] = '"';
+            tc_hex_encode(key_id, sizeof(key_id), tee_pubkey_etag + 1);
+            strcat(tee_pubkey_etag, "\"");
+            __atomic_store_n(&tee_pubkey_loaded, 1, __ATOMIC_RELEASE);
+        } else {
+            printf("Failed to get TEE public key: 0x%x origin 0x%x\n", res, err_origin);
+        }
+    }
+    pthread_mutex_unlock(&tee_pubkey_lock);
+    return res;
+}
+
+// 处理获取TEE公钥请求：GET /tee-pubkey[?format=pem|der|json]
+static void handle_get_tee_pubkey(int client_socket, const char *request, const char *path) {
+    char format[8] = "pem";
+    char if_none_match[256];
+    char headers[256];
+    TEEC_Result res;
+
+    res = load_tee_pubkey();
+    if (res != TEEC_SUCCESS) {
+        send_tee_error(client_socket, res, "Failed to get TEE public key");
+        return;
+    }
+
+    // ETag是公钥内容的哈希，密钥不变则缓存一直有效
+    snprintf(headers, sizeof(headers),
+             "ETag: %s\r\nCache-Control: public, max-age=86400\r\nVary: Accept-Encoding\r\n",
+             tee_pubkey_etag);
+    if (request_header(request, "If-None-Match", if_none_match, sizeof(if_none_match)) &&
+        strstr(if_none_match, tee_pubkey_etag) != NULL) {
+        send_http_response(client_socket, 304, "application/json", headers, "", 0);
+        return;
+    }
+
+    query_param_str(path, "format", format, sizeof(format));
+    if (strcmp(format, "der") == 0) {
+        send_http_response(client_socket, 200, "application/octet-stream", headers,
+                           tee_pubkey_der, tee_pubkey_der_len);
+    } else if (strcmp(format, "json") == 0) {
+        char der_hex[sizeof(tee_pubkey_der) * 2 + 1];
+        tc_hex_encode(tee_pubkey_der, tee_pubkey_der_len, der_hex);
+        json_t *obj = json_object();
+        json_object_set_new(obj, "pem", json_stringn(tee_pubkey_pem, tee_pubkey_pem_len));
+        json_object_set_new(obj, "der", json_string(der_hex));
+        json_object_set_new(obj, "key_id", json_stringn(tee_pubkey_etag + 1, TC_HASH_SIZE * 2));
+        json_object_set_new(obj, "algorithm", json_string(tc_sig_alg_name(tee_pubkey_alg)));
+        // 签名密钥不是RSA时，加密内容密钥要用单独的RSA公钥
+        if (tee_enc_pubkey_der_len != tee_pubkey_der_len ||
+            memcmp(tee_enc_pubkey_der, tee_pubkey_der, tee_pubkey_der_len) != 0) {
+            char enc_hex[sizeof(tee_enc_pubkey_der) * 2 + 1];
+            tc_hex_encode(tee_enc_pubkey_der, tee_enc_pubkey_der_len, enc_hex);
+            json_object_set_new(obj, "encryption_der", json_string(enc_hex));
+        }
+        char *text = json_dumps(obj, JSON_COMPACT);
+        json_decref(obj);
+        if (text == NULL) {
+            send_json_response(client_socket, 500, "{\"error\":\"Failed to encode response\"}");
+            return;
+        }
+        send_response_with_headers(client_socket, 200, headers, text);
+        free(text);
+    } else {
+        send_http_response(client_socket, 200, "application/x-pem-file", headers,
+                           tee_pubkey_pem, tee_pubkey_pem_len);
+    }
+}
+
+#define AUDIT_DEFAULT_LIMIT 100
+#define AUDIT_MAX_LIMIT 1000
+
+static void send_audit_hits(int client_socket, size_t total, const struct tc_audit_hit *hits,
+                            size_t count, size_t max) {
+    json_t *items = json_array();
+
+    for (size_t i = 0; i < count; i++) {
+        json_t *item = json_object();
+        json_object_set_new(item, "repository_id", json_integer(hits[i].rep_id));
+        json_object_set_new(item, "seq", json_integer(hits[i].seq));
+        json_object_set_new(item, "block_height", json_integer(hits[i].block_height));
+        json_object_set_new(item, "trust_timestamp", json_integer(hits[i].ts_seconds));
+        json_array_append_new(items, item);
+    }
+    json_t *response = json_object();
+    json_object_set_new(response, "total", json_integer((json_int_t)total));
+    json_object_set_new(response, "truncated", json_boolean(count == max && total > count));
+    json_object_set_new(response, "blocks", items);
+    send_json_object(client_socket, 200, response);
+}
+
+// 审计查询：
+//   GET /audit/commits/{commit_hash_hex}?limit=  登记该commit的区块
+//   GET /audit/identities?key=URL编码的公钥|fp=指纹hex&since=&until=&limit=
+//     该身份签发的区块，since/until为可信时间（秒），结果按时间升序
+static void handle_audit(int client_socket, const char *path) {
+    enum tc_audit_kind kind;
+    uint8_t key[TC_HASH_SIZE];
+    uint32_t since = 0, until = UINT32_MAX;
+    uint32_t limit = query_param_u32(path, "limit", AUDIT_DEFAULT_LIMIT);
+    struct tc_audit_hit hits[AUDIT_MAX_LIMIT];
+
+    if (limit == 0 || limit > AUDIT_MAX_LIMIT) {
+        limit = AUDIT_MAX_LIMIT;
+    }
+
+    if (strncmp(path, "/audit/commits/", 15) == 0) {
+        char hex[2 * TC_HASH_SIZE + 1];
+        uint8_t hash[TC_HASH_SIZE];
+        size_t hex_len = strcspn(path + 15, "?");
+        size_t hash_len;
+        if (hex_len == 0 || hex_len >= sizeof(hex)) {
+            send_json_response(client_socket, 400, "{\"error\":\"Invalid commit hash\"}");
+            return;
+        }
+        memcpy(hex, path + 15, hex_len);
+        hex[hex_len] = '\0';
+        if (tc_hex_decode(hex, hash, sizeof(hash), &hash_len) != 0) {
+            send_json_response(client_socket, 400, "{\"error\":\"Invalid commit hash\"}");
+            return;
+        }
+        kind = TC_AUDIT_COMMIT;
+        tc_audit_commit_key(hash, hash_len, key);
+    } else if (strcmp(path, "/audit/identities") == 0 || strncmp(path, "/audit/identities?", 18) == 0) {
+        char arg[MAX_KEY_LENGTH + 1];
+        size_t fp_len;
+        if (query_param_str(path, "key", arg, sizeof(arg))) {
+            tc_pubkey_id(arg, strlen(arg), key);
+        } else if (!query_param_str(path, "fp", arg, sizeof(arg)) ||
+                   tc_hex_decode(arg, key, sizeof(key), &fp_len) != 0 || fp_len != TC_HASH_SIZE) {
+            send_json_response(client_socket, 400, "{\"error\":\"Missing or invalid query parameter: key or fp\"}");
+            return;
+        }
+        kind = TC_AUDIT_IDENTITY;
+        since = query_param_u32(path, "since", 0);
+        until = query_param_u32(path, "until", UINT32_MAX);
+    } else {
+        send_json_response(client_socket, 404, "{\"error\":\"Endpoint not found\"}");
+        return;
+    }
+
+    size_t total;
+    int count = tc_audit_query(kind, key, since, until, hits, limit, &total);
+    if (count < 0) {
+        send_json_response(client_socket, 503, "{\"error\":\"Audit index unavailable\"}");
+        return;
+    }
+    send_audit_hits(client_socket, total, hits, (size_t)count, limit);
+}
+
+// TA命令产生新区块后由结果线程调用：更新视图、追加区块日志并建审计索引，再通知订阅者
+static void on_tee_result(uint32_t cmd_id, uint32_t rep_id, const uint8_t *blocks, size_t len) {
+    int is_new = cmd_id == TA_TRUST_CHAIN_CMD_INIT_REPO;
+
+    tc_view_add_blocks(rep_id, blocks, len, is_new);
+    uint32_t first_seq = tc_blocklog_append(rep_id, blocks, len, is_new);
+    tc_audit_add_blocks(rep_id, blocks, len, first_seq);
+    tc_acl_add_blocks(rep_id, blocks, len, first_seq);
+    tc_events_add_blocks(rep_id, blocks, len);
+}
+
+// TA侧计时直方图与slab占用：GET /metrics，Prometheus文本格式，只读
+static void handle_metrics(int client_socket) {
+    uint32_t err_origin;
+    char *text = NULL;
+    size_t len = 0;
+
+    TEEC_Result res = tc_metrics_render(&text, &len, &err_origin);
+    if (res != TEEC_SUCCESS) {
+        printf("Failed to collect TA stats: 0x%x origin 0x%x\n", res, err_origin);
+        send_tee_error(client_socket, res, "Failed to collect TA stats");
+        return;
+    }
+    send_http_response(client_socket, 200, "text/plain; version=0.0.4", NULL, text, len);
+    free(text);
+}
+
+// 推送区块中单个commit的包含证明：GET /push-proof?root=推送根&commit=commit ID
+static void handle_push_proof(int client_socket, const char *path) {
+    char arg[TC_HASH_SIZE * 2 + 1];
+    uint8_t push_root[TC_HASH_SIZE], commit[TC_HASH_SIZE];
+    uint8_t proof[TC_PUSH_MAX_DEPTH * TC_HASH_SIZE];
+    size_t root_len, commit_len;
+    uint16_t path_len;
+    struct tc_push push;
+    int64_t index;
+
+    if (!query_param_str(path, "root", arg, sizeof(arg)) ||
+        tc_hex_decode(arg, push_root, sizeof(push_root), &root_len) != 0 || root_len != TC_HASH_SIZE ||
+        !query_param_str(path, "commit", arg, sizeof(arg)) ||
+        tc_hex_decode(arg, commit, sizeof(commit), &commit_len) != 0 || commit_len == 0) {
+        send_json_response(client_socket, 400, "{\"error\":\"Missing or invalid query parameter: root or commit\"}");
+        return;
+    }
+    if (tc_push_load(push_root, &push) != 0) {
+        send_json_response(client_socket, 404, "{\"error\":\"Unknown push\"}");
+        return;
+    }
+    index = tc_push_find(&push, commit, commit_len);
+    if (index < 0 || tc_push_proof(&push, (uint32_t)index, proof, &path_len) != 0) {
+        tc_push_free(&push);
+        send_json_response(client_socket, 404, "{\"error\":\"Commit not in push\"}");
+        return;
+    }
+
+    char hex[TC_HASH_SIZE * 2 + 1];
+    json_t *response = json_object();
+    json_t *siblings = json_array();
+    tc_hex_encode(push_root, TC_HASH_SIZE, hex);
+    json_object_set_new(response, "push_root", json_string(hex));
+    json_object_set_new(response, "push_count", json_integer(push.count));
+    tc_hex_encode(commit, commit_len, hex);
+    json_object_set_new(response, "commit", json_string(hex));
+    json_object_set_new(response, "leaf_index", json_integer(index));
+    for (uint16_t i = 0; i < path_len; i++) {
+        tc_hex_encode(proof + (size_t)i * TC_HASH_SIZE, TC_HASH_SIZE, hex);
+        json_array_append_new(siblings, json_string(hex));
+    }
+    json_object_set_new(response, "path", siblings);
+    tc_push_free(&push);
+    send_json_object(client_socket, 200, response);
 }
 
 // 处理HTTP请求
 void handle_http_request(int client_socket, const char *request) {
-    char method[16], path[256];
-    sscanf(request, "%s %s", method, path);
+    char method[16], path[2048];
+    sscanf(request, "%15s %2047s", method, path);
     
     printf("Received %s request for %s\n", method, path);
     
@@ -415,7 +1520,7 @@ void handle_http_request(int client_socket, const char *request) {
                          "Access-Control-Allow-Methods: GET, POST, OPTIONS\r\n"
                          "Access-Control-Allow-Headers: Content-Type\r\n"
                          "\r\n";
-        (void)write(client_socket, response, strlen(response));
+        send_raw(client_socket, response, strlen(response));
         return;
     }
     
@@ -430,13 +1535,35 @@ void handle_http_request(int client_socket, const char *request) {
             handle_commit(client_socket, body);
         } else if (strcmp(path, "/access-control") == 0) {
             handle_access_control(client_socket, body);
+        } else if (strcmp(path, "/delete-repo") == 0) {
+            handle_delete_repo(client_socket, body);
+        } else if (strcmp(path, "/key-session") == 0) {
+            handle_key_session(client_socket, body);
+        } else if (strcmp(path, "/acl-checkpoint") == 0) {
+            handle_acl_checkpoint(client_socket, body);
         } else {
             send_json_response(client_socket, 404, "{\"error\":\"Endpoint not found\"}");
         }
     } else if (strcmp(method, "GET") == 0) {
         if (strncmp(path, "/latest-hash/", 13) == 0) {
-            uint32_t repo_id = atoi(path + 13);
-            handle_get_latest_hash(client_socket, repo_id);
+            uint32_t repo_id = strtoul(path + 13, NULL, 10);
+            uint32_t nonce = query_param_u32(path, "nonce", 0);
+            char branch[MAX_BRANCH_LENGTH + 1];
+            if (query_param_str(path, "branch", branch, sizeof(branch)) && branch[0] != '\0') {
+                handle_get_branch_head(client_socket, repo_id, nonce, branch);
+            } else {
+                handle_get_latest_hash(client_socket, repo_id, nonce);
+            }
+        } else if (strcmp(path, "/tee-pubkey") == 0 || strncmp(path, "/tee-pubkey?", 12) == 0) {
+            handle_get_tee_pubkey(client_socket, request, path);
+        } else if (strncmp(path, "/repos/", 7) == 0) {
+            handle_repo_view(client_socket, request, path);
+        } else if (strncmp(path, "/audit/", 7) == 0) {
+            handle_audit(client_socket, path);
+        } else if (strncmp(path, "/push-proof?", 12) == 0) {
+            handle_push_proof(client_socket, path);
+        } else if (strcmp(path, "/metrics") == 0 || strncmp(path, "/metrics?", 9) == 0) {
+            handle_metrics(client_socket);
         } else {
             send_json_response(client_socket, 404, "{\"error\":\"Endpoint not found\"}");
         }
@@ -445,6 +1572,76 @@ void handle_http_request(int client_socket, const char *request) {
     }
 }
 
+// 请求体没有随首个分段收全时返回请求的总长度，否则返回0
+static size_t incomplete_request_len(const char *request) {
+    const char *body = strstr(request, "\r\n\r\n");
+    char value[32];
+    unsigned long content_len;
+
+    if (body == NULL || !request_header(request, "Content-Length", value, sizeof(value))) {
+        return 0;
+    }
+    body += 4;
+    content_len = strtoul(value, NULL, 10);
+    if (strlen(body) >= content_len) {
+        return 0;
+    }
+    return (size_t)(body - request) + content_len;
+}
+
+// 读完请求体（阻塞读取）后处理请求，超过MAX_REQUEST_SIZE时返回413
+static void serve_request(int client_socket, const char *request) {
+    size_t total = incomplete_request_len(request);
+    size_t have = strlen(request);
+    char *full;
+
+    if (total == 0) {
+        handle_http_request(client_socket, request);
+        return;
+    }
+    if (total > MAX_REQUEST_SIZE || (full = malloc(total + 1)) == NULL) {
+        send_json_response(client_socket, 413, "{\"error\":\"Request too large\"}");
+        return;
+    }
+    memcpy(full, request, have);
+    while (have < total) {
+        ssize_t n = recv(client_socket, full + have, total - have, 0);
+        if (n <= 0) {
+            free(full);
+            return;
+        }
+        have += (size_t)n;
+    }
+    full[have] = '\0';
+    handle_http_request(client_socket, full);
+    free(full);
+}
+
+// SSE订阅会一直占用连接，请求体没有收全的请求要继续阻塞读取，io_uring后端为它们单独开线程
+static int is_stream_request(const char *request) {
+    char method[16], path[2048];
+    char *end;
+
+    if (incomplete_request_len(request) > 0) {
+        return 1;
+    }
+    if (sscanf(request, "%15s %2047s", method, path) != 2 ||
+        strcmp(method, "GET") != 0 || strncmp(path, "/repos/", 7) != 0) {
+        return 0;
+    }
+    strtoul(path + 7, &end, 10);
+    return end != path + 7 &&
+           (strcmp(end, "/events") == 0 || strncmp(end, "/events?", 8) == 0);
+}
+
+// io_uring后端处理请求的工作线程数：环境变量TRUST_CHAIN_NET_WORKERS
+// 请求会阻塞在TEE调用和刷盘上，默认每个分片4个
+static unsigned int configured_net_workers(void) {
+    const char *env = getenv("TRUST_CHAIN_NET_WORKERS");
+    long count = env ? strtol(env, NULL, 10) : 4L * configured_shard_count();
+    return count < 1 ? 1 : (unsigned int)count;
+}
+
 // 处理客户端连接（在新线程中）
 void *handle_client(void *socket_desc) {
     int connection_socket = *(int*)socket_desc;
@@ -454,7 +1651,7 @@ void *handle_client(void *socket_desc) {
     bytes_read = recv(connection_socket, buffer, BUFFER_SIZE - 1, 0);
     if (bytes_read > 0) {
         buffer[bytes_read] = '\0';
-        handle_http_request(connection_socket, buffer);
+        serve_request(connection_socket, buffer);
     }
     
     close(connection_socket);
@@ -465,6 +1662,14 @@ void *handle_client(void *socket_desc) {
 int main(void)
 {
     printf("=== Trust Chain HTTP Service ===\n");
+    configure_sha256();
+
+    // 仓库视图、区块日志与新区块订阅由结果线程在TA命令成功后更新
+    tc_view_init();
+    tc_shard_set_result_hook(on_tee_result);
+    // 成员树在TA执行每条命令的前后同步：附上成员证明，再按新区块更新
+    tc_shard_set_exec_hooks(tc_members_prepare, tc_members_executed);
+    init_block_log();
 
     // 初始化TEE连接
     if (init_tee_connection() != 0) {
@@ -496,7 +1701,7 @@ int main(void)
         return 1;
     }
 
-    if (listen(listen_socket, 10) < 0) {
+    if (listen(listen_socket, SOMAXCONN) < 0) {
         printf("Listen failed\n");
         return 1;
     }
@@ -507,6 +1712,28 @@ int main(void)
     printf("  POST /access-control - Access control\n");
     printf("  GET /latest-hash/{repo_id} - Get latest hash\n");
     printf("  POST /commit - Commit operation\n");
+    printf("  POST /delete-repo - Delete repository\n");
+    printf("  POST /key-session - Open a content key session\n");
+    printf("  POST /acl-checkpoint - Create an ACL checkpoint block\n");
+    printf("  GET /tee-pubkey[?format=pem|der|json] - TEE public key\n");
+    printf("  GET /repos/{repo_id}[/members|/height|/role?key=] - Repository view\n");
+    printf("  GET /repos/{repo_id}/blocks?from=&to= - Export blocks from the block log\n");
+    printf("  GET /audit/commits/{commit_hash} - Blocks registering a commit\n");
+    printf("  GET /audit/identities?key=|fp=&since=&until= - Blocks signed by an identity\n");
+    printf("  GET /repos/{repo_id}/events - Stream new blocks (Server-Sent Events)\n");
+    printf("  GET /repos/{repo_id}/head-proof - Head proof from the latest signed head tree\n");
+    printf("  GET /repos/{repo_id}/acl-checkpoint - Latest ACL checkpoint with its member set\n");
+    printf("  GET /repos/{repo_id}/member-proof?key=|fp= - Membership proof against the ACL root\n");
+    printf("  GET /push-proof?root=&commit= - Inclusion proof of a commit in a push block\n");
+    printf("  GET /metrics - TA timing histograms and slab usage (Prometheus)\n");
+
+    // 网络后端：环境变量TRUST_CHAIN_NET=uring使用io_uring事件循环，
+    // 不可用时退回默认的每连接一个线程
+    const char *net_backend = getenv("TRUST_CHAIN_NET");
+    if (net_backend != NULL && strcmp(net_backend, "uring") == 0) {
+        tc_uring_serve(listen_socket, configured_net_workers(), serve_request, is_stream_request);
+        printf("io_uring backend unavailable, using one thread per connection\n");
+    }
 
     socklen_t client_len = sizeof(client_addr);
     // 主循环：接受客户端连接并为每个连接创建新线程
@@ -532,6 +1759,8 @@ int main(void)
 
     // 清理TEE连接
     close_tee_connection();
+    tc_audit_close();
+    tc_blocklog_close();
 
 	return 0;
 }
@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <trust_chain_ta.h>
+#include <trust_chain_abi.h>
+
+#include "tc_acl.h"
+#include "tc_view.h"
+#include "tc_codec.h"
+#include "tc_sha256.h"
+
+static char acl_dir[PATH_MAX];
+static int acl_enabled = 0;
+
+int tc_acl_init(const char *dir) {
+    if (snprintf(acl_dir, sizeof(acl_dir), "%s", dir) >= (int)sizeof(acl_dir)) {
+        return -1;
+    }
+    if (mkdir(acl_dir, 0700) != 0 && errno != EEXIST) {
+        printf("Failed to create ACL checkpoint directory %s: %s\n", acl_dir, strerror(errno));
+        return -1;
+    }
+    acl_enabled = 1;
+    return 0;
+}
+
+static void acl_path(char *path, size_t cap, uint32_t rep_id, const char *suffix) {
+    snprintf(path, cap, "%s/%u.json%s", acl_dir, rep_id, suffix);
+}
+
+static json_t *hex_json(const uint8_t *bytes, size_t len) {
+    char *hex = malloc(2 * len + 1);
+    json_t *value;
+
+    if (hex == NULL) {
+        return NULL;
+    }
+    tc_hex_encode(bytes, len, hex);
+    value = json_string(hex);
+    free(hex);
+    return value;
+}
+
+/* 区块是ACL检查点时取出其成员集合状态，返回0 */
+static int block_acl_state(const uint8_t *blk, struct tc_acl_state *state) {
+    struct tc_block_hdr hdr;
+    struct tc_reader reader;
+    const uint8_t *val;
+    uint16_t tag, vlen;
+
+    memcpy(&hdr, blk, sizeof(hdr));
+    if (hdr.block_type != TC_BLOCK_ACL_CHECKPOINT) {
+        return -1;
+    }
+    tc_reader_init(&reader, blk + sizeof(hdr), hdr.body_len);
+    while (tc_next_tlv(&reader, &tag, &val, &vlen) > 0) {
+        if (tag == TC_TAG_ACL_STATE && vlen == sizeof(*state)) {
+            memcpy(state, val, sizeof(*state));
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/*
+ * 用视图中的成员核对区块记录的成员数，一致时写临时文件后rename，替换该
+ * 仓库上一个检查点。成员树的根在TA执行时已由tc_members与CA的树核对过。
+ * 调用时视图已应用到本批区块的末尾，检查点区块总是一批中的最后一个。
+ */
+static void save_checkpoint(uint32_t rep_id, uint32_t seq, const uint8_t *blk, size_t total,
+                            const struct tc_acl_state *state) {
+    struct tc_block_hdr hdr;
+    uint32_t admin_count, writer_count;
+    uint8_t block_hash[TC_HASH_SIZE];
+    char path[PATH_MAX], tmp[PATH_MAX];
+    json_t *members, *obj;
+
+    if (tc_view_acl_members(rep_id, &admin_count, &writer_count, &members) != 0) {
+        printf("No view of repository %u, ACL checkpoint %u not stored\n", rep_id, seq);
+        return;
+    }
+    if (admin_count != state->admin_count || writer_count != state->writer_count) {
+        printf("ACL checkpoint %u of repository %u does not match the view, not stored\n",
+               seq, rep_id);
+        json_decref(members);
+        return;
+    }
+
+    memcpy(&hdr, blk, sizeof(hdr));
+    tc_sha256(blk, sizeof(hdr) + hdr.body_len, block_hash);
+    obj = json_object();
+    json_object_set_new(obj, "repository_id", json_integer(rep_id));
+    json_object_set_new(obj, "seq", json_integer(seq));
+    json_object_set_new(obj, "block_height", json_integer(hdr.block_height));
+    json_object_set_new(obj, "block_hash", hex_json(block_hash, TC_HASH_SIZE));
+    json_object_set_new(obj, "admin_count", json_integer(state->admin_count));
+    json_object_set_new(obj, "writer_count", json_integer(state->writer_count));
+    json_object_set_new(obj, "acl_root", hex_json(state->root, TC_HASH_SIZE));
+    json_object_set_new(obj, "admins", json_incref(json_object_get(members, "admins")));
+    json_object_set_new(obj, "writers", json_incref(json_object_get(members, "writers")));
+    json_object_set_new(obj, "raw", hex_json(blk, total));
+    json_decref(members);
+
+    acl_path(path, sizeof(path), rep_id, "");
+    acl_path(tmp, sizeof(tmp), rep_id, ".tmp");
+    if (json_dump_file(obj, tmp, JSON_COMPACT) != 0 || rename(tmp, path) != 0) {
+        printf("Failed to store ACL checkpoint %u of repository %u\n", seq, rep_id);
+        unlink(tmp);
+    }
+    json_decref(obj);
+}
+
+void tc_acl_add_blocks(uint32_t rep_id, const uint8_t *blocks, size_t len, uint32_t first_seq) {
+    uint32_t seq = first_seq;
+    char path[PATH_MAX];
+
+    /* 检查点以日志序号定位区块，区块未能写入日志时不保存 */
+    if (!acl_enabled || first_seq == 0) {
+        return;
+    }
+    /* 创世区块开始仓库的新一代，TA重启前同ID仓库的检查点作废 */
+    if (first_seq == 1) {
+        acl_path(path, sizeof(path), rep_id, "");
+        unlink(path);
+    }
+    while (len > 0) {
+        size_t total = tc_block_total_len(blocks, len);
+        struct tc_acl_state state;
+
+        if (total == 0) {
+            break;
+        }
+        if (block_acl_state(blocks, &state) == 0) {
+            save_checkpoint(rep_id, seq, blocks, total, &state);
+        }
+        blocks += total;
+        len -= total;
+        seq++;
+    }
+}
+
+json_t *tc_acl_latest(uint32_t rep_id) {
+    char path[PATH_MAX];
+
+    if (!acl_enabled) {
+        return NULL;
+    }
+    acl_path(path, sizeof(path), rep_id, "");
+    return json_load_file(path, 0, NULL);
+}
@@ -0,0 +1,30 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#ifndef TC_ACL_H
+#define TC_ACL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <jansson.h>
+
+/*
+ * ACL检查点（格式见trust_chain_abi.h）的成员集合。区块只记录成员数与成员
+ * 树的根，CA在检查点区块进入区块日志后，用仓库视图核对成员数，一致时把
+ * 完整的成员公钥与检查点区块一起保存为<dir>/<rep_id>.json，
+ * 每个仓库只保留最新的一个。新的验证者和重启的镜像从这里起步，只需
+ * 重放检查点之后的区块。
+ */
+
+/* 打开目录（不存在则创建），失败返回-1 */
+int tc_acl_init(const char *dir);
+
+/* 分片工作线程在区块写入日志后调用，first_seq为第一个区块的日志序号 */
+void tc_acl_add_blocks(uint32_t rep_id, const uint8_t *blocks, size_t len, uint32_t first_seq);
+
+/* 仓库最新的ACL检查点，没有时返回NULL */
+json_t *tc_acl_latest(uint32_t rep_id);
+
+#endif /* TC_ACL_H */
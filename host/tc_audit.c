@@ -0,0 +1,1042 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <trust_chain_ta.h>
+#include <trust_chain_abi.h>
+
+#include "tc_audit.h"
+#include "tc_blocklog.h"
+#include "tc_sha256.h"
+#include "tc_pubkey.h"
+#include "tc_push.h"
+#include "tc_mpsc.h"
+
+#define AUDIT_RUN_MAGIC      0x49414354  /* "TCAI" */
+#define AUDIT_MANIFEST_MAGIC 0x4D414354  /* "TCAM" */
+#define AUDIT_VERSION        2           /* 2: 身份按规范公钥指纹索引 */
+
+/* 内存表攒够这么多条记录，或距上次落盘超过AUDIT_FLUSH_MS，就写成段文件 */
+#define AUDIT_FLUSH_RECORDS  8192
+#define AUDIT_FLUSH_MS       1000
+#define AUDIT_MAX_RUNS       64
+
+/* 一条索引记录，段文件内按(key, ts_seconds, rep_id, seq)排序 */
+struct audit_record {
+    uint8_t key[TC_HASH_SIZE];
+    uint32_t ts_seconds;
+    uint32_t rep_id;
+    uint32_t seq;
+    uint32_t block_height;
+};
+
+struct audit_run_hdr {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t kind;
+    uint64_t count;
+};
+
+/* 不可变的有序段，整个文件mmap进来；段列表持有一个引用，查询期间各持一个 */
+struct audit_run {
+    uint32_t id;
+    unsigned int refs;
+    size_t count;
+    const struct audit_record *records;
+    void *map;
+    size_t map_len;
+};
+
+/*
+ * 每个仓库的水位：seq之前（含）的区块已全部落入段文件。epoch是当前这一代
+ * 仓库创世区块的可信时间，TA重启后复用的仓库ID会换代，早于epoch的记录
+ * 属于旧仓库，查询时过滤、合并时丢弃。
+ */
+struct repo_mark {
+    uint32_t rep_id;
+    uint32_t seq;
+    uint32_t epoch;
+};
+
+struct mark_table {
+    struct repo_mark *marks;
+    size_t count;
+    size_t cap;
+};
+
+struct memtable {
+    struct audit_record *records;
+    size_t count;
+    size_t cap;
+};
+
+/* 待建索引的一组区块，由结果钩子复制后交给后台线程 */
+struct index_job {
+    struct tc_mpsc_node node;
+    uint32_t rep_id;
+    uint32_t first_seq;
+    size_t len;
+    uint8_t blocks[];
+};
+
+static char audit_dir[PATH_MAX];
+static int audit_enabled = 0;
+
+/*
+ * audit_lock保护内存表、段列表和水位，持锁期间不做文件I/O和段扫描：
+ * 查询在锁内给段加引用、复制内存表中的匹配记录和水位，出锁后再二分查找
+ * 段文件；后台线程摘下的旧段在最后一个引用释放时unmap。建索引（包括读取
+ * 推送列表）在后台线程中进行，分片工作线程只把区块放进index_queue。
+ */
+static pthread_mutex_t audit_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct tc_mpsc_queue index_queue;
+static int wake_fd = -1;                            /* 唤醒后台线程 */
+static struct memtable active[TC_AUDIT_KINDS];
+static struct memtable frozen[TC_AUDIT_KINDS];     /* 正在写成段文件，查询仍要查 */
+static struct mark_table active_marks;
+static struct mark_table durable_marks;
+static struct audit_run *runs[TC_AUDIT_KINDS][AUDIT_MAX_RUNS];
+static size_t run_count[TC_AUDIT_KINDS];
+static uint32_t next_run_id = 1;
+static int stopping = 0;
+static pthread_t compactor;
+
+static int record_cmp(const void *a, const void *b) {
+    const struct audit_record *x = a, *y = b;
+    int c = memcmp(x->key, y->key, TC_HASH_SIZE);
+    if (c != 0) {
+        return c;
+    }
+    if (x->ts_seconds != y->ts_seconds) {
+        return x->ts_seconds < y->ts_seconds ? -1 : 1;
+    }
+    if (x->rep_id != y->rep_id) {
+        return x->rep_id < y->rep_id ? -1 : 1;
+    }
+    if (x->seq != y->seq) {
+        return x->seq < y->seq ? -1 : 1;
+    }
+    return 0;
+}
+
+static int hit_cmp(const void *a, const void *b) {
+    const struct tc_audit_hit *x = a, *y = b;
+    if (x->ts_seconds != y->ts_seconds) {
+        return x->ts_seconds < y->ts_seconds ? -1 : 1;
+    }
+    if (x->rep_id != y->rep_id) {
+        return x->rep_id < y->rep_id ? -1 : 1;
+    }
+    return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+static struct repo_mark *mark_find(const struct mark_table *t, uint32_t rep_id) {
+    size_t lo = 0, hi = t->count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (t->marks[mid].rep_id < rep_id) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < t->count && t->marks[lo].rep_id == rep_id ? &t->marks[lo] : NULL;
+}
+
+/* 按rep_id有序插入，已存在则返回原项 */
+static struct repo_mark *mark_get(struct mark_table *t, uint32_t rep_id) {
+    size_t lo = 0, hi = t->count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (t->marks[mid].rep_id < rep_id) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < t->count && t->marks[lo].rep_id == rep_id) {
+        return &t->marks[lo];
+    }
+    if (t->count == t->cap) {
+        size_t cap = t->cap ? t->cap * 2 : 64;
+        struct repo_mark *grown = realloc(t->marks, cap * sizeof(*grown));
+        if (grown == NULL) {
+            return NULL;
+        }
+        t->marks = grown;
+        t->cap = cap;
+    }
+    memmove(&t->marks[lo + 1], &t->marks[lo], (t->count - lo) * sizeof(*t->marks));
+    t->count++;
+    memset(&t->marks[lo], 0, sizeof(*t->marks));
+    t->marks[lo].rep_id = rep_id;
+    return &t->marks[lo];
+}
+
+static int is_stale(const struct mark_table *t, uint32_t rep_id, uint32_t ts) {
+    const struct repo_mark *m = mark_find(t, rep_id);
+    return m != NULL && ts < m->epoch;
+}
+
+static int memtable_push(struct memtable *m, const struct audit_record *rec) {
+    if (m->count == m->cap) {
+        size_t cap = m->cap ? m->cap * 2 : 1024;
+        struct audit_record *grown = realloc(m->records, cap * sizeof(*grown));
+        if (grown == NULL) {
+            return -1;
+        }
+        m->records = grown;
+        m->cap = cap;
+    }
+    m->records[m->count++] = *rec;
+    return 0;
+}
+
+void tc_audit_commit_key(const uint8_t *hash, size_t len, uint8_t *key) {
+    memset(key, 0, TC_HASH_SIZE);
+    memcpy(key, hash, len < TC_HASH_SIZE ? len : TC_HASH_SIZE);
+}
+
+static void run_path(char *path, size_t cap, uint32_t id) {
+    snprintf(path, cap, "%s/%08u.run", audit_dir, id);
+}
+
+static void free_run(struct audit_run *run) {
+    if (run != NULL) {
+        munmap(run->map, run->map_len);
+        free(run);
+    }
+}
+
+static void run_get(struct audit_run *run) {
+    __atomic_add_fetch(&run->refs, 1, __ATOMIC_RELAXED);
+}
+
+static void run_put(struct audit_run *run) {
+    if (__atomic_sub_fetch(&run->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        free_run(run);
+    }
+}
+
+static struct audit_run *open_run(uint32_t id, enum tc_audit_kind kind) {
+    char path[PATH_MAX];
+    struct audit_run_hdr hdr;
+    struct stat st;
+    struct audit_run *run = NULL;
+
+    run_path(path, sizeof(path), id);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(hdr) ||
+        pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+        hdr.magic != AUDIT_RUN_MAGIC || hdr.version != AUDIT_VERSION || hdr.kind != kind ||
+        sizeof(hdr) + hdr.count * sizeof(struct audit_record) != (size_t)st.st_size) {
+        printf("Invalid audit index run %s\n", path);
+        goto out;
+    }
+    run = calloc(1, sizeof(*run));
+    if (run == NULL) {
+        goto out;
+    }
+    run->map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (run->map == MAP_FAILED) {
+        free(run);
+        run = NULL;
+        goto out;
+    }
+    run->id = id;
+    run->refs = 1;
+    run->count = hdr.count;
+    run->map_len = st.st_size;
+    run->records = (const struct audit_record *)((const uint8_t *)run->map + sizeof(hdr));
+out:
+    close(fd);
+    return run;
+}
+
+static int write_all(int fd, const void *buf, size_t len) {
+    const uint8_t *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static void sync_dir(void) {
+    int fd = open(audit_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+/* 把有序记录写成段文件并落盘，再mmap回来 */
+static struct audit_run *write_run(uint32_t id, enum tc_audit_kind kind,
+                                   const struct audit_record *records, size_t count) {
+    char path[PATH_MAX];
+    struct audit_run_hdr hdr = {
+        .magic = AUDIT_RUN_MAGIC, .version = AUDIT_VERSION, .kind = kind, .count = count,
+    };
+
+    run_path(path, sizeof(path), id);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (write_all(fd, &hdr, sizeof(hdr)) != 0 ||
+        write_all(fd, records, count * sizeof(*records)) != 0 || fdatasync(fd) != 0) {
+        printf("Failed to write audit index run %s: %s\n", path, strerror(errno));
+        close(fd);
+        unlink(path);
+        return NULL;
+    }
+    close(fd);
+    return open_run(id, kind);
+}
+
+struct manifest_run {
+    uint32_t kind;
+    uint32_t id;
+};
+
+struct manifest_hdr {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t next_run_id;
+    uint32_t run_count;
+    uint32_t mark_count;
+};
+
+/* 在锁内拍下清单内容，锁外写文件；清单只由后台线程写 */
+static void *snapshot_manifest(size_t *len) {
+    struct manifest_hdr hdr = {
+        .magic = AUDIT_MANIFEST_MAGIC, .version = AUDIT_VERSION,
+        .next_run_id = next_run_id, .mark_count = durable_marks.count,
+    };
+    for (int k = 0; k < TC_AUDIT_KINDS; k++) {
+        hdr.run_count += run_count[k];
+    }
+    *len = sizeof(hdr) + hdr.run_count * sizeof(struct manifest_run) +
+           hdr.mark_count * sizeof(struct repo_mark);
+    uint8_t *buf = malloc(*len);
+    if (buf == NULL) {
+        return NULL;
+    }
+    uint8_t *p = buf;
+    memcpy(p, &hdr, sizeof(hdr));
+    p += sizeof(hdr);
+    for (int k = 0; k < TC_AUDIT_KINDS; k++) {
+        for (size_t i = 0; i < run_count[k]; i++) {
+            struct manifest_run r = { .kind = k, .id = runs[k][i]->id };
+            memcpy(p, &r, sizeof(r));
+            p += sizeof(r);
+        }
+    }
+    memcpy(p, durable_marks.marks, hdr.mark_count * sizeof(struct repo_mark));
+    return buf;
+}
+
+/* 原子替换清单：写临时文件、落盘、rename */
+static int write_manifest(const void *buf, size_t len) {
+    char path[PATH_MAX], tmp[PATH_MAX];
+
+    snprintf(path, sizeof(path), "%s/MANIFEST", audit_dir);
+    snprintf(tmp, sizeof(tmp), "%s/MANIFEST.tmp", audit_dir);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return -1;
+    }
+    if (write_all(fd, buf, len) != 0 || fdatasync(fd) != 0) {
+        close(fd);
+        unlink(tmp);
+        return -1;
+    }
+    close(fd);
+    if (rename(tmp, path) != 0) {
+        return -1;
+    }
+    sync_dir();
+    return 0;
+}
+
+static void publish_manifest(void) {
+    size_t len;
+    void *buf = snapshot_manifest(&len);
+    pthread_mutex_unlock(&audit_lock);
+    if (buf == NULL || write_manifest(buf, len) != 0) {
+        printf("Failed to write audit index manifest\n");
+    }
+    free(buf);
+    pthread_mutex_lock(&audit_lock);
+}
+
+/* 冻结内存表写成段文件，调用时持锁 */
+static void flush_memtables(void) {
+    struct audit_run *flushed[TC_AUDIT_KINDS] = { NULL };
+    struct mark_table marks = active_marks;
+    uint32_t ids[TC_AUDIT_KINDS];
+
+    for (int k = 0; k < TC_AUDIT_KINDS; k++) {
+        frozen[k] = active[k];
+        memset(&active[k], 0, sizeof(active[k]));
+        ids[k] = next_run_id++;
+    }
+    memset(&active_marks, 0, sizeof(active_marks));
+    pthread_mutex_unlock(&audit_lock);
+
+    for (int k = 0; k < TC_AUDIT_KINDS; k++) {
+        if (frozen[k].count > 0) {
+            qsort(frozen[k].records, frozen[k].count, sizeof(struct audit_record), record_cmp);
+            flushed[k] = write_run(ids[k], k, frozen[k].records, frozen[k].count);
+        }
+    }
+
+    pthread_mutex_lock(&audit_lock);
+    int failed = 0;
+    for (int k = 0; k < TC_AUDIT_KINDS; k++) {
+        if (frozen[k].count > 0 && (flushed[k] == NULL || run_count[k] == AUDIT_MAX_RUNS)) {
+            failed = 1;
+        }
+    }
+    if (failed) {
+        /* 写段失败：记录放回内存表，下次重试 */
+        for (int k = 0; k < TC_AUDIT_KINDS; k++) {
+            for (size_t i = 0; i < frozen[k].count; i++) {
+                memtable_push(&active[k], &frozen[k].records[i]);
+            }
+            free_run(flushed[k]);
+        }
+        for (size_t i = 0; i < marks.count; i++) {
+            struct repo_mark *m = mark_get(&active_marks, marks.marks[i].rep_id);
+            if (m != NULL && m->seq < marks.marks[i].seq) {
+                *m = marks.marks[i];
+            }
+        }
+    } else {
+        for (int k = 0; k < TC_AUDIT_KINDS; k++) {
+            if (flushed[k] != NULL) {
+                runs[k][run_count[k]++] = flushed[k];
+            }
+        }
+        /* 水位只在记录进入段文件后前移；仓库已换代的旧水位作废 */
+        for (size_t i = 0; i < marks.count; i++) {
+            struct repo_mark *m = mark_get(&durable_marks, marks.marks[i].rep_id);
+            if (m != NULL && m->epoch == marks.marks[i].epoch) {
+                m->seq = marks.marks[i].seq;
+            }
+        }
+    }
+    for (int k = 0; k < TC_AUDIT_KINDS; k++) {
+        free(frozen[k].records);
+        memset(&frozen[k], 0, sizeof(frozen[k]));
+    }
+    free(marks.marks);
+    if (!failed) {
+        publish_manifest();
+    }
+}
+
+/*
+ * 合并相邻的两个段：较旧的段不超过较新段的两倍时合并，每条记录只被重写
+ * 对数次，段数保持在对数级。调用时持锁，没有可合并的段返回0。
+ */
+static int compact_once(void) {
+    for (int k = 0; k < TC_AUDIT_KINDS; k++) {
+        for (size_t i = run_count[k]; i >= 2; i--) {
+            struct audit_run *a = runs[k][i - 2], *b = runs[k][i - 1];
+            if (a->count > 2 * b->count) {
+                continue;
+            }
+
+            uint32_t id = next_run_id++;
+            struct mark_table marks = { NULL, durable_marks.count, durable_marks.count };
+            marks.marks = malloc((marks.count ? marks.count : 1) * sizeof(*marks.marks));
+            if (marks.marks == NULL) {
+                return 0;
+            }
+            memcpy(marks.marks, durable_marks.marks, marks.count * sizeof(*marks.marks));
+            pthread_mutex_unlock(&audit_lock);
+
+            /* 两路归并，顺带丢弃已换代仓库的旧记录 */
+            struct audit_record *merged = malloc((a->count + b->count + 1) * sizeof(*merged));
+            struct audit_run *run = NULL;
+            if (merged != NULL) {
+                size_t x = 0, y = 0, n = 0;
+                while (x < a->count || y < b->count) {
+                    const struct audit_record *r;
+                    if (y == b->count || (x < a->count && record_cmp(&a->records[x], &b->records[y]) <= 0)) {
+                        r = &a->records[x++];
+                    } else {
+                        r = &b->records[y++];
+                    }
+                    if (!is_stale(&marks, r->rep_id, r->ts_seconds)) {
+                        merged[n++] = *r;
+                    }
+                }
+                run = write_run(id, k, merged, n);
+                free(merged);
+            }
+            free(marks.marks);
+
+            pthread_mutex_lock(&audit_lock);
+            if (run == NULL) {
+                return 0;
+            }
+            runs[k][i - 2] = run;
+            memmove(&runs[k][i - 1], &runs[k][i], (run_count[k] - i) * sizeof(runs[k][0]));
+            run_count[k]--;
+            publish_manifest();
+
+            /* 正在查询的段在查询结束后才unmap，已打开的映射不受unlink影响 */
+            char path[PATH_MAX];
+            run_path(path, sizeof(path), a->id);
+            unlink(path);
+            run_path(path, sizeof(path), b->id);
+            unlink(path);
+            run_put(a);
+            run_put(b);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* 为一个区块生成索引记录：调用时不持锁，读取推送列表等都在锁外完成 */
+static void index_block(uint32_t rep_id, uint32_t seq, const uint8_t *blk, size_t len) {
+    struct memtable local[TC_AUDIT_KINDS];
+    struct tc_block_hdr hdr;
+    struct tc_reader reader;
+    struct audit_record rec;
+    const uint8_t *val;
+    uint16_t tag, vlen;
+
+    (void)len;
+    memset(local, 0, sizeof(local));
+    memcpy(&hdr, blk, sizeof(hdr));
+    memset(&rec, 0, sizeof(rec));
+    rec.ts_seconds = hdr.ts_seconds;
+    rec.rep_id = rep_id;
+    rec.seq = seq;
+    rec.block_height = hdr.block_height;
+
+    tc_reader_init(&reader, blk + sizeof(hdr), hdr.body_len);
+    while (tc_next_tlv(&reader, &tag, &val, &vlen) > 0) {
+        if (tag == TC_TAG_SIGKEY) {
+            tc_pubkey_id((const char *)val, vlen, rec.key);
+            memtable_push(&local[TC_AUDIT_IDENTITY], &rec);
+        } else if (tag == TC_TAG_COMMIT_HASH) {
+            tc_audit_commit_key(val, vlen, rec.key);
+            memtable_push(&local[TC_AUDIT_COMMIT], &rec);
+        } else if (tag == TC_TAG_PUSH_ROOT && vlen == TC_HASH_SIZE) {
+            /* 推送区块：按根取回commit列表，每个commit都指向这个区块 */
+            struct tc_push push;
+            if (tc_push_load_held(val, &push) != 0) {
+                continue;
+            }
+            for (uint32_t i = 0; i < push.count; i++) {
+                tc_audit_commit_key(push.ids + (size_t)i * push.id_len, push.id_len, rec.key);
+                memtable_push(&local[TC_AUDIT_COMMIT], &rec);
+            }
+            tc_push_free(&push);
+        }
+    }
+
+    pthread_mutex_lock(&audit_lock);
+    /* 创世区块开始仓库的新一代，旧水位作废 */
+    struct repo_mark *durable = mark_get(&durable_marks, rep_id);
+    if (seq == 1 && durable != NULL) {
+        durable->epoch = hdr.ts_seconds;
+        durable->seq = 0;
+    }
+    for (int k = 0; k < TC_AUDIT_KINDS; k++) {
+        for (size_t i = 0; i < local[k].count; i++) {
+            memtable_push(&active[k], &local[k].records[i]);
+        }
+    }
+    struct repo_mark *m = mark_get(&active_marks, rep_id);
+    if (m != NULL) {
+        m->seq = seq;
+        m->epoch = durable != NULL ? durable->epoch : 0;
+    }
+    pthread_mutex_unlock(&audit_lock);
+
+    for (int k = 0; k < TC_AUDIT_KINDS; k++) {
+        free(local[k].records);
+    }
+}
+
+static void index_blocks(uint32_t rep_id, uint32_t seq, const uint8_t *blocks, size_t len) {
+    while (len > 0) {
+        size_t block_len = tc_block_total_len(blocks, len);
+        if (block_len == 0) {
+            break;
+        }
+        index_block(rep_id, seq++, blocks, block_len);
+        blocks += block_len;
+        len -= block_len;
+    }
+}
+
+static void wake_compactor(void) {
+    uint64_t one = 1;
+    while (write(wake_fd, &one, sizeof(one)) < 0 && errno == EINTR) {
+    }
+}
+
+/* 取空索引队列；生产者入队到一半时pop会暂时返回NULL，入队完成后会再唤醒 */
+static void drain_index_queue(void) {
+    struct tc_mpsc_node *node;
+
+    while ((node = tc_mpsc_pop(&index_queue)) != NULL) {
+        struct index_job *job = tc_mpsc_entry(node, struct index_job, node);
+        index_blocks(job->rep_id, job->first_seq, job->blocks, job->len);
+        free(job);
+    }
+}
+
+static int flush_due(const struct timespec *last_flush, const struct timespec *now) {
+    size_t pending = 0;
+
+    for (int k = 0; k < TC_AUDIT_KINDS; k++) {
+        pending += active[k].count;
+    }
+    long elapsed_ms = (now->tv_sec - last_flush->tv_sec) * 1000 +
+                      (now->tv_nsec - last_flush->tv_nsec) / 1000000;
+    return pending >= AUDIT_FLUSH_RECORDS ||
+           ((pending > 0 || active_marks.count > 0) && elapsed_ms >= AUDIT_FLUSH_MS);
+}
+
+static void *compactor_thread(void *arg) {
+    struct timespec last_flush;
+    (void)arg;
+
+    clock_gettime(CLOCK_MONOTONIC, &last_flush);
+    for (;;) {
+        struct timespec now;
+        int busy;
+
+        drain_index_queue();
+        pthread_mutex_lock(&audit_lock);
+        if (stopping) {
+            pthread_mutex_unlock(&audit_lock);
+            break;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (flush_due(&last_flush, &now)) {
+            flush_memtables();
+            last_flush = now;
+            busy = 1;
+        } else {
+            busy = compact_once();
+        }
+        pthread_mutex_unlock(&audit_lock);
+        if (busy) {
+            continue;
+        }
+
+        struct pollfd pfd = { .fd = wake_fd, .events = POLLIN };
+        if (poll(&pfd, 1, AUDIT_FLUSH_MS) > 0) {
+            uint64_t n;
+            while (read(wake_fd, &n, sizeof(n)) < 0 && errno == EINTR) {
+            }
+        }
+    }
+
+    /* 退出前把已入队的区块建完索引再落盘 */
+    drain_index_queue();
+    pthread_mutex_lock(&audit_lock);
+    if (active[TC_AUDIT_COMMIT].count > 0 || active[TC_AUDIT_IDENTITY].count > 0 ||
+        active_marks.count > 0) {
+        flush_memtables();
+    }
+    pthread_mutex_unlock(&audit_lock);
+    return NULL;
+}
+
+void tc_audit_add_blocks(uint32_t rep_id, const uint8_t *blocks, size_t len, uint32_t first_seq) {
+    struct index_job *job;
+
+    /* 索引指向区块日志，区块未能写入日志时不建索引 */
+    if (!audit_enabled || first_seq == 0 || len == 0) {
+        return;
+    }
+    /* 只复制区块入队，解析和读取推送列表交给后台线程 */
+    job = malloc(sizeof(*job) + len);
+    if (job == NULL) {
+        printf("Audit index: dropped %zu bytes of blocks for repo %u\n", len, rep_id);
+        return;
+    }
+    job->rep_id = rep_id;
+    job->first_seq = first_seq;
+    job->len = len;
+    memcpy(job->blocks, blocks, len);
+    tc_mpsc_push(&index_queue, &job->node);
+    wake_compactor();
+}
+
+/* 找到首个不小于rec的位置 */
+static size_t run_lower_bound(const struct audit_run *run, const struct audit_record *rec) {
+    size_t lo = 0, hi = run->count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (record_cmp(&run->records[mid], rec) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/* 找到首个大于rec的位置 */
+static size_t run_upper_bound(const struct audit_run *run, const struct audit_record *rec) {
+    size_t lo = 0, hi = run->count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (record_cmp(&run->records[mid], rec) <= 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static void add_hit(struct tc_audit_hit **hits, size_t *count, size_t *cap,
+                    const struct audit_record *rec) {
+    if (*count == *cap) {
+        size_t new_cap = *cap ? *cap * 2 : 64;
+        struct tc_audit_hit *grown = realloc(*hits, new_cap * sizeof(*grown));
+        if (grown == NULL) {
+            return;
+        }
+        *hits = grown;
+        *cap = new_cap;
+    }
+    (*hits)[*count].rep_id = rec->rep_id;
+    (*hits)[*count].seq = rec->seq;
+    (*hits)[*count].block_height = rec->block_height;
+    (*hits)[*count].ts_seconds = rec->ts_seconds;
+    (*count)++;
+}
+
+int tc_audit_query(enum tc_audit_kind kind, const uint8_t *key,
+                   uint32_t since, uint32_t until,
+                   struct tc_audit_hit *hits, size_t max, size_t *total) {
+    struct audit_run *snap[AUDIT_MAX_RUNS];
+    struct tc_audit_hit *found = NULL;
+    size_t found_count = 0, found_cap = 0, nsnap = 0;
+    struct mark_table marks = { NULL, 0, 0 };
+    struct audit_record lo, hi;
+
+    *total = 0;
+    if (!audit_enabled || kind >= TC_AUDIT_KINDS) {
+        return -1;
+    }
+    memset(&lo, 0, sizeof(lo));
+    memcpy(lo.key, key, TC_HASH_SIZE);
+    lo.ts_seconds = since;
+    hi = lo;
+    hi.ts_seconds = until;
+    hi.rep_id = UINT32_MAX;
+    hi.seq = UINT32_MAX;
+
+    /* 锁内只给段加引用、复制水位和内存表中的匹配记录 */
+    pthread_mutex_lock(&audit_lock);
+    marks.count = marks.cap = durable_marks.count;
+    marks.marks = malloc((marks.count ? marks.count : 1) * sizeof(*marks.marks));
+    if (marks.marks == NULL) {
+        pthread_mutex_unlock(&audit_lock);
+        return -1;
+    }
+    memcpy(marks.marks, durable_marks.marks, marks.count * sizeof(*marks.marks));
+    for (size_t r = 0; r < run_count[kind]; r++) {
+        run_get(runs[kind][r]);
+        snap[nsnap++] = runs[kind][r];
+    }
+    /* 内存表无序，逐条比较；内存表不超过AUDIT_FLUSH_RECORDS条 */
+    const struct memtable *tables[] = { &active[kind], &frozen[kind] };
+    for (size_t t = 0; t < 2; t++) {
+        for (size_t i = 0; i < tables[t]->count; i++) {
+            const struct audit_record *rec = &tables[t]->records[i];
+            if (memcmp(rec->key, key, TC_HASH_SIZE) != 0 ||
+                rec->ts_seconds < since || rec->ts_seconds > until ||
+                is_stale(&marks, rec->rep_id, rec->ts_seconds)) {
+                continue;
+            }
+            (*total)++;
+            add_hit(&found, &found_count, &found_cap, rec);
+        }
+    }
+    pthread_mutex_unlock(&audit_lock);
+
+    /*
+     * 段内记录按(key, 时间)有序，两次二分得到命中区间，区间长度计入总数，
+     * 不逐条扫描；已换代仓库的旧记录要到合并时才丢弃，因此总数是上界。
+     * 每个段最多取区间内前max条即可。
+     */
+    for (size_t r = 0; r < nsnap; r++) {
+        const struct audit_run *run = snap[r];
+        size_t begin = run_lower_bound(run, &lo);
+        size_t end = run_upper_bound(run, &hi);
+        size_t taken = 0;
+
+        *total += end > begin ? end - begin : 0;
+        for (size_t i = begin; i < end && taken < max; i++) {
+            const struct audit_record *rec = &run->records[i];
+            if (is_stale(&marks, rec->rep_id, rec->ts_seconds)) {
+                continue;
+            }
+            add_hit(&found, &found_count, &found_cap, rec);
+            taken++;
+        }
+        run_put(snap[r]);
+    }
+    free(marks.marks);
+
+    /* 不足max条说明每个段都已取尽，此时总数是精确的 */
+    if (found_count < max) {
+        *total = found_count;
+    }
+    if (found_count > 0) {
+        qsort(found, found_count, sizeof(*found), hit_cmp);
+        if (found_count > max) {
+            found_count = max;
+        }
+        memcpy(hits, found, found_count * sizeof(*hits));
+    }
+    free(found);
+    return (int)found_count;
+}
+
+/* 读取清单并打开其中的段，清单之外的段文件是未完成的写入或已合并的旧段 */
+static int load_manifest(void) {
+    char path[PATH_MAX];
+    struct manifest_hdr hdr;
+    struct stat st;
+    uint8_t *buf = NULL;
+    int ret = -1;
+
+    snprintf(path, sizeof(path), "%s/MANIFEST", audit_dir);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return errno == ENOENT ? 0 : -1;
+    }
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(hdr) ||
+        (buf = malloc(st.st_size)) == NULL ||
+        pread(fd, buf, st.st_size, 0) != st.st_size) {
+        goto out;
+    }
+    memcpy(&hdr, buf, sizeof(hdr));
+    if (hdr.magic != AUDIT_MANIFEST_MAGIC || hdr.version != AUDIT_VERSION ||
+        sizeof(hdr) + (size_t)hdr.run_count * sizeof(struct manifest_run) +
+        (size_t)hdr.mark_count * sizeof(struct repo_mark) != (size_t)st.st_size) {
+        printf("Invalid audit index manifest\n");
+        goto out;
+    }
+
+    const uint8_t *p = buf + sizeof(hdr);
+    for (uint32_t i = 0; i < hdr.run_count; i++, p += sizeof(struct manifest_run)) {
+        struct manifest_run r;
+        memcpy(&r, p, sizeof(r));
+        if (r.kind >= TC_AUDIT_KINDS || run_count[r.kind] == AUDIT_MAX_RUNS) {
+            goto out;
+        }
+        struct audit_run *run = open_run(r.id, r.kind);
+        if (run == NULL) {
+            goto out;
+        }
+        runs[r.kind][run_count[r.kind]++] = run;
+    }
+    durable_marks.marks = malloc((hdr.mark_count ? hdr.mark_count : 1) * sizeof(struct repo_mark));
+    if (durable_marks.marks == NULL) {
+        goto out;
+    }
+    memcpy(durable_marks.marks, p, hdr.mark_count * sizeof(struct repo_mark));
+    durable_marks.count = durable_marks.cap = hdr.mark_count;
+    next_run_id = hdr.next_run_id;
+    ret = 0;
+out:
+    free(buf);
+    close(fd);
+    return ret;
+}
+
+static void remove_orphan_runs(void) {
+    DIR *dir = opendir(audit_dir);
+    struct dirent *de;
+
+    if (dir == NULL) {
+        return;
+    }
+    while ((de = readdir(dir)) != NULL) {
+        char *end;
+        unsigned long id = strtoul(de->d_name, &end, 10);
+        int live = 0;
+        if (end == de->d_name || strcmp(end, ".run") != 0) {
+            continue;
+        }
+        for (int k = 0; k < TC_AUDIT_KINDS; k++) {
+            for (size_t i = 0; i < run_count[k]; i++) {
+                live |= runs[k][i]->id == id;
+            }
+        }
+        if (!live) {
+            char path[PATH_MAX];
+            run_path(path, sizeof(path), (uint32_t)id);
+            unlink(path);
+        }
+    }
+    closedir(dir);
+}
+
+/* 从区块日志补齐水位之后的区块，调用时后台线程尚未启动 */
+static void catch_up_repo(uint32_t rep_id) {
+    struct tc_blocklog_range range;
+    struct tc_block_hdr genesis;
+    uint8_t buf[4 * TC_MAX_BLOCK_SIZE];
+    size_t have = 0;
+    uint32_t seq;
+
+    if (tc_blocklog_open_range(rep_id, 1, 1, &range) != 0) {
+        return;
+    }
+    int ok = pread(range.fd, &genesis, sizeof(genesis), range.offset) == sizeof(genesis);
+    close(range.fd);
+    if (!ok) {
+        return;
+    }
+
+    struct repo_mark *m = mark_get(&durable_marks, rep_id);
+    if (m == NULL) {
+        return;
+    }
+    /* 日志换成了新一代仓库，旧水位作废 */
+    if (m->epoch != genesis.ts_seconds) {
+        m->epoch = genesis.ts_seconds;
+        m->seq = 0;
+    }
+    if (tc_blocklog_open_range(rep_id, m->seq + 1, UINT32_MAX, &range) != 0) {
+        return;
+    }
+
+    seq = range.first;
+    off_t offset = range.offset;
+    uint64_t remaining = range.len;
+    while (remaining > 0 || have > 0) {
+        size_t want = sizeof(buf) - have;
+        if (want > remaining) {
+            want = remaining;
+        }
+        ssize_t n = want > 0 ? pread(range.fd, buf + have, want, offset) : 0;
+        if (n < 0) {
+            break;
+        }
+        offset += n;
+        remaining -= n;
+        have += n;
+
+        size_t used = 0;
+        for (;;) {
+            size_t block_len = tc_block_total_len(buf + used, have - used);
+            if (block_len == 0) {
+                break;
+            }
+            index_block(rep_id, seq++, buf + used, block_len);
+            used += block_len;
+        }
+        if (used == 0 && (remaining == 0 || n == 0)) {
+            break;
+        }
+        memmove(buf, buf + used, have - used);
+        have -= used;
+    }
+    close(range.fd);
+}
+
+int tc_audit_init(const char *dir) {
+    uint32_t *rep_ids;
+    size_t count;
+
+    if (snprintf(audit_dir, sizeof(audit_dir), "%s", dir) >= (int)sizeof(audit_dir)) {
+        return -1;
+    }
+    if (mkdir(audit_dir, 0700) != 0 && errno != EEXIST) {
+        printf("Failed to create audit index directory %s: %s\n", audit_dir, strerror(errno));
+        return -1;
+    }
+    if (load_manifest() != 0) {
+        printf("Failed to load audit index, rebuilding from the block log\n");
+        for (int k = 0; k < TC_AUDIT_KINDS; k++) {
+            for (size_t i = 0; i < run_count[k]; i++) {
+                free_run(runs[k][i]);
+            }
+            run_count[k] = 0;
+        }
+        free(durable_marks.marks);
+        memset(&durable_marks, 0, sizeof(durable_marks));
+    }
+    remove_orphan_runs();
+
+    if (tc_blocklog_list(&rep_ids, &count) == 0) {
+        for (size_t i = 0; i < count; i++) {
+            catch_up_repo(rep_ids[i]);
+        }
+        free(rep_ids);
+    }
+
+    wake_fd = eventfd(0, EFD_CLOEXEC);
+    if (wake_fd < 0) {
+        return -1;
+    }
+    tc_mpsc_init(&index_queue);
+    audit_enabled = 1;
+    stopping = 0;
+    if (pthread_create(&compactor, NULL, compactor_thread, NULL) != 0) {
+        audit_enabled = 0;
+        close(wake_fd);
+        wake_fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+void tc_audit_close(void) {
+    if (!audit_enabled) {
+        return;
+    }
+    pthread_mutex_lock(&audit_lock);
+    stopping = 1;
+    pthread_mutex_unlock(&audit_lock);
+    wake_compactor();
+    pthread_join(compactor, NULL);
+    audit_enabled = 0;
+    close(wake_fd);
+    wake_fd = -1;
+}
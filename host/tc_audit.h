@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#ifndef TC_AUDIT_H
+#define TC_AUDIT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * 审计用二级索引，建立在区块日志之上：
+ *   commit索引：commit哈希 -> (仓库, 日志序号)
+ *   身份索引：  签名者公钥指纹（公钥文本的SHA256，与TA一致）-> 其签发的区块
+ * 新记录先进内存表，攒够后排序写成不可变的有序段文件，查询对每个段二分查找；
+ * 后台线程把大小相近的段合并，段数保持在对数级。清单文件记录现有段和每个
+ * 仓库已落入段文件的日志序号，启动时从区块日志补齐之后的区块。
+ */
+
+enum tc_audit_kind {
+    TC_AUDIT_COMMIT,
+    TC_AUDIT_IDENTITY,
+    TC_AUDIT_KINDS,
+};
+
+struct tc_audit_hit {
+    uint32_t rep_id;
+    uint32_t seq;           /* 日志序号，可用GET /repos/{id}/blocks取回区块 */
+    uint32_t block_height;
+    uint32_t ts_seconds;    /* 区块的可信时间 */
+};
+
+/* 打开索引目录并从区块日志补齐索引，须在tc_blocklog_init之后调用 */
+int tc_audit_init(const char *dir);
+void tc_audit_close(void);
+
+/*
+ * 为刚追加到区块日志的区块建索引，first_seq为tc_blocklog_append的返回值。
+ * 只复制区块入队，由后台线程异步建索引，返回后查询不一定立即可见。
+ */
+void tc_audit_add_blocks(uint32_t rep_id, const uint8_t *blocks, size_t len, uint32_t first_seq);
+
+/*
+ * 按键查询，key为32字节（commit哈希不足32字节时补0，身份为公钥指纹），
+ * 只返回可信时间在[since, until]内的记录。结果按时间升序，最多max条；
+ * 返回写入hits的条数，索引不可用返回-1。total为匹配总数：结果不足max条
+ * 时精确，否则由段内二分区间估算，是包含已换代仓库旧记录的上界。
+ */
+int tc_audit_query(enum tc_audit_kind kind, const uint8_t *key,
+                   uint32_t since, uint32_t until,
+                   struct tc_audit_hit *hits, size_t max, size_t *total);
+
+/* 将commit哈希规整为32字节的索引键 */
+void tc_audit_commit_key(const uint8_t *hash, size_t len, uint8_t *key);
+
+#endif /* TC_AUDIT_H */
@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#include <string.h>
+
+#include "tc_batch.h"
+#include "tc_sha256.h"
+
+void tc_batch_reset(struct tc_batch *b) {
+    b->leaf_count = 0;
+    b->depth = 0;
+}
+
+/* 区块末尾是空的聚合签名占位字段时返回区块总长，否则返回0 */
+static size_t placeholder_block_len(const uint8_t *blk, size_t avail) {
+    struct tc_block_hdr hdr;
+    struct tc_tlv_hdr tlv;
+    size_t total = tc_block_total_len(blk, avail);
+
+    if (total == 0) {
+        return 0;
+    }
+    memcpy(&hdr, blk, sizeof(hdr));
+    memcpy(&tlv, blk + sizeof(hdr) + hdr.body_len, sizeof(tlv));
+    return tlv.tag == TC_TAG_TEE_BATCH_SIG && tlv.len == 0 ? total : 0;
+}
+
+uint32_t tc_batch_pending_blocks(const uint8_t *blocks, size_t len) {
+    uint32_t count = 0;
+    size_t off = 0;
+
+    while (off < len) {
+        size_t total = tc_block_total_len(blocks + off, len - off);
+        if (total == 0) {
+            break;
+        }
+        if (placeholder_block_len(blocks + off, len - off) != 0) {
+            count++;
+        }
+        off += total;
+    }
+    return count;
+}
+
+/* 叶子位置先存区块哈希，建树时统一加前缀算成叶子 */
+int tc_batch_add_blocks(struct tc_batch *b, const uint8_t *blocks, size_t len) {
+    struct tc_sha256_msg msgs[TC_MAX_BATCH_LEAVES];
+    uint32_t count = 0;
+    size_t off = 0;
+
+    while (off < len) {
+        size_t total = placeholder_block_len(blocks + off, len - off);
+        struct tc_block_hdr hdr;
+
+        if (total == 0) {
+            total = tc_block_total_len(blocks + off, len - off);
+            if (total == 0) {
+                return -1;
+            }
+            off += total;
+            continue;
+        }
+        if (b->leaf_count + count >= TC_MAX_BATCH_LEAVES) {
+            return -1;
+        }
+        /* 区块哈希覆盖区块头与签名字段 */
+        memcpy(&hdr, blocks + off, sizeof(hdr));
+        msgs[count].data = blocks + off;
+        msgs[count].len = sizeof(hdr) + hdr.body_len;
+        msgs[count].has_prefix = 0;
+        count++;
+        off += total;
+    }
+    tc_sha256_many(msgs, count, &b->nodes[b->leaf_count]);
+    b->leaf_count += count;
+    return 0;
+}
+
+int tc_batch_build(struct tc_batch *b, const struct tc_batch_root *root) {
+    uint32_t start = 0;
+    uint32_t width = b->leaf_count;
+    uint32_t level = 0;
+    struct tc_sha256_msg msgs[TC_MAX_BATCH_LEAVES];
+
+    if (width == 0 || root->leaf_count != width) {
+        return -1;
+    }
+    /* 叶子为SHA256(0x00 || 区块哈希)，原地计算 */
+    for (uint32_t i = 0; i < width; i++) {
+        msgs[i].data = b->nodes[i];
+        msgs[i].len = TC_HASH_SIZE;
+        msgs[i].has_prefix = 1;
+        msgs[i].prefix = TC_MERKLE_LEAF_PREFIX;
+    }
+    tc_sha256_many(msgs, width, b->nodes);
+    b->level_start[0] = 0;
+    b->level_width[0] = width;
+    while (width > 1) {
+        uint32_t next = start + width;
+        uint32_t next_width = width / 2;
+
+        tc_sha256_pairs(TC_MERKLE_NODE_PREFIX, b->nodes[start], next_width, b->nodes[next]);
+        if (width % 2) {
+            memcpy(b->nodes[next + next_width++], b->nodes[start + width - 1], TC_HASH_SIZE);
+        }
+        level++;
+        b->level_start[level] = next;
+        b->level_width[level] = next_width;
+        start = next;
+        width = next_width;
+    }
+    b->depth = level;
+    return memcmp(b->nodes[start], root->root, TC_HASH_SIZE) == 0 ? 0 : -1;
+}
+
+/* 自底向上收集兄弟节点，没有兄弟（奇数层的最后一个）时跳过 */
+static uint16_t merkle_path(const struct tc_batch *b, uint32_t index, uint8_t *path) {
+    uint16_t path_len = 0;
+
+    for (uint32_t level = 0; level < b->depth; level++) {
+        uint32_t sibling = index ^ 1;
+        if (sibling < b->level_width[level]) {
+            memcpy(path + (size_t)path_len * TC_HASH_SIZE,
+                   b->nodes[b->level_start[level] + sibling], TC_HASH_SIZE);
+            path_len++;
+        }
+        index /= 2;
+    }
+    return path_len;
+}
+
+int tc_batch_fill(const struct tc_batch *b, uint32_t first_leaf,
+                  const struct tc_batch_root *root, const uint8_t *sig, size_t sig_len,
+                  uint8_t *blocks, size_t *len, size_t cap) {
+    uint32_t leaf = first_leaf;
+    size_t off = 0;
+
+    if (sig_len > TC_MAX_TEE_SIG_SIZE) {
+        return -1;
+    }
+    while (off < *len) {
+        size_t total = placeholder_block_len(blocks + off, *len - off);
+        struct tc_batch_proof_hdr proof;
+        struct tc_tlv_hdr tlv;
+        uint8_t path[TC_MAX_BATCH_DEPTH * TC_HASH_SIZE];
+        size_t proof_len;
+        uint8_t *p;
+
+        if (total == 0) {
+            total = tc_block_total_len(blocks + off, *len - off);
+            if (total == 0) {
+                return -1;
+            }
+            off += total;
+            continue;
+        }
+        if (leaf >= b->leaf_count) {
+            return -1;
+        }
+
+        memset(&proof, 0, sizeof(proof));
+        proof.root = *root;
+        proof.leaf_index = leaf;
+        proof.path_len = merkle_path(b, leaf, path);
+        proof.sig_len = (uint16_t)sig_len;
+        proof_len = sizeof(proof) + (size_t)proof.path_len * TC_HASH_SIZE + sig_len;
+        if (*len + proof_len > cap) {
+            return -1;
+        }
+
+        /* 占位字段是区块的最后一个字段，其后的区块整体后移 */
+        p = blocks + off + total;
+        memmove(p + proof_len, p, *len - off - total);
+        memcpy(p, &proof, sizeof(proof));
+        memcpy(p + sizeof(proof), path, (size_t)proof.path_len * TC_HASH_SIZE);
+        memcpy(p + sizeof(proof) + (size_t)proof.path_len * TC_HASH_SIZE, sig, sig_len);
+        tlv.tag = TC_TAG_TEE_BATCH_SIG;
+        tlv.len = (uint16_t)proof_len;
+        memcpy(p - sizeof(tlv), &tlv, sizeof(tlv));
+
+        *len += proof_len;
+        off += total + proof_len;
+        leaf++;
+    }
+    return 0;
+}
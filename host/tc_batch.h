@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#ifndef TC_BATCH_H
+#define TC_BATCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <trust_chain_abi.h>
+
+/*
+ * CA侧的聚合签名窗口（格式见trust_chain_abi.h）：TA只对窗口内全部区块
+ * 哈希的Merkle根签名一次，CA在普通世界里按同样的规则重建这棵树，核对
+ * TA签名的根，再为每个区块算出包含证明，填进区块末尾的占位字段。
+ */
+struct tc_batch {
+    uint8_t nodes[2 * TC_MAX_BATCH_LEAVES][TC_HASH_SIZE];  /* 各层节点依次存放，叶子在前 */
+    uint32_t level_start[TC_MAX_BATCH_DEPTH + 1];
+    uint32_t level_width[TC_MAX_BATCH_DEPTH + 1];
+    uint32_t depth;                 /* 根所在的层 */
+    uint32_t leaf_count;
+};
+
+void tc_batch_reset(struct tc_batch *b);
+
+/* 连续编码的区块中尚未填入证明的区块数 */
+uint32_t tc_batch_pending_blocks(const uint8_t *blocks, size_t len);
+
+/* 把这些区块的哈希按顺序记为叶子，叶子数超过上限时返回-1 */
+int tc_batch_add_blocks(struct tc_batch *b, const uint8_t *blocks, size_t len);
+
+/* 建树并与TA签名的根比较，一致时返回0 */
+int tc_batch_build(struct tc_batch *b, const struct tc_batch_root *root);
+
+/*
+ * 从first_leaf号叶子起，依次为blocks中的每个占位字段填入证明。区块长度
+ * 随之增加，*len更新为新长度，总长不能超过cap。成功返回0。
+ */
+int tc_batch_fill(const struct tc_batch *b, uint32_t first_leaf,
+                  const struct tc_batch_root *root, const uint8_t *sig, size_t sig_len,
+                  uint8_t *blocks, size_t *len, size_t cap);
+
+#endif /* TC_BATCH_H */
@@ -0,0 +1,425 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <trust_chain_ta.h>
+#include <trust_chain_abi.h>
+
+#include "tc_blocklog.h"
+
+/* 一次TA命令最多返回的区块数（提交区块加检查点区块） */
+#define MAX_RESULT_BLOCKS 8
+
+static char log_dir[PATH_MAX];
+static int log_enabled = 0;
+static unsigned int log_fsync_ms;
+
+/*
+ * 组提交状态：append_seq每追加一批区块加一，durable_seq是已落盘的批次。
+ * dirty记录自上次刷盘以来写过的仓库。
+ */
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t flush_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t durable_cond = PTHREAD_COND_INITIALIZER;
+static uint64_t append_seq = 0;
+static uint64_t durable_seq = 0;
+static unsigned int waiters = 0;
+static int stopping = 0;
+static uint32_t *dirty = NULL;
+static size_t dirty_count = 0;
+static size_t dirty_cap = 0;
+static pthread_t flusher;
+
+static void log_path(char *path, size_t cap, uint32_t rep_id, const char *ext) {
+    snprintf(path, cap, "%s/%u.%s", log_dir, rep_id, ext);
+}
+
+static int write_all(int fd, const void *buf, size_t len) {
+    const uint8_t *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/*
+ * 崩溃后日志与索引可能不一致（页缓存回写顺序不定）：丢弃不完整的索引项和
+ * 指向日志末尾之外的索引项，再把日志截到最后一个索引项的末尾，
+ * 保证任意连续序号的区块在日志中首尾相接。只在启动时、没有读者时调用。
+ */
+static void repair_log(uint32_t rep_id) {
+    char blk_path[PATH_MAX], idx_path[PATH_MAX];
+    struct tc_blocklog_entry entry;
+    struct stat blk_st, idx_st;
+    uint64_t end = 0;
+    size_t n;
+
+    log_path(blk_path, sizeof(blk_path), rep_id, "blk");
+    log_path(idx_path, sizeof(idx_path), rep_id, "idx");
+    int blk_fd = open(blk_path, O_RDWR | O_CLOEXEC);
+    int idx_fd = open(idx_path, O_RDWR | O_CLOEXEC);
+    if (blk_fd < 0 || idx_fd < 0 || fstat(blk_fd, &blk_st) != 0 || fstat(idx_fd, &idx_st) != 0) {
+        goto out;
+    }
+
+    n = idx_st.st_size / sizeof(entry);
+    while (n > 0) {
+        if (pread(idx_fd, &entry, sizeof(entry), (n - 1) * sizeof(entry)) != sizeof(entry)) {
+            n = 0;
+            break;
+        }
+        end = entry.offset + entry.len;
+        if (end <= (uint64_t)blk_st.st_size) {
+            break;
+        }
+        n--;
+        end = 0;
+    }
+    if ((off_t)(n * sizeof(entry)) != idx_st.st_size || (off_t)end != blk_st.st_size) {
+        printf("Repairing block log of repository %u: %zu blocks\n", rep_id, n);
+        if (ftruncate(idx_fd, n * sizeof(entry)) != 0 || ftruncate(blk_fd, end) != 0) {
+            printf("Failed to repair block log of repository %u\n", rep_id);
+        }
+    }
+out:
+    if (blk_fd >= 0) {
+        close(blk_fd);
+    }
+    if (idx_fd >= 0) {
+        close(idx_fd);
+    }
+}
+
+static void repair_all(void) {
+    DIR *dir = opendir(log_dir);
+    struct dirent *de;
+
+    if (dir == NULL) {
+        return;
+    }
+    while ((de = readdir(dir)) != NULL) {
+        char *end;
+        unsigned long rep_id = strtoul(de->d_name, &end, 10);
+        if (end != de->d_name && strcmp(end, ".idx") == 0) {
+            repair_log((uint32_t)rep_id);
+        }
+    }
+    closedir(dir);
+}
+
+static void sync_file(uint32_t rep_id, const char *ext) {
+    char path[PATH_MAX];
+    log_path(path, sizeof(path), rep_id, ext);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        if (fdatasync(fd) != 0) {
+            printf("fdatasync %s failed: %s\n", path, strerror(errno));
+        }
+        close(fd);
+    }
+}
+
+/* 刷盘线程：有人等待时立即刷盘，否则最多攒log_fsync_ms毫秒的写入 */
+static void *flusher_thread(void *arg) {
+    (void)arg;
+
+    pthread_mutex_lock(&log_lock);
+    for (;;) {
+        while (!stopping && append_seq == durable_seq) {
+            pthread_cond_wait(&flush_cond, &log_lock);
+        }
+        if (append_seq == durable_seq) {
+            break;
+        }
+        if (waiters == 0 && !stopping) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += (long)log_fsync_ms * 1000000;
+            deadline.tv_sec += deadline.tv_nsec / 1000000000;
+            deadline.tv_nsec %= 1000000000;
+            while (waiters == 0 && !stopping &&
+                   pthread_cond_timedwait(&flush_cond, &log_lock, &deadline) != ETIMEDOUT) {
+            }
+        }
+
+        uint64_t target = append_seq;
+        uint32_t *batch = dirty;
+        size_t count = dirty_count;
+        dirty = NULL;
+        dirty_count = 0;
+        dirty_cap = 0;
+        pthread_mutex_unlock(&log_lock);
+
+        /* 先日志后索引，索引项指向的区块总是先落盘 */
+        for (size_t i = 0; i < count; i++) {
+            sync_file(batch[i], "blk");
+        }
+        for (size_t i = 0; i < count; i++) {
+            sync_file(batch[i], "idx");
+        }
+        free(batch);
+
+        pthread_mutex_lock(&log_lock);
+        durable_seq = target;
+        pthread_cond_broadcast(&durable_cond);
+    }
+    pthread_mutex_unlock(&log_lock);
+    return NULL;
+}
+
+int tc_blocklog_init(const char *dir, unsigned int fsync_ms) {
+    if (snprintf(log_dir, sizeof(log_dir), "%s", dir) >= (int)sizeof(log_dir)) {
+        return -1;
+    }
+    if (mkdir(log_dir, 0700) != 0 && errno != EEXIST) {
+        printf("Failed to create block log directory %s: %s\n", log_dir, strerror(errno));
+        return -1;
+    }
+    repair_all();
+
+    log_fsync_ms = fsync_ms;
+    stopping = 0;
+    if (pthread_create(&flusher, NULL, flusher_thread, NULL) != 0) {
+        return -1;
+    }
+    log_enabled = 1;
+    return 0;
+}
+
+void tc_blocklog_close(void) {
+    if (!log_enabled) {
+        return;
+    }
+    pthread_mutex_lock(&log_lock);
+    stopping = 1;
+    pthread_cond_signal(&flush_cond);
+    pthread_mutex_unlock(&log_lock);
+    pthread_join(flusher, NULL);
+    log_enabled = 0;
+}
+
+static void mark_dirty(uint32_t rep_id) {
+    pthread_mutex_lock(&log_lock);
+    size_t i;
+    for (i = 0; i < dirty_count && dirty[i] != rep_id; i++) {
+    }
+    if (i == dirty_count) {
+        if (dirty_count == dirty_cap) {
+            size_t cap = dirty_cap ? dirty_cap * 2 : 16;
+            uint32_t *grown = realloc(dirty, cap * sizeof(*dirty));
+            if (grown != NULL) {
+                dirty = grown;
+                dirty_cap = cap;
+            }
+        }
+        if (dirty_count < dirty_cap) {
+            dirty[dirty_count++] = rep_id;
+        }
+    }
+    append_seq++;
+    pthread_cond_signal(&flush_cond);
+    pthread_mutex_unlock(&log_lock);
+}
+
+uint32_t tc_blocklog_append(uint32_t rep_id, const uint8_t *blocks, size_t len, int is_new) {
+    struct tc_blocklog_entry entries[MAX_RESULT_BLOCKS];
+    char blk_path[PATH_MAX], idx_path[PATH_MAX];
+    size_t count = 0, total = 0;
+    struct stat st, idx_st;
+    int blk_fd = -1, idx_fd = -1;
+    uint32_t first = 0;
+
+    if (!log_enabled) {
+        return 0;
+    }
+    while (total < len && count < MAX_RESULT_BLOCKS) {
+        size_t block_len = tc_block_total_len(blocks + total, len - total);
+        struct tc_block_hdr hdr;
+        if (block_len == 0) {
+            break;
+        }
+        memcpy(&hdr, blocks + total, sizeof(hdr));
+        entries[count].offset = total;
+        entries[count].len = (uint32_t)block_len;
+        entries[count].block_height = hdr.block_height;
+        count++;
+        total += block_len;
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    log_path(blk_path, sizeof(blk_path), rep_id, "blk");
+    log_path(idx_path, sizeof(idx_path), rep_id, "idx");
+    if (is_new) {
+        /* 正在读旧文件的读者仍持有旧inode，不受影响 */
+        unlink(idx_path);
+        unlink(blk_path);
+    }
+    blk_fd = open(blk_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    idx_fd = open(idx_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (blk_fd < 0 || idx_fd < 0 || fstat(blk_fd, &st) != 0 || fstat(idx_fd, &idx_st) != 0) {
+        printf("Failed to open block log of repository %u: %s\n", rep_id, strerror(errno));
+        goto out;
+    }
+    for (size_t i = 0; i < count; i++) {
+        entries[i].offset += st.st_size;
+    }
+
+    /* 区块先于索引项写入，读者看到的索引项总能在日志中找到完整区块 */
+    if (write_all(blk_fd, blocks, total) != 0) {
+        printf("Failed to append to block log of repository %u: %s\n", rep_id, strerror(errno));
+        if (ftruncate(blk_fd, st.st_size) != 0) {
+            printf("Failed to roll back block log of repository %u\n", rep_id);
+        }
+        goto out;
+    }
+    if (write_all(idx_fd, entries, count * sizeof(entries[0])) != 0) {
+        printf("Failed to append to block index of repository %u: %s\n", rep_id, strerror(errno));
+        goto out;
+    }
+    mark_dirty(rep_id);
+    first = (uint32_t)(idx_st.st_size / sizeof(entries[0])) + 1;
+out:
+    if (blk_fd >= 0) {
+        close(blk_fd);
+    }
+    if (idx_fd >= 0) {
+        close(idx_fd);
+    }
+    return first;
+}
+
+int tc_blocklog_list(uint32_t **rep_ids, size_t *count) {
+    DIR *dir;
+    struct dirent *de;
+    size_t cap = 0;
+
+    *rep_ids = NULL;
+    *count = 0;
+    if (!log_enabled || (dir = opendir(log_dir)) == NULL) {
+        return -1;
+    }
+    while ((de = readdir(dir)) != NULL) {
+        char *end;
+        unsigned long rep_id = strtoul(de->d_name, &end, 10);
+        if (end == de->d_name || strcmp(end, ".idx") != 0) {
+            continue;
+        }
+        if (*count == cap) {
+            size_t new_cap = cap ? cap * 2 : 64;
+            uint32_t *grown = realloc(*rep_ids, new_cap * sizeof(**rep_ids));
+            if (grown == NULL) {
+                break;
+            }
+            *rep_ids = grown;
+            cap = new_cap;
+        }
+        (*rep_ids)[(*count)++] = (uint32_t)rep_id;
+    }
+    closedir(dir);
+    return 0;
+}
+
+void tc_blocklog_sync(void) {
+    if (!log_enabled) {
+        return;
+    }
+    pthread_mutex_lock(&log_lock);
+    uint64_t target = append_seq;
+    if (durable_seq < target) {
+        waiters++;
+        pthread_cond_signal(&flush_cond);
+        while (durable_seq < target) {
+            pthread_cond_wait(&durable_cond, &log_lock);
+        }
+        waiters--;
+    }
+    pthread_mutex_unlock(&log_lock);
+}
+
+int tc_blocklog_open_range(uint32_t rep_id, uint32_t from, uint32_t to,
+                           struct tc_blocklog_range *range) {
+    char blk_path[PATH_MAX], idx_path[PATH_MAX];
+    const struct tc_blocklog_entry *index;
+    struct stat blk_st, idx_st;
+    size_t n;
+    int ret = -1;
+
+    memset(range, 0, sizeof(*range));
+    range->fd = -1;
+    if (!log_enabled) {
+        return -1;
+    }
+
+    log_path(blk_path, sizeof(blk_path), rep_id, "blk");
+    log_path(idx_path, sizeof(idx_path), rep_id, "idx");
+    int idx_fd = open(idx_path, O_RDONLY | O_CLOEXEC);
+    if (idx_fd < 0) {
+        return -1;
+    }
+    int blk_fd = open(blk_path, O_RDONLY | O_CLOEXEC);
+    if (blk_fd < 0 || fstat(idx_fd, &idx_st) != 0 || fstat(blk_fd, &blk_st) != 0) {
+        goto out;
+    }
+
+    ret = -2;
+    n = idx_st.st_size / sizeof(*index);
+    if (n == 0) {
+        goto out;
+    }
+    index = mmap(NULL, n * sizeof(*index), PROT_READ, MAP_SHARED, idx_fd, 0);
+    if (index == MAP_FAILED) {
+        ret = -1;
+        goto out;
+    }
+    /* 写者先写日志后写索引，这里的截断只是防御 */
+    while (n > 0 && index[n - 1].offset + index[n - 1].len > (uint64_t)blk_st.st_size) {
+        n--;
+    }
+    range->total = n;
+    if (from == 0) {
+        from = 1;
+    }
+    if (to > n) {
+        to = n;
+    }
+    if (from <= to) {
+        range->first = from;
+        range->count = to - from + 1;
+        range->offset = index[from - 1].offset;
+        range->len = index[to - 1].offset + index[to - 1].len - range->offset;
+        range->fd = blk_fd;
+        blk_fd = -1;
+        ret = 0;
+    }
+    munmap((void *)index, idx_st.st_size / sizeof(*index) * sizeof(*index));
+out:
+    if (blk_fd >= 0) {
+        close(blk_fd);
+    }
+    close(idx_fd);
+    return ret;
+}
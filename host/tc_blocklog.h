@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#ifndef TC_BLOCKLOG_H
+#define TC_BLOCKLOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * 只追加的区块日志：TA签发的每个区块按原样追加到仓库的日志文件
+ * <dir>/<rep_id>.blk，区块首尾相接，整个文件就是该仓库的链导出。
+ * 索引文件<dir>/<rep_id>.idx是定长的struct tc_blocklog_entry数组，第n项
+ * （从0开始）对应仓库的第n + 1个区块（按TA签发顺序，下称日志序号），
+ * 读者直接mmap索引查找，任意一段连续序号的区块在日志中也是连续的，
+ * 可以用一次sendfile发出。
+ *
+ * 写入由分片的结果线程完成，同一仓库只有一个写者；fdatasync由后台刷盘
+ * 线程批量执行。同步调用TA的请求返回时其区块已追加，需要持久化保证的
+ * 调用者再用tc_blocklog_sync等待落盘（组提交）。
+ */
+
+struct tc_blocklog_entry {
+    uint64_t offset;        /* 区块在.blk中的起始偏移 */
+    uint32_t len;           /* 区块总长度，含TEE签名 */
+    uint32_t block_height;  /* 区块头中的高度（分支区块为分支高度） */
+};
+
+/*
+ * 打开日志目录（不存在则创建）并启动刷盘线程。fsync_ms为无人等待时两次
+ * 刷盘的最长间隔。失败返回-1，此时日志不可用，其余功能不受影响。
+ */
+int tc_blocklog_init(const char *dir, unsigned int fsync_ms);
+void tc_blocklog_close(void);
+
+/*
+ * 追加一次TA命令返回的区块（由结果线程调用）。is_new表示创世区块：
+ * 仓库ID可能在TA重启前用过，此时旧日志被换成新文件。
+ * 返回第一个区块的日志序号，日志不可用或写入失败返回0。
+ */
+uint32_t tc_blocklog_append(uint32_t rep_id, const uint8_t *blocks, size_t len, int is_new);
+
+/* 列出有日志的仓库，*rep_ids由调用者free */
+int tc_blocklog_list(uint32_t **rep_ids, size_t *count);
+
+/* 等待此前追加的全部区块落盘，日志不可用时立即返回 */
+void tc_blocklog_sync(void);
+
+/* 一段连续区块在日志中的位置 */
+struct tc_blocklog_range {
+    int fd;                 /* 日志文件，调用者负责关闭 */
+    uint64_t offset;
+    uint64_t len;
+    uint32_t first;         /* 实际返回的第一个日志序号 */
+    uint32_t count;         /* 实际返回的区块数 */
+    uint32_t total;         /* 仓库当前的区块总数 */
+};
+
+/*
+ * 查找日志序号from..to（含两端，从1开始）的区块，to超出时截到最后一个。
+ * 成功返回0；仓库没有日志返回-1；范围为空返回-2（range->total仍有效）。
+ */
+int tc_blocklog_open_range(uint32_t rep_id, uint32_t from, uint32_t to,
+                           struct tc_blocklog_range *range);
+
+#endif /* TC_BLOCKLOG_H */
@@ -0,0 +1,362 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tc_codec.h"
+
+void tc_hex_encode(const uint8_t *in, size_t len, char *out) {
+    static const char digits[] = "0123456789abcdef";
+    for (size_t i = 0; i < len; i++) {
+        out[2 * i] = digits[in[i] >> 4];
+        out[2 * i + 1] = digits[in[i] & 0xf];
+    }
+    out[2 * len] = '\0';
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+int tc_hex_decode(const char *hex, uint8_t *out, size_t cap, size_t *out_len) {
+    size_t hex_len = strlen(hex);
+    if (hex_len % 2 != 0 || hex_len / 2 > cap) {
+        return -1;
+    }
+    for (size_t i = 0; i < hex_len / 2; i++) {
+        int high = hex_value(hex[2 * i]);
+        int low = hex_value(hex[2 * i + 1]);
+        if (high < 0 || low < 0) {
+            return -1;
+        }
+        out[i] = (uint8_t)((high << 4) | low);
+    }
+    *out_len = hex_len / 2;
+    return 0;
+}
+
+/* base64字符到6位值，非法字符为0x80 */
+static const uint8_t b64_table[256] = {
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x3e, 0x80, 0x80, 0x80, 0x3f,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
+    0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30, 0x31, 0x32, 0x33, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+};
+
+/* 每次查表4个字符，只对4个值或在一起的结果判断一次非法位 */
+int tc_base64_decode(const char *in, size_t in_len, uint8_t *out, size_t cap, size_t *out_len) {
+    const uint8_t *s = (const uint8_t *)in;
+    size_t i = 0;
+    size_t o = 0;
+
+    if (in_len == 0 || in_len % 4 != 0) {
+        return -1;
+    }
+    for (; i + 4 <= in_len; i += 4) {
+        uint32_t a = b64_table[s[i]];
+        uint32_t b = b64_table[s[i + 1]];
+        uint32_t c = b64_table[s[i + 2]];
+        uint32_t d = b64_table[s[i + 3]];
+        uint32_t v;
+
+        if ((a | b | c | d) & 0x80) {
+            break;
+        }
+        if (o + 3 > cap) {
+            return -1;
+        }
+        v = a << 18 | b << 12 | c << 6 | d;
+        out[o] = (uint8_t)(v >> 16);
+        out[o + 1] = (uint8_t)(v >> 8);
+        out[o + 2] = (uint8_t)v;
+        o += 3;
+    }
+
+    /* 只有最后一组可以带'='填充 */
+    if (i < in_len) {
+        uint32_t a = b64_table[s[i]];
+        uint32_t b = b64_table[s[i + 1]];
+        uint32_t c = b64_table[s[i + 2]];
+
+        if (i + 4 != in_len || ((a | b) & 0x80) || s[i + 3] != '=') {
+            return -1;
+        }
+        if (s[i + 2] != '=' && (c & 0x80)) {
+            return -1;
+        }
+        if (o + (s[i + 2] == '=' ? 1 : 2) > cap) {
+            return -1;
+        }
+        out[o++] = (uint8_t)(a << 2 | b >> 4);
+        if (s[i + 2] != '=') {
+            out[o++] = (uint8_t)(b << 4 | c >> 2);
+        }
+    }
+    *out_len = o;
+    return 0;
+}
+
+void tc_msg_begin(struct tc_msg_builder *m, uint16_t msg_type,
+                  uint32_t rep_id, uint32_t op, uint32_t role) {
+    memset(&m->hdr, 0, sizeof(m->hdr));
+    m->hdr.version = TC_ABI_VERSION;
+    m->hdr.msg_type = msg_type;
+    m->hdr.rep_id = rep_id;
+    m->hdr.op = op;
+    m->hdr.role = role;
+    tc_writer_init(&m->w, m->buf, sizeof(m->buf));
+    m->w.len = sizeof(m->hdr);
+}
+
+void tc_msg_put(struct tc_msg_builder *m, uint16_t tag, const void *val, size_t len) {
+    tc_put_tlv(&m->w, tag, val, len);
+}
+
+void tc_msg_put_str(struct tc_msg_builder *m, uint16_t tag, const char *str) {
+    tc_put_tlv(&m->w, tag, str, strlen(str));
+}
+
+int tc_msg_put_hex(struct tc_msg_builder *m, uint16_t tag, const char *hex) {
+    uint8_t bytes[TC_MAX_MSG_SIZE / 2];
+    size_t len;
+    if (tc_hex_decode(hex, bytes, sizeof(bytes), &len) != 0) {
+        return -1;
+    }
+    tc_put_tlv(&m->w, tag, bytes, len);
+    return 0;
+}
+
+size_t tc_msg_finish(struct tc_msg_builder *m) {
+    if (m->w.overflow) {
+        return 0;
+    }
+    m->hdr.body_len = m->w.len - sizeof(m->hdr);
+    memcpy(m->buf, &m->hdr, sizeof(m->hdr));
+    return m->w.len;
+}
+
+/* TLV字段在JSON中的名称与编码方式 */
+struct tlv_json_field {
+    uint16_t tag;
+    const char *name;
+    int is_text;
+};
+
+static const struct tlv_json_field tlv_json_fields[] = {
+    { TC_TAG_PUBKEY,      "pubkey",      1 },
+    { TC_TAG_SIGKEY,      "sigkey",      1 },
+    { TC_TAG_SIGNATURE,   "signature",   0 },
+    { TC_TAG_COMMIT_HASH, "commit_hash", 0 },
+    { TC_TAG_BRANCH,      "branch",      1 },
+    { TC_TAG_BRANCH_ROOT, "branch_root", 0 },
+    { TC_TAG_TEE_SIG,     "tee_sig",     0 },
+    { TC_TAG_PUSH_ROOT,   "push_root",   0 },
+    { TC_TAG_OLD_TIP,     "old_tip",     0 },
+    { TC_TAG_NEW_TIP,     "new_tip",     0 },
+    { TC_TAG_ACL_ROOT,    "acl_root",    0 },
+};
+
+static json_t *hex_json(const uint8_t *bytes, size_t len) {
+    char *hex = malloc(2 * len + 1);
+    if (hex == NULL) {
+        return NULL;
+    }
+    tc_hex_encode(bytes, len, hex);
+    json_t *value = json_string(hex);
+    free(hex);
+    return value;
+}
+
+static const char *block_type_name(uint16_t block_type) {
+    switch (block_type) {
+    case TC_BLOCK_ACCESS:
+        return "access";
+    case TC_BLOCK_CONTRIBUTION:
+        return "contribution";
+    case TC_BLOCK_CHECKPOINT:
+        return "checkpoint";
+    case TC_BLOCK_ACL_CHECKPOINT:
+        return "acl_checkpoint";
+    default:
+        return "unknown";
+    }
+}
+
+static const struct {
+    uint32_t alg;
+    const char *name;
+} sig_alg_names[] = {
+    { TC_SIG_ALG_RSA_PKCS1_SHA256,  "rsa-pkcs1-sha256" },
+    { TC_SIG_ALG_ECDSA_P256_SHA256, "ecdsa-p256-sha256" },
+    { TC_SIG_ALG_ED25519,           "ed25519" },
+};
+
+const char *tc_sig_alg_name(uint32_t alg) {
+    for (size_t i = 0; i < sizeof(sig_alg_names) / sizeof(sig_alg_names[0]); i++) {
+        if (sig_alg_names[i].alg == alg) {
+            return sig_alg_names[i].name;
+        }
+    }
+    return "unknown";
+}
+
+uint32_t tc_sig_alg_from_name(const char *name) {
+    for (size_t i = 0; i < sizeof(sig_alg_names) / sizeof(sig_alg_names[0]); i++) {
+        if (strcmp(sig_alg_names[i].name, name) == 0) {
+            return sig_alg_names[i].alg;
+        }
+    }
+    return 0;
+}
+
+json_t *tc_branch_head_to_json(const struct tc_branch_head *branch) {
+    json_t *obj = json_object();
+    json_object_set_new(obj, "name_fp", hex_json(branch->name_fp, TC_HASH_SIZE));
+    json_object_set_new(obj, "head", hex_json(branch->head, TC_HASH_SIZE));
+    json_object_set_new(obj, "height", json_integer(branch->height));
+    return obj;
+}
+
+/* 聚合签名的包含证明，占位字段（尚未填入证明）返回NULL */
+static json_t *batch_proof_to_json(const uint8_t *val, size_t len) {
+    struct tc_batch_proof_hdr proof;
+    json_t *path;
+
+    if (len < sizeof(proof)) {
+        return NULL;
+    }
+    memcpy(&proof, val, sizeof(proof));
+    if (len != sizeof(proof) + (size_t)proof.path_len * TC_HASH_SIZE + proof.sig_len) {
+        return NULL;
+    }
+    val += sizeof(proof);
+
+    json_t *obj = json_object();
+    json_object_set_new(obj, "shard", json_integer(proof.root.shard));
+    json_object_set_new(obj, "seq", json_integer(proof.root.seq));
+    json_object_set_new(obj, "leaf_count", json_integer(proof.root.leaf_count));
+    json_object_set_new(obj, "leaf_index", json_integer(proof.leaf_index));
+    json_object_set_new(obj, "root", hex_json(proof.root.root, TC_HASH_SIZE));
+    path = json_array();
+    for (uint16_t i = 0; i < proof.path_len; i++) {
+        json_array_append_new(path, hex_json(val + (size_t)i * TC_HASH_SIZE, TC_HASH_SIZE));
+    }
+    json_object_set_new(obj, "path", path);
+    json_object_set_new(obj, "signature",
+                        hex_json(val + (size_t)proof.path_len * TC_HASH_SIZE, proof.sig_len));
+    return obj;
+}
+
+json_t *tc_block_to_json(const uint8_t *blk, size_t len) {
+    struct tc_block_hdr hdr;
+    struct tc_reader reader;
+    const uint8_t *val;
+    uint16_t tag, vlen;
+    size_t total = tc_block_total_len(blk, len);
+    int ret;
+
+    if (total == 0) {
+        return NULL;
+    }
+    memcpy(&hdr, blk, sizeof(hdr));
+
+    json_t *obj = json_object();
+    json_object_set_new(obj, "block_type", json_string(block_type_name(hdr.block_type)));
+    json_object_set_new(obj, "block_height", json_integer(hdr.block_height));
+    json_object_set_new(obj, "parent_hash", hex_json(hdr.parent_hash, TC_HASH_SIZE));
+    json_object_set_new(obj, "op", json_integer(hdr.op));
+    if (hdr.block_type == TC_BLOCK_ACCESS) {
+        json_object_set_new(obj, "role", json_integer(hdr.role));
+    }
+    json_object_set_new(obj, "trust_timestamp", json_integer(hdr.ts_seconds));
+    json_object_set_new(obj, "trust_timestamp_millis", json_integer(hdr.ts_millis));
+
+    /* 遍历签名字段以及末尾的TEE签名 */
+    tc_reader_init(&reader, blk + sizeof(hdr), total - sizeof(hdr));
+    while ((ret = tc_next_tlv(&reader, &tag, &val, &vlen)) > 0) {
+        const struct tlv_json_field *field = NULL;
+        /* 检查点区块中重复出现的分支链头汇总为数组 */
+        if (tag == TC_TAG_BRANCH_HEAD && vlen == sizeof(struct tc_branch_head)) {
+            struct tc_branch_head branch;
+            json_t *heads = json_object_get(obj, "branch_heads");
+            if (heads == NULL) {
+                heads = json_array();
+                json_object_set_new(obj, "branch_heads", heads);
+            }
+            memcpy(&branch, val, sizeof(branch));
+            json_array_append_new(heads, tc_branch_head_to_json(&branch));
+            continue;
+        }
+        if (tag == TC_TAG_TEE_BATCH_SIG) {
+            json_t *proof = batch_proof_to_json(val, vlen);
+            if (proof == NULL) {
+                json_decref(obj);
+                return NULL;
+            }
+            json_object_set_new(obj, "tee_batch_sig", proof);
+            continue;
+        }
+        if (tag == TC_TAG_PUSH_COUNT && vlen == sizeof(uint32_t)) {
+            uint32_t count;
+            memcpy(&count, val, sizeof(count));
+            json_object_set_new(obj, "push_count", json_integer(count));
+            continue;
+        }
+        if (tag == TC_TAG_ACL_STATE && vlen == sizeof(struct tc_acl_state)) {
+            struct tc_acl_state state;
+            json_t *acl = json_object();
+            memcpy(&state, val, sizeof(state));
+            json_object_set_new(acl, "admin_count", json_integer(state.admin_count));
+            json_object_set_new(acl, "writer_count", json_integer(state.writer_count));
+            json_object_set_new(acl, "root", hex_json(state.root, TC_HASH_SIZE));
+            json_object_set_new(obj, "acl_state", acl);
+            continue;
+        }
+        if (tag == TC_TAG_SIG_ALG && vlen == 1) {
+            json_object_set_new(obj, "tee_sig_alg", json_string(tc_sig_alg_name(val[0])));
+            continue;
+        }
+        for (size_t i = 0; i < sizeof(tlv_json_fields) / sizeof(tlv_json_fields[0]); i++) {
+            if (tlv_json_fields[i].tag == tag) {
+                field = &tlv_json_fields[i];
+                break;
+            }
+        }
+        if (field == NULL) {
+            char name[16];
+            snprintf(name, sizeof(name), "tag_%u", tag);
+            json_object_set_new(obj, name, hex_json(val, vlen));
+        } else if (field->is_text) {
+            json_object_set_new(obj, field->name, json_stringn((const char *)val, vlen));
+        } else {
+            json_object_set_new(obj, field->name, hex_json(val, vlen));
+        }
+    }
+    if (ret < 0) {
+        json_decref(obj);
+        return NULL;
+    }
+
+    /* 原始区块字节，客户端可直接据此校验TEE签名 */
+    json_object_set_new(obj, "raw", hex_json(blk, total));
+    return obj;
+}
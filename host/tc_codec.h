@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#ifndef TC_CODEC_H
+#define TC_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <jansson.h>
+
+#include <trust_chain_abi.h>
+
+/* 十六进制编码，out至少2 * len + 1字节 */
+void tc_hex_encode(const uint8_t *in, size_t len, char *out);
+
+/* 十六进制解码，成功返回0 */
+int tc_hex_decode(const char *hex, uint8_t *out, size_t cap, size_t *out_len);
+
+/* base64解码（不接受空白），成功返回0 */
+int tc_base64_decode(const char *in, size_t in_len, uint8_t *out, size_t cap, size_t *out_len);
+
+/* 请求消息构造器（线格式见trust_chain_abi.h） */
+struct tc_msg_builder {
+    struct tc_msg_hdr hdr;
+    struct tc_writer w;
+    uint8_t buf[TC_MAX_MSG_SIZE];
+};
+
+void tc_msg_begin(struct tc_msg_builder *m, uint16_t msg_type,
+                  uint32_t rep_id, uint32_t op, uint32_t role);
+void tc_msg_put(struct tc_msg_builder *m, uint16_t tag, const void *val, size_t len);
+void tc_msg_put_str(struct tc_msg_builder *m, uint16_t tag, const char *str);
+
+/* 解码十六进制字符串后写入字段，非法十六进制返回-1 */
+int tc_msg_put_hex(struct tc_msg_builder *m, uint16_t tag, const char *hex);
+
+/* 写入消息头，返回消息总长度，溢出返回0 */
+size_t tc_msg_finish(struct tc_msg_builder *m);
+
+/* TEE签名算法（TC_SIG_ALG_*）的名称，未知算法返回"unknown" */
+const char *tc_sig_alg_name(uint32_t alg);
+
+/* 按名称查找TEE签名算法，未知名称返回0 */
+uint32_t tc_sig_alg_from_name(const char *name);
+
+/* 分支链头（检查点区块与分支链头应答中使用）转换为JSON对象 */
+json_t *tc_branch_head_to_json(const struct tc_branch_head *branch);
+
+/* 将一个编码后的区块解码为JSON对象，格式错误返回NULL */
+json_t *tc_block_to_json(const uint8_t *blk, size_t len);
+
+#endif /* TC_CODEC_H */
@@ -0,0 +1,270 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <trust_chain_ta.h>
+#include <trust_chain_abi.h>
+
+#include "tc_events.h"
+#include "tc_codec.h"
+#include "tc_shard.h"
+
+#define CHANNEL_BUCKETS 256
+
+/* 一个仓库的订阅频道，有订阅者时才存在 */
+struct event_channel {
+    uint32_t rep_id;
+    unsigned int subscribers;
+    uint64_t pos;                               /* 已发布的帧数 */
+    struct tc_event *ring[TC_EVENTS_RING];      /* 第pos个帧在ring[pos % TC_EVENTS_RING] */
+    int closed;
+    int linked;
+    pthread_cond_t cond;
+    struct event_channel *next;
+};
+
+struct tc_subscription {
+    struct event_channel *channel;
+    uint64_t pos;                               /* 下一个要读的帧 */
+};
+
+static pthread_mutex_t events_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct event_channel *channels[CHANNEL_BUCKETS];
+
+/* 帧ID全局递增，频道释放重建后也不会重复，重连时据此判断能否补发 */
+static uint64_t next_event_id = 1;
+
+static struct event_channel **channel_slot(uint32_t rep_id) {
+    struct event_channel **pp = &channels[rep_id % CHANNEL_BUCKETS];
+    while (*pp != NULL && (*pp)->rep_id != rep_id) {
+        pp = &(*pp)->next;
+    }
+    return pp;
+}
+
+void tc_event_put(struct tc_event *ev) {
+    if (ev != NULL && __atomic_sub_fetch(&ev->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(ev);
+    }
+}
+
+static void channel_unlink(struct event_channel *ch) {
+    if (ch->linked) {
+        struct event_channel **pp = channel_slot(ch->rep_id);
+        *pp = ch->next;
+        ch->linked = 0;
+    }
+}
+
+static void channel_free(struct event_channel *ch) {
+    for (size_t i = 0; i < TC_EVENTS_RING; i++) {
+        tc_event_put(ch->ring[i]);
+    }
+    pthread_cond_destroy(&ch->cond);
+    free(ch);
+}
+
+/* 将一个区块序列化为SSE帧，帧ID在发布时填入 */
+static struct tc_event *make_event(const uint8_t *blk, size_t len) {
+    json_t *obj = tc_block_to_json(blk, len);
+    struct tc_event *ev;
+    char *text;
+    size_t text_len, cap;
+
+    if (obj == NULL) {
+        return NULL;
+    }
+    text = json_dumps(obj, JSON_COMPACT);
+    json_decref(obj);
+    if (text == NULL) {
+        return NULL;
+    }
+    text_len = strlen(text);
+    /* "id: " + 20位十进制 + "\nevent: block\ndata: " + JSON + "\n\n" */
+    cap = text_len + 64;
+    ev = malloc(sizeof(*ev) + cap);
+    if (ev != NULL) {
+        ev->refs = 1;
+        ev->id = 0;
+        ev->len = 0;
+        memcpy(ev->data, text, text_len + 1);
+    }
+    free(text);
+    return ev;
+}
+
+static void frame_event(struct tc_event *ev, uint64_t id) {
+    size_t text_len = strlen(ev->data);
+    char prefix[48];
+    int n = snprintf(prefix, sizeof(prefix), "id: %llu\nevent: block\ndata: ",
+                     (unsigned long long)id);
+
+    memmove(ev->data + n, ev->data, text_len);
+    memcpy(ev->data, prefix, n);
+    memcpy(ev->data + n + text_len, "\n\n", 3);
+    ev->id = id;
+    ev->len = n + text_len + 2;
+}
+
+void tc_events_add_blocks(uint32_t rep_id, const uint8_t *blk, size_t len) {
+    struct tc_event *events[8];
+    size_t count = 0;
+    int deleted = 0;
+
+    /* 没有订阅者时不序列化 */
+    pthread_mutex_lock(&events_lock);
+    int subscribed = *channel_slot(rep_id) != NULL;
+    pthread_mutex_unlock(&events_lock);
+    if (!subscribed) {
+        return;
+    }
+
+    /* 序列化在锁外完成，每个区块一次，所有订阅者共享结果 */
+    while (len > 0 && count < sizeof(events) / sizeof(events[0])) {
+        size_t block_len = tc_block_total_len(blk, len);
+        struct tc_block_hdr hdr;
+        if (block_len == 0) {
+            break;
+        }
+        memcpy(&hdr, blk, sizeof(hdr));
+        if (hdr.op == OP_DELETE_REPO) {
+            deleted = 1;
+        }
+        events[count] = make_event(blk, block_len);
+        if (events[count] != NULL) {
+            count++;
+        }
+        blk += block_len;
+        len -= block_len;
+    }
+
+    pthread_mutex_lock(&events_lock);
+    struct event_channel *ch = *channel_slot(rep_id);
+    for (size_t i = 0; i < count; i++) {
+        if (ch == NULL) {
+            tc_event_put(events[i]);
+            continue;
+        }
+        frame_event(events[i], next_event_id++);
+        struct tc_event **slot = &ch->ring[ch->pos % TC_EVENTS_RING];
+        tc_event_put(*slot);
+        *slot = events[i];
+        ch->pos++;
+    }
+    if (ch != NULL) {
+        if (deleted) {
+            /* 仓库已删除：订阅者读完剩余帧后结束，新订阅不再进入该频道 */
+            ch->closed = 1;
+            channel_unlink(ch);
+        }
+        pthread_cond_broadcast(&ch->cond);
+    }
+    pthread_mutex_unlock(&events_lock);
+}
+
+struct tc_subscription *tc_events_subscribe(uint32_t rep_id, uint64_t last_id, int *resync) {
+    struct tc_subscription *sub = calloc(1, sizeof(*sub));
+    struct event_channel **pp, *ch;
+
+    if (sub == NULL) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&events_lock);
+    pp = channel_slot(rep_id);
+    ch = *pp;
+    if (ch == NULL) {
+        ch = calloc(1, sizeof(*ch));
+        if (ch == NULL) {
+            pthread_mutex_unlock(&events_lock);
+            free(sub);
+            return NULL;
+        }
+        ch->rep_id = rep_id;
+        ch->linked = 1;
+        pthread_cond_init(&ch->cond, NULL);
+        *pp = ch;
+    }
+    ch->subscribers++;
+    sub->channel = ch;
+    sub->pos = ch->pos;
+
+    /* Last-Event-ID仍在环中时从其后一帧开始补发 */
+    *resync = last_id != 0;
+    if (last_id != 0) {
+        uint64_t oldest = ch->pos > TC_EVENTS_RING ? ch->pos - TC_EVENTS_RING : 0;
+        for (uint64_t p = oldest; p < ch->pos; p++) {
+            if (ch->ring[p % TC_EVENTS_RING]->id == last_id) {
+                sub->pos = p + 1;
+                *resync = 0;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&events_lock);
+    return sub;
+}
+
+void tc_events_unsubscribe(struct tc_subscription *sub) {
+    struct event_channel *ch;
+
+    if (sub == NULL) {
+        return;
+    }
+    ch = sub->channel;
+    pthread_mutex_lock(&events_lock);
+    if (--ch->subscribers == 0) {
+        channel_unlink(ch);
+    } else {
+        ch = NULL;
+    }
+    pthread_mutex_unlock(&events_lock);
+    if (ch != NULL) {
+        channel_free(ch);
+    }
+    free(sub);
+}
+
+int tc_events_next(struct tc_subscription *sub, struct tc_event **events,
+                   size_t max, int timeout_ms) {
+    struct event_channel *ch = sub->channel;
+    struct timespec deadline;
+    int count = 0;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&events_lock);
+    while (sub->pos == ch->pos && !ch->closed) {
+        if (pthread_cond_timedwait(&ch->cond, &events_lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    if (ch->pos - sub->pos > TC_EVENTS_RING) {
+        count = TC_EVENTS_DROPPED;
+    } else if (sub->pos == ch->pos) {
+        count = ch->closed ? TC_EVENTS_CLOSED : TC_EVENTS_TIMEOUT;
+    } else {
+        while (sub->pos < ch->pos && (size_t)count < max) {
+            struct tc_event *ev = ch->ring[sub->pos % TC_EVENTS_RING];
+            __atomic_add_fetch(&ev->refs, 1, __ATOMIC_RELAXED);
+            events[count++] = ev;
+            sub->pos++;
+        }
+    }
+    pthread_mutex_unlock(&events_lock);
+    return count;
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#ifndef TC_EVENTS_H
+#define TC_EVENTS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <tee_client_api.h>
+
+/*
+ * 新区块订阅：分片工作线程拿到TA签发的区块后，按仓库发布给订阅者
+ * （GET /repos/{id}/events，Server-Sent Events）。
+ * 每个区块只序列化一次，得到的SSE帧带引用计数，由该仓库的所有订阅者共享。
+ * 每个仓库保留最近TC_EVENTS_RING个帧，订阅者落后超过这个数量即被断开，
+ * 发布者从不因慢订阅者阻塞或无限缓存。没有订阅者的仓库不做任何序列化。
+ */
+
+#define TC_EVENTS_RING 64
+
+/* 一个已序列化的SSE帧："id: N\nevent: block\ndata: {...}\n\n" */
+struct tc_event {
+    unsigned int refs;
+    uint64_t id;
+    size_t len;
+    char data[];
+};
+
+struct tc_subscription;
+
+/* tc_events_next的返回值 */
+#define TC_EVENTS_TIMEOUT   0
+#define TC_EVENTS_DROPPED  -1   /* 订阅者落后过多，帧已被覆盖 */
+#define TC_EVENTS_CLOSED   -2   /* 仓库已删除 */
+
+/* 由结果线程在区块写入日志后调用，把新区块推给该仓库的订阅者 */
+void tc_events_add_blocks(uint32_t rep_id, const uint8_t *blocks, size_t len);
+
+/*
+ * 订阅仓库的新区块。last_id非0时（SSE重连携带的Last-Event-ID）从其后一帧
+ * 开始，若这些帧仍在环中则补发；否则从下一个新区块开始，并置*resync为1，
+ * 表示中间可能有区块遗漏，客户端应重新读取仓库视图。
+ */
+struct tc_subscription *tc_events_subscribe(uint32_t rep_id, uint64_t last_id, int *resync);
+void tc_events_unsubscribe(struct tc_subscription *sub);
+
+/*
+ * 等待最多timeout_ms毫秒，取出最多max个帧的引用（用完后调用tc_event_put）。
+ * 返回取出的帧数，或TC_EVENTS_TIMEOUT/TC_EVENTS_DROPPED/TC_EVENTS_CLOSED。
+ */
+int tc_events_next(struct tc_subscription *sub, struct tc_event **events,
+                   size_t max, int timeout_ms);
+
+void tc_event_put(struct tc_event *ev);
+
+#endif /* TC_EVENTS_H */
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "tc_head_tree.h"
+#include "tc_sha256.h"
+
+int tc_head_tree_build(struct tc_head_tree *t, const struct tc_head_leaf *leaves,
+                       uint32_t count, const uint8_t *root) {
+    uint32_t start = 0, width = count, level = 0;
+    uint8_t empty[TC_HASH_SIZE] = { 0 };
+    struct tc_sha256_msg *msgs;
+
+    memset(t, 0, sizeof(*t));
+    if (count == 0) {
+        return memcmp(root, empty, TC_HASH_SIZE) == 0 ? 0 : -1;
+    }
+    /* 每层最多比一半多一个，各层合计不超过2 * count + 深度 */
+    t->nodes = malloc(((size_t)2 * count + TC_MAX_HEAD_TREE_DEPTH) * TC_HASH_SIZE);
+    msgs = malloc(count * sizeof(*msgs));
+    if (t->nodes == NULL || msgs == NULL) {
+        free(msgs);
+        return -1;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        msgs[i].data = &leaves[i];
+        msgs[i].len = sizeof(leaves[i]);
+        msgs[i].has_prefix = 1;
+        msgs[i].prefix = TC_MERKLE_LEAF_PREFIX;
+    }
+    tc_sha256_many(msgs, count, t->nodes);
+    free(msgs);
+    t->leaf_count = count;
+    t->level_start[0] = 0;
+    t->level_width[0] = width;
+    while (width > 1) {
+        uint32_t next = start + width;
+        uint32_t next_width = width / 2;
+
+        tc_sha256_pairs(TC_MERKLE_NODE_PREFIX, t->nodes[start], next_width, t->nodes[next]);
+        if (width % 2) {
+            memcpy(t->nodes[next + next_width++], t->nodes[start + width - 1], TC_HASH_SIZE);
+        }
+        if (++level > TC_MAX_HEAD_TREE_DEPTH) {
+            return -1;
+        }
+        t->level_start[level] = next;
+        t->level_width[level] = next_width;
+        start = next;
+        width = next_width;
+    }
+    t->depth = level;
+    return memcmp(t->nodes[start], root, TC_HASH_SIZE) == 0 ? 0 : -1;
+}
+
+/* 没有兄弟（奇数层的最后一个）时跳过 */
+uint32_t tc_head_tree_path(const struct tc_head_tree *t, uint32_t index, uint8_t *path) {
+    uint32_t path_len = 0;
+
+    for (uint32_t level = 0; level < t->depth; level++) {
+        if ((index ^ 1) < t->level_width[level]) {
+            memcpy(path + (size_t)path_len * TC_HASH_SIZE,
+                   t->nodes[t->level_start[level] + (index ^ 1)], TC_HASH_SIZE);
+            path_len++;
+        }
+        index /= 2;
+    }
+    return path_len;
+}
+
+void tc_head_tree_free(struct tc_head_tree *t) {
+    free(t->nodes);
+    t->nodes = NULL;
+}
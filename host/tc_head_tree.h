@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#ifndef TC_HEAD_TREE_H
+#define TC_HEAD_TREE_H
+
+#include <stdint.h>
+#include <trust_chain_abi.h>
+
+/*
+ * CA侧的链头树（格式见trust_chain_abi.h）：由TA签名时返回的叶子重建整棵
+ * 树、核对签名的根，之后从内存生成单个仓库的包含证明。
+ */
+struct tc_head_tree {
+    uint8_t (*nodes)[TC_HASH_SIZE];         /* 各层节点依次存放，叶子在前 */
+    uint32_t level_start[TC_MAX_HEAD_TREE_DEPTH + 1];
+    uint32_t level_width[TC_MAX_HEAD_TREE_DEPTH + 1];
+    uint32_t depth;                         /* 根所在的层 */
+    uint32_t leaf_count;
+};
+
+/* 由count个叶子建树并与root比较，一致时返回0；无论成败都要tc_head_tree_free */
+int tc_head_tree_build(struct tc_head_tree *t, const struct tc_head_leaf *leaves,
+                       uint32_t count, const uint8_t *root);
+
+/* 第index个叶子的兄弟节点，自底向上写入path（至少TC_MAX_HEAD_TREE_DEPTH个），返回个数 */
+uint32_t tc_head_tree_path(const struct tc_head_tree *t, uint32_t index, uint8_t *path);
+
+void tc_head_tree_free(struct tc_head_tree *t);
+
+#endif /* TC_HEAD_TREE_H */
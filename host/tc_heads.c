@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <trust_chain_ta.h>
+#include <trust_chain_abi.h>
+
+#include "tc_heads.h"
+#include "tc_head_tree.h"
+#include "tc_shard.h"
+#include "tc_codec.h"
+#include "tc_rcu.h"
+
+/* 一个分片的一个已核对的纪元，发布后不再修改 */
+struct head_epoch {
+    struct tc_head_tree_root root;
+    uint8_t sig[TC_MAX_TEE_SIG_SIZE];
+    size_t sig_len;
+    struct tc_head_leaf *leaves;
+    struct tc_head_tree tree;
+    uint16_t leaf_of_slot[MAX_REPO_ID];     /* 叶子序号加1，0表示没有 */
+};
+
+/* 按分片号索引，读者经tc_rcu_dereference读取 */
+static struct head_epoch *epochs[TC_MAX_SHARDS];
+
+static pthread_t signer;
+static pthread_mutex_t heads_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t heads_cond = PTHREAD_COND_INITIALIZER;
+static int heads_enabled = 0;
+static int stopping = 0;
+static unsigned int heads_interval_ms;
+
+static void epoch_free(struct head_epoch *e) {
+    if (e != NULL) {
+        free(e->leaves);
+        tc_head_tree_free(&e->tree);
+        free(e);
+    }
+}
+
+/* 核对TA返回的叶子属于该分片，再重建整棵树并与签名的根比较，一致时返回0 */
+static int epoch_build(struct head_epoch *e) {
+    for (uint32_t i = 0; i < e->root.leaf_count; i++) {
+        uint32_t slot = REPO_ID_SLOT(e->leaves[i].rep_id);
+
+        if (slot >= MAX_REPO_ID || REPO_ID_SHARD(e->leaves[i].rep_id) != e->root.shard) {
+            return -1;
+        }
+        e->leaf_of_slot[slot] = (uint16_t)(i + 1);
+    }
+    return tc_head_tree_build(&e->tree, e->leaves, e->root.leaf_count, e->root.root);
+}
+
+/* 让一个分片签名epoch纪元，核对后发布，替换该分片的上一个纪元 */
+static void sign_shard(unsigned int shard, uint32_t epoch) {
+    struct head_epoch *e = calloc(1, sizeof(*e));
+    struct head_epoch *old;
+    TEEC_Operation op;
+    TEEC_Result res;
+    uint32_t err_origin;
+
+    if (e == NULL || (e->leaves = malloc(MAX_REPO_ID * sizeof(*e->leaves))) == NULL) {
+        epoch_free(e);
+        return;
+    }
+    memset(&op, 0, sizeof(op));
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_MEMREF_TEMP_OUTPUT,
+                                     TEEC_MEMREF_TEMP_OUTPUT, TEEC_MEMREF_TEMP_OUTPUT);
+    op.params[0].value.a = epoch;
+    op.params[1].tmpref.buffer = &e->root;
+    op.params[1].tmpref.size = sizeof(e->root);
+    op.params[2].tmpref.buffer = e->sig;
+    op.params[2].tmpref.size = sizeof(e->sig);
+    op.params[3].tmpref.buffer = e->leaves;
+    op.params[3].tmpref.size = MAX_REPO_ID * sizeof(*e->leaves);
+
+    res = tc_shard_invoke(shard, TA_TRUST_CHAIN_CMD_SIGN_HEAD_TREE, &op, &err_origin);
+    if (res != TEEC_SUCCESS) {
+        // 分片繁忙时跳过本轮，读者继续使用上一个纪元
+        if (res != TEEC_ERROR_BUSY) {
+            printf("Shard %u: signing head tree failed with code 0x%x origin 0x%x\n",
+                   shard, res, err_origin);
+        }
+        epoch_free(e);
+        return;
+    }
+    e->sig_len = op.params[2].tmpref.size;
+    if (op.params[1].tmpref.size != sizeof(e->root) || e->root.epoch != epoch ||
+        e->root.shard != shard || e->root.leaf_count > MAX_REPO_ID ||
+        op.params[3].tmpref.size != e->root.leaf_count * sizeof(*e->leaves) ||
+        epoch_build(e) != 0) {
+        printf("Shard %u: signed head tree does not match its leaves\n", shard);
+        epoch_free(e);
+        return;
+    }
+
+    old = epochs[shard];
+    tc_rcu_assign_pointer(epochs[shard], e);
+    if (old != NULL) {
+        tc_rcu_synchronize();
+        epoch_free(old);
+    }
+}
+
+static void *signer_thread(void *arg) {
+    uint32_t epoch = 0;
+    (void)arg;
+
+    pthread_mutex_lock(&heads_lock);
+    while (!stopping) {
+        pthread_mutex_unlock(&heads_lock);
+        epoch++;
+        for (unsigned int i = 0; i < tc_shard_count(); i++) {
+            sign_shard(i, epoch);
+        }
+        pthread_mutex_lock(&heads_lock);
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += heads_interval_ms / 1000;
+        deadline.tv_nsec += (long)(heads_interval_ms % 1000) * 1000000;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000;
+        deadline.tv_nsec %= 1000000000;
+        while (!stopping && pthread_cond_timedwait(&heads_cond, &heads_lock, &deadline) == 0) {
+        }
+    }
+    pthread_mutex_unlock(&heads_lock);
+    return NULL;
+}
+
+int tc_heads_init(unsigned int interval_ms) {
+    if (interval_ms == 0) {
+        return 0;
+    }
+    heads_interval_ms = interval_ms;
+    stopping = 0;
+    if (pthread_create(&signer, NULL, signer_thread, NULL) != 0) {
+        return -1;
+    }
+    heads_enabled = 1;
+    return 0;
+}
+
+void tc_heads_close(void) {
+    if (!heads_enabled) {
+        return;
+    }
+    pthread_mutex_lock(&heads_lock);
+    stopping = 1;
+    pthread_cond_signal(&heads_cond);
+    pthread_mutex_unlock(&heads_lock);
+    pthread_join(signer, NULL);
+    heads_enabled = 0;
+    for (unsigned int i = 0; i < TC_MAX_SHARDS; i++) {
+        epoch_free(epochs[i]);
+        epochs[i] = NULL;
+    }
+}
+
+static json_t *hex_json(const uint8_t *bytes, size_t len) {
+    char hex[TC_MAX_TEE_SIG_SIZE * 2 + 1];
+    tc_hex_encode(bytes, len, hex);
+    return json_string(hex);
+}
+
+json_t *tc_heads_proof(uint32_t rep_id) {
+    unsigned int shard = REPO_ID_SHARD(rep_id);
+    uint32_t slot = REPO_ID_SLOT(rep_id);
+    json_t *result = NULL;
+
+    if (slot >= MAX_REPO_ID) {
+        return NULL;
+    }
+    unsigned int phase = tc_rcu_read_lock();
+    struct head_epoch *e = tc_rcu_dereference(epochs[shard]);
+    uint32_t index = e != NULL ? e->leaf_of_slot[slot] : 0;
+
+    if (index > 0 && e->leaves[index - 1].rep_id == rep_id) {
+        const struct tc_head_leaf *leaf = &e->leaves[--index];
+        uint8_t siblings[TC_MAX_HEAD_TREE_DEPTH * TC_HASH_SIZE];
+        uint32_t path_len = tc_head_tree_path(&e->tree, index, siblings);
+        json_t *path = json_array();
+
+        result = json_object();
+        json_object_set_new(result, "repository_id", json_integer(rep_id));
+        json_object_set_new(result, "block_height", json_integer(leaf->block_height));
+        json_object_set_new(result, "latest_hash", hex_json(leaf->head, TC_HASH_SIZE));
+        json_object_set_new(result, "shard", json_integer(e->root.shard));
+        json_object_set_new(result, "epoch", json_integer(e->root.epoch));
+        json_object_set_new(result, "trust_timestamp", json_integer(e->root.ts_seconds));
+        json_object_set_new(result, "leaf_count", json_integer(e->root.leaf_count));
+        json_object_set_new(result, "leaf_index", json_integer(index));
+        for (uint32_t i = 0; i < path_len; i++) {
+            json_array_append_new(path, hex_json(siblings + (size_t)i * TC_HASH_SIZE, TC_HASH_SIZE));
+        }
+        json_object_set_new(result, "path", path);
+        json_object_set_new(result, "root", hex_json(e->root.root, TC_HASH_SIZE));
+        json_object_set_new(result, "tee_sig", hex_json(e->sig, e->sig_len));
+    }
+    tc_rcu_read_unlock(phase);
+    return result;
+}
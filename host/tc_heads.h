@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#ifndef TC_HEADS_H
+#define TC_HEADS_H
+
+#include <stdint.h>
+#include <jansson.h>
+
+/*
+ * 链头树纪元（格式见trust_chain_abi.h）：后台线程每隔interval_ms毫秒
+ * 让每个分片的TA对其全部仓库的链头签名一次，纪元号在一轮内各分片相同。
+ * CA重建同一棵树并核对TA签名的根后，以RCU发布为该分片的最新纪元，
+ * 之后的链头证明直接从内存生成，不进入TEE。能接受有界陈旧度的客户端
+ * 用它代替带nonce的/latest-hash。
+ */
+
+/* 启动纪元线程，interval_ms为0时不启用 */
+int tc_heads_init(unsigned int interval_ms);
+
+void tc_heads_close(void);
+
+/*
+ * 仓库在所属分片最新纪元中的链头与包含证明，该纪元中没有这个仓库
+ * （尚未签过纪元，或仓库在纪元之后才创建）时返回NULL
+ */
+json_t *tc_heads_proof(uint32_t rep_id);
+
+#endif /* TC_HEADS_H */
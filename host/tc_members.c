@@ -0,0 +1,379 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <trust_chain_ta.h>
+#include <trust_chain_abi.h>
+
+#include "tc_members.h"
+#include "tc_smt.h"
+#include "tc_shard.h"
+#include "tc_codec.h"
+#include "tc_pubkey.h"
+#include "tc_blocklog.h"
+
+#define TREE_SLOTS (TC_MAX_SHARDS * MAX_REPO_ID)
+#define REPLAY_BUF (4 * TC_MAX_BLOCK_SIZE)
+
+/*
+ * stale表示仓库仍存在但树已丢弃（内存不足或与TA不一致），want_root是TA
+ * 最新区块记录的根（has_root为0时未知），tried是上次重建失败时日志中的
+ * 区块数。stale、want_root与tried只由该仓库分片的工作线程访问。
+ */
+struct repo_tree {
+    uint32_t rep_id;
+    struct tc_smt *tree;
+    int stale;
+    int has_root;
+    uint8_t want_root[TC_HASH_SIZE];
+    uint32_t tried;
+};
+
+/* 工作线程改树时持写锁，生成证明持读锁 */
+static pthread_rwlock_t trees_lock = PTHREAD_RWLOCK_INITIALIZER;
+static struct repo_tree trees[TREE_SLOTS];
+
+static struct repo_tree *tree_slot(uint32_t rep_id) {
+    uint32_t slot = REPO_ID_SLOT(rep_id);
+
+    if (slot >= MAX_REPO_ID) {
+        return NULL;
+    }
+    return &trees[REPO_ID_SHARD(rep_id) * MAX_REPO_ID + slot];
+}
+
+static struct tc_smt *tree_get(uint32_t rep_id) {
+    struct repo_tree *rt = tree_slot(rep_id);
+
+    return rt != NULL && rt->tree != NULL && rt->rep_id == rep_id ? rt->tree : NULL;
+}
+
+/* 替换仓库槽位上的树，tree为NULL时只丢弃（仓库已删除） */
+static void tree_put(uint32_t rep_id, struct tc_smt *tree) {
+    struct repo_tree *rt = tree_slot(rep_id);
+
+    if (rt == NULL) {
+        tc_smt_free(tree);
+        return;
+    }
+    tc_smt_free(rt->tree);
+    rt->rep_id = rep_id;
+    rt->tree = tree;
+    rt->stale = 0;
+}
+
+/* 丢弃无法继续维护的树，等下一个请求从区块日志重建；root为TA记录的根 */
+static void tree_drop(uint32_t rep_id, const uint8_t *root) {
+    struct repo_tree *rt = tree_slot(rep_id);
+
+    if (rt == NULL) {
+        return;
+    }
+    tree_put(rep_id, NULL);
+    rt->stale = 1;
+    rt->has_root = root != NULL;
+    if (root != NULL) {
+        memcpy(rt->want_root, root, TC_HASH_SIZE);
+    }
+    rt->tried = 0;
+}
+
+static int apply_block(struct tc_smt *tree, const uint8_t *blk, const uint8_t **root);
+
+/*
+ * 按区块日志重放仓库的全部区块重建树，根与TA最新记录的一致时装回。
+ * 日志可能还没追上TA（结果线程或聚合签名窗口中的区块），此时失败，
+ * 日志增长后的下一个请求再试。成功返回0。
+ */
+static int tree_rebuild(struct repo_tree *rt) {
+    struct tc_blocklog_range range;
+    struct tc_smt *tree;
+    uint8_t log_root[TC_HASH_SIZE], current[TC_HASH_SIZE];
+    uint8_t *buf;
+    size_t have = 0;
+    int has_log_root = 0, ok = 1;
+
+    if (tc_blocklog_open_range(rt->rep_id, 1, UINT32_MAX, &range) != 0) {
+        return -1;
+    }
+    if (range.total == rt->tried) {
+        close(range.fd);
+        return -1;
+    }
+    tree = tc_smt_new();
+    buf = malloc(REPLAY_BUF);
+    if (tree == NULL || buf == NULL) {
+        tc_smt_free(tree);
+        free(buf);
+        close(range.fd);
+        return -1;
+    }
+
+    off_t offset = range.offset;
+    uint64_t remaining = range.len;
+    while (ok && (remaining > 0 || have > 0)) {
+        size_t want = REPLAY_BUF - have;
+        if (want > remaining) {
+            want = remaining;
+        }
+        ssize_t n = want > 0 ? pread(range.fd, buf + have, want, offset) : 0;
+        if (n < 0) {
+            ok = 0;
+            break;
+        }
+        offset += n;
+        remaining -= n;
+        have += n;
+
+        size_t used = 0;
+        for (;;) {
+            size_t total = tc_block_total_len(buf + used, have - used);
+            const uint8_t *root;
+            if (total == 0) {
+                break;
+            }
+            if (apply_block(tree, buf + used, &root) != 0) {
+                ok = 0;
+                break;
+            }
+            if (root != NULL) {
+                memcpy(log_root, root, TC_HASH_SIZE);
+                has_log_root = 1;
+            }
+            used += total;
+        }
+        if (used == 0 && (remaining == 0 || n == 0)) {
+            break;
+        }
+        memmove(buf, buf + used, have - used);
+        have -= used;
+    }
+    free(buf);
+    close(range.fd);
+
+    tc_smt_root(tree, current);
+    if (ok && have == 0 && (rt->has_root || has_log_root) &&
+        memcmp(current, rt->has_root ? rt->want_root : log_root, TC_HASH_SIZE) == 0) {
+        printf("Rebuilt the membership tree of repository %u from %u logged blocks\n",
+               rt->rep_id, range.total);
+        pthread_rwlock_wrlock(&trees_lock);
+        tree_put(rt->rep_id, tree);
+        pthread_rwlock_unlock(&trees_lock);
+        return 0;
+    }
+    /* 读日志或内存出错时下次照常重试，根不一致则等日志增长 */
+    if (ok) {
+        rt->tried = range.total;
+    }
+    tc_smt_free(tree);
+    return -1;
+}
+
+static void put_proof(struct tc_writer *w, uint16_t tag, const struct tc_smt *tree,
+                      const uint8_t *fp) {
+    uint8_t proof[TC_SMT_MAX_PROOF_SIZE];
+    size_t len = tc_smt_prove(tree, fp, proof);
+
+    tc_put_tlv(w, tag, proof, len);
+}
+
+size_t tc_members_prepare(uint32_t cmd_id, const TEEC_Operation *op, uint8_t *msg) {
+    const TEEC_TempMemoryReference *in = &op->params[0].tmpref;
+    const uint8_t *sigkey = NULL, *pubkey = NULL, *val;
+    uint16_t sigkey_len = 0, pubkey_len = 0, tag, vlen;
+    struct tc_msg_hdr hdr;
+    struct tc_reader reader;
+    struct tc_writer w;
+    struct tc_smt *tree;
+    uint8_t fp[TC_HASH_SIZE];
+
+    if (cmd_id != TA_TRUST_CHAIN_CMD_COMMIT && cmd_id != TA_TRUST_CHAIN_CMD_ACCESS_CONTROL &&
+        cmd_id != TA_TRUST_CHAIN_CMD_DELETE_REPO) {
+        return 0;
+    }
+    if (in->size < sizeof(hdr) || in->size > TC_MAX_MSG_SIZE) {
+        return 0;
+    }
+    memcpy(&hdr, in->buffer, sizeof(hdr));
+    if (hdr.body_len != in->size - sizeof(hdr)) {
+        return 0;
+    }
+    tc_reader_init(&reader, (const uint8_t *)in->buffer + sizeof(hdr), hdr.body_len);
+    while (tc_next_tlv(&reader, &tag, &val, &vlen) > 0) {
+        if (tag == TC_TAG_SIGKEY) {
+            sigkey = val;
+            sigkey_len = vlen;
+        } else if (tag == TC_TAG_PUBKEY) {
+            pubkey = val;
+            pubkey_len = vlen;
+        }
+    }
+    if (sigkey == NULL) {
+        return 0;
+    }
+    /* 树已丢弃时先从区块日志重建，重建不了就不进入TEE，免得TA以无权限拒绝 */
+    struct repo_tree *rt = tree_slot(hdr.rep_id);
+    if (rt != NULL && rt->stale && rt->rep_id == hdr.rep_id && tree_rebuild(rt) != 0) {
+        return TC_SHARD_PREPARE_FAILED;
+    }
+
+    /* 原消息之后追加证明字段，再改写消息头的body_len */
+    memcpy(msg, in->buffer, in->size);
+    tc_writer_init(&w, msg + sizeof(hdr), TC_MAX_PROVEN_MSG_SIZE - sizeof(hdr));
+    w.len = hdr.body_len;
+    pthread_rwlock_rdlock(&trees_lock);
+    tree = tree_get(hdr.rep_id);
+    if (tree != NULL) {
+        tc_pubkey_id((const char *)sigkey, sigkey_len, fp);
+        put_proof(&w, TC_TAG_SIGKEY_PROOF, tree, fp);
+        if (pubkey != NULL) {
+            tc_pubkey_id((const char *)pubkey, pubkey_len, fp);
+            put_proof(&w, TC_TAG_PUBKEY_PROOF, tree, fp);
+        }
+    }
+    pthread_rwlock_unlock(&trees_lock);
+    if (tree == NULL || w.overflow) {
+        return 0;
+    }
+    hdr.body_len = (uint32_t)w.len;
+    memcpy(msg, &hdr, sizeof(hdr));
+    return sizeof(hdr) + w.len;
+}
+
+/*
+ * 按一个区块更新树，返回区块记录的根（没有时为NULL），树无法更新返回-1；
+ * tree为NULL时只取出根
+ */
+static int apply_block(struct tc_smt *tree, const uint8_t *blk, const uint8_t **root) {
+    struct tc_block_hdr hdr;
+    struct tc_reader reader;
+    const uint8_t *val, *pubkey = NULL;
+    uint16_t tag, vlen, pubkey_len = 0;
+
+    memcpy(&hdr, blk, sizeof(hdr));
+    *root = NULL;
+    tc_reader_init(&reader, blk + sizeof(hdr), hdr.body_len);
+    while (tc_next_tlv(&reader, &tag, &val, &vlen) > 0) {
+        if (tag == TC_TAG_PUBKEY) {
+            pubkey = val;
+            pubkey_len = vlen;
+        } else if (tag == TC_TAG_ACL_ROOT && vlen == TC_HASH_SIZE) {
+            *root = val;
+        } else if (tag == TC_TAG_ACL_STATE && vlen == sizeof(struct tc_acl_state)) {
+            *root = val + offsetof(struct tc_acl_state, root);
+        }
+    }
+    if (tree != NULL && hdr.block_type == TC_BLOCK_ACCESS && pubkey != NULL) {
+        uint8_t fp[TC_HASH_SIZE];
+        tc_pubkey_id((const char *)pubkey, pubkey_len, fp);
+        return tc_smt_set(tree, fp, hdr.op == OP_ADD ? (uint8_t)hdr.role : 0);
+    }
+    return 0;
+}
+
+void tc_members_executed(uint32_t cmd_id, const TEEC_Operation *op) {
+    uint32_t rep_id;
+    const uint8_t *blocks;
+    size_t len;
+    struct tc_smt *tree;
+    struct repo_tree *rt;
+
+    if (tc_shard_result_blocks(cmd_id, op, &rep_id, &blocks, &len) != 0) {
+        return;
+    }
+    pthread_rwlock_wrlock(&trees_lock);
+    if (cmd_id == TA_TRUST_CHAIN_CMD_INIT_REPO) {
+        tree_put(rep_id, tc_smt_new());
+    } else if (cmd_id == TA_TRUST_CHAIN_CMD_DELETE_REPO) {
+        tree_put(rep_id, NULL);
+    }
+    tree = tree_get(rep_id);
+    rt = tree_slot(rep_id);
+    while (len > 0) {
+        size_t total = tc_block_total_len(blocks, len);
+        const uint8_t *root;
+        uint8_t current[TC_HASH_SIZE];
+
+        if (total == 0) {
+            break;
+        }
+        if (tree == NULL) {
+            /* 树等待重建期间跟踪TA的最新根，重建结果须与之一致 */
+            if (rt != NULL && rt->stale && rt->rep_id == rep_id &&
+                apply_block(NULL, blocks, &root) == 0 && root != NULL) {
+                memcpy(rt->want_root, root, TC_HASH_SIZE);
+                rt->has_root = 1;
+            }
+        } else if (apply_block(tree, blocks, &root) != 0) {
+            printf("Out of memory updating the membership tree of repository %u, will rebuild\n", rep_id);
+            tree_drop(rep_id, root);
+            tree = NULL;
+        } else {
+            tc_smt_root(tree, current);
+            if (root != NULL && memcmp(root, current, TC_HASH_SIZE) != 0) {
+                /* 与TA不一致的树给出的证明都会被拒绝，不再对外提供 */
+                printf("Membership tree of repository %u diverged from the TA, will rebuild\n", rep_id);
+                tree_drop(rep_id, root);
+                tree = NULL;
+            }
+        }
+        blocks += total;
+        len -= total;
+    }
+    pthread_rwlock_unlock(&trees_lock);
+}
+
+static json_t *hex_json(const uint8_t *bytes, size_t len) {
+    char hex[TC_HASH_SIZE * 2 + 1];
+
+    tc_hex_encode(bytes, len, hex);
+    return json_string(hex);
+}
+
+json_t *tc_members_proof(uint32_t rep_id, const uint8_t *fp) {
+    uint8_t proof[TC_SMT_MAX_PROOF_SIZE];
+    uint8_t root[TC_HASH_SIZE];
+    struct tc_smt *tree;
+    json_t *obj, *siblings;
+    size_t len;
+
+    pthread_rwlock_rdlock(&trees_lock);
+    tree = tree_get(rep_id);
+    if (tree == NULL) {
+        pthread_rwlock_unlock(&trees_lock);
+        return NULL;
+    }
+    len = tc_smt_prove(tree, fp, proof);
+    tc_smt_root(tree, root);
+    pthread_rwlock_unlock(&trees_lock);
+
+    obj = json_object();
+    json_object_set_new(obj, "repository_id", json_integer(rep_id));
+    json_object_set_new(obj, "fingerprint", hex_json(fp, TC_HASH_SIZE));
+    json_object_set_new(obj, "role", json_string(proof[0] == ROLE_ADMIN ? "admin" :
+                                                 proof[0] == ROLE_WRITER ? "writer" : "none"));
+    json_object_set_new(obj, "acl_root", hex_json(root, TC_HASH_SIZE));
+    json_object_set_new(obj, "bitmap", hex_json(proof + 1, TC_SMT_BITMAP_SIZE));
+    /* 兄弟节点之后可能是相邻成员：非成员路径终点的唯一成员，或成员最深的兄弟 */
+    size_t end = (len - 1 - TC_SMT_BITMAP_SIZE) % TC_HASH_SIZE == 0 ? len : len - TC_SMT_LEAF_SIZE;
+    siblings = json_array();
+    for (size_t off = 1 + TC_SMT_BITMAP_SIZE; off < end; off += TC_HASH_SIZE) {
+        json_array_append_new(siblings, hex_json(proof + off, TC_HASH_SIZE));
+    }
+    json_object_set_new(obj, "siblings", siblings);
+    if (end < len) {
+        json_t *leaf = json_object();
+        json_object_set_new(leaf, "fingerprint", hex_json(proof + end, TC_HASH_SIZE));
+        json_object_set_new(leaf, "role", json_string(proof[end + TC_HASH_SIZE] == ROLE_ADMIN ?
+                                                      "admin" : "writer"));
+        json_object_set_new(obj, "leaf", leaf);
+    }
+    return obj;
+}
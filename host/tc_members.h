@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#ifndef TC_MEMBERS_H
+#define TC_MEMBERS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <jansson.h>
+#include <tee_client_api.h>
+
+/*
+ * 每个仓库成员集合的稀疏Merkle树（见tc_smt.h）。TA只保存树根，CA在命令
+ * 进入TEE前为签名者和被授权者附上成员证明，命令成功后立即按新区块更新
+ * 树，并与区块中的ACL_ROOT核对。两个钩子都由分片工作线程在TA调用前后
+ * 同步执行，因此树总是与TA当前的根一致，不受聚合签名窗口推迟交付的影响。
+ * TA实例随CA的会话关闭而销毁，CA启动后创建的仓库都有完整的树。
+ *
+ * 内存不足或与TA不一致时丢弃该仓库的树，下一个需要证明的请求从区块日志
+ * 重放重建，根与TA最新记录的一致才装回；重建不了（日志未启用或尚未追上
+ * TA）时请求不进入TEE，prepare返回TC_SHARD_PREPARE_FAILED。
+ */
+
+/* 分片钩子，见tc_shard_set_exec_hooks */
+size_t tc_members_prepare(uint32_t cmd_id, const TEEC_Operation *op, uint8_t *msg);
+void tc_members_executed(uint32_t cmd_id, const TEEC_Operation *op);
+
+/*
+ * fp在仓库成员树中的证明：{repository_id, fingerprint, role, acl_root, bitmap,
+ * siblings}，有相邻成员时另有leaf{fingerprint, role}，任何人可按
+ * trust_chain_abi.h中的规则验证。仓库不存在返回NULL。
+ */
+json_t *tc_members_proof(uint32_t rep_id, const uint8_t *fp);
+
+#endif /* TC_MEMBERS_H */
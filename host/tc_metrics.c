@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <trust_chain_ta.h>
+#include <trust_chain_abi.h>
+
+#include "tc_metrics.h"
+#include "tc_shard.h"
+
+static const char *const cmd_names[TC_STATS_MAX_CMDS] = {
+    [TA_TRUST_CHAIN_CMD_INIT_REPO]         = "init_repo",
+    [TA_TRUST_CHAIN_CMD_DELETE_REPO]       = "delete_repo",
+    [TA_TRUST_CHAIN_CMD_ACCESS_CONTROL]    = "access_control",
+    [TA_TRUST_CHAIN_CMD_GET_LATEST_HASH]   = "get_latest_hash",
+    [TA_TRUST_CHAIN_CMD_COMMIT]            = "commit",
+    [TA_TRUST_CHAIN_CMD_GET_TEE_PUBKEY]    = "get_tee_pubkey",
+    [TA_TRUST_CHAIN_CMD_GET_BRANCH_HEAD]   = "get_branch_head",
+    [TA_TRUST_CHAIN_CMD_BENCH_SIGN]        = "bench_sign",
+    [TA_TRUST_CHAIN_CMD_SEAL_BATCH]        = "seal_batch",
+    [TA_TRUST_CHAIN_CMD_OPEN_KEY_SESSION]  = "open_key_session",
+    [TA_TRUST_CHAIN_CMD_SIGN_HEAD_TREE]    = "sign_head_tree",
+    [TA_TRUST_CHAIN_CMD_ACL_CHECKPOINT]    = "acl_checkpoint",
+    [TA_TRUST_CHAIN_CMD_GET_STATS]         = "get_stats",
+};
+
+static const char *const phase_names[TC_STATS_PHASES] = {
+    [TC_STATS_PHASE_COMMAND]    = "command",
+    [TC_STATS_PHASE_PUBKEY]     = "pubkey",
+    [TC_STATS_PHASE_VERIFY]     = "verify",
+    [TC_STATS_PHASE_BLOCK_HASH] = "block_hash",
+    [TC_STATS_PHASE_KEY_LOAD]   = "key_load",
+    [TC_STATS_PHASE_SIGN]       = "sign",
+    [TC_STATS_PHASE_DECRYPT]    = "decrypt",
+};
+
+/* 各分片的应答，按头部声明的条数校验长度 */
+struct shard_stats {
+    struct tc_stats_hdr hdr;
+    const struct tc_stats_entry *entries;
+    const struct tc_stats_slab *slabs;
+};
+
+static int parse_stats(const uint8_t *buf, size_t len, struct shard_stats *st) {
+    if (len < sizeof(st->hdr)) {
+        return -1;
+    }
+    memcpy(&st->hdr, buf, sizeof(st->hdr));
+    if (st->hdr.ticks_per_sec == 0 ||
+        st->hdr.entry_count > TC_STATS_MAX_CMDS * TC_STATS_PHASES ||
+        st->hdr.slab_count > TC_STATS_MAX_SLABS ||
+        len != sizeof(st->hdr) + st->hdr.entry_count * sizeof(struct tc_stats_entry) +
+               st->hdr.slab_count * sizeof(struct tc_stats_slab)) {
+        return -1;
+    }
+    st->entries = (const struct tc_stats_entry *)(buf + sizeof(st->hdr));
+    st->slabs = (const struct tc_stats_slab *)(st->entries + st->hdr.entry_count);
+    return 0;
+}
+
+static void write_labels(FILE *out, const struct shard_stats *st, const struct tc_stats_entry *e) {
+    fprintf(out, "shard=\"%u\",phase=\"%s\",command=\"", st->hdr.shard, phase_names[e->phase]);
+    if (cmd_names[e->cmd_id] != NULL) {
+        fputs(cmd_names[e->cmd_id], out);
+    } else {
+        fprintf(out, "%u", e->cmd_id);
+    }
+    fputc('"', out);
+}
+
+/* 分片只有毫秒时钟时，命令内各阶段只有次数，不输出直方图 */
+static int timed(const struct shard_stats *st, const struct tc_stats_entry *e) {
+    return e->cmd_id < TC_STATS_MAX_CMDS && e->phase < TC_STATS_PHASES &&
+           (!(st->hdr.flags & TC_STATS_HDR_COARSE) || e->phase == TC_STATS_PHASE_COMMAND);
+}
+
+/* 第i个桶的上界为2^i个周期，最后一个桶归入+Inf */
+static void write_histograms(FILE *out, const struct shard_stats *sts, unsigned int count) {
+    fputs("# HELP trust_chain_ta_phase_seconds Time spent in a TA command and its phases.\n"
+          "# TYPE trust_chain_ta_phase_seconds histogram\n", out);
+    for (unsigned int s = 0; s < count; s++) {
+        double tps = (double)sts[s].hdr.ticks_per_sec;
+
+        for (uint32_t i = 0; i < sts[s].hdr.entry_count; i++) {
+            const struct tc_stats_entry *e = &sts[s].entries[i];
+            uint64_t cum = 0;
+
+            if (!timed(&sts[s], e)) {
+                continue;
+            }
+            for (unsigned int b = 0; b < TC_STATS_BUCKETS - 1; b++) {
+                cum += e->buckets[b];
+                fputs("trust_chain_ta_phase_seconds_bucket{", out);
+                write_labels(out, &sts[s], e);
+                fprintf(out, ",le=\"%.9g\"} %llu\n", (double)(1ULL << b) / tps,
+                        (unsigned long long)cum);
+            }
+            fputs("trust_chain_ta_phase_seconds_bucket{", out);
+            write_labels(out, &sts[s], e);
+            fprintf(out, ",le=\"+Inf\"} %llu\n", (unsigned long long)e->count);
+            fputs("trust_chain_ta_phase_seconds_sum{", out);
+            write_labels(out, &sts[s], e);
+            fprintf(out, "} %.9g\n", (double)e->sum_ticks / tps);
+            fputs("trust_chain_ta_phase_seconds_count{", out);
+            write_labels(out, &sts[s], e);
+            fprintf(out, "} %llu\n", (unsigned long long)e->count);
+        }
+    }
+
+    fputs("# HELP trust_chain_ta_phase_max_seconds Longest TA command or phase since the TA started.\n"
+          "# TYPE trust_chain_ta_phase_max_seconds gauge\n", out);
+    for (unsigned int s = 0; s < count; s++) {
+        for (uint32_t i = 0; i < sts[s].hdr.entry_count; i++) {
+            const struct tc_stats_entry *e = &sts[s].entries[i];
+
+            if (!timed(&sts[s], e)) {
+                continue;
+            }
+            fputs("trust_chain_ta_phase_max_seconds{", out);
+            write_labels(out, &sts[s], e);
+            fprintf(out, "} %.9g\n", (double)e->max_ticks / (double)sts[s].hdr.ticks_per_sec);
+        }
+    }
+
+    fputs("# HELP trust_chain_ta_phase_untimed_total Phases run by a TA without a fine-grained clock.\n"
+          "# TYPE trust_chain_ta_phase_untimed_total counter\n", out);
+    for (unsigned int s = 0; s < count; s++) {
+        for (uint32_t i = 0; i < sts[s].hdr.entry_count; i++) {
+            const struct tc_stats_entry *e = &sts[s].entries[i];
+
+            if (timed(&sts[s], e) || e->cmd_id >= TC_STATS_MAX_CMDS || e->phase >= TC_STATS_PHASES) {
+                continue;
+            }
+            fputs("trust_chain_ta_phase_untimed_total{", out);
+            write_labels(out, &sts[s], e);
+            fprintf(out, "} %llu\n", (unsigned long long)e->count);
+        }
+    }
+}
+
+static void write_slab_metric(FILE *out, const struct shard_stats *sts, unsigned int count,
+                              const char *name, const char *type, const char *help, size_t field) {
+    fprintf(out, "# HELP trust_chain_ta_slab_%s %s\n# TYPE trust_chain_ta_slab_%s %s\n",
+            name, help, name, type);
+    for (unsigned int s = 0; s < count; s++) {
+        for (uint32_t i = 0; i < sts[s].hdr.slab_count; i++) {
+            const struct tc_stats_slab *sl = &sts[s].slabs[i];
+            uint32_t value;
+
+            memcpy(&value, (const uint8_t *)sl + field, sizeof(value));
+            fprintf(out, "trust_chain_ta_slab_%s{shard=\"%u\",cache=\"%.*s\"} %u\n", name,
+                    sts[s].hdr.shard, (int)strnlen(sl->name, sizeof(sl->name)), sl->name, value);
+        }
+    }
+}
+
+static void write_slabs(FILE *out, const struct shard_stats *sts, unsigned int count) {
+    write_slab_metric(out, sts, count, "object_bytes", "gauge", "Object size of a TA slab cache.",
+                      offsetof(struct tc_stats_slab, obj_size));
+    write_slab_metric(out, sts, count, "pages", "gauge", "Pages held by a TA slab cache.",
+                      offsetof(struct tc_stats_slab, page_count));
+    write_slab_metric(out, sts, count, "objects", "gauge", "Object slots in a TA slab cache.",
+                      offsetof(struct tc_stats_slab, total_objs));
+    write_slab_metric(out, sts, count, "objects_in_use", "gauge", "Objects allocated from a TA slab cache.",
+                      offsetof(struct tc_stats_slab, in_use));
+    write_slab_metric(out, sts, count, "objects_peak", "gauge", "Peak objects allocated from a TA slab cache.",
+                      offsetof(struct tc_stats_slab, peak_in_use));
+    write_slab_metric(out, sts, count, "alloc_failures_total", "counter", "Failed allocations from a TA slab cache.",
+                      offsetof(struct tc_stats_slab, alloc_fail));
+}
+
+TEEC_Result tc_metrics_render(char **text, size_t *len, uint32_t *err_origin) {
+    TEEC_Operation ops[TC_MAX_SHARDS];
+    struct shard_stats sts[TC_MAX_SHARDS];
+    unsigned int count = tc_shard_count();
+    uint8_t *bufs;
+    TEEC_Result res;
+    FILE *out;
+
+    bufs = malloc((size_t)count * TC_MAX_STATS_SIZE);
+    if (bufs == NULL) {
+        return TEEC_ERROR_OUT_OF_MEMORY;
+    }
+    memset(ops, 0, sizeof(ops));
+    for (unsigned int i = 0; i < count; i++) {
+        ops[i].paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT,
+                                             TEEC_MEMREF_TEMP_OUTPUT,
+                                             TEEC_NONE,
+                                             TEEC_NONE);
+        ops[i].params[0].value.a = 0;
+        ops[i].params[1].tmpref.buffer = bufs + (size_t)i * TC_MAX_STATS_SIZE;
+        ops[i].params[1].tmpref.size = TC_MAX_STATS_SIZE;
+    }
+    res = tc_shards_invoke_all(TA_TRUST_CHAIN_CMD_GET_STATS, ops, err_origin);
+    if (res != TEEC_SUCCESS) {
+        free(bufs);
+        return res;
+    }
+    for (unsigned int i = 0; i < count; i++) {
+        if (parse_stats(bufs + (size_t)i * TC_MAX_STATS_SIZE, ops[i].params[1].tmpref.size, &sts[i]) != 0) {
+            free(bufs);
+            return TEEC_ERROR_BAD_FORMAT;
+        }
+    }
+
+    out = open_memstream(text, len);
+    if (out == NULL) {
+        free(bufs);
+        return TEEC_ERROR_OUT_OF_MEMORY;
+    }
+    write_histograms(out, sts, count);
+    write_slabs(out, sts, count);
+    fclose(out);
+    free(bufs);
+    return TEEC_SUCCESS;
+}
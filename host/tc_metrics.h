@@ -0,0 +1,22 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#ifndef TC_METRICS_H
+#define TC_METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <tee_client_api.h>
+
+/*
+ * 从每个分片取TA统计（TA_TRUST_CHAIN_CMD_GET_STATS），输出Prometheus
+ * 文本格式：各命令、各阶段的耗时直方图（秒）和slab缓存占用。直方图从
+ * TA启动起单调累加，不清零，区间内的变化由Prometheus按计数器差值计算。
+ * 成功时*text由调用者free；TA调用失败返回其结果，应答格式不对返回
+ * TEEC_ERROR_BAD_FORMAT。
+ */
+TEEC_Result tc_metrics_render(char **text, size_t *len, uint32_t *err_origin);
+
+#endif /* TC_METRICS_H */
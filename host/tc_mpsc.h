@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#ifndef TC_MPSC_H
+#define TC_MPSC_H
+
+#include <stddef.h>
+
+/*
+ * 无锁多生产者单消费者队列（Vyukov侵入式队列）。
+ * 生产者只做一次原子交换加一次存储，从不等待；消费者独占队尾。
+ * 生产者交换完队头、尚未链上next的瞬间，消费者可能看到队列暂时为空，
+ * 此时tc_mpsc_pop返回NULL，调用者稍后重试即可（生产者随后会唤醒它）。
+ */
+
+struct tc_mpsc_node {
+    struct tc_mpsc_node *next;
+};
+
+struct tc_mpsc_queue {
+    struct tc_mpsc_node *head;      /* 生产者在这里追加 */
+    struct tc_mpsc_node *tail;      /* 消费者从这里取 */
+    struct tc_mpsc_node stub;
+};
+
+static inline void tc_mpsc_init(struct tc_mpsc_queue *q)
+{
+    q->stub.next = NULL;
+    q->head = &q->stub;
+    q->tail = &q->stub;
+}
+
+static inline void tc_mpsc_push(struct tc_mpsc_queue *q, struct tc_mpsc_node *node)
+{
+    struct tc_mpsc_node *prev;
+
+    __atomic_store_n(&node->next, NULL, __ATOMIC_RELAXED);
+    prev = __atomic_exchange_n(&q->head, node, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+}
+
+/* 只能由消费者调用 */
+static inline struct tc_mpsc_node *tc_mpsc_pop(struct tc_mpsc_queue *q)
+{
+    struct tc_mpsc_node *tail = q->tail;
+    struct tc_mpsc_node *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+
+    if (tail == &q->stub) {
+        if (next == NULL) {
+            return NULL;
+        }
+        q->tail = next;
+        tail = next;
+        next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+    }
+    if (next != NULL) {
+        q->tail = next;
+        return tail;
+    }
+    if (tail != __atomic_load_n(&q->head, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    /* 只剩最后一个节点：重新放入stub，使其可以出队 */
+    tc_mpsc_push(q, &q->stub);
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (next != NULL) {
+        q->tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+#define tc_mpsc_entry(node, type, member) \
+    ((type *)((char *)(node) - offsetof(type, member)))
+
+#endif /* TC_MPSC_H */
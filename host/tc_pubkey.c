@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+
+#include <trust_chain_ta.h>
+
+#include "tc_pubkey.h"
+#include "tc_codec.h"
+#include "tc_sha256.h"
+
+#define SSH_RSA_NAME     "ssh-rsa"
+#define SSH_RSA_NAME_LEN 7
+#define RSA_MAX_BYTES    512
+
+struct rsa_params {
+    const uint8_t *n;
+    size_t n_len;
+    const uint8_t *e;
+    size_t e_len;
+};
+
+/* 去掉大整数的前导0 */
+static void strip_zeros(const uint8_t **val, size_t *len) {
+    while (*len > 0 && (*val)[0] == 0) {
+        (*val)++;
+        (*len)--;
+    }
+}
+
+static bool ssh_read_string(const uint8_t **p, const uint8_t *end,
+                            const uint8_t **val, size_t *len) {
+    uint32_t n;
+
+    if (end - *p < 4) {
+        return false;
+    }
+    n = (uint32_t)(*p)[0] << 24 | (uint32_t)(*p)[1] << 16 | (uint32_t)(*p)[2] << 8 | (*p)[3];
+    *p += 4;
+    if ((size_t)(end - *p) < n) {
+        return false;
+    }
+    *val = *p;
+    *len = n;
+    *p += n;
+    return true;
+}
+
+/* ssh-rsa AAAA... [注释] */
+static int parse_openssh(const char *key, size_t key_len, uint8_t *blob, size_t cap,
+                         struct rsa_params *rsa) {
+    size_t start = SSH_RSA_NAME_LEN + 1;
+    size_t end = start;
+    size_t blob_len;
+    const uint8_t *p = blob;
+    const uint8_t *name;
+    size_t name_len;
+
+    while (end < key_len && key[end] != ' ' && key[end] != '\t' &&
+           key[end] != '\r' && key[end] != '\n') {
+        end++;
+    }
+    if (tc_base64_decode(key + start, end - start, blob, cap, &blob_len) != 0) {
+        return -1;
+    }
+    if (!ssh_read_string(&p, blob + blob_len, &name, &name_len) ||
+        name_len != SSH_RSA_NAME_LEN || memcmp(name, SSH_RSA_NAME, SSH_RSA_NAME_LEN) != 0 ||
+        !ssh_read_string(&p, blob + blob_len, &rsa->e, &rsa->e_len) ||
+        !ssh_read_string(&p, blob + blob_len, &rsa->n, &rsa->n_len) ||
+        p != blob + blob_len) {
+        return -1;
+    }
+    return 0;
+}
+
+/* DER的tag与长度（最多两字节的长格式），返回内容起点 */
+static bool der_read(const uint8_t **p, const uint8_t *end, uint8_t tag,
+                     const uint8_t **val, size_t *len) {
+    size_t n;
+
+    if (end - *p < 2 || (*p)[0] != tag) {
+        return false;
+    }
+    n = (*p)[1];
+    *p += 2;
+    if (n == 0x81 || n == 0x82) {
+        size_t bytes = n & 0x7f;
+        if ((size_t)(end - *p) < bytes) {
+            return false;
+        }
+        n = bytes == 1 ? (*p)[0] : (size_t)(*p)[0] << 8 | (*p)[1];
+        *p += bytes;
+    } else if (n & 0x80) {
+        return false;
+    }
+    if ((size_t)(end - *p) < n) {
+        return false;
+    }
+    *val = *p;
+    *len = n;
+    *p += n;
+    return true;
+}
+
+/* RSAPublicKey ::= SEQUENCE { modulus INTEGER, publicExponent INTEGER }的内容 */
+static bool der_rsa_public_key(const uint8_t *p, const uint8_t *end, struct rsa_params *rsa) {
+    return der_read(&p, end, 0x02, &rsa->n, &rsa->n_len) &&
+           der_read(&p, end, 0x02, &rsa->e, &rsa->e_len) &&
+           p == end;
+}
+
+/* PEM：SubjectPublicKeyInfo（rsaEncryption）或PKCS#1 RSAPublicKey */
+static int parse_pem(const char *key, size_t key_len, uint8_t *der, size_t cap,
+                     struct rsa_params *rsa) {
+    static const uint8_t rsa_oid[] = { 0x2a, 0x86, 0x48, 0x86, 0xf7, 0x0d, 0x01, 0x01, 0x01 };
+    char b64[MAX_KEY_LENGTH];
+    size_t b64_len = 0;
+    size_t der_len;
+    const char *p = memchr(key, '\n', key_len);
+    const char *end = key + key_len;
+    const uint8_t *d, *seq, *alg, *oid, *bits;
+    size_t seq_len, alg_len, oid_len, bits_len;
+
+    if (key_len < 11 || memcmp(key, "-----BEGIN ", 11) != 0 || p == NULL) {
+        return -1;
+    }
+    /* 拼接首尾两行之间去掉空白的base64正文 */
+    for (p++; p < end && *p != '-'; p++) {
+        if (*p == '\n' || *p == '\r' || *p == ' ' || *p == '\t') {
+            continue;
+        }
+        if (b64_len >= sizeof(b64)) {
+            return -1;
+        }
+        b64[b64_len++] = *p;
+    }
+    if (tc_base64_decode(b64, b64_len, der, cap, &der_len) != 0) {
+        return -1;
+    }
+
+    /* 外层SEQUENCE的第一个元素是INTEGER时为PKCS#1，否则为SubjectPublicKeyInfo */
+    d = der;
+    if (!der_read(&d, der + der_len, 0x30, &seq, &seq_len) || d != der + der_len || seq_len < 1) {
+        return -1;
+    }
+    if (seq[0] == 0x02) {
+        return der_rsa_public_key(seq, seq + seq_len, rsa) ? 0 : -1;
+    }
+    if (!der_read(&seq, seq + seq_len, 0x30, &alg, &alg_len) ||
+        !der_read(&alg, alg + alg_len, 0x06, &oid, &oid_len) ||
+        oid_len != sizeof(rsa_oid) || memcmp(oid, rsa_oid, sizeof(rsa_oid)) != 0 ||
+        !der_read(&seq, d, 0x03, &bits, &bits_len) ||
+        bits_len < 1 || bits[0] != 0) {
+        return -1;
+    }
+    d = bits + bits_len;
+    bits++;
+    if (!der_read(&bits, d, 0x30, &seq, &seq_len) || bits != d) {
+        return -1;
+    }
+    return der_rsa_public_key(seq, seq + seq_len, rsa) ? 0 : -1;
+}
+
+static size_t put_mpint(uint8_t *out, const uint8_t *val, size_t len) {
+    size_t pad = val[0] & 0x80 ? 1 : 0;
+    uint32_t n = (uint32_t)(len + pad);
+
+    out[0] = (uint8_t)(n >> 24);
+    out[1] = (uint8_t)(n >> 16);
+    out[2] = (uint8_t)(n >> 8);
+    out[3] = (uint8_t)n;
+    out[4] = 0;
+    memcpy(out + 4 + pad, val, len);
+    return 4 + pad + len;
+}
+
+int tc_pubkey_fingerprint(const char *key, size_t key_len, uint8_t *fp) {
+    uint8_t buf[MAX_KEY_LENGTH];
+    uint8_t blob[4 + SSH_RSA_NAME_LEN + 4 + 1 + 8 + 4 + 1 + RSA_MAX_BYTES];
+    struct rsa_params rsa;
+    size_t len;
+    int res;
+
+    if (key_len > SSH_RSA_NAME_LEN && memcmp(key, SSH_RSA_NAME " ", SSH_RSA_NAME_LEN + 1) == 0) {
+        res = parse_openssh(key, key_len, buf, sizeof(buf), &rsa);
+    } else {
+        res = parse_pem(key, key_len, buf, sizeof(buf), &rsa);
+    }
+    if (res != 0) {
+        return -1;
+    }
+    /* 两种格式的整数都是有符号大端数，拒绝负数后去掉前导0，按SSH mpint重新编码 */
+    if (rsa.n_len == 0 || rsa.e_len == 0 || (rsa.n[0] & 0x80) || (rsa.e[0] & 0x80)) {
+        return -1;
+    }
+    strip_zeros(&rsa.n, &rsa.n_len);
+    strip_zeros(&rsa.e, &rsa.e_len);
+    if (rsa.n_len == 0 || rsa.n_len > RSA_MAX_BYTES || rsa.e_len == 0 || rsa.e_len > 8) {
+        return -1;
+    }
+
+    memcpy(blob, "\0\0\0\7" SSH_RSA_NAME, 4 + SSH_RSA_NAME_LEN);
+    len = 4 + SSH_RSA_NAME_LEN;
+    len += put_mpint(blob + len, rsa.e, rsa.e_len);
+    len += put_mpint(blob + len, rsa.n, rsa.n_len);
+    tc_sha256(blob, len, fp);
+    return 0;
+}
+
+void tc_pubkey_id(const char *key, size_t key_len, uint8_t *fp) {
+    if (tc_pubkey_fingerprint(key, key_len, fp) != 0) {
+        tc_sha256(key, key_len, fp);
+    }
+}
@@ -0,0 +1,23 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#ifndef TC_PUBKEY_H
+#define TC_PUBKEY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * 客户端RSA公钥的规范指纹，与TA（ta/rsa_pubkey）的定义相同：
+ * SHA256(string "ssh-rsa" || mpint e || mpint n)。接受OpenSSH单行格式和
+ * PEM（SubjectPublicKeyInfo或PKCS#1），同一把钥匙的两种格式指纹相同。
+ * 成功返回0，无法解析返回-1。
+ */
+int tc_pubkey_fingerprint(const char *key, size_t key_len, uint8_t *fp);
+
+/* 成员与身份索引使用的指纹：规范指纹，无法解析时退回公钥文本的SHA256 */
+void tc_pubkey_id(const char *key, size_t key_len, uint8_t *fp);
+
+#endif /* TC_PUBKEY_H */
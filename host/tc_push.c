@@ -0,0 +1,299 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "tc_push.h"
+#include "tc_codec.h"
+#include "tc_sha256.h"
+
+#define PUSH_FILE_MAGIC   0x4C504354  /* "TCPL" */
+#define PUSH_FILE_VERSION 1
+
+struct push_file_hdr {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+    uint32_t id_len;
+};
+
+static char push_dir[PATH_MAX];
+static int push_enabled = 0;
+
+/* 已登记、尚未保存的列表，数量不超过在途的commit请求数 */
+struct held_push {
+    struct held_push *next;
+    const struct tc_push *push;
+    uint8_t root[TC_HASH_SIZE];
+};
+
+static pthread_mutex_t held_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct held_push *held_head = NULL;
+
+static void push_path(char *path, size_t cap, const uint8_t *root, const char *suffix) {
+    char hex[TC_HASH_SIZE * 2 + 1];
+    tc_hex_encode(root, TC_HASH_SIZE, hex);
+    snprintf(path, cap, "%s/%s%s", push_dir, hex, suffix);
+}
+
+int tc_push_init(const char *dir) {
+    if (snprintf(push_dir, sizeof(push_dir), "%s", dir) >= (int)sizeof(push_dir)) {
+        return -1;
+    }
+    if (mkdir(push_dir, 0700) != 0 && errno != EEXIST) {
+        printf("Failed to create push list directory %s: %s\n", push_dir, strerror(errno));
+        return -1;
+    }
+    push_enabled = 1;
+    return 0;
+}
+
+/*
+ * 逐层原地归并，奇数个时最后一个原样上移；path非NULL时顺带收集index
+ * 的兄弟节点。列表为空或内存不足返回-1。
+ */
+static int merkle(const struct tc_push *p, uint32_t index, uint8_t *root,
+                  uint8_t *path, uint16_t *path_len) {
+    uint8_t (*level)[TC_HASH_SIZE];
+    struct tc_sha256_msg *msgs;
+    uint32_t width = p->count;
+
+    if (width == 0 || width > TC_MAX_PUSH_COMMITS) {
+        return -1;
+    }
+    level = malloc((size_t)width * TC_HASH_SIZE);
+    msgs = malloc((size_t)width * sizeof(*msgs));
+    if (level == NULL || msgs == NULL) {
+        free(level);
+        free(msgs);
+        return -1;
+    }
+    for (uint32_t i = 0; i < width; i++) {
+        msgs[i].data = p->ids + (size_t)i * p->id_len;
+        msgs[i].len = p->id_len;
+        msgs[i].has_prefix = 1;
+        msgs[i].prefix = TC_MERKLE_LEAF_PREFIX;
+    }
+    tc_sha256_many(msgs, width, level);
+    free(msgs);
+    if (path_len != NULL) {
+        *path_len = 0;
+    }
+    while (width > 1) {
+        uint32_t next = width / 2;
+
+        if (path != NULL && (index ^ 1) < width) {
+            memcpy(path + (size_t)(*path_len)++ * TC_HASH_SIZE, level[index ^ 1], TC_HASH_SIZE);
+        }
+        tc_sha256_pairs(TC_MERKLE_NODE_PREFIX, level[0], next, level[0]);
+        if (width % 2) {
+            memcpy(level[next++], level[width - 1], TC_HASH_SIZE);
+        }
+        width = next;
+        index /= 2;
+    }
+    if (root != NULL) {
+        memcpy(root, level[0], TC_HASH_SIZE);
+    }
+    free(level);
+    return 0;
+}
+
+void tc_push_root(const struct tc_push *p, uint8_t *root) {
+    if (merkle(p, 0, root, NULL, NULL) != 0) {
+        memset(root, 0, TC_HASH_SIZE);
+    }
+}
+
+int tc_push_proof(const struct tc_push *p, uint32_t index, uint8_t *path, uint16_t *path_len) {
+    if (index >= p->count) {
+        return -1;
+    }
+    return merkle(p, index, NULL, path, path_len);
+}
+
+int64_t tc_push_find(const struct tc_push *p, const uint8_t *id, size_t id_len) {
+    if (id_len != p->id_len) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < p->count; i++) {
+        if (memcmp(p->ids + (size_t)i * id_len, id, id_len) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int write_all(int fd, const void *buf, size_t len) {
+    const uint8_t *q = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, q, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        q += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int tc_push_save(const struct tc_push *p, const uint8_t *root) {
+    char path[PATH_MAX], tmp[PATH_MAX];
+    struct push_file_hdr hdr = {
+        .magic = PUSH_FILE_MAGIC, .version = PUSH_FILE_VERSION,
+        .count = p->count, .id_len = p->id_len,
+    };
+    int fd, ret;
+
+    if (!push_enabled) {
+        return -1;
+    }
+    push_path(path, sizeof(path), root, "");
+    if (access(path, F_OK) == 0) {
+        return 0;
+    }
+    /* 同一个列表可能被并发提交，各自写唯一的临时文件 */
+    push_path(tmp, sizeof(tmp), root, ".XXXXXX");
+    fd = mkstemp(tmp);
+    if (fd < 0) {
+        return -1;
+    }
+    ret = write_all(fd, &hdr, sizeof(hdr));
+    if (ret == 0) {
+        ret = write_all(fd, p->ids, (size_t)p->count * p->id_len);
+    }
+    if (ret == 0) {
+        ret = fsync(fd);
+    }
+    close(fd);
+    if (ret == 0) {
+        ret = rename(tmp, path);
+    }
+    if (ret != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    /* 目录项也要落盘，响应返回后列表必须可以找回 */
+    fd = open(push_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+    return 0;
+}
+
+int tc_push_load(const uint8_t *root, struct tc_push *p) {
+    char path[PATH_MAX];
+    struct push_file_hdr hdr;
+    uint8_t check[TC_HASH_SIZE];
+    size_t len;
+    ssize_t n;
+    int fd;
+
+    if (!push_enabled) {
+        return -1;
+    }
+    push_path(path, sizeof(path), root, "");
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    memset(p, 0, sizeof(*p));
+    if (read(fd, &hdr, sizeof(hdr)) != (ssize_t)sizeof(hdr) ||
+        hdr.magic != PUSH_FILE_MAGIC || hdr.version != PUSH_FILE_VERSION ||
+        hdr.count == 0 || hdr.count > TC_MAX_PUSH_COMMITS ||
+        hdr.id_len == 0 || hdr.id_len > TC_HASH_SIZE) {
+        close(fd);
+        return -1;
+    }
+    len = (size_t)hdr.count * hdr.id_len;
+    p->ids = malloc(len);
+    if (p->ids == NULL) {
+        close(fd);
+        return -1;
+    }
+    n = pread(fd, p->ids, len, sizeof(hdr));
+    close(fd);
+    p->count = hdr.count;
+    p->id_len = hdr.id_len;
+    /* 列表必须与文件名中的根一致 */
+    if (n != (ssize_t)len || merkle(p, 0, check, NULL, NULL) != 0 ||
+        memcmp(check, root, TC_HASH_SIZE) != 0) {
+        tc_push_free(p);
+        return -1;
+    }
+    return 0;
+}
+
+int tc_push_hold(const struct tc_push *p, const uint8_t *root) {
+    struct held_push *h = malloc(sizeof(*h));
+
+    if (h == NULL) {
+        return -1;
+    }
+    h->push = p;
+    memcpy(h->root, root, TC_HASH_SIZE);
+    pthread_mutex_lock(&held_lock);
+    h->next = held_head;
+    held_head = h;
+    pthread_mutex_unlock(&held_lock);
+    return 0;
+}
+
+void tc_push_release(const struct tc_push *p) {
+    struct held_push **link, *h = NULL;
+
+    pthread_mutex_lock(&held_lock);
+    for (link = &held_head; *link != NULL; link = &(*link)->next) {
+        if ((*link)->push == p) {
+            h = *link;
+            *link = h->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&held_lock);
+    free(h);
+}
+
+int tc_push_load_held(const uint8_t *root, struct tc_push *p) {
+    struct held_push *h;
+    int found = 0;
+
+    memset(p, 0, sizeof(*p));
+    pthread_mutex_lock(&held_lock);
+    for (h = held_head; h != NULL; h = h->next) {
+        if (memcmp(h->root, root, TC_HASH_SIZE) != 0) {
+            continue;
+        }
+        size_t len = (size_t)h->push->count * h->push->id_len;
+        p->ids = malloc(len);
+        if (p->ids != NULL) {
+            memcpy(p->ids, h->push->ids, len);
+            p->count = h->push->count;
+            p->id_len = h->push->id_len;
+            found = 1;
+        }
+        break;
+    }
+    pthread_mutex_unlock(&held_lock);
+    return found ? 0 : tc_push_load(root, p);
+}
+
+void tc_push_free(struct tc_push *p) {
+    free(p->ids);
+    p->ids = NULL;
+    p->count = 0;
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#ifndef TC_PUSH_H
+#define TC_PUSH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <trust_chain_abi.h>
+
+/*
+ * 推送区块（格式见trust_chain_abi.h）的commit列表。区块只记录列表的
+ * Merkle根，TA接受推送区块后CA把列表按根存进<dir>/<根十六进制>，供逐个
+ * commit的包含证明和审计索引（重建时也要）使用。TA验签之前列表只登记
+ * 在内存中，被拒绝的请求不会在磁盘上留下文件。
+ */
+
+#define TC_PUSH_MAX_DEPTH 16      /* ceil(log2(TC_MAX_PUSH_COMMITS)) */
+
+struct tc_push {
+    uint32_t count;
+    uint32_t id_len;            /* 每个commit ID的字节数，列表内相同 */
+    uint8_t *ids;               /* count * id_len字节，推送顺序 */
+};
+
+/* 打开列表目录（不存在则创建），失败返回-1，此时推送区块仍可提交但没有证明 */
+int tc_push_init(const char *dir);
+
+/* 计算列表的Merkle根 */
+void tc_push_root(const struct tc_push *p, uint8_t *root);
+
+/* 第index个commit的兄弟节点路径，path至少TC_PUSH_MAX_DEPTH * TC_HASH_SIZE字节 */
+int tc_push_proof(const struct tc_push *p, uint32_t index, uint8_t *path, uint16_t *path_len);
+
+/* 查找commit在列表中的位置，不存在返回-1 */
+int64_t tc_push_find(const struct tc_push *p, const uint8_t *id, size_t id_len);
+
+/* 持久化列表（写临时文件、落盘、rename），已存在时直接返回0 */
+int tc_push_save(const struct tc_push *p, const uint8_t *root);
+
+/* 按根读取已保存的列表并核对根，成功后由调用者tc_push_free */
+int tc_push_load(const uint8_t *root, struct tc_push *p);
+
+/*
+ * 在内存中登记正在提交的列表：结果线程可能在tc_push_save之前就把区块交给
+ * 审计索引。TA成功后先tc_push_save再tc_push_release，失败时直接release；
+ * 登记期间p须保持有效。内存不足返回-1。
+ */
+int tc_push_hold(const struct tc_push *p, const uint8_t *root);
+void tc_push_release(const struct tc_push *p);
+
+/* 同tc_push_load，但先查找已登记、尚未保存的列表，供审计索引使用 */
+int tc_push_load_held(const uint8_t *root, struct tc_push *p);
+
+void tc_push_free(struct tc_push *p);
+
+#endif /* TC_PUSH_H */
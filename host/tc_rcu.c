@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "tc_rcu.h"
+
+static unsigned int rcu_phase = 0;
+static unsigned long rcu_readers[2];
+/* 切换阶段与等待必须串行：两个宽限期交叠会使其中一个等待错误的计数器 */
+static pthread_mutex_t rcu_sync_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* 延迟回收：回调经MPSC队列交给回收线程，首次使用时启动 */
+static struct tc_mpsc_queue rcu_callbacks;
+static int rcu_efd = -1;
+static int rcu_reclaimer_ok = 0;
+static pthread_once_t rcu_once = PTHREAD_ONCE_INIT;
+
+unsigned int tc_rcu_read_lock(void) {
+    for (;;) {
+        unsigned int phase = __atomic_load_n(&rcu_phase, __ATOMIC_SEQ_CST) & 1;
+        __atomic_add_fetch(&rcu_readers[phase], 1, __ATOMIC_SEQ_CST);
+        /*
+         * 计数之后阶段未变，说明之后的写者一定会等待本读者；
+         * 阶段已切换则撤销计数重试，避免在写者检查之后才登记。
+         */
+        if ((__atomic_load_n(&rcu_phase, __ATOMIC_SEQ_CST) & 1) == phase) {
+            return phase;
+        }
+        __atomic_sub_fetch(&rcu_readers[phase], 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+void tc_rcu_read_unlock(unsigned int phase) {
+    __atomic_sub_fetch(&rcu_readers[phase], 1, __ATOMIC_RELEASE);
+}
+
+void tc_rcu_synchronize(void) {
+    unsigned int old_phase;
+
+    pthread_mutex_lock(&rcu_sync_lock);
+    old_phase = __atomic_fetch_add(&rcu_phase, 1, __ATOMIC_SEQ_CST) & 1;
+    while (__atomic_load_n(&rcu_readers[old_phase], __ATOMIC_ACQUIRE) != 0) {
+        sched_yield();
+    }
+    pthread_mutex_unlock(&rcu_sync_lock);
+}
+
+static void *rcu_reclaimer(void *arg) {
+    (void)arg;
+
+    for (;;) {
+        struct tc_rcu_head *batch = NULL;
+        struct tc_mpsc_node *node;
+
+        while ((node = tc_mpsc_pop(&rcu_callbacks)) != NULL) {
+            struct tc_rcu_head *head = tc_mpsc_entry(node, struct tc_rcu_head, node);
+            head->next = batch;
+            batch = head;
+        }
+        if (batch == NULL) {
+            /* 队列空或生产者正在链入节点，入队完成后会写eventfd */
+            uint64_t count;
+            while (read(rcu_efd, &count, sizeof(count)) < 0 && errno == EINTR) {
+            }
+            continue;
+        }
+        /* 回调都在摘下旧对象之后入队，之后开始的宽限期覆盖整批 */
+        tc_rcu_synchronize();
+        while (batch != NULL) {
+            struct tc_rcu_head *next = batch->next;
+            batch->func(batch);
+            batch = next;
+        }
+    }
+    return NULL;
+}
+
+static void rcu_reclaimer_start(void) {
+    pthread_t thread;
+
+    tc_mpsc_init(&rcu_callbacks);
+    rcu_efd = eventfd(0, EFD_CLOEXEC);
+    if (rcu_efd < 0) {
+        return;
+    }
+    if (pthread_create(&thread, NULL, rcu_reclaimer, NULL) != 0) {
+        close(rcu_efd);
+        rcu_efd = -1;
+        return;
+    }
+    pthread_detach(thread);
+    rcu_reclaimer_ok = 1;
+}
+
+void tc_rcu_call(struct tc_rcu_head *head, void (*func)(struct tc_rcu_head *head)) {
+    uint64_t one = 1;
+
+    pthread_once(&rcu_once, rcu_reclaimer_start);
+    head->func = func;
+    if (!rcu_reclaimer_ok) {
+        /* 回收线程启动失败时退化为同步等待 */
+        tc_rcu_synchronize();
+        func(head);
+        return;
+    }
+    tc_mpsc_push(&rcu_callbacks, &head->node);
+    while (write(rcu_efd, &one, sizeof(one)) < 0 && errno == EINTR) {
+    }
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#ifndef TC_RCU_H
+#define TC_RCU_H
+
+#include "tc_mpsc.h"
+
+/*
+ * 极简的用户态RCU：两个读者计数器按当前阶段交替使用。
+ * 读者只做原子加减，不加锁；写者发布新指针后切换阶段，等待旧阶段的读者
+ * 全部退出，再释放旧对象。读临界区内不能阻塞。全局只有一个域，不同数据的
+ * 写者（视图、链头树纪元）可以并发调用tc_rcu_synchronize，内部串行执行。
+ */
+
+/* 进入读临界区，返回值需传给tc_rcu_read_unlock */
+unsigned int tc_rcu_read_lock(void);
+void tc_rcu_read_unlock(unsigned int phase);
+
+/* 等待在此之前进入的读者全部退出（宽限期），可由多个写者并发调用 */
+void tc_rcu_synchronize(void);
+
+/* 嵌入待回收对象中，供tc_rcu_call使用 */
+struct tc_rcu_head {
+    struct tc_mpsc_node node;
+    struct tc_rcu_head *next;
+    void (*func)(struct tc_rcu_head *head);
+};
+
+/*
+ * 延迟回收：调用者摘下旧对象后立即返回，回收线程在宽限期结束后调用func。
+ * 同一批回调共用一个宽限期；func在回收线程上运行，可以加锁但不应长时间阻塞。
+ */
+void tc_rcu_call(struct tc_rcu_head *head, void (*func)(struct tc_rcu_head *head));
+
+#define tc_rcu_entry(head, type, member) tc_mpsc_entry(head, type, member)
+
+#define tc_rcu_dereference(p)     __atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+#define tc_rcu_assign_pointer(p, v) __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+
+#endif /* TC_RCU_H */
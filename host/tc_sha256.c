@@ -0,0 +1,495 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+#include "tc_sha256.h"
+
+static const uint32_t k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static const uint32_t iv[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static inline uint32_t load_be32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static void compress_block(uint32_t *state, const uint8_t *block) {
+    uint32_t w[64];
+    uint32_t a, b, c, d, e, f, g, h;
+
+    for (int i = 0; i < 16; i++) {
+        w[i] = load_be32(block + 4 * i);
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    a = state[0]; b = state[1]; c = state[2]; d = state[3];
+    e = state[4]; f = state[5]; g = state[6]; h = state[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t s1 = ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25);
+        uint32_t ch = (e & f) ^ (~e & g);
+        uint32_t t1 = h + s1 + ch + k[i] + w[i];
+        uint32_t s0 = ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22);
+        uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t t2 = s0 + maj;
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+static void compress_scalar(uint32_t *state, const uint8_t *data, size_t blocks) {
+    for (size_t i = 0; i < blocks; i++) {
+        compress_block(state, data + i * TC_SHA256_BLOCK_SIZE);
+    }
+}
+
+/*
+ * 多路压缩：lanes条消息各压缩一个块，state按字交错存放（state[w * lanes + l]）。
+ * VEC是lanes个uint32_t的GCC向量类型，同一段代码在x86上以target("avx2")编译
+ * 为256位指令，在arm64上编译为NEON指令。
+ */
+#define DEFINE_COMPRESS_LANES(attr, name, VEC, lanes)                                   \
+static attr void name(uint32_t *state, const uint8_t *const *blocks) {                       \
+    VEC w[16], a, b, c, d, e, f, g, h, t1, t2, s[8];                                    \
+    uint32_t col[lanes];                                                                \
+                                                                                        \
+    for (int i = 0; i < 16; i++) {                                                      \
+        for (int l = 0; l < (lanes); l++) {                                             \
+            col[l] = load_be32(blocks[l] + 4 * i);                                      \
+        }                                                                               \
+        memcpy(&w[i], col, sizeof(col));                                                \
+    }                                                                                   \
+    memcpy(s, state, sizeof(s));                                                        \
+    a = s[0]; b = s[1]; c = s[2]; d = s[3];                                             \
+    e = s[4]; f = s[5]; g = s[6]; h = s[7];                                             \
+    for (int i = 0; i < 64; i++) {                                                      \
+        if (i >= 16) {                                                                  \
+            VEC x = w[(i - 15) & 15], y = w[(i - 2) & 15];                              \
+            w[i & 15] += (ROTR(x, 7) ^ ROTR(x, 18) ^ (x >> 3)) + w[(i - 7) & 15] +      \
+                         (ROTR(y, 17) ^ ROTR(y, 19) ^ (y >> 10));                       \
+        }                                                                               \
+        t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g)) +      \
+             k[i] + w[i & 15];                                                          \
+        t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));  \
+        h = g; g = f; f = e; e = d + t1;                                                \
+        d = c; c = b; b = a; a = t1 + t2;                                               \
+    }                                                                                   \
+    s[0] += a; s[1] += b; s[2] += c; s[3] += d;                                         \
+    s[4] += e; s[5] += f; s[6] += g; s[7] += h;                                         \
+    memcpy(state, s, sizeof(s));                                                        \
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#define SHANI __attribute__((target("sha,sse4.1")))
+
+/* SHA扩展指令按ABEF/CDGH两个寄存器存放状态，与按字顺序的abcd/efgh互换 */
+static inline SHANI void shani_pack(__m128i abcd, __m128i efgh, __m128i *abef, __m128i *cdgh) {
+    __m128i tmp = _mm_shuffle_epi32(abcd, 0xB1);
+
+    efgh = _mm_shuffle_epi32(efgh, 0x1B);
+    *abef = _mm_alignr_epi8(tmp, efgh, 8);
+    *cdgh = _mm_blend_epi16(efgh, tmp, 0xF0);
+}
+
+static inline SHANI void shani_unpack(__m128i abef, __m128i cdgh, __m128i *abcd, __m128i *efgh) {
+    __m128i tmp = _mm_shuffle_epi32(abef, 0x1B);
+
+    cdgh = _mm_shuffle_epi32(cdgh, 0xB1);
+    *abcd = _mm_blend_epi16(tmp, cdgh, 0xF0);
+    *efgh = _mm_alignr_epi8(cdgh, tmp, 8);
+}
+
+/* 第g组四轮，w为最近四组消息字的环形缓冲 */
+static inline SHANI void shani_rounds(__m128i *abef, __m128i *cdgh, __m128i *w, int g,
+                                      const uint8_t *block) {
+    const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i msg;
+
+    if (g < 4) {
+        w[g] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(block + 16 * g)), mask);
+    } else {
+        msg = _mm_alignr_epi8(w[(g - 1) & 3], w[(g - 2) & 3], 4);
+        msg = _mm_add_epi32(_mm_sha256msg1_epu32(w[g & 3], w[(g - 3) & 3]), msg);
+        w[g & 3] = _mm_sha256msg2_epu32(msg, w[(g - 1) & 3]);
+    }
+    msg = _mm_add_epi32(w[g & 3], _mm_loadu_si128((const __m128i *)&k[4 * g]));
+    *cdgh = _mm_sha256rnds2_epu32(*cdgh, *abef, msg);
+    *abef = _mm_sha256rnds2_epu32(*abef, *cdgh, _mm_shuffle_epi32(msg, 0x0E));
+}
+
+static SHANI void compress_shani(uint32_t *state, const uint8_t *data, size_t blocks) {
+    __m128i abef, cdgh, abcd, efgh, w[4];
+
+    shani_pack(_mm_loadu_si128((const __m128i *)&state[0]),
+               _mm_loadu_si128((const __m128i *)&state[4]), &abef, &cdgh);
+    for (size_t n = 0; n < blocks; n++, data += TC_SHA256_BLOCK_SIZE) {
+        __m128i abef_save = abef, cdgh_save = cdgh;
+
+        for (int g = 0; g < 16; g++) {
+            shani_rounds(&abef, &cdgh, w, g, data);
+        }
+        abef = _mm_add_epi32(abef, abef_save);
+        cdgh = _mm_add_epi32(cdgh, cdgh_save);
+    }
+    shani_unpack(abef, cdgh, &abcd, &efgh);
+    _mm_storeu_si128((__m128i *)&state[0], abcd);
+    _mm_storeu_si128((__m128i *)&state[4], efgh);
+}
+
+/*
+ * 两路交错：sha256rnds2受延迟限制，两条消息的轮函数交替发射可以填满
+ * 流水线。state按字交错存放，与向量多路实现相同。
+ */
+static SHANI void compress_shani_x2(uint32_t *state, const uint8_t *const *blocks) {
+    __m128i abef[2], cdgh[2], save[2][2], w[2][4], abcd, efgh;
+
+    for (int l = 0; l < 2; l++) {
+        shani_pack(_mm_set_epi32(state[6 + l], state[4 + l], state[2 + l], state[l]),
+                   _mm_set_epi32(state[14 + l], state[12 + l], state[10 + l], state[8 + l]),
+                   &abef[l], &cdgh[l]);
+        save[l][0] = abef[l];
+        save[l][1] = cdgh[l];
+    }
+    for (int g = 0; g < 16; g++) {
+        shani_rounds(&abef[0], &cdgh[0], w[0], g, blocks[0]);
+        shani_rounds(&abef[1], &cdgh[1], w[1], g, blocks[1]);
+    }
+    for (int l = 0; l < 2; l++) {
+        uint32_t out[8];
+
+        shani_unpack(_mm_add_epi32(abef[l], save[l][0]), _mm_add_epi32(cdgh[l], save[l][1]),
+                     &abcd, &efgh);
+        _mm_storeu_si128((__m128i *)&out[0], abcd);
+        _mm_storeu_si128((__m128i *)&out[4], efgh);
+        for (int i = 0; i < 8; i++) {
+            state[2 * i + l] = out[i];
+        }
+    }
+}
+
+typedef uint32_t vec8_u32 __attribute__((vector_size(32)));
+
+DEFINE_COMPRESS_LANES(__attribute__((target("avx2"))), compress_avx2, vec8_u32, 8)
+
+static int have_shani(void) {
+    unsigned int a, b, c, d;
+
+    /* CPUID.7.0:EBX第29位为SHA扩展，另需SSSE3与SSE4.1 */
+    if (!__get_cpuid_count(7, 0, &a, &b, &c, &d) || !(b & (1u << 29))) {
+        return 0;
+    }
+    return __builtin_cpu_supports("ssse3") && __builtin_cpu_supports("sse4.1");
+}
+
+static int have_avx2(void) {
+    return __builtin_cpu_supports("avx2");
+}
+
+#elif defined(__aarch64__)
+
+typedef uint32_t vec4_u32 __attribute__((vector_size(16)));
+
+DEFINE_COMPRESS_LANES(, compress_neon, vec4_u32, 4)
+
+static int have_neon(void) {
+    return (getauxval(AT_HWCAP) & HWCAP_ASIMD) != 0;
+}
+
+#endif
+
+static int have_always(void) {
+    return 1;
+}
+
+#define MAX_LANES 8
+
+struct sha256_impl {
+    const char *name;
+    int (*supported)(void);
+    /* 单路压缩连续的blocks个块 */
+    void (*compress)(uint32_t *state, const uint8_t *data, size_t blocks);
+    /* 多路压缩，lanes为1时为NULL */
+    void (*compress_lanes)(uint32_t *state, const uint8_t *const *blocks);
+    unsigned int lanes;
+};
+
+/* 按优先顺序排列，首个CPU支持的实现为默认 */
+static const struct sha256_impl impls[] = {
+#if defined(__x86_64__) || defined(__i386__)
+    { "shani", have_shani, compress_shani, compress_shani_x2, 2 },
+    { "avx2", have_avx2, compress_scalar, compress_avx2, 8 },
+#elif defined(__aarch64__)
+    { "neon", have_neon, compress_scalar, compress_neon, 4 },
+#endif
+    { "scalar", have_always, compress_scalar, NULL, 1 },
+};
+
+static const struct sha256_impl *active_impl;
+
+static const struct sha256_impl *impl(void) {
+    const struct sha256_impl *p = __atomic_load_n(&active_impl, __ATOMIC_ACQUIRE);
+
+    if (p == NULL) {
+        /* 并发首次调用时各自探测，结果相同 */
+        for (p = impls; !p->supported(); p++) {
+        }
+        __atomic_store_n(&active_impl, p, __ATOMIC_RELEASE);
+    }
+    return p;
+}
+
+const char *tc_sha256_impl_name(void) {
+    return impl()->name;
+}
+
+int tc_sha256_select(const char *name) {
+    for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+        if (strcmp(impls[i].name, name) == 0) {
+            if (!impls[i].supported()) {
+                return -1;
+            }
+            __atomic_store_n(&active_impl, &impls[i], __ATOMIC_RELEASE);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* 取出第0路的摘要，stride为state中相邻两个字的间隔（多路时为路数） */
+static void store_digest(const uint32_t *state, unsigned int stride, uint8_t *digest) {
+    for (int i = 0; i < 8; i++) {
+        uint32_t v = state[i * stride];
+        digest[4 * i] = (uint8_t)(v >> 24);
+        digest[4 * i + 1] = (uint8_t)(v >> 16);
+        digest[4 * i + 2] = (uint8_t)(v >> 8);
+        digest[4 * i + 3] = (uint8_t)v;
+    }
+}
+
+void tc_sha256_init(struct tc_sha256_ctx *c) {
+    memcpy(c->state, iv, sizeof(iv));
+    c->total_len = 0;
+    c->buf_len = 0;
+}
+
+void tc_sha256_update(struct tc_sha256_ctx *c, const void *data, size_t len) {
+    const uint8_t *p = data;
+    void (*compress)(uint32_t *, const uint8_t *, size_t) = impl()->compress;
+
+    c->total_len += len;
+    if (c->buf_len > 0) {
+        size_t n = TC_SHA256_BLOCK_SIZE - c->buf_len;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(c->buf + c->buf_len, p, n);
+        c->buf_len += n;
+        p += n;
+        len -= n;
+        if (c->buf_len < TC_SHA256_BLOCK_SIZE) {
+            return;
+        }
+        compress(c->state, c->buf, 1);
+        c->buf_len = 0;
+    }
+    if (len >= TC_SHA256_BLOCK_SIZE) {
+        size_t blocks = len / TC_SHA256_BLOCK_SIZE;
+        compress(c->state, p, blocks);
+        p += blocks * TC_SHA256_BLOCK_SIZE;
+        len -= blocks * TC_SHA256_BLOCK_SIZE;
+    }
+    memcpy(c->buf, p, len);
+    c->buf_len = len;
+}
+
+void tc_sha256_final(struct tc_sha256_ctx *c, uint8_t *digest) {
+    uint64_t bit_len = c->total_len * 8;
+    void (*compress)(uint32_t *, const uint8_t *, size_t) = impl()->compress;
+
+    c->buf[c->buf_len++] = 0x80;
+    if (c->buf_len > TC_SHA256_BLOCK_SIZE - 8) {
+        memset(c->buf + c->buf_len, 0, TC_SHA256_BLOCK_SIZE - c->buf_len);
+        compress(c->state, c->buf, 1);
+        c->buf_len = 0;
+    }
+    memset(c->buf + c->buf_len, 0, TC_SHA256_BLOCK_SIZE - 8 - c->buf_len);
+    for (int i = 0; i < 8; i++) {
+        c->buf[TC_SHA256_BLOCK_SIZE - 1 - i] = (uint8_t)(bit_len >> (8 * i));
+    }
+    compress(c->state, c->buf, 1);
+
+    store_digest(c->state, 1, digest);
+}
+
+void tc_sha256(const void *data, size_t len, uint8_t *digest) {
+    struct tc_sha256_ctx c;
+    tc_sha256_init(&c);
+    tc_sha256_update(&c, data, len);
+    tc_sha256_final(&c, digest);
+}
+
+/* 前缀、数据与填充连起来后的总块数 */
+static size_t msg_blocks(const struct tc_sha256_msg *m) {
+    size_t total = (m->has_prefix ? 1 : 0) + m->len;
+    return (total + 8) / TC_SHA256_BLOCK_SIZE + 1;
+}
+
+/*
+ * 取消息（含前缀与填充）从off开始的一块：整块落在数据内时直接返回数据
+ * 指针，否则拼到buf里。
+ */
+static const uint8_t *msg_block(const struct tc_sha256_msg *m, size_t off, size_t blocks,
+                                uint8_t *buf) {
+    const uint8_t *data = m->data;
+    size_t skip = m->has_prefix ? 1 : 0;
+    size_t total = skip + m->len;
+    size_t i = 0;
+
+    if (off >= skip && off + TC_SHA256_BLOCK_SIZE <= total) {
+        return data + off - skip;
+    }
+    memset(buf, 0, TC_SHA256_BLOCK_SIZE);
+    if (off < skip) {
+        buf[i++] = m->prefix;
+    }
+    if (off + i < total) {
+        size_t n = total - off - i;
+        if (n > TC_SHA256_BLOCK_SIZE - i) {
+            n = TC_SHA256_BLOCK_SIZE - i;
+        }
+        memcpy(buf + i, data + off + i - skip, n);
+    }
+    if (total >= off && total < off + TC_SHA256_BLOCK_SIZE) {
+        buf[total - off] = 0x80;
+    }
+    if (off / TC_SHA256_BLOCK_SIZE == blocks - 1) {
+        uint64_t bit_len = (uint64_t)total * 8;
+        for (int j = 0; j < 8; j++) {
+            buf[TC_SHA256_BLOCK_SIZE - 1 - j] = (uint8_t)(bit_len >> (8 * j));
+        }
+    }
+    return buf;
+}
+
+static void hash_msg(const struct tc_sha256_msg *m, uint8_t *digest) {
+    struct tc_sha256_ctx c;
+
+    tc_sha256_init(&c);
+    if (m->has_prefix) {
+        tc_sha256_update(&c, &m->prefix, 1);
+    }
+    tc_sha256_update(&c, m->data, m->len);
+    tc_sha256_final(&c, digest);
+}
+
+/*
+ * 多路调度：每路独立推进自己的消息，每轮各压缩一块，哪一路算完就写出
+ * 摘要并换上下一条消息。消息取完后空闲的路压缩全零块，结果丢弃。
+ */
+static void hash_lanes(const struct sha256_impl *im, const struct tc_sha256_msg *msgs, size_t count,
+                       uint8_t (*digests)[TC_SHA256_DIGEST_SIZE]) {
+    static const uint8_t zero_block[TC_SHA256_BLOCK_SIZE];
+    unsigned int lanes = im->lanes;
+    uint32_t state[8 * MAX_LANES];
+    uint8_t bufs[MAX_LANES][TC_SHA256_BLOCK_SIZE];
+    const uint8_t *blocks[MAX_LANES];
+    size_t cur[MAX_LANES], off[MAX_LANES], nblocks[MAX_LANES];
+    size_t next = 0, active = 0;
+
+    for (unsigned int l = 0; l < lanes; l++) {
+        cur[l] = SIZE_MAX;
+    }
+    for (;;) {
+        for (unsigned int l = 0; l < lanes; l++) {
+            if (cur[l] == SIZE_MAX && next < count) {
+                cur[l] = next++;
+                off[l] = 0;
+                nblocks[l] = msg_blocks(&msgs[cur[l]]);
+                for (int w = 0; w < 8; w++) {
+                    state[w * lanes + l] = iv[w];
+                }
+                active++;
+            }
+            blocks[l] = cur[l] == SIZE_MAX ? zero_block :
+                        msg_block(&msgs[cur[l]], off[l], nblocks[l], bufs[l]);
+        }
+        if (active == 0) {
+            break;
+        }
+        im->compress_lanes(state, blocks);
+        for (unsigned int l = 0; l < lanes; l++) {
+            if (cur[l] == SIZE_MAX) {
+                continue;
+            }
+            off[l] += TC_SHA256_BLOCK_SIZE;
+            if (off[l] == nblocks[l] * TC_SHA256_BLOCK_SIZE) {
+                store_digest(state + l, lanes, digests[cur[l]]);
+                cur[l] = SIZE_MAX;
+                active--;
+            }
+        }
+    }
+}
+
+void tc_sha256_many(const struct tc_sha256_msg *msgs, size_t count,
+                    uint8_t (*digests)[TC_SHA256_DIGEST_SIZE]) {
+    const struct sha256_impl *im = impl();
+
+    if (im->lanes > 1 && count > 1) {
+        hash_lanes(im, msgs, count, digests);
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        hash_msg(&msgs[i], digests[i]);
+    }
+}
+
+/* 每次最多并发处理的节点对数，摘要先写到栈上，原地归并时不会覆盖未读的输入 */
+#define PAIR_CHUNK 64
+
+void tc_sha256_pairs(uint8_t prefix, const uint8_t *in, size_t pairs, uint8_t *out) {
+    struct tc_sha256_msg msgs[PAIR_CHUNK];
+    uint8_t digests[PAIR_CHUNK][TC_SHA256_DIGEST_SIZE];
+
+    for (size_t base = 0; base < pairs; base += PAIR_CHUNK) {
+        size_t n = pairs - base < PAIR_CHUNK ? pairs - base : PAIR_CHUNK;
+
+        for (size_t i = 0; i < n; i++) {
+            msgs[i].data = in + (base + i) * 2 * TC_SHA256_DIGEST_SIZE;
+            msgs[i].len = 2 * TC_SHA256_DIGEST_SIZE;
+            msgs[i].has_prefix = 1;
+            msgs[i].prefix = prefix;
+        }
+        tc_sha256_many(msgs, n, digests);
+        memcpy(out + base * TC_SHA256_DIGEST_SIZE, digests, n * TC_SHA256_DIGEST_SIZE);
+    }
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#ifndef TC_SHA256_H
+#define TC_SHA256_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define TC_SHA256_DIGEST_SIZE 32
+#define TC_SHA256_BLOCK_SIZE  64
+
+/* CA侧的SHA256，用于计算TA返回区块的哈希（区块链头） */
+struct tc_sha256_ctx {
+    uint32_t state[8];
+    uint64_t total_len;
+    uint8_t buf[TC_SHA256_BLOCK_SIZE];
+    size_t buf_len;
+};
+
+void tc_sha256_init(struct tc_sha256_ctx *c);
+void tc_sha256_update(struct tc_sha256_ctx *c, const void *data, size_t len);
+void tc_sha256_final(struct tc_sha256_ctx *c, uint8_t *digest);
+
+/* 一次性计算data的SHA256 */
+void tc_sha256(const void *data, size_t len, uint8_t *digest);
+
+/*
+ * 批量哈希的一条消息：has_prefix非0时哈希prefix || data，否则只哈希data。
+ * 前缀字节用于Merkle树叶子与内部节点的域分隔，省得调用者先拼接。
+ */
+struct tc_sha256_msg {
+    const void *data;
+    size_t len;
+    uint8_t has_prefix;
+    uint8_t prefix;
+};
+
+/*
+ * 批量计算count条相互独立的消息，digests[i]对应msgs[i]，可以就是
+ * msgs[i]的数据（原地计算）。多路实现让各条消息在向量的不同通道里
+ * 同步压缩，一条算完即换上下一条，消息长短不一时通道也不会空转。
+ */
+void tc_sha256_many(const struct tc_sha256_msg *msgs, size_t count,
+                    uint8_t (*digests)[TC_SHA256_DIGEST_SIZE]);
+
+/*
+ * Merkle树的一层：in为连续的2 * pairs个摘要，第i个输出为
+ * SHA256(prefix || 第2i个 || 第2i+1个)，连续写到out。out可以与in相同，
+ * 逐层原地归并。
+ */
+void tc_sha256_pairs(uint8_t prefix, const uint8_t *in, size_t pairs, uint8_t *out);
+
+/*
+ * 实现在首次使用时按CPU选择：x86上依次为shani（SHA扩展指令，批量时两路
+ * 交错）、avx2（八路并行），arm64上为neon（四路并行），都不可用时为
+ * scalar。单条哈希在有SHA扩展时也用shani，多路实现只用于批量接口。
+ */
+const char *tc_sha256_impl_name(void);
+
+/* 指定实现（测试与压测用），名称未知或CPU不支持时返回-1 */
+int tc_sha256_select(const char *name);
+
+#endif /* TC_SHA256_H */
@@ -0,0 +1,932 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#include <trust_chain_ta.h>
+#include <trust_chain_abi.h>
+
+#include "tc_shard.h"
+#include "tc_batch.h"
+
+/*
+ * 调度参数：权重越大，该类别的流分到的TA时间越多；排队上限包括入口队列
+ * 和调度器里的请求，不含正在执行的那一个。
+ */
+static const unsigned int class_weight[TC_CLASS_COUNT] = { 1, 2, 4 };
+static const unsigned int class_shard_depth[TC_CLASS_COUNT] = { 128, 128, 32 };
+static const unsigned int class_flow_depth[TC_CLASS_COUNT] = { 16, 16, 8 };
+
+#define SCHED_MAX_QUEUED    (128 + 128 + 32)    /* 各类别分片上限之和，也是活跃流数的上限 */
+#define SCHED_COST          (1ULL << 20)        /* 一个请求的虚拟服务量，除以权重得到标签增量 */
+#define SCHED_HASH_SIZE     512
+#define FLOW_DEPTH_BUCKETS  1024                /* 按仓库槽位号统计流的排队数，冲突只会更严格 */
+#define JOB_MAX_BLOCKS      2                   /* 一次commit可能带出一个检查点区块 */
+
+/* 一个（仓库，类别）流，只在有排队请求时存在 */
+struct flow {
+    struct flow *hash_next;
+    uint32_t rep_id;
+    enum tc_shard_class cls;
+    struct tc_shard_job *head;
+    struct tc_shard_job *tail;
+    uint64_t finish_tag;            /* 最后入队请求的虚拟完成时间 */
+};
+
+/* 调度器只由工作线程访问 */
+struct sched {
+    uint64_t vtime;                 /* 当前虚拟时间：最近开始执行的请求的起始标签 */
+    struct flow *buckets[SCHED_HASH_SIZE];
+    struct flow *free_flows;
+    struct flow *heap[SCHED_MAX_QUEUED];  /* 按队首请求的起始标签排序的小根堆 */
+    unsigned int heap_len;
+    struct flow flows[SCHED_MAX_QUEUED];
+};
+
+struct shard {
+    unsigned int index;
+    TEEC_Session sess;
+    int sess_open;
+    pthread_t worker;
+    int worker_started;
+    struct tc_mpsc_queue queue;
+    unsigned long pending;      /* 已入队未取出的请求数 */
+    int sleeping;               /* 工作线程即将或正在阻塞在efd上 */
+    int efd;                    /* 唤醒工作线程 */
+    int stopping;
+    /* 准入计数：提交时增加，开始执行时减少 */
+    unsigned int class_depth[TC_CLASS_COUNT];
+    unsigned short flow_depth[FLOW_DEPTH_BUCKETS][TC_CLASS_COUNT];
+    struct sched *sched;
+    /* 聚合签名：窗口内已执行、等待根签名的请求，按执行顺序 */
+    uint32_t batch_window;      /* 每个窗口的区块数上限，0为逐块签名 */
+    struct tc_shard_job *held_head;
+    struct tc_shard_job *held_tail;
+    struct tc_batch *batch;
+    /* prepare钩子改写后的请求消息 */
+    uint8_t proven_msg[TC_MAX_PROVEN_MSG_SIZE];
+};
+
+static TEEC_Context ctx;
+static int ctx_initialized = 0;
+static struct shard shards[TC_MAX_SHARDS];
+static unsigned int shard_count = 0;
+static unsigned int next_new_repo_shard = 0;
+static tc_shard_result_hook result_hook = NULL;
+static tc_shard_prepare_hook prepare_hook = NULL;
+static tc_shard_executed_hook executed_hook = NULL;
+
+/*
+ * 结果线程：工作线程复制TA输出的区块后经MPSC队列交给它，随即执行下一条
+ * 命令；视图、区块日志、索引与订阅推送都在结果线程上完成，不占用TEE。
+ * 结果按入队顺序编号（编号与入队在同一把锁内，队列顺序即编号顺序），
+ * 同步调用者等到自己的编号被处理完再返回。
+ */
+struct shard_result {
+    struct tc_mpsc_node node;
+    uint64_t seq;
+    uint32_t cmd_id;
+    uint32_t rep_id;
+    size_t len;
+    uint8_t blocks[];
+};
+
+static struct tc_mpsc_queue result_queue;
+static int result_efd = -1;
+static int result_stopping = 0;
+static int result_started = 0;
+static pthread_t result_thread;
+static pthread_mutex_t result_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t result_cond = PTHREAD_COND_INITIALIZER;
+static uint64_t result_posted = 0;     /* 最后入队结果的编号，result_lock保护 */
+static uint64_t result_applied = 0;    /* 最后处理完的结果编号，result_lock保护 */
+static unsigned int result_waiters = 0;
+
+static void eventfd_signal(int efd) {
+    uint64_t one = 1;
+    while (write(efd, &one, sizeof(one)) < 0 && errno == EINTR) {
+    }
+}
+
+static void eventfd_drain(int efd) {
+    uint64_t count;
+    while (read(efd, &count, sizeof(count)) < 0 && errno == EINTR) {
+    }
+}
+
+int tc_cq_init(struct tc_completion_queue *cq) {
+    tc_mpsc_init(&cq->q);
+    cq->efd = eventfd(0, EFD_CLOEXEC);
+    return cq->efd < 0 ? -1 : 0;
+}
+
+void tc_cq_destroy(struct tc_completion_queue *cq) {
+    if (cq->efd >= 0) {
+        close(cq->efd);
+        cq->efd = -1;
+    }
+}
+
+struct tc_shard_job *tc_cq_pop(struct tc_completion_queue *cq) {
+    struct tc_mpsc_node *node = tc_mpsc_pop(&cq->q);
+    return node ? tc_mpsc_entry(node, struct tc_shard_job, node) : NULL;
+}
+
+/* 入队后不再访问job，调用者取出后即可释放或复用 */
+static void complete_job(struct tc_shard_job *job) {
+    struct tc_completion_queue *cq = job->cq;
+    tc_mpsc_push(&cq->q, &job->node);
+    eventfd_signal(cq->efd);
+}
+
+enum tc_shard_class tc_shard_class_of(uint32_t cmd_id) {
+    switch (cmd_id) {
+    case TA_TRUST_CHAIN_CMD_COMMIT:
+        return TC_CLASS_WRITE;
+    case TA_TRUST_CHAIN_CMD_INIT_REPO:
+    case TA_TRUST_CHAIN_CMD_DELETE_REPO:
+    case TA_TRUST_CHAIN_CMD_ACCESS_CONTROL:
+    case TA_TRUST_CHAIN_CMD_ACL_CHECKPOINT:
+        return TC_CLASS_ACL;
+    default:
+        return TC_CLASS_READ;
+    }
+}
+
+static unsigned short *flow_depth_slot(struct shard *s, uint32_t rep_id, enum tc_shard_class cls) {
+    return &s->flow_depth[REPO_ID_SLOT(rep_id) % FLOW_DEPTH_BUCKETS][cls];
+}
+
+/* 准入控制：类别和流都未满时占一个名额，返回0 */
+static int admit(struct shard *s, uint32_t rep_id, enum tc_shard_class cls) {
+    unsigned short *flow = flow_depth_slot(s, rep_id, cls);
+
+    if (__atomic_add_fetch(&s->class_depth[cls], 1, __ATOMIC_RELAXED) > class_shard_depth[cls]) {
+        __atomic_sub_fetch(&s->class_depth[cls], 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+    if (__atomic_add_fetch(flow, 1, __ATOMIC_RELAXED) > class_flow_depth[cls]) {
+        __atomic_sub_fetch(flow, 1, __ATOMIC_RELAXED);
+        __atomic_sub_fetch(&s->class_depth[cls], 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+    return 0;
+}
+
+static void release_admission(struct shard *s, uint32_t rep_id, enum tc_shard_class cls) {
+    __atomic_sub_fetch(flow_depth_slot(s, rep_id, cls), 1, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&s->class_depth[cls], 1, __ATOMIC_RELAXED);
+}
+
+static int flow_before(const struct flow *a, const struct flow *b) {
+    return a->head->start_tag < b->head->start_tag;
+}
+
+static void heap_push(struct sched *q, struct flow *f) {
+    unsigned int i = q->heap_len++;
+
+    while (i > 0) {
+        unsigned int parent = (i - 1) / 2;
+        if (!flow_before(f, q->heap[parent])) {
+            break;
+        }
+        q->heap[i] = q->heap[parent];
+        i = parent;
+    }
+    q->heap[i] = f;
+}
+
+static struct flow *heap_pop(struct sched *q) {
+    struct flow *top = q->heap[0];
+    struct flow *last = q->heap[--q->heap_len];
+    unsigned int i = 0;
+
+    for (;;) {
+        unsigned int child = 2 * i + 1;
+        if (child >= q->heap_len) {
+            break;
+        }
+        if (child + 1 < q->heap_len && flow_before(q->heap[child + 1], q->heap[child])) {
+            child++;
+        }
+        if (!flow_before(q->heap[child], last)) {
+            break;
+        }
+        q->heap[i] = q->heap[child];
+        i = child;
+    }
+    if (q->heap_len > 0) {
+        q->heap[i] = last;
+    }
+    return top;
+}
+
+static unsigned int flow_hash(uint32_t rep_id, enum tc_shard_class cls) {
+    return ((rep_id * 2654435761u) ^ cls) % SCHED_HASH_SIZE;
+}
+
+/*
+ * 请求进入所属流：起始标签取虚拟时间与该流上一个请求完成标签中的较大者，
+ * 因此积压多的流标签不断后移，偶尔来一个请求的流总能排到前面。
+ */
+static void sched_enqueue(struct sched *q, struct tc_shard_job *job) {
+    enum tc_shard_class cls = tc_shard_class_of(job->cmd_id);
+    unsigned int h = flow_hash(job->rep_id, cls);
+    struct flow *f;
+
+    for (f = q->buckets[h]; f != NULL; f = f->hash_next) {
+        if (f->rep_id == job->rep_id && f->cls == cls) {
+            break;
+        }
+    }
+    job->sched_next = NULL;
+    if (f != NULL) {
+        job->start_tag = f->finish_tag > q->vtime ? f->finish_tag : q->vtime;
+        f->finish_tag = job->start_tag + SCHED_COST / class_weight[cls];
+        f->tail->sched_next = job;
+        f->tail = job;
+        return;
+    }
+
+    /* 准入计数保证活跃流不超过SCHED_MAX_QUEUED，空闲链表不会耗尽 */
+    f = q->free_flows;
+    q->free_flows = f->hash_next;
+    f->rep_id = job->rep_id;
+    f->cls = cls;
+    f->head = job;
+    f->tail = job;
+    job->start_tag = q->vtime;
+    f->finish_tag = job->start_tag + SCHED_COST / class_weight[cls];
+    f->hash_next = q->buckets[h];
+    q->buckets[h] = f;
+    heap_push(q, f);
+}
+
+/* 取起始标签最小的请求；流排空后即回收，不保留历史份额 */
+static struct tc_shard_job *sched_dequeue(struct sched *q) {
+    struct flow *f;
+    struct flow **link;
+    struct tc_shard_job *job;
+
+    if (q->heap_len == 0) {
+        return NULL;
+    }
+    f = heap_pop(q);
+    job = f->head;
+    q->vtime = job->start_tag;
+    f->head = job->sched_next;
+    if (f->head != NULL) {
+        heap_push(q, f);
+        return job;
+    }
+
+    link = &q->buckets[flow_hash(f->rep_id, f->cls)];
+    while (*link != f) {
+        link = &(*link)->hash_next;
+    }
+    *link = f->hash_next;
+    f->hash_next = q->free_flows;
+    q->free_flows = f;
+    return job;
+}
+
+static struct sched *sched_create(void) {
+    struct sched *q = calloc(1, sizeof(*q));
+
+    if (q == NULL) {
+        return NULL;
+    }
+    for (unsigned int i = 0; i < SCHED_MAX_QUEUED; i++) {
+        q->flows[i].hash_next = q->free_flows;
+        q->free_flows = &q->flows[i];
+    }
+    return q;
+}
+
+/* 把入口队列里的请求全部移入调度器 */
+static void sched_ingest(struct shard *s) {
+    struct tc_mpsc_node *node;
+
+    while ((node = tc_mpsc_pop(&s->queue)) != NULL) {
+        __atomic_sub_fetch(&s->pending, 1, __ATOMIC_SEQ_CST);
+        sched_enqueue(s->sched, tc_mpsc_entry(node, struct tc_shard_job, node));
+    }
+}
+
+/* 产生区块的命令的输出参数下标，以及TA对该缓冲区要求的最小容量；其他命令返回-1 */
+static int result_param(uint32_t cmd_id, size_t *cap) {
+    switch (cmd_id) {
+    case TA_TRUST_CHAIN_CMD_INIT_REPO:
+        *cap = TC_MAX_BLOCK_SIZE;
+        return 2;
+    case TA_TRUST_CHAIN_CMD_DELETE_REPO:
+    case TA_TRUST_CHAIN_CMD_ACL_CHECKPOINT:
+        *cap = TC_MAX_BLOCK_SIZE;
+        return 1;
+    case TA_TRUST_CHAIN_CMD_ACCESS_CONTROL:
+        /* 成员变更区块之后可能跟一个ACL检查点区块 */
+        *cap = TC_MAX_COMMIT_OUTPUT;
+        return 1;
+    case TA_TRUST_CHAIN_CMD_COMMIT:
+        *cap = TC_MAX_COMMIT_OUTPUT;
+        return 2;
+    default:
+        return -1;
+    }
+}
+
+/*
+ * 复制结果区块交给结果线程，在job->result_seq中记下编号；TEEC_Operation的
+ * 缓冲区在完成后归调用者所有
+ */
+static void post_result(struct tc_shard_job *job) {
+    struct shard_result *r;
+    const uint8_t *blocks;
+    uint32_t rep_id;
+    size_t len;
+
+    if (tc_shard_result_blocks(job->cmd_id, job->op, &rep_id, &blocks, &len) != 0) {
+        return;
+    }
+    r = malloc(sizeof(*r) + len);
+    if (r == NULL) {
+        printf("Dropped result of command %u for repository %u: out of memory\n",
+               job->cmd_id, rep_id);
+        return;
+    }
+    r->cmd_id = job->cmd_id;
+    r->rep_id = rep_id;
+    r->len = len;
+    memcpy(r->blocks, blocks, len);
+    pthread_mutex_lock(&result_lock);
+    r->seq = ++result_posted;
+    tc_mpsc_push(&result_queue, &r->node);
+    pthread_mutex_unlock(&result_lock);
+    job->result_seq = r->seq;
+    eventfd_signal(result_efd);
+}
+
+/* 等待编号为seq的结果被结果钩子处理完 */
+static void wait_result(uint64_t seq) {
+    pthread_mutex_lock(&result_lock);
+    result_waiters++;
+    while (result_applied < seq) {
+        pthread_cond_wait(&result_cond, &result_lock);
+    }
+    result_waiters--;
+    pthread_mutex_unlock(&result_lock);
+}
+
+static void *result_worker(void *arg) {
+    (void)arg;
+
+    for (;;) {
+        struct tc_mpsc_node *node = tc_mpsc_pop(&result_queue);
+        if (node != NULL) {
+            struct shard_result *r = tc_mpsc_entry(node, struct shard_result, node);
+            result_hook(r->cmd_id, r->rep_id, r->blocks, r->len);
+            pthread_mutex_lock(&result_lock);
+            result_applied = r->seq;
+            if (result_waiters > 0) {
+                pthread_cond_broadcast(&result_cond);
+            }
+            pthread_mutex_unlock(&result_lock);
+            free(r);
+            continue;
+        }
+        /* 生产者都已退出时队列已取空 */
+        if (__atomic_load_n(&result_stopping, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+        /* 队列空或生产者正在链入节点，入队完成后会写eventfd */
+        eventfd_drain(result_efd);
+    }
+    return NULL;
+}
+
+static void finish_job(struct tc_shard_job *job) {
+    if (job->res == TEEC_SUCCESS && result_started) {
+        post_result(job);
+    }
+    complete_job(job);
+}
+
+/* 成功的请求带出了待签名区块时，记下区块哈希并留到窗口结束，返回1 */
+static int hold_job(struct shard *s, struct tc_shard_job *job) {
+    size_t cap;
+    int param = result_param(job->cmd_id, &cap);
+    TEEC_TempMemoryReference *out;
+
+    if (param < 0) {
+        return 0;
+    }
+    out = &job->op->params[param].tmpref;
+    if (tc_batch_pending_blocks(out->buffer, out->size) == 0) {
+        return 0;
+    }
+    if (tc_batch_add_blocks(s->batch, out->buffer, out->size) != 0) {
+        job->res = TEEC_ERROR_GENERIC;
+        job->err_origin = TEEC_ORIGIN_API;
+        return 0;
+    }
+    job->sched_next = NULL;
+    if (s->held_tail != NULL) {
+        s->held_tail->sched_next = job;
+    } else {
+        s->held_head = job;
+    }
+    s->held_tail = job;
+    return 1;
+}
+
+/*
+ * 结束聚合签名窗口：TA对窗口内全部区块哈希的Merkle根签名，本线程重建
+ * 同一棵树并核对根，再把包含证明填进各区块，按执行顺序交付。签名失败时
+ * 窗口内的请求都以该错误完成，与TA执行后CA未能交付区块的情形相同。
+ */
+static void seal_window(struct shard *s) {
+    struct tc_batch_root root;
+    uint8_t sig[TC_MAX_TEE_SIG_SIZE];
+    struct tc_shard_job *job;
+    TEEC_Operation op;
+    TEEC_Result res;
+    uint32_t err_origin;
+    uint32_t leaf = 0;
+
+    memset(&op, 0, sizeof(op));
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_OUTPUT, TEEC_MEMREF_TEMP_OUTPUT,
+                                     TEEC_NONE, TEEC_NONE);
+    op.params[0].tmpref.buffer = &root;
+    op.params[0].tmpref.size = sizeof(root);
+    op.params[1].tmpref.buffer = sig;
+    op.params[1].tmpref.size = sizeof(sig);
+    res = TEEC_InvokeCommand(&s->sess, TA_TRUST_CHAIN_CMD_SEAL_BATCH, &op, &err_origin);
+    if (res == TEEC_SUCCESS &&
+        (op.params[0].tmpref.size != sizeof(root) || tc_batch_build(s->batch, &root) != 0)) {
+        printf("Shard %u: signed batch root does not match the held blocks\n", s->index);
+        res = TEEC_ERROR_SECURITY;
+        err_origin = TEEC_ORIGIN_API;
+    } else if (res != TEEC_SUCCESS) {
+        printf("Shard %u: sealing batch failed with code 0x%x origin 0x%x\n",
+               s->index, res, err_origin);
+    }
+
+    while ((job = s->held_head) != NULL) {
+        size_t cap;
+        TEEC_TempMemoryReference *out = &job->op->params[result_param(job->cmd_id, &cap)].tmpref;
+        uint32_t blocks = tc_batch_pending_blocks(out->buffer, out->size);
+
+        s->held_head = job->sched_next;
+        if (res != TEEC_SUCCESS) {
+            job->res = res;
+            job->err_origin = err_origin;
+        } else if (tc_batch_fill(s->batch, leaf, &root, sig, op.params[1].tmpref.size,
+                                 out->buffer, &out->size, cap) != 0) {
+            job->res = TEEC_ERROR_GENERIC;
+            job->err_origin = TEEC_ORIGIN_API;
+        }
+        leaf += blocks;
+        finish_job(job);
+    }
+    s->held_tail = NULL;
+    tc_batch_reset(s->batch);
+}
+
+/* 执行一条命令：prepare钩子改写的消息只在本次调用期间替换params[0] */
+static void invoke_job(struct shard *s, struct tc_shard_job *job) {
+    TEEC_TempMemoryReference msg = job->op->params[0].tmpref;
+    size_t len = prepare_hook != NULL ? prepare_hook(job->cmd_id, job->op, s->proven_msg) : 0;
+
+    if (len == TC_SHARD_PREPARE_FAILED) {
+        job->res = TC_ERROR_PREPARE_FAILED;
+        job->err_origin = TEEC_ORIGIN_API;
+        return;
+    }
+    if (len > 0) {
+        job->op->params[0].tmpref.buffer = s->proven_msg;
+        job->op->params[0].tmpref.size = len;
+    }
+    job->res = TEEC_InvokeCommand(&s->sess, job->cmd_id, job->op, &job->err_origin);
+    if (job->res == TEEC_SUCCESS && executed_hook != NULL) {
+        executed_hook(job->cmd_id, job->op);
+    }
+    if (len > 0) {
+        job->op->params[0].tmpref = msg;
+    }
+}
+
+/*
+ * 工作线程：取空队列后先声明要睡眠，再复查pending，生产者入队后检查
+ * sleeping，两边都是顺序一致的原子操作，至少一方能看到对方，不会丢失唤醒。
+ */
+static void *shard_worker(void *arg) {
+    struct shard *s = arg;
+
+    for (;;) {
+        struct tc_shard_job *job;
+
+        sched_ingest(s);
+        job = sched_dequeue(s->sched);
+        if (job == NULL) {
+            if (__atomic_load_n(&s->pending, __ATOMIC_SEQ_CST) > 0) {
+                /* 生产者正在链入节点，稍后即可取出 */
+                sched_yield();
+                continue;
+            }
+            /* 没有排队的请求，聚合签名窗口到此结束 */
+            if (s->held_head != NULL) {
+                seal_window(s);
+                continue;
+            }
+            if (__atomic_load_n(&s->stopping, __ATOMIC_ACQUIRE)) {
+                break;
+            }
+            __atomic_store_n(&s->sleeping, 1, __ATOMIC_SEQ_CST);
+            if (__atomic_load_n(&s->pending, __ATOMIC_SEQ_CST) > 0 ||
+                __atomic_load_n(&s->stopping, __ATOMIC_ACQUIRE)) {
+                __atomic_store_n(&s->sleeping, 0, __ATOMIC_SEQ_CST);
+                continue;
+            }
+            eventfd_drain(s->efd);
+            __atomic_store_n(&s->sleeping, 0, __ATOMIC_SEQ_CST);
+            continue;
+        }
+        release_admission(s, job->rep_id, tc_shard_class_of(job->cmd_id));
+
+        /*
+         * 读请求返回的链头必须对应已交付的区块；窗口可能放不下本请求的
+         * 区块时也先结束窗口
+         */
+        if (s->held_head != NULL &&
+            (tc_shard_class_of(job->cmd_id) == TC_CLASS_READ ||
+             s->batch->leaf_count + JOB_MAX_BLOCKS > s->batch_window)) {
+            seal_window(s);
+        }
+
+        /* 同一会话上的调用由本线程串行执行，调度顺序即执行顺序 */
+        invoke_job(s, job);
+        if (job->res == TEEC_SUCCESS && s->batch_window > 0 && hold_job(s, job)) {
+            continue;
+        }
+        finish_job(job);
+    }
+    return NULL;
+}
+
+static void wake_worker(struct shard *s) {
+    if (__atomic_exchange_n(&s->sleeping, 0, __ATOMIC_SEQ_CST)) {
+        eventfd_signal(s->efd);
+    }
+}
+
+static int open_shard(struct shard *s, unsigned int index, uint32_t sign_alg,
+                      uint32_t batch_window) {
+    TEEC_UUID uuid = TA_TRUST_CHAIN_UUID;
+    TEEC_Operation op;
+    uint32_t err_origin;
+    TEEC_Result res;
+
+    memset(s, 0, sizeof(*s));
+    s->index = index;
+    tc_mpsc_init(&s->queue);
+    s->efd = eventfd(0, EFD_CLOEXEC);
+    if (s->efd < 0) {
+        printf("Could not create eventfd for shard %u\n", index);
+        return -1;
+    }
+    s->sched = sched_create();
+    if (s->sched == NULL) {
+        printf("Could not allocate scheduler for shard %u\n", index);
+        return -1;
+    }
+    s->batch_window = batch_window;
+    if (batch_window > 0) {
+        s->batch = calloc(1, sizeof(*s->batch));
+        if (s->batch == NULL) {
+            printf("Could not allocate batch window for shard %u\n", index);
+            return -1;
+        }
+    }
+
+    /*
+     * 打开会话时告知TA实例自己的分片号（TA据此生成仓库ID）、签名算法偏好
+     * 和聚合签名窗口大小
+     */
+    memset(&op, 0, sizeof(op));
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_VALUE_INPUT,
+                                     TEEC_NONE, TEEC_NONE);
+    op.params[0].value.a = index;
+    op.params[0].value.b = sign_alg;
+    op.params[1].value.a = batch_window;
+
+    res = TEEC_OpenSession(&ctx, &s->sess, &uuid,
+                           TEEC_LOGIN_PUBLIC, NULL, &op, &err_origin);
+    if (res != TEEC_SUCCESS) {
+        printf("TEEC_OpenSession for shard %u failed with code 0x%x origin 0x%x\n",
+               index, res, err_origin);
+        return -1;
+    }
+    s->sess_open = 1;
+
+    if (pthread_create(&s->worker, NULL, shard_worker, s) != 0) {
+        printf("Could not create worker thread for shard %u\n", index);
+        return -1;
+    }
+    s->worker_started = 1;
+    return 0;
+}
+
+static void close_shard(struct shard *s) {
+    if (s->worker_started) {
+        __atomic_store_n(&s->stopping, 1, __ATOMIC_SEQ_CST);
+        eventfd_signal(s->efd);
+        pthread_join(s->worker, NULL);
+        s->worker_started = 0;
+    }
+    if (s->sess_open) {
+        TEEC_CloseSession(&s->sess);
+        s->sess_open = 0;
+    }
+    if (s->efd >= 0) {
+        close(s->efd);
+        s->efd = -1;
+    }
+    free(s->sched);
+    s->sched = NULL;
+    free(s->batch);
+    s->batch = NULL;
+}
+
+int tc_shards_init(unsigned int count, uint32_t sign_alg, uint32_t batch_window) {
+    TEEC_Result res;
+
+    if (shard_count > 0) {
+        return 0;
+    }
+    if (count == 0 || count > TC_MAX_SHARDS) {
+        printf("Invalid shard count %u, must be 1..%u\n", count, TC_MAX_SHARDS);
+        return -1;
+    }
+    if (batch_window != 0 && (batch_window < JOB_MAX_BLOCKS || batch_window > TC_MAX_BATCH_LEAVES)) {
+        printf("Invalid batch window %u, must be 0 or %u..%u\n",
+               batch_window, JOB_MAX_BLOCKS, TC_MAX_BATCH_LEAVES);
+        return -1;
+    }
+
+    res = TEEC_InitializeContext(NULL, &ctx);
+    if (res != TEEC_SUCCESS) {
+        printf("TEEC_InitializeContext failed with code 0x%x\n", res);
+        return -1;
+    }
+    ctx_initialized = 1;
+
+    if (result_hook != NULL) {
+        tc_mpsc_init(&result_queue);
+        result_stopping = 0;
+        result_efd = eventfd(0, EFD_CLOEXEC);
+        if (result_efd < 0 || pthread_create(&result_thread, NULL, result_worker, NULL) != 0) {
+            printf("Could not create result thread\n");
+            tc_shards_close();
+            return -1;
+        }
+        result_started = 1;
+    }
+
+    for (unsigned int i = 0; i < count; i++) {
+        if (open_shard(&shards[i], i, sign_alg, batch_window) != 0) {
+            close_shard(&shards[i]);
+            shard_count = i;
+            tc_shards_close();
+            return -1;
+        }
+    }
+    shard_count = count;
+    printf("Opened %u TA shard session(s)\n", count);
+    return 0;
+}
+
+void tc_shards_close(void) {
+    for (unsigned int i = 0; i < shard_count; i++) {
+        close_shard(&shards[i]);
+    }
+    shard_count = 0;
+    /* 工作线程都已退出，结果线程处理完队列中剩余的结果后结束 */
+    if (result_started) {
+        __atomic_store_n(&result_stopping, 1, __ATOMIC_RELEASE);
+        eventfd_signal(result_efd);
+        pthread_join(result_thread, NULL);
+        result_started = 0;
+    }
+    if (result_efd >= 0) {
+        close(result_efd);
+        result_efd = -1;
+    }
+    if (ctx_initialized) {
+        TEEC_FinalizeContext(&ctx);
+        ctx_initialized = 0;
+    }
+}
+
+void tc_shard_set_result_hook(tc_shard_result_hook hook) {
+    result_hook = hook;
+}
+
+void tc_shard_set_exec_hooks(tc_shard_prepare_hook prepare, tc_shard_executed_hook executed) {
+    prepare_hook = prepare;
+    executed_hook = executed;
+}
+
+/* 从请求消息头中取出仓库ID */
+static uint32_t msg_rep_id(const TEEC_Operation *op) {
+    struct tc_msg_hdr hdr;
+    if (op->params[0].tmpref.size < sizeof(hdr)) {
+        return 0;
+    }
+    memcpy(&hdr, op->params[0].tmpref.buffer, sizeof(hdr));
+    return hdr.rep_id;
+}
+
+int tc_shard_result_blocks(uint32_t cmd_id, const TEEC_Operation *op, uint32_t *rep_id,
+                           const uint8_t **blocks, size_t *len) {
+    size_t cap;
+    int param = result_param(cmd_id, &cap);
+    const TEEC_TempMemoryReference *out;
+
+    if (param < 0) {
+        return -1;
+    }
+    out = &op->params[param].tmpref;
+    *rep_id = cmd_id == TA_TRUST_CHAIN_CMD_INIT_REPO ? op->params[1].value.a : msg_rep_id(op);
+    *blocks = out->buffer;
+    *len = out->size;
+    return 0;
+}
+
+unsigned int tc_shard_count(void) {
+    return shard_count;
+}
+
+unsigned int tc_shard_for_repo(uint32_t rep_id) {
+    return REPO_ID_SHARD(rep_id);
+}
+
+unsigned int tc_shard_for_new_repo(void) {
+    unsigned int n = __atomic_fetch_add(&next_new_repo_shard, 1, __ATOMIC_RELAXED);
+    return n % shard_count;
+}
+
+void tc_shard_submit(unsigned int shard, struct tc_shard_job *job) {
+    if (shard >= shard_count) {
+        job->res = TEEC_ERROR_ITEM_NOT_FOUND;
+        job->err_origin = TEEC_ORIGIN_API;
+        complete_job(job);
+        return;
+    }
+    struct shard *s = &shards[shard];
+
+    if (admit(s, job->rep_id, tc_shard_class_of(job->cmd_id)) != 0) {
+        job->res = TEEC_ERROR_BUSY;
+        job->err_origin = TEEC_ORIGIN_API;
+        complete_job(job);
+        return;
+    }
+    tc_mpsc_push(&s->queue, &job->node);
+    __atomic_add_fetch(&s->pending, 1, __ATOMIC_SEQ_CST);
+    wake_worker(s);
+}
+
+/* 每个同步调用线程一个完成队列，线程退出时关闭其eventfd */
+static pthread_key_t sync_cq_key;
+static pthread_once_t sync_cq_once = PTHREAD_ONCE_INIT;
+
+static void sync_cq_free(void *arg) {
+    tc_cq_destroy(arg);
+    free(arg);
+}
+
+static void sync_cq_key_init(void) {
+    pthread_key_create(&sync_cq_key, sync_cq_free);
+}
+
+static struct tc_completion_queue *sync_cq(void) {
+    struct tc_completion_queue *cq;
+
+    pthread_once(&sync_cq_once, sync_cq_key_init);
+    cq = pthread_getspecific(sync_cq_key);
+    if (cq == NULL) {
+        cq = malloc(sizeof(*cq));
+        if (cq == NULL) {
+            return NULL;
+        }
+        if (tc_cq_init(cq) != 0) {
+            free(cq);
+            return NULL;
+        }
+        pthread_setspecific(sync_cq_key, cq);
+    }
+    return cq;
+}
+
+static TEEC_Result invoke_sync(unsigned int shard, uint32_t rep_id, uint32_t cmd_id,
+                               TEEC_Operation *op, uint32_t *err_origin) {
+    struct tc_completion_queue *cq = sync_cq();
+    struct tc_shard_job job;
+
+    if (cq == NULL) {
+        if (err_origin) {
+            *err_origin = TEEC_ORIGIN_API;
+        }
+        return TEEC_ERROR_OUT_OF_MEMORY;
+    }
+
+    memset(&job, 0, sizeof(job));
+    job.rep_id = rep_id;
+    job.cmd_id = cmd_id;
+    job.op = op;
+    job.cq = cq;
+    tc_shard_submit(shard, &job);
+
+    /*
+     * 本线程同时只有这一个请求在途：先等eventfd通知，工作线程写完eventfd后
+     * 不再访问本线程的完成队列，线程退出时可以安全关闭它
+     */
+    eventfd_drain(cq->efd);
+    while (tc_cq_pop(cq) == NULL) {
+        sched_yield();
+    }
+    if (err_origin) {
+        *err_origin = job.err_origin;
+    }
+    /* 本请求的区块已进入视图和区块日志后才返回，调用者随后可以等它落盘 */
+    if (job.res == TEEC_SUCCESS && job.result_seq != 0) {
+        wait_result(job.result_seq);
+    }
+    return job.res;
+}
+
+TEEC_Result tc_shards_invoke_all(uint32_t cmd_id, TEEC_Operation *ops, uint32_t *err_origin) {
+    struct tc_completion_queue *cq = sync_cq();
+    struct tc_shard_job jobs[TC_MAX_SHARDS];
+    unsigned int count = shard_count;
+    uint64_t signaled = 0;
+    unsigned int done = 0;
+    TEEC_Result res = TEEC_SUCCESS;
+
+    if (err_origin) {
+        *err_origin = TEEC_ORIGIN_API;
+    }
+    if (cq == NULL) {
+        return TEEC_ERROR_OUT_OF_MEMORY;
+    }
+
+    memset(jobs, 0, sizeof(jobs));
+    for (unsigned int i = 0; i < count; i++) {
+        jobs[i].cmd_id = cmd_id;
+        jobs[i].op = &ops[i];
+        jobs[i].cq = cq;
+        tc_shard_submit(i, &jobs[i]);
+    }
+
+    /* 等到每个请求都写过eventfd，工作线程才不再访问本线程的完成队列 */
+    while (signaled < count || done < count) {
+        struct tc_shard_job *job;
+        uint64_t n;
+
+        while ((job = tc_cq_pop(cq)) != NULL) {
+            done++;
+            if (job->res != TEEC_SUCCESS && res == TEEC_SUCCESS) {
+                res = job->res;
+                if (err_origin) {
+                    *err_origin = job->err_origin;
+                }
+            }
+        }
+        if (signaled < count) {
+            if (read(cq->efd, &n, sizeof(n)) == sizeof(n)) {
+                signaled += n;
+            }
+        } else if (done < count) {
+            sched_yield();
+        }
+    }
+    return res;
+}
+
+TEEC_Result tc_shard_invoke(unsigned int shard, uint32_t cmd_id,
+                            TEEC_Operation *op, uint32_t *err_origin) {
+    return invoke_sync(shard, 0, cmd_id, op, err_origin);
+}
+
+TEEC_Result tc_repo_invoke(uint32_t rep_id, uint32_t cmd_id,
+                           TEEC_Operation *op, uint32_t *err_origin) {
+    return invoke_sync(tc_shard_for_repo(rep_id), rep_id, cmd_id, op, err_origin);
+}
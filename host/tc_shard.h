@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#ifndef TC_SHARD_H
+#define TC_SHARD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <tee_client_api.h>
+
+#include "tc_mpsc.h"
+
+/*
+ * 仓库分片：TA未设置TA_FLAG_SINGLE_INSTANCE，每个会话对应一个独立的TA实例。
+ * CA为每个分片打开一个会话，并配一个专门调用TEE的工作线程和一个无锁的
+ * 多生产者单消费者队列。仓库ID中带有分片号（见trust_chain_ta.h中的
+ * REPO_ID_SHARD），同一仓库的请求总是进入同一分片；不同分片的请求在
+ * 不同的安全世界核上并行执行。
+ *
+ * 分片内按（仓库，请求类别）分流，工作线程以加权公平排队（起始时间公平
+ * 排队，SFQ）在各流之间调度：每个仓库各类别的请求按权重分享TA，同一流内
+ * 保持到达顺序。提交时做准入控制：分片内每个类别、每个流排队的请求数都有
+ * 上限，超出时请求不入队，直接以TEEC_ERROR_BUSY完成，调用者应返回503。
+ *
+ * 提交请求的线程不持锁、不进入TEE：请求入队后即可处理其他网络I/O，
+ * 完成的请求被放进提交时指定的完成队列，并通过该队列的eventfd通知，
+ * 因此完成事件可以和套接字一起放进epoll/io_uring等待。
+ */
+
+/* 完成队列：消费者单线程，eventfd可读表示有请求完成 */
+struct tc_completion_queue {
+    struct tc_mpsc_queue q;
+    int efd;
+};
+
+int tc_cq_init(struct tc_completion_queue *cq);
+void tc_cq_destroy(struct tc_completion_queue *cq);
+
+/* 取出一个已完成的请求，没有则返回NULL；读eventfd清零计数由调用者负责 */
+struct tc_shard_job *tc_cq_pop(struct tc_completion_queue *cq);
+
+/*
+ * 一次TA调用，从提交到从完成队列取出期间由调用者保持有效；
+ * 完成队列要比所有在途请求活得更久。
+ */
+struct tc_shard_job {
+    struct tc_mpsc_node node;       /* 以下三项内部使用 */
+    struct tc_shard_job *sched_next;
+    uint64_t start_tag;
+    uint32_t rep_id;                /* 调度用的仓库ID，不属于某个仓库的请求为0 */
+    uint32_t cmd_id;
+    TEEC_Operation *op;
+    struct tc_completion_queue *cq;
+    void *user;                     /* 调用者的上下文 */
+    TEEC_Result res;
+    uint32_t err_origin;
+    uint64_t result_seq;            /* 交给结果线程的结果编号，没有为0（内部使用） */
+};
+
+/* 请求类别，决定调度权重和排队上限 */
+enum tc_shard_class {
+    TC_CLASS_READ,                  /* 查询最新哈希、分支头、TEE公钥 */
+    TC_CLASS_WRITE,                 /* commit */
+    TC_CLASS_ACL,                   /* 权限变更与仓库创建、删除 */
+    TC_CLASS_COUNT,
+};
+
+enum tc_shard_class tc_shard_class_of(uint32_t cmd_id);
+
+/*
+ * 异步提交到指定分片，分片号不存在时直接以TEEC_ERROR_ITEM_NOT_FOUND完成，
+ * 队列已满时直接以TEEC_ERROR_BUSY完成（err_origin为TEEC_ORIGIN_API）
+ */
+void tc_shard_submit(unsigned int shard, struct tc_shard_job *job);
+
+/*
+ * 打开count个分片会话并启动工作线程，成功返回0。sign_alg为TEE签名密钥
+ * 首次生成时使用的算法（TC_SIG_ALG_*，0为TA默认），已有密钥不受影响。
+ * batch_window非0时启用聚合签名：工作线程连续执行排队的请求，TA只记录
+ * 区块哈希，排队请求执行完、遇到读请求或窗口内区块数达到batch_window时，
+ * TA对这些区块哈希的Merkle根签名一次，工作线程填入各区块的包含证明后
+ * 再交付和调用结果钩子。
+ */
+int tc_shards_init(unsigned int count, uint32_t sign_alg, uint32_t batch_window);
+
+/* 停止工作线程并关闭全部会话 */
+void tc_shards_close(void);
+
+unsigned int tc_shard_count(void);
+
+/* 仓库ID对应的分片 */
+unsigned int tc_shard_for_repo(uint32_t rep_id);
+
+/* 为新仓库选择分片（轮转） */
+unsigned int tc_shard_for_new_repo(void);
+
+/*
+ * 在指定分片上同步执行TA命令：经本线程的完成队列提交，阻塞在其eventfd上
+ * 直到完成；产生区块的命令成功时，还要等结果钩子处理完本次的区块（已
+ * 追加到区块日志，tc_blocklog_sync即可等它落盘）。分片号不存在时返回TEEC_ERROR_ITEM_NOT_FOUND，队列已满时返回
+ * TEEC_ERROR_BUSY。请求不属于某个仓库，与其他这类请求共用一个流。
+ */
+TEEC_Result tc_shard_invoke(unsigned int shard, uint32_t cmd_id,
+                            TEEC_Operation *op, uint32_t *err_origin);
+
+/*
+ * 在每个分片上执行同一条TA命令（ops[i]用于第i个分片，共tc_shard_count()个），
+ * 各分片并行执行，全部完成后返回；有失败时返回第一个失败的结果。
+ */
+TEEC_Result tc_shards_invoke_all(uint32_t cmd_id, TEEC_Operation *ops, uint32_t *err_origin);
+
+/*
+ * 产生区块的TA命令成功后调用的钩子，blocks为TA新签发区块的副本。钩子在
+ * 单独的结果线程上运行，不阻塞分片工作线程；各分片按执行顺序入队，因此
+ * 同一仓库的结果按TA执行顺序到达。同步调用（tc_repo_invoke等）等钩子
+ * 处理完本次结果才返回，异步提交的请求则可能先于钩子完成。钩子内不能
+ * 同步调用TA。须在tc_shards_init之前设置。
+ */
+typedef void (*tc_shard_result_hook)(uint32_t cmd_id, uint32_t rep_id,
+                                     const uint8_t *blocks, size_t len);
+void tc_shard_set_result_hook(tc_shard_result_hook hook);
+
+/*
+ * 命令进入TEE前后由分片工作线程调用的钩子，供需要与TA状态逐条同步的结构
+ * 使用。prepare可以把补充了字段的请求消息写进msg（TC_MAX_PROVEN_MSG_SIZE
+ * 字节）并返回其长度，本次调用期间params[0]改为指向msg；返回0时使用原消息；
+ * 返回TC_SHARD_PREPARE_FAILED时命令不进入TEE，以TC_ERROR_PREPARE_FAILED
+ * （err_origin为TEEC_ORIGIN_API）完成，调用者应返回503。
+ * executed在命令成功后立即调用，早于聚合签名窗口结束和结果钩子，此时区块
+ * 的签名字段可能还是占位。
+ */
+#define TC_SHARD_PREPARE_FAILED ((size_t)-1)
+#define TC_ERROR_PREPARE_FAILED 0x80000100   /* CA自定义，不与TA的TC_ERROR_*重叠 */
+
+typedef size_t (*tc_shard_prepare_hook)(uint32_t cmd_id, const TEEC_Operation *op, uint8_t *msg);
+typedef void (*tc_shard_executed_hook)(uint32_t cmd_id, const TEEC_Operation *op);
+void tc_shard_set_exec_hooks(tc_shard_prepare_hook prepare, tc_shard_executed_hook executed);
+
+/*
+ * 从成功的TA命令结果中取出仓库ID与TA新签发的区块（连续编码，见
+ * trust_chain_abi.h）。不产生区块的命令返回-1。
+ */
+int tc_shard_result_blocks(uint32_t cmd_id, const TEEC_Operation *op, uint32_t *rep_id,
+                           const uint8_t **blocks, size_t *len);
+
+/* 按仓库ID路由并调度的便捷函数 */
+TEEC_Result tc_repo_invoke(uint32_t rep_id, uint32_t cmd_id,
+                           TEEC_Operation *op, uint32_t *err_origin);
+
+#endif /* TC_SHARD_H */
@@ -0,0 +1,266 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "tc_smt.h"
+#include "tc_sha256.h"
+
+/*
+ * 叶子的depth为TC_SMT_DEPTH；分叉节点的depth为两侧子树分开的位，
+ * key取其下任一叶子的fp，前depth位即公共前缀。
+ */
+struct smt_node {
+    struct smt_node *child[2];
+    uint16_t depth;
+    uint8_t role;
+    uint8_t key[TC_HASH_SIZE];
+    uint8_t hash[TC_HASH_SIZE];     /* 深度depth处的哈希 */
+    uint8_t top[TC_HASH_SIZE];      /* 上移到父节点下一层（根节点为深度0）后的哈希 */
+};
+
+struct tc_smt {
+    struct smt_node *root;
+    uint32_t count;
+};
+
+static int bit_at(const uint8_t *bits, uint32_t i) {
+    return (bits[i / 8] >> (7 - i % 8)) & 1;
+}
+
+/* a与b在[from, to)内第一个不同的位，没有则返回to */
+static uint32_t first_diff(const uint8_t *a, const uint8_t *b, uint32_t from, uint32_t to) {
+    for (uint32_t i = from; i < to; i++) {
+        if (bit_at(a, i) != bit_at(b, i)) {
+            return i;
+        }
+    }
+    return to;
+}
+
+static void node_hash(const uint8_t *left, const uint8_t *right, uint8_t *out) {
+    static const uint8_t prefix = TC_MERKLE_NODE_PREFIX;
+    struct tc_sha256_ctx c;
+
+    tc_sha256_init(&c);
+    tc_sha256_update(&c, &prefix, 1);
+    tc_sha256_update(&c, left, TC_HASH_SIZE);
+    tc_sha256_update(&c, right, TC_HASH_SIZE);
+    tc_sha256_final(&c, out);
+}
+
+/*
+ * 节点的子树只有一侧非空，沿压缩路径从depth上移到深度to。只有一个成员的
+ * 子树即为该成员的叶子，上移不变；分叉节点每上移一层哈希一次。
+ */
+static void chain_up(const struct smt_node *n, uint32_t to, uint8_t *out) {
+    static const uint8_t empty[TC_HASH_SIZE];
+    uint8_t h[TC_HASH_SIZE];
+
+    memcpy(h, n->hash, TC_HASH_SIZE);
+    for (uint32_t i = n->depth; i > to && n->depth < TC_SMT_DEPTH; i--) {
+        if (bit_at(n->key, i - 1)) {
+            node_hash(empty, h, h);
+        } else {
+            node_hash(h, empty, h);
+        }
+    }
+    memcpy(out, h, TC_HASH_SIZE);
+}
+
+/* 子节点已更新后，重算节点自身的哈希和上移到深度top的哈希 */
+static void refresh(struct smt_node *n, uint32_t top) {
+    if (n->depth == TC_SMT_DEPTH) {
+        static const uint8_t prefix = TC_MERKLE_LEAF_PREFIX;
+        struct tc_sha256_ctx c;
+
+        tc_sha256_init(&c);
+        tc_sha256_update(&c, &prefix, 1);
+        tc_sha256_update(&c, n->key, TC_HASH_SIZE);
+        tc_sha256_update(&c, &n->role, 1);
+        tc_sha256_final(&c, n->hash);
+    } else {
+        node_hash(n->child[0]->top, n->child[1]->top, n->hash);
+    }
+    chain_up(n, top, n->top);
+}
+
+static struct smt_node *new_leaf(const uint8_t *fp, uint8_t role) {
+    struct smt_node *leaf = calloc(1, sizeof(*leaf));
+
+    if (leaf != NULL) {
+        leaf->depth = TC_SMT_DEPTH;
+        leaf->role = role;
+        memcpy(leaf->key, fp, TC_HASH_SIZE);
+    }
+    return leaf;
+}
+
+static void free_nodes(struct smt_node *n) {
+    if (n == NULL) {
+        return;
+    }
+    free_nodes(n->child[0]);
+    free_nodes(n->child[1]);
+    free(n);
+}
+
+/*
+ * 在上移到深度top的子树n中设置fp，返回新的子树（可能为NULL）。
+ * 分叉节点的一侧删空时由另一侧子树顶替。
+ */
+static struct smt_node *set_node(struct tc_smt *t, struct smt_node *n, uint32_t top,
+                                 const uint8_t *fp, uint8_t role, int *err) {
+    if (n == NULL) {
+        struct smt_node *leaf;
+        if (role == 0) {
+            return NULL;
+        }
+        if ((leaf = new_leaf(fp, role)) == NULL) {
+            *err = -1;
+            return NULL;
+        }
+        refresh(leaf, top);
+        t->count++;
+        return leaf;
+    }
+
+    uint32_t p = first_diff(n->key, fp, top, n->depth);
+    if (p < n->depth) {
+        /* fp在n的压缩路径中途分开，不在树中 */
+        struct smt_node *leaf, *fork;
+        if (role == 0) {
+            return n;
+        }
+        leaf = new_leaf(fp, role);
+        fork = calloc(1, sizeof(*fork));
+        if (leaf == NULL || fork == NULL) {
+            free(leaf);
+            free(fork);
+            *err = -1;
+            return n;
+        }
+        fork->depth = p;
+        memcpy(fork->key, fp, TC_HASH_SIZE);
+        fork->child[bit_at(fp, p)] = leaf;
+        fork->child[!bit_at(fp, p)] = n;
+        refresh(leaf, p + 1);
+        refresh(n, p + 1);
+        refresh(fork, top);
+        t->count++;
+        return fork;
+    }
+
+    if (n->depth == TC_SMT_DEPTH) {
+        if (role == 0) {
+            free(n);
+            t->count--;
+            return NULL;
+        }
+        n->role = role;
+        refresh(n, top);
+        return n;
+    }
+
+    int b = bit_at(fp, n->depth);
+    struct smt_node *c = set_node(t, n->child[b], n->depth + 1, fp, role, err);
+    if (c == NULL) {
+        struct smt_node *other = n->child[!b];
+        free(n);
+        refresh(other, top);
+        return other;
+    }
+    n->child[b] = c;
+    refresh(n, top);
+    return n;
+}
+
+struct tc_smt *tc_smt_new(void) {
+    return calloc(1, sizeof(struct tc_smt));
+}
+
+void tc_smt_free(struct tc_smt *t) {
+    if (t != NULL) {
+        free_nodes(t->root);
+        free(t);
+    }
+}
+
+int tc_smt_set(struct tc_smt *t, const uint8_t *fp, uint8_t role) {
+    int err = 0;
+
+    t->root = set_node(t, t->root, 0, fp, role, &err);
+    return err;
+}
+
+void tc_smt_root(const struct tc_smt *t, uint8_t *root) {
+    if (t->root == NULL) {
+        memset(root, 0, TC_HASH_SIZE);
+    } else {
+        memcpy(root, t->root->top, TC_HASH_SIZE);
+    }
+}
+
+uint32_t tc_smt_count(const struct tc_smt *t) {
+    return t->count;
+}
+
+/*
+ * 自根向下沿fp的路径收集非空兄弟，按自叶向根的顺序写出。路径终点是另一
+ * 成员独占的子树（非成员），或最深的兄弟只有一个成员（成员）时，在末尾
+ * 附上该成员的fp和角色。
+ */
+size_t tc_smt_prove(const struct tc_smt *t, const uint8_t *fp, uint8_t *out) {
+    uint8_t siblings[TC_SMT_DEPTH][TC_HASH_SIZE];
+    uint8_t *bitmap = out + 1;
+    const struct smt_node *n = t->root;
+    const struct smt_node *last_sibling = NULL;
+    const struct smt_node *other = NULL;
+    uint32_t top = 0;
+    size_t len;
+
+    out[0] = 0;
+    memset(bitmap, 0, TC_SMT_BITMAP_SIZE);
+    while (n != NULL) {
+        uint32_t p = first_diff(n->key, fp, top, n->depth);
+        if (n->depth == TC_SMT_DEPTH) {
+            if (p < n->depth) {
+                other = n;
+            } else {
+                out[0] = n->role;
+                if (last_sibling != NULL && last_sibling->depth == TC_SMT_DEPTH) {
+                    other = last_sibling;
+                }
+            }
+            break;
+        }
+        if (p < n->depth) {
+            chain_up(n, p + 1, siblings[p]);
+            bitmap[p / 8] |= 0x80 >> (p % 8);
+            break;
+        }
+        int b = bit_at(fp, n->depth);
+        last_sibling = n->child[!b];
+        memcpy(siblings[n->depth], last_sibling->top, TC_HASH_SIZE);
+        bitmap[n->depth / 8] |= 0x80 >> (n->depth % 8);
+        top = n->depth + 1;
+        n = n->child[b];
+    }
+
+    len = 1 + TC_SMT_BITMAP_SIZE;
+    for (int i = TC_SMT_DEPTH - 1; i >= 0; i--) {
+        if (bit_at(bitmap, i)) {
+            memcpy(out + len, siblings[i], TC_HASH_SIZE);
+            len += TC_HASH_SIZE;
+        }
+    }
+    if (other != NULL) {
+        memcpy(out + len, other->key, TC_HASH_SIZE);
+        out[len + TC_HASH_SIZE] = other->role;
+        len += TC_SMT_LEAF_SIZE;
+    }
+    return len;
+}
@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#ifndef TC_SMT_H
+#define TC_SMT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <trust_chain_abi.h>
+
+/*
+ * 成员集合的稀疏Merkle树（格式见trust_chain_abi.h）的节点，由CA保存，
+ * TA只保存根。树高256层，按路径压缩存储：只保留叶子和两侧都非空的分叉
+ * 节点，每个节点缓存自身的哈希和沿压缩路径上移到父节点下一层的哈希。
+ * 只有一个成员的子树即为该成员的叶子，修改一个成员只在路径上的分叉节点
+ * 各哈希一次；生成证明只沿分叉节点取兄弟哈希，证明的键不在树中、路径在
+ * 分叉节点的压缩段中途分开时，才需要现算一段。
+ * 不加锁，由调用者串行化写操作。
+ */
+struct tc_smt;
+
+struct tc_smt *tc_smt_new(void);
+void tc_smt_free(struct tc_smt *t);
+
+/* 设置fp的角色（ROLE_ADMIN/ROLE_WRITER），role为0时移除；内存不足返回-1，树不变 */
+int tc_smt_set(struct tc_smt *t, const uint8_t *fp, uint8_t role);
+
+/* 当前的根，空树为全0 */
+void tc_smt_root(const struct tc_smt *t, uint8_t *root);
+
+uint32_t tc_smt_count(const struct tc_smt *t);
+
+/* fp的成员证明，out至少TC_SMT_MAX_PROOF_SIZE字节，返回证明长度 */
+size_t tc_smt_prove(const struct tc_smt *t, const uint8_t *fp, uint8_t *out);
+
+#endif /* TC_SMT_H */
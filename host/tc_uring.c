@@ -0,0 +1,606 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+
+#include "tc_uring.h"
+
+#ifdef TC_HAVE_IO_URING
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <linux/io_uring.h>
+
+#include "tc_mpsc.h"
+
+/* 直接使用io_uring系统调用，不依赖liburing */
+
+#define RING_ENTRIES    256
+#define BUF_COUNT       256         /* 缓冲环大小，必须是2的幂 */
+#define BUF_SIZE        4096        /* 与线程后端的请求缓冲一样大 */
+#define BUF_GROUP       0
+
+/* user_data低3位是操作类型，其余是连接指针（至少8字节对齐） */
+enum op_kind {
+    OP_ACCEPT,
+    OP_RECV,
+    OP_SEND,
+    OP_CLOSE,
+    OP_WAKE,
+};
+#define OP_MASK 7ULL
+
+struct response {
+    char *data;
+    size_t len;
+    size_t cap;
+    int failed;                     /* 内存不足，不发送残缺的响应 */
+};
+
+struct conn {
+    struct tc_mpsc_node node;       /* 处理完后交回事件循环 */
+    struct conn *next;              /* 工作队列或等待缓冲区的连接 */
+    int fd;
+    int bid;                        /* 占用的接收缓冲区，-1表示没有 */
+    char *request;
+    struct response resp;
+};
+
+struct ring {
+    int fd;
+    unsigned int entries;
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int sq_mask;
+    unsigned int sq_local_tail;     /* 已填好、尚未发布给内核的位置 */
+    struct io_uring_sqe *sqes;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int cq_mask;
+    struct io_uring_cqe *cqes;
+    void *ring_ptr;
+    size_t ring_size;
+    size_t sqes_size;
+};
+
+static struct ring ring;
+static struct io_uring_buf_ring *buf_ring;
+static char *bufs;
+static unsigned short buf_ring_tail;
+static struct conn *starved_head;   /* 收到-ENOBUFS、等待缓冲区的连接 */
+static struct conn *starved_tail;
+
+static int listen_fd;
+static int wake_fd;
+static uint64_t wake_count;
+static struct tc_mpsc_queue done_queue;
+
+static tc_uring_handler request_handler;
+static tc_uring_stream_filter stream_filter;
+
+static pthread_mutex_t jobs_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t jobs_cond = PTHREAD_COND_INITIALIZER;
+static struct conn *jobs_head;
+static struct conn *jobs_tail;
+
+static __thread struct response *current_response;
+
+static int ring_setup(unsigned int entries) {
+    struct io_uring_params p;
+    size_t sq_size, cq_size;
+    unsigned int *sq_array;
+    char *ptr;
+
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_COOP_TASKRUN;
+    ring.fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (ring.fd < 0 && errno == EINVAL) {
+        memset(&p, 0, sizeof(p));
+        ring.fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    }
+    if (ring.fd < 0) {
+        return -1;
+    }
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_NODROP)) {
+        close(ring.fd);
+        errno = ENOSYS;
+        return -1;
+    }
+
+    sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    ring.ring_size = sq_size > cq_size ? sq_size : cq_size;
+    ring.ring_ptr = mmap(NULL, ring.ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING);
+    if (ring.ring_ptr == MAP_FAILED) {
+        close(ring.fd);
+        return -1;
+    }
+    ring.sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring.sqes = mmap(NULL, ring.sqes_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES);
+    if (ring.sqes == MAP_FAILED) {
+        munmap(ring.ring_ptr, ring.ring_size);
+        close(ring.fd);
+        return -1;
+    }
+
+    ptr = ring.ring_ptr;
+    ring.entries = p.sq_entries;
+    ring.sq_head = (unsigned int *)(ptr + p.sq_off.head);
+    ring.sq_tail = (unsigned int *)(ptr + p.sq_off.tail);
+    ring.sq_mask = *(unsigned int *)(ptr + p.sq_off.ring_mask);
+    ring.sq_local_tail = *ring.sq_tail;
+    ring.cq_head = (unsigned int *)(ptr + p.cq_off.head);
+    ring.cq_tail = (unsigned int *)(ptr + p.cq_off.tail);
+    ring.cq_mask = *(unsigned int *)(ptr + p.cq_off.ring_mask);
+    ring.cqes = (struct io_uring_cqe *)(ptr + p.cq_off.cqes);
+
+    /* SQ下标数组固定为恒等映射，之后只需推进tail */
+    sq_array = (unsigned int *)(ptr + p.sq_off.array);
+    for (unsigned int i = 0; i < p.sq_entries; i++) {
+        sq_array[i] = i;
+    }
+    return 0;
+}
+
+static void ring_teardown(void) {
+    munmap(ring.sqes, ring.sqes_size);
+    munmap(ring.ring_ptr, ring.ring_size);
+    close(ring.fd);
+}
+
+/* 发布已填好的SQE，wait_nr > 0时同时等待完成事件 */
+static int ring_enter(unsigned int wait_nr) {
+    unsigned int to_submit;
+    int ret;
+
+    __atomic_store_n(ring.sq_tail, ring.sq_local_tail, __ATOMIC_RELEASE);
+    to_submit = ring.sq_local_tail - __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE);
+    if (to_submit == 0 && wait_nr == 0) {
+        return 0;
+    }
+    do {
+        ret = (int)syscall(__NR_io_uring_enter, ring.fd, to_submit, wait_nr,
+                           wait_nr ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    } while (ret < 0 && errno == EINTR);
+    /* 完成队列暂时满：先收割再提交 */
+    if (ret < 0 && (errno == EBUSY || errno == EAGAIN)) {
+        return 0;
+    }
+    return ret < 0 ? -1 : 0;
+}
+
+static unsigned int sq_space(void) {
+    return ring.entries - (ring.sq_local_tail - __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE));
+}
+
+static struct io_uring_sqe *ring_get_sqe(void) {
+    struct io_uring_sqe *sqe;
+
+    if (sq_space() == 0) {
+        ring_enter(0);
+        if (sq_space() == 0) {
+            return NULL;
+        }
+    }
+    sqe = &ring.sqes[ring.sq_local_tail & ring.sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    ring.sq_local_tail++;
+    return sqe;
+}
+
+static uint64_t op_data(struct conn *c, enum op_kind kind) {
+    return (uint64_t)(uintptr_t)c | kind;
+}
+
+static int buf_ring_setup(void) {
+    struct io_uring_buf_reg reg;
+    size_t ring_size = BUF_COUNT * sizeof(struct io_uring_buf);
+
+    buf_ring = mmap(NULL, ring_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buf_ring == MAP_FAILED) {
+        return -1;
+    }
+    bufs = malloc((size_t)BUF_COUNT * BUF_SIZE);
+    if (bufs == NULL) {
+        munmap(buf_ring, ring_size);
+        return -1;
+    }
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)buf_ring;
+    reg.ring_entries = BUF_COUNT;
+    reg.bgid = BUF_GROUP;
+    if (syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        free(bufs);
+        munmap(buf_ring, ring_size);
+        return -1;
+    }
+
+    buf_ring_tail = 0;
+    for (int bid = 0; bid < BUF_COUNT; bid++) {
+        struct io_uring_buf *b = &buf_ring->bufs[buf_ring_tail & (BUF_COUNT - 1)];
+        b->addr = (uint64_t)(uintptr_t)(bufs + (size_t)bid * BUF_SIZE);
+        b->len = BUF_SIZE - 1;      /* 留一个字节放'\0' */
+        b->bid = (unsigned short)bid;
+        buf_ring_tail++;
+    }
+    __atomic_store_n(&buf_ring->tail, buf_ring_tail, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static void arm_accept(void) {
+    struct io_uring_sqe *sqe = ring_get_sqe();
+
+    if (sqe == NULL) {
+        return;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listen_fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = op_data(NULL, OP_ACCEPT);
+}
+
+static void arm_wake(void) {
+    struct io_uring_sqe *sqe = ring_get_sqe();
+
+    if (sqe == NULL) {
+        return;
+    }
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = wake_fd;
+    sqe->addr = (uint64_t)(uintptr_t)&wake_count;
+    sqe->len = sizeof(wake_count);
+    sqe->user_data = op_data(NULL, OP_WAKE);
+}
+
+static void conn_free(struct conn *c) {
+    free(c->resp.data);
+    free(c->request);
+    free(c);
+}
+
+/* 没有空闲SQE时同步关闭，保证连接不会泄漏 */
+static void arm_close(struct conn *c) {
+    struct io_uring_sqe *sqe = ring_get_sqe();
+
+    if (sqe == NULL) {
+        close(c->fd);
+        conn_free(c);
+        return;
+    }
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = c->fd;
+    sqe->user_data = op_data(c, OP_CLOSE);
+}
+
+static void arm_recv(struct conn *c) {
+    struct io_uring_sqe *sqe = ring_get_sqe();
+
+    if (sqe == NULL) {
+        close(c->fd);
+        conn_free(c);
+        return;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = c->fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUF_GROUP;
+    sqe->user_data = op_data(c, OP_RECV);
+}
+
+/* 响应发送和关闭链在一起提交；发送失败时内核取消关闭，由OP_CLOSE补上 */
+static void arm_send_close(struct conn *c) {
+    struct io_uring_sqe *send_sqe;
+    struct io_uring_sqe *close_sqe;
+
+    if (sq_space() < 2) {
+        ring_enter(0);
+    }
+    if (sq_space() < 2) {
+        /* 提交队列仍满（极少见）：在事件循环里同步发送 */
+        (void)send(c->fd, c->resp.data, c->resp.len, MSG_NOSIGNAL);
+        close(c->fd);
+        conn_free(c);
+        return;
+    }
+    send_sqe = ring_get_sqe();
+    send_sqe->opcode = IORING_OP_SEND;
+    send_sqe->fd = c->fd;
+    send_sqe->addr = (uint64_t)(uintptr_t)c->resp.data;
+    send_sqe->len = (uint32_t)c->resp.len;
+    send_sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+    send_sqe->flags = IOSQE_IO_LINK;
+    send_sqe->user_data = op_data(c, OP_SEND);
+
+    close_sqe = ring_get_sqe();
+    close_sqe->opcode = IORING_OP_CLOSE;
+    close_sqe->fd = c->fd;
+    close_sqe->user_data = op_data(c, OP_CLOSE);
+}
+
+static void recycle_buffer(int bid) {
+    struct io_uring_buf *b = &buf_ring->bufs[buf_ring_tail & (BUF_COUNT - 1)];
+    struct conn *c;
+
+    b->addr = (uint64_t)(uintptr_t)(bufs + (size_t)bid * BUF_SIZE);
+    b->len = BUF_SIZE - 1;
+    b->bid = (unsigned short)bid;
+    buf_ring_tail++;
+    __atomic_store_n(&buf_ring->tail, buf_ring_tail, __ATOMIC_RELEASE);
+
+    c = starved_head;
+    if (c != NULL) {
+        starved_head = c->next;
+        if (starved_head == NULL) {
+            starved_tail = NULL;
+        }
+        arm_recv(c);
+    }
+}
+
+static void *worker_thread(void *arg) {
+    (void)arg;
+
+    for (;;) {
+        struct conn *c;
+
+        pthread_mutex_lock(&jobs_lock);
+        while (jobs_head == NULL) {
+            pthread_cond_wait(&jobs_cond, &jobs_lock);
+        }
+        c = jobs_head;
+        jobs_head = c->next;
+        if (jobs_head == NULL) {
+            jobs_tail = NULL;
+        }
+        pthread_mutex_unlock(&jobs_lock);
+
+        current_response = &c->resp;
+        request_handler(c->fd, bufs + (size_t)c->bid * BUF_SIZE);
+        current_response = NULL;
+
+        tc_mpsc_push(&done_queue, &c->node);
+        uint64_t one = 1;
+        while (write(wake_fd, &one, sizeof(one)) < 0 && errno == EINTR) {
+        }
+    }
+    return NULL;
+}
+
+/* 长连接请求：与线程后端一样由独立线程直接读写套接字并负责关闭 */
+static void *stream_thread(void *arg) {
+    struct conn *c = arg;
+
+    request_handler(c->fd, c->request);
+    close(c->fd);
+    conn_free(c);
+    return NULL;
+}
+
+static void dispatch(struct conn *c, int bid, int len) {
+    char *request = bufs + (size_t)bid * BUF_SIZE;
+
+    request[len] = '\0';
+    if (stream_filter != NULL && stream_filter(request)) {
+        pthread_t thread;
+
+        /* 缓冲区只属于事件循环，复制后立即归还 */
+        c->request = strdup(request);
+        recycle_buffer(bid);
+        if (c->request == NULL ||
+            pthread_create(&thread, NULL, stream_thread, c) != 0) {
+            arm_close(c);
+            return;
+        }
+        pthread_detach(thread);
+        return;
+    }
+
+    c->bid = bid;
+    c->next = NULL;
+    pthread_mutex_lock(&jobs_lock);
+    if (jobs_tail != NULL) {
+        jobs_tail->next = c;
+    } else {
+        jobs_head = c;
+    }
+    jobs_tail = c;
+    pthread_cond_signal(&jobs_cond);
+    pthread_mutex_unlock(&jobs_lock);
+}
+
+/* 收割工作线程处理完的请求：归还接收缓冲区，提交发送+关闭 */
+static void drain_done(void) {
+    struct tc_mpsc_node *node;
+
+    while ((node = tc_mpsc_pop(&done_queue)) != NULL) {
+        struct conn *c = tc_mpsc_entry(node, struct conn, node);
+
+        recycle_buffer(c->bid);
+        c->bid = -1;
+        if (c->resp.len > 0 && !c->resp.failed) {
+            arm_send_close(c);
+        } else {
+            arm_close(c);
+        }
+    }
+}
+
+static void handle_cqe(const struct io_uring_cqe *cqe) {
+    struct conn *c = (struct conn *)(uintptr_t)(cqe->user_data & ~OP_MASK);
+
+    switch ((enum op_kind)(cqe->user_data & OP_MASK)) {
+    case OP_ACCEPT:
+        if (cqe->res >= 0) {
+            c = calloc(1, sizeof(*c));
+            if (c == NULL) {
+                close(cqe->res);
+            } else {
+                c->fd = cqe->res;
+                c->bid = -1;
+                arm_recv(c);
+            }
+        }
+        /* 多发accept被内核终止（出错或资源不足）时重新提交 */
+        if (!(cqe->flags & IORING_CQE_F_MORE)) {
+            arm_accept();
+        }
+        break;
+    case OP_RECV:
+        if (cqe->res > 0 && (cqe->flags & IORING_CQE_F_BUFFER)) {
+            dispatch(c, (int)(cqe->flags >> IORING_CQE_BUFFER_SHIFT), cqe->res);
+        } else if (cqe->res == -ENOBUFS) {
+            /* 缓冲区都在处理中的请求手里，等有缓冲区归还再收 */
+            c->next = NULL;
+            if (starved_tail != NULL) {
+                starved_tail->next = c;
+            } else {
+                starved_head = c;
+            }
+            starved_tail = c;
+        } else {
+            if (cqe->flags & IORING_CQE_F_BUFFER) {
+                recycle_buffer((int)(cqe->flags >> IORING_CQE_BUFFER_SHIFT));
+            }
+            arm_close(c);
+        }
+        break;
+    case OP_SEND:
+        /* 连接在链尾的关闭完成后释放 */
+        break;
+    case OP_CLOSE:
+        if (cqe->res == -ECANCELED) {
+            close(c->fd);
+        }
+        conn_free(c);
+        break;
+    case OP_WAKE:
+        drain_done();
+        arm_wake();
+        break;
+    }
+}
+
+int tc_uring_serve(int listen_socket, unsigned int workers,
+                   tc_uring_handler handler, tc_uring_stream_filter is_stream) {
+    if (workers == 0) {
+        workers = 1;
+    }
+    if (ring_setup(RING_ENTRIES) != 0) {
+        perror("io_uring_setup");
+        return -1;
+    }
+    if (buf_ring_setup() != 0) {
+        perror("io_uring buffer ring");
+        ring_teardown();
+        return -1;
+    }
+    wake_fd = eventfd(0, EFD_CLOEXEC);
+    if (wake_fd < 0) {
+        ring_teardown();
+        return -1;
+    }
+
+    listen_fd = listen_socket;
+    request_handler = handler;
+    stream_filter = is_stream;
+    tc_mpsc_init(&done_queue);
+
+    for (unsigned int i = 0; i < workers; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, worker_thread, NULL) != 0) {
+            printf("Could not create io_uring worker thread\n");
+            if (i == 0) {
+                close(wake_fd);
+                ring_teardown();
+                return -1;
+            }
+            break;
+        }
+        pthread_detach(thread);
+    }
+
+    arm_accept();
+    arm_wake();
+    printf("Network backend: io_uring (%u workers)\n", workers);
+
+    for (;;) {
+        unsigned int head, tail;
+
+        if (ring_enter(1) != 0) {
+            perror("io_uring_enter");
+            return -1;
+        }
+        head = *ring.cq_head;
+        tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            handle_cqe(&ring.cqes[head & ring.cq_mask]);
+            head++;
+            /* 逐个推进，处理中提交SQE时内核可以继续写入完成队列 */
+            __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+int tc_uring_capture(const void *data, size_t len) {
+    struct response *r = current_response;
+
+    if (r == NULL) {
+        return 0;
+    }
+    if (r->failed || len == 0) {
+        return 1;
+    }
+    if (r->len + len > r->cap) {
+        size_t cap = r->cap ? r->cap : 1024;
+        char *grown;
+        while (cap < r->len + len) {
+            cap *= 2;
+        }
+        grown = realloc(r->data, cap);
+        if (grown == NULL) {
+            r->failed = 1;
+            return 1;
+        }
+        r->data = grown;
+        r->cap = cap;
+    }
+    memcpy(r->data + r->len, data, len);
+    r->len += len;
+    return 1;
+}
+
+#else /* !TC_HAVE_IO_URING */
+
+int tc_uring_serve(int listen_socket, unsigned int workers,
+                   tc_uring_handler handler, tc_uring_stream_filter is_stream) {
+    (void)listen_socket;
+    (void)workers;
+    (void)handler;
+    (void)is_stream;
+    printf("io_uring backend not compiled in\n");
+    errno = ENOSYS;
+    return -1;
+}
+
+int tc_uring_capture(const void *data, size_t len) {
+    (void)data;
+    (void)len;
+    return 0;
+}
+
+#endif /* TC_HAVE_IO_URING */
@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#ifndef TC_URING_H
+#define TC_URING_H
+
+#include <stddef.h>
+
+/*
+ * 可选的io_uring网络后端（编译时定义TC_HAVE_IO_URING才可用）。
+ * 事件循环线程独占一个io_uring：多发accept（一次提交持续接受连接）、
+ * 从注册的缓冲环里取缓冲区接收请求、响应发送与关闭用IOSQE_IO_LINK串成
+ * 一条链，一次io_uring_enter同时提交和收割所有连接的I/O。
+ * 请求处理可能阻塞在TEE调用上，交给固定数量的工作线程执行；处理函数
+ * 写出的响应先缓存在内存里，处理完经无锁队列和eventfd交回事件循环发送。
+ * 长连接请求（SSE订阅）仍由独立线程直接读写套接字。
+ */
+
+/* 与每连接一个线程的后端相同：request以'\0'结尾，处理函数返回后连接被关闭 */
+typedef void (*tc_uring_handler)(int client_socket, const char *request);
+/* 返回非0表示该请求会长期占用连接，不进入工作线程池 */
+typedef int (*tc_uring_stream_filter)(const char *request);
+
+/*
+ * 在listen_socket上运行事件循环，不返回；io_uring不可用（未编译、
+ * 内核过旧或被禁用）或事件循环出错时返回-1，调用者可退回线程后端。
+ */
+int tc_uring_serve(int listen_socket, unsigned int workers,
+                   tc_uring_handler handler, tc_uring_stream_filter is_stream);
+
+/*
+ * 当前线程正在为io_uring后端处理请求时，把响应数据追加到该请求的
+ * 发送缓冲并返回1；否则返回0，调用者自己写套接字。
+ */
+int tc_uring_capture(const void *data, size_t len);
+
+#endif /* TC_URING_H */
@@ -0,0 +1,492 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <trust_chain_ta.h>
+#include <trust_chain_abi.h>
+
+#include "tc_view.h"
+#include "tc_codec.h"
+#include "tc_rcu.h"
+#include "tc_sha256.h"
+#include "tc_shard.h"
+#include "tc_pubkey.h"
+
+#define VIEW_SLOTS (TC_MAX_SHARDS * MAX_REPO_ID)
+
+/* 成员集合，多个快照共享，只在成员变化时复制；成员按规范公钥指纹比较 */
+struct view_acl {
+    unsigned int refs;
+    size_t count;
+    struct view_member {
+        char *key;                  /* 首次授权时的公钥文本 */
+        uint8_t fp[TC_HASH_SIZE];
+        uint32_t role;
+    } *members;
+};
+
+/* 分支链头表，多个快照共享，只在分支提交时复制 */
+struct view_branches {
+    unsigned int refs;
+    size_t count;
+    struct view_branch {
+        char name[MAX_BRANCH_LENGTH + 1];
+        uint8_t head[TC_HASH_SIZE];
+        uint32_t height;
+    } items[];
+};
+
+/* 一个仓库的不可变快照 */
+struct repo_view {
+    uint32_t rep_id;
+    uint64_t version;
+    uint32_t block_height;
+    uint8_t head[TC_HASH_SIZE];
+    struct view_acl *acl;
+    struct view_branches *branches;
+    struct tc_rcu_head rcu;
+};
+
+/* 按分片号与槽位索引，读者经tc_rcu_dereference读取 */
+static struct repo_view *views[VIEW_SLOTS];
+
+/* 写者串行化，也保护成员集合与分支表的引用计数：结果线程与回收线程持有 */
+static pthread_mutex_t view_write_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct view_acl empty_acl = { .refs = 1 };
+
+static size_t view_index(uint32_t rep_id) {
+    uint32_t slot = REPO_ID_SLOT(rep_id);
+    if (slot >= MAX_REPO_ID) {
+        return VIEW_SLOTS;
+    }
+    return REPO_ID_SHARD(rep_id) * MAX_REPO_ID + slot;
+}
+
+static void acl_put(struct view_acl *acl) {
+    if (acl == NULL || acl == &empty_acl || --acl->refs > 0) {
+        return;
+    }
+    for (size_t i = 0; i < acl->count; i++) {
+        free(acl->members[i].key);
+    }
+    free(acl->members);
+    free(acl);
+}
+
+static void branches_put(struct view_branches *branches) {
+    if (branches != NULL && --branches->refs == 0) {
+        free(branches);
+    }
+}
+
+static void view_free(struct repo_view *view) {
+    if (view != NULL) {
+        acl_put(view->acl);
+        branches_put(view->branches);
+        free(view);
+    }
+}
+
+/* 成员集合写时复制 */
+static struct view_acl *acl_clone(const struct view_acl *old) {
+    struct view_acl *acl = calloc(1, sizeof(*acl));
+    if (acl == NULL) {
+        return NULL;
+    }
+    acl->refs = 1;
+    acl->members = calloc(old->count > 0 ? old->count : 1, sizeof(*acl->members));
+    if (acl->members == NULL) {
+        free(acl);
+        return NULL;
+    }
+    for (size_t i = 0; i < old->count; i++) {
+        acl->members[i].role = old->members[i].role;
+        memcpy(acl->members[i].fp, old->members[i].fp, TC_HASH_SIZE);
+        acl->members[i].key = strdup(old->members[i].key);
+        if (acl->members[i].key == NULL) {
+            acl->count = i;
+            acl_put(acl);
+            return NULL;
+        }
+    }
+    acl->count = old->count;
+    return acl;
+}
+
+static struct view_member *acl_find(const struct view_acl *acl, const uint8_t *fp) {
+    for (size_t i = 0; i < acl->count; i++) {
+        if (memcmp(acl->members[i].fp, fp, TC_HASH_SIZE) == 0) {
+            return &acl->members[i];
+        }
+    }
+    return NULL;
+}
+
+/* 按Access区块更新成员：ADD设置角色（管理员兼有写权限），DELETE移除 */
+static int acl_apply(struct view_acl *acl, uint32_t op, uint32_t role,
+                     const char *key, size_t key_len) {
+    uint8_t fp[TC_HASH_SIZE];
+    struct view_member *member;
+
+    tc_pubkey_id(key, key_len, fp);
+    member = acl_find(acl, fp);
+
+    if (op == OP_ADD) {
+        if (member != NULL) {
+            member->role = role;
+            return 0;
+        }
+        struct view_member *members =
+            realloc(acl->members, (acl->count + 1) * sizeof(*acl->members));
+        if (members == NULL) {
+            return -1;
+        }
+        acl->members = members;
+        member = &acl->members[acl->count];
+        member->key = strndup(key, key_len);
+        if (member->key == NULL) {
+            return -1;
+        }
+        memcpy(member->fp, fp, TC_HASH_SIZE);
+        member->role = role;
+        acl->count++;
+    } else if (op == OP_DELETE && member != NULL && member->role == role) {
+        free(member->key);
+        *member = acl->members[--acl->count];
+    }
+    return 0;
+}
+
+static struct view_branches *branches_clone(const struct view_branches *old, size_t extra) {
+    size_t count = old ? old->count : 0;
+    struct view_branches *branches =
+        malloc(sizeof(*branches) + (count + extra) * sizeof(branches->items[0]));
+    if (branches == NULL) {
+        return NULL;
+    }
+    branches->refs = 1;
+    branches->count = count;
+    if (count > 0) {
+        memcpy(branches->items, old->items, count * sizeof(branches->items[0]));
+    }
+    return branches;
+}
+
+static int branches_apply(struct repo_view *view, const char *name, size_t name_len,
+                          const uint8_t *block_hash, uint32_t height) {
+    struct view_branches *old = view->branches;
+    struct view_branches *branches;
+    size_t i;
+
+    if (name_len > MAX_BRANCH_LENGTH) {
+        return -1;
+    }
+    branches = branches_clone(old, 1);
+    if (branches == NULL) {
+        return -1;
+    }
+    for (i = 0; i < branches->count; i++) {
+        if (strlen(branches->items[i].name) == name_len &&
+            memcmp(branches->items[i].name, name, name_len) == 0) {
+            break;
+        }
+    }
+    if (i == branches->count) {
+        memcpy(branches->items[i].name, name, name_len);
+        branches->items[i].name[name_len] = '\0';
+        branches->count++;
+    }
+    memcpy(branches->items[i].head, block_hash, TC_HASH_SIZE);
+    branches->items[i].height = height;
+
+    branches_put(old);
+    view->branches = branches;
+    return 0;
+}
+
+/*
+ * 将一个区块应用到写者私有的快照副本上。
+ * 返回1表示仓库已删除，0表示成功，-1表示区块无法解析。
+ */
+static int apply_block(struct repo_view *view, int *acl_owned,
+                       const uint8_t *blk, size_t len) {
+    struct tc_block_hdr hdr;
+    struct tc_reader reader;
+    const uint8_t *val;
+    const uint8_t *pubkey = NULL, *branch = NULL;
+    uint16_t tag, vlen, pubkey_len = 0, branch_len = 0;
+    uint8_t block_hash[TC_HASH_SIZE];
+    int ret;
+
+    /* 调用者已按tc_block_total_len切分，这里仍以len约束签名字段的读取 */
+    if (len < sizeof(hdr)) {
+        return -1;
+    }
+    memcpy(&hdr, blk, sizeof(hdr));
+    if (hdr.body_len > len - sizeof(hdr)) {
+        return -1;
+    }
+    tc_reader_init(&reader, blk + sizeof(hdr), hdr.body_len);
+    while ((ret = tc_next_tlv(&reader, &tag, &val, &vlen)) > 0) {
+        if (tag == TC_TAG_PUBKEY) {
+            pubkey = val;
+            pubkey_len = vlen;
+        } else if (tag == TC_TAG_BRANCH) {
+            branch = val;
+            branch_len = vlen;
+        }
+    }
+    if (ret < 0) {
+        return -1;
+    }
+
+    /* 区块哈希覆盖区块头与签名字段，不含末尾的TEE签名 */
+    tc_sha256(blk, sizeof(hdr) + hdr.body_len, block_hash);
+
+    if (hdr.block_type == TC_BLOCK_ACCESS && hdr.op == OP_DELETE_REPO) {
+        return 1;
+    }
+    if (hdr.block_type == TC_BLOCK_CONTRIBUTION && branch != NULL) {
+        return branches_apply(view, (const char *)branch, branch_len,
+                              block_hash, hdr.block_height);
+    }
+
+    /* 其余区块都在主链上 */
+    view->block_height = hdr.block_height;
+    memcpy(view->head, block_hash, TC_HASH_SIZE);
+
+    if (hdr.block_type == TC_BLOCK_ACCESS && pubkey != NULL) {
+        if (!*acl_owned) {
+            struct view_acl *acl = acl_clone(view->acl);
+            if (acl == NULL) {
+                return -1;
+            }
+            acl_put(view->acl);
+            view->acl = acl;
+            *acl_owned = 1;
+        }
+        return acl_apply(view->acl, hdr.op, hdr.role, (const char *)pubkey, pubkey_len);
+    }
+    return 0;
+}
+
+/* 宽限期结束后由回收线程调用，释放共享部分前需要持写锁 */
+static void view_reclaim(struct tc_rcu_head *head) {
+    pthread_mutex_lock(&view_write_lock);
+    view_free(tc_rcu_entry(head, struct repo_view, rcu));
+    pthread_mutex_unlock(&view_write_lock);
+}
+
+/* 在写锁内把一批区块应用到仓库视图，发布新快照，旧快照交给回收线程 */
+static void apply_blocks(uint32_t rep_id, const uint8_t *blk, size_t len, int is_new) {
+    size_t index = view_index(rep_id);
+    struct repo_view *old, *view;
+    int acl_owned = 0, deleted = 0;
+
+    if (index >= VIEW_SLOTS) {
+        return;
+    }
+
+    pthread_mutex_lock(&view_write_lock);
+    old = views[index];
+    /* 没有视图的仓库（CA启动前创建或视图已丢弃）无法从中途的区块重建 */
+    if (old == NULL && !is_new) {
+        pthread_mutex_unlock(&view_write_lock);
+        return;
+    }
+    view = calloc(1, sizeof(*view));
+    if (view == NULL) {
+        pthread_mutex_unlock(&view_write_lock);
+        return;
+    }
+    if (old != NULL && !is_new) {
+        *view = *old;
+        view->acl->refs++;
+        if (view->branches != NULL) {
+            view->branches->refs++;
+        }
+    } else {
+        view->rep_id = rep_id;
+        view->acl = &empty_acl;
+    }
+    view->version++;
+
+    while (len > 0 && !deleted) {
+        size_t block_len = tc_block_total_len(blk, len);
+        int ret;
+        if (block_len == 0) {
+            break;
+        }
+        ret = apply_block(view, &acl_owned, blk, block_len);
+        if (ret < 0) {
+            /* 视图无法跟上链上状态，丢弃该仓库视图，避免返回错误结果 */
+            printf("Failed to apply block to view of repository %u\n", rep_id);
+            deleted = 1;
+        } else if (ret > 0) {
+            deleted = 1;
+        }
+        blk += block_len;
+        len -= block_len;
+    }
+
+    if (deleted) {
+        view_free(view);
+        view = NULL;
+    }
+    tc_rcu_assign_pointer(views[index], view);
+    pthread_mutex_unlock(&view_write_lock);
+    if (old != NULL) {
+        tc_rcu_call(&old->rcu, view_reclaim);
+    }
+}
+
+void tc_view_init(void) {
+    memset(views, 0, sizeof(views));
+}
+
+void tc_view_add_blocks(uint32_t rep_id, const uint8_t *blocks, size_t len, int is_new) {
+    apply_blocks(rep_id, blocks, len, is_new);
+}
+
+static void format_etag(const struct repo_view *view, char *etag) {
+    snprintf(etag, TC_VIEW_ETAG_SIZE, "\"%u-%llu\"",
+             view->rep_id, (unsigned long long)view->version);
+}
+
+int tc_view_etag(uint32_t rep_id, char *etag) {
+    size_t index = view_index(rep_id);
+    int found = -1;
+
+    if (index >= VIEW_SLOTS) {
+        return -1;
+    }
+    unsigned int phase = tc_rcu_read_lock();
+    struct repo_view *view = tc_rcu_dereference(views[index]);
+    if (view != NULL && view->rep_id == rep_id) {
+        format_etag(view, etag);
+        found = 0;
+    }
+    tc_rcu_read_unlock(phase);
+    return found;
+}
+
+static json_t *hash_json(const uint8_t *hash) {
+    char hex[TC_HASH_SIZE * 2 + 1];
+    tc_hex_encode(hash, TC_HASH_SIZE, hex);
+    return json_string(hex);
+}
+
+static json_t *members_json(const struct view_acl *acl, uint32_t role) {
+    json_t *keys = json_array();
+    for (size_t i = 0; i < acl->count; i++) {
+        if (acl->members[i].role == role) {
+            json_array_append_new(keys, json_string(acl->members[i].key));
+        }
+    }
+    return keys;
+}
+
+static json_t *branches_json(const struct view_branches *branches) {
+    json_t *items = json_array();
+    for (size_t i = 0; branches != NULL && i < branches->count; i++) {
+        json_t *item = json_object();
+        json_object_set_new(item, "name", json_string(branches->items[i].name));
+        json_object_set_new(item, "head", hash_json(branches->items[i].head));
+        json_object_set_new(item, "height", json_integer(branches->items[i].height));
+        json_array_append_new(items, item);
+    }
+    return items;
+}
+
+int tc_view_query(uint32_t rep_id, enum tc_view_query query, const char *key,
+                  json_t **out, char *etag) {
+    size_t index = view_index(rep_id);
+    json_t *obj;
+
+    if (index >= VIEW_SLOTS) {
+        return -1;
+    }
+    unsigned int phase = tc_rcu_read_lock();
+    struct repo_view *view = tc_rcu_dereference(views[index]);
+    if (view == NULL || view->rep_id != rep_id) {
+        tc_rcu_read_unlock(phase);
+        return -1;
+    }
+
+    obj = json_object();
+    json_object_set_new(obj, "repository_id", json_integer(rep_id));
+    switch (query) {
+    case TC_VIEW_SUMMARY:
+        json_object_set_new(obj, "block_height", json_integer(view->block_height));
+        json_object_set_new(obj, "head", hash_json(view->head));
+        json_object_set_new(obj, "admins", members_json(view->acl, ROLE_ADMIN));
+        json_object_set_new(obj, "writers", members_json(view->acl, ROLE_WRITER));
+        json_object_set_new(obj, "branches", branches_json(view->branches));
+        break;
+    case TC_VIEW_MEMBERS:
+        json_object_set_new(obj, "admins", members_json(view->acl, ROLE_ADMIN));
+        json_object_set_new(obj, "writers", members_json(view->acl, ROLE_WRITER));
+        break;
+    case TC_VIEW_HEIGHT:
+        json_object_set_new(obj, "block_height", json_integer(view->block_height));
+        json_object_set_new(obj, "head", hash_json(view->head));
+        break;
+    case TC_VIEW_ROLE: {
+        const struct view_member *member = NULL;
+        if (key != NULL) {
+            uint8_t fp[TC_HASH_SIZE];
+            tc_pubkey_id(key, strlen(key), fp);
+            member = acl_find(view->acl, fp);
+        }
+        const char *role = "none";
+        if (member != NULL) {
+            role = member->role == ROLE_ADMIN ? "admin" : "writer";
+        }
+        json_object_set_new(obj, "role", json_string(role));
+        json_object_set_new(obj, "can_write", json_boolean(member != NULL));
+        break;
+    }
+    }
+    format_etag(view, etag);
+    tc_rcu_read_unlock(phase);
+
+    *out = obj;
+    return 0;
+}
+
+int tc_view_acl_members(uint32_t rep_id, uint32_t *admin_count, uint32_t *writer_count,
+                        json_t **members) {
+    size_t index = view_index(rep_id);
+
+    if (index >= VIEW_SLOTS) {
+        return -1;
+    }
+    unsigned int phase = tc_rcu_read_lock();
+    struct repo_view *view = tc_rcu_dereference(views[index]);
+    if (view == NULL || view->rep_id != rep_id) {
+        tc_rcu_read_unlock(phase);
+        return -1;
+    }
+
+    *admin_count = 0;
+    *writer_count = 0;
+    for (size_t i = 0; i < view->acl->count; i++) {
+        if (view->acl->members[i].role == ROLE_ADMIN) {
+            (*admin_count)++;
+        } else {
+            (*writer_count)++;
+        }
+    }
+    *members = json_object();
+    json_object_set_new(*members, "admins", members_json(view->acl, ROLE_ADMIN));
+    json_object_set_new(*members, "writers", members_json(view->acl, ROLE_WRITER));
+    tc_rcu_read_unlock(phase);
+    return 0;
+}
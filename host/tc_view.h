@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#ifndef TC_VIEW_H
+#define TC_VIEW_H
+
+#include <stdint.h>
+#include <jansson.h>
+#include <tee_client_api.h>
+
+/*
+ * CA侧的仓库只读视图：由TA返回并签名的区块增量构建（成员集合、主链高度与
+ * 链头、各分支链头），读请求直接从内存返回，不再进入TEE。
+ * 视图是不可变快照，更新时复制后整体替换指针（RCU），读者无锁。
+ * 视图只是方便查询的物化结果，不带TEE签名；需要新鲜性证明时仍应调用
+ * /latest-hash，由TEE对链头签名。
+ */
+
+/* ETag形如"<rep_id>-<version>"（含双引号），每应用一批区块version加一 */
+#define TC_VIEW_ETAG_SIZE 32
+
+enum tc_view_query {
+    TC_VIEW_SUMMARY,    /* 高度、链头、成员与分支 */
+    TC_VIEW_MEMBERS,    /* 管理员与写权限者公钥 */
+    TC_VIEW_HEIGHT,     /* 主链高度与链头 */
+    TC_VIEW_ROLE,       /* 指定公钥的角色 */
+};
+
+void tc_view_init(void);
+
+/*
+ * 结果线程在TA命令成功后调用，按TA的执行顺序把新区块应用到视图；is_new
+ * 表示区块来自创建仓库的命令。同一仓库的结果按执行顺序到达，因此视图的
+ * 更新顺序与链上顺序一致。旧快照延迟回收，调用者不等待读者。
+ */
+void tc_view_add_blocks(uint32_t rep_id, const uint8_t *blocks, size_t len, int is_new);
+
+/* 读取仓库当前ETag，仓库不存在返回-1 */
+int tc_view_etag(uint32_t rep_id, char *etag);
+
+/*
+ * 在读临界区内构造查询结果。key仅用于TC_VIEW_ROLE。
+ * 成功返回0并写入*out与对应的etag，仓库不存在返回-1。
+ */
+int tc_view_query(uint32_t rep_id, enum tc_view_query query, const char *key,
+                  json_t **out, char *etag);
+
+/*
+ * 当前的管理员数、写权限者数与成员公钥{admins, writers}，供核对并保存
+ * ACL检查点。仓库没有视图返回-1。
+ */
+int tc_view_acl_members(uint32_t rep_id, uint32_t *admin_count, uint32_t *writer_count,
+                        json_t **members);
+
+#endif /* TC_VIEW_H */
@@ -5,128 +5,209 @@
 
 #include "block.h"
 #include "../utils/utils.h"
-#include <stdio.h>
+#include "../tee_key_manager/tee_key_manager.h"
+#include "../sign_batch/sign_batch.h"
+#include "../stats/stats.h"
 #include <string.h>
 
 /* 通用区块初始化函数 */
-void init_base_block(struct base_block *base, 
-                     uint32_t block_height,
-                     const char *parent_hash,
-                     uint32_t op,
-                     const char *sigkey,
-                     const char *signature) {
-    if (base == NULL) return;
-    
-    base->block_height = block_height;
+void block_begin(struct block_builder *b, void *buf, size_t cap,
+                 uint16_t block_type,
+                 uint32_t block_height,
+                 const uint8_t *parent_hash,
+                 uint32_t op,
+                 uint32_t role) {
+    TEE_Time now = get_trust_time();
+
+    memset(&b->hdr, 0, sizeof(b->hdr));
+    b->hdr.version = TC_ABI_VERSION;
+    b->hdr.block_type = block_type;
+    b->hdr.block_height = block_height;
+    b->hdr.op = op;
+    b->hdr.role = role;
+    b->hdr.ts_seconds = now.seconds;
+    b->hdr.ts_millis = now.millis;
     if (parent_hash) {
-        strcpy(base->parent_hash, parent_hash);
-    } else {
-        strcpy(base->parent_hash, "");
+        memcpy(b->hdr.parent_hash, parent_hash, TC_HASH_SIZE);
     }
-    base->op = op;
-    if (sigkey) {
-        strcpy(base->sigkey, sigkey);
+    b->sealed = false;
+
+    /* 预留区块头，封口时再写入 */
+    tc_writer_init(&b->w, buf, cap);
+    if (cap < sizeof(b->hdr)) {
+        b->w.overflow = 1;
     } else {
-        strcpy(base->sigkey, "");
+        b->w.len = sizeof(b->hdr);
     }
-    if (signature) {
-        strcpy(base->signature, signature);
-    } else {
-        strcpy(base->signature, "");
+}
+
+void block_put_field(struct block_builder *b, uint16_t tag, const void *val, size_t len) {
+    if (b->sealed) {
+        b->w.overflow = 1;
+        return;
+    }
+    tc_put_tlv(&b->w, tag, val, len);
+}
+
+/* 区块哈希计算函数，签名算法作为最后一个签名字段写入 */
+TEE_Result block_seal(struct block_builder *b, uint8_t *block_hash) {
+    size_t hash_len = TC_HASH_SIZE;
+    uint8_t sig_alg;
+    uint64_t start;
+    TEE_Result res;
+
+    if (b->w.overflow || b->sealed) {
+        return TEE_ERROR_SHORT_BUFFER;
+    }
+    sig_alg = tee_sign_alg();
+    if (sig_alg == 0) {
+        return TEE_ERROR_BAD_STATE;
+    }
+    tc_put_tlv(&b->w, TC_TAG_SIG_ALG, &sig_alg, sizeof(sig_alg));
+    if (b->w.overflow) {
+        return TEE_ERROR_SHORT_BUFFER;
+    }
+
+    b->hdr.body_len = b->w.len - sizeof(b->hdr);
+    memcpy(b->w.buf, &b->hdr, sizeof(b->hdr));
+    b->sealed = true;
+
+    start = stats_now();
+    res = compute_sha256_hash(b->w.buf, b->w.len, block_hash, &hash_len);
+    stats_record(TC_STATS_PHASE_BLOCK_HASH, start);
+    return res;
+}
+
+TEE_Result block_append_tee_sig(struct block_builder *b, const uint8_t *sig, size_t sig_len) {
+    if (!b->sealed) {
+        return TEE_ERROR_BAD_STATE;
+    }
+    tc_put_tlv(&b->w, TC_TAG_TEE_SIG, sig, sig_len);
+    return b->w.overflow ? TEE_ERROR_SHORT_BUFFER : TEE_SUCCESS;
+}
+
+/*
+ * 聚合签名时只追加空的证明占位字段并记录区块哈希，CA填入证明后区块
+ * 不超过TC_MAX_BLOCK_SIZE
+ */
+static TEE_Result block_defer_tee_sig(struct block_builder *b, const uint8_t *block_hash) {
+    if (b->w.len + sizeof(struct tc_tlv_hdr) + TC_MAX_BATCH_PROOF > TC_MAX_BLOCK_SIZE) {
+        return TEE_ERROR_SHORT_BUFFER;
     }
-    base->trust_timestamp = get_trust_time();
-    strcpy(base->tee_sig, ""); // 初始化为空，等待TEE签名
+    tc_put_tlv(&b->w, TC_TAG_TEE_BATCH_SIG, NULL, 0);
+    if (b->w.overflow) {
+        return TEE_ERROR_SHORT_BUFFER;
+    }
+    return sign_batch_add(block_hash);
+}
+
+TEE_Result block_finish(struct block_builder *b, uint8_t *block_hash) {
+    uint8_t tee_sig[TEE_SIGNATURE_SIZE_BYTES];
+    size_t tee_sig_len = sizeof(tee_sig);
+    TEE_Result res;
+
+    if ((res = block_seal(b, block_hash)) != TEE_SUCCESS) {
+        return res;
+    }
+    if (sign_batch_enabled()) {
+        return block_defer_tee_sig(b, block_hash);
+    }
+    if ((res = tee_sign_hash(block_hash, TC_HASH_SIZE, tee_sig, &tee_sig_len)) != TEE_SUCCESS) {
+        return res;
+    }
+    return block_append_tee_sig(b, tee_sig, tee_sig_len);
+}
+
+size_t block_len(const struct block_builder *b) {
+    return b->w.len;
 }
 
 /* Access区块初始化函数 */
-void init_access_block(struct access_block *block,
+void init_access_block(struct block_builder *b, void *buf, size_t cap,
                       uint32_t block_height,
-                      const char *parent_hash,
+                      const uint8_t *parent_hash,
                       uint32_t op,
                       uint32_t role,
-                      const char *pubkey,
-                      const char *sigkey,
-                      const char *signature) {
-    if (block == NULL) return;
-    
-    /* 初始化基础区块 */
-    init_base_block(&block->base, block_height, parent_hash, op, sigkey, signature);
-    
+                      const void *pubkey, size_t pubkey_len,
+                      const void *sigkey, size_t sigkey_len,
+                      const void *signature, size_t signature_len,
+                      const uint8_t *acl_root) {
+    block_begin(b, buf, cap, TC_BLOCK_ACCESS, block_height, parent_hash, op, role);
+
     /* 初始化Access区块特定字段 */
-    block->role = role;
-    if (pubkey) {
-        strcpy(block->pubkey, pubkey);
-    } else {
-        strcpy(block->pubkey, "");
+    block_put_field(b, TC_TAG_SIGKEY, sigkey, sigkey_len);
+    block_put_field(b, TC_TAG_SIGNATURE, signature, signature_len);
+    block_put_field(b, TC_TAG_PUBKEY, pubkey, pubkey_len);
+    /* 变更后的成员树根，墓碑区块没有 */
+    if (acl_root != NULL) {
+        block_put_field(b, TC_TAG_ACL_ROOT, acl_root, TC_HASH_SIZE);
     }
 }
 
 /* Contribution区块初始化函数 */
-void init_contribution_block(struct contribution_block *block,
+void init_contribution_block(struct block_builder *b, void *buf, size_t cap,
                            uint32_t block_height,
-                           const char *parent_hash,
+                           const uint8_t *parent_hash,
                            uint32_t op,
-                           const char *commit_hash,
-                           const char *sigkey,
-                           const char *signature) {
-    if (block == NULL) return;
-    
-    /* 初始化基础区块 */
-    init_base_block(&block->base, block_height, parent_hash, op, sigkey, signature);
-    
+                           const void *commit_hash, size_t commit_hash_len,
+                           const void *branch, size_t branch_len,
+                           const void *sigkey, size_t sigkey_len,
+                           const void *signature, size_t signature_len) {
+    block_begin(b, buf, cap, TC_BLOCK_CONTRIBUTION, block_height, parent_hash, op, 0);
+
     /* 初始化Contribution区块特定字段 */
-    if (commit_hash) {
-        strcpy(block->commit_hash, commit_hash);
-    } else {
-        strcpy(block->commit_hash, "");
+    block_put_field(b, TC_TAG_SIGKEY, sigkey, sigkey_len);
+    block_put_field(b, TC_TAG_SIGNATURE, signature, signature_len);
+    block_put_field(b, TC_TAG_COMMIT_HASH, commit_hash, commit_hash_len);
+    /* 分支区块记录分支名，高度与父哈希均属于该分支自己的链 */
+    if (branch_len > 0) {
+        block_put_field(b, TC_TAG_BRANCH, branch, branch_len);
+    }
+}
+
+/* 推送区块初始化函数 */
+void init_push_block(struct block_builder *b, void *buf, size_t cap,
+                     uint32_t block_height,
+                     const uint8_t *parent_hash,
+                     uint32_t op,
+                     const uint8_t *push_root, uint32_t push_count,
+                     const void *old_tip, size_t old_tip_len,
+                     const void *new_tip, size_t new_tip_len,
+                     const void *branch, size_t branch_len,
+                     const void *sigkey, size_t sigkey_len,
+                     const void *signature, size_t signature_len) {
+    block_begin(b, buf, cap, TC_BLOCK_CONTRIBUTION, block_height, parent_hash, op, 0);
+
+    block_put_field(b, TC_TAG_SIGKEY, sigkey, sigkey_len);
+    block_put_field(b, TC_TAG_SIGNATURE, signature, signature_len);
+    block_put_field(b, TC_TAG_PUSH_ROOT, push_root, TC_HASH_SIZE);
+    block_put_field(b, TC_TAG_PUSH_COUNT, &push_count, sizeof(push_count));
+    if (old_tip_len > 0) {
+        block_put_field(b, TC_TAG_OLD_TIP, old_tip, old_tip_len);
+    }
+    block_put_field(b, TC_TAG_NEW_TIP, new_tip, new_tip_len);
+    if (branch_len > 0) {
+        block_put_field(b, TC_TAG_BRANCH, branch, branch_len);
     }
 }
 
-/* Access区块哈希计算函数 */
-TEE_Result calculate_access_block_hash(const struct access_block *block, char *hash) {
-    if (block == NULL || hash == NULL) {
-        return TEE_ERROR_BAD_PARAMETERS;
-    }
-    
-    char data_buffer[1024];
-    
-    /* 序列化Access区块的所有字段 */
-    snprintf(data_buffer, sizeof(data_buffer),
-             "%u:%.64s:%u:%.256s:%.256s:%u:%u:%u:%.256s", 
-             block->base.block_height, 
-             block->base.parent_hash, 
-             block->base.op, 
-             block->base.sigkey, 
-             block->base.signature,
-             block->base.trust_timestamp.seconds,
-             block->base.trust_timestamp.millis,
-             block->role,
-             block->pubkey);
-    
-    /* 计算哈希 */
-    return hash_data(data_buffer, strlen(data_buffer), hash);
+/* Checkpoint区块初始化函数，调用者随后追加各分支的TC_TAG_BRANCH_HEAD字段 */
+void init_checkpoint_block(struct block_builder *b, void *buf, size_t cap,
+                           uint32_t block_height,
+                           const uint8_t *parent_hash,
+                           const uint8_t *branch_root) {
+    block_begin(b, buf, cap, TC_BLOCK_CHECKPOINT, block_height, parent_hash, OP_CHECKPOINT, 0);
+
+    block_put_field(b, TC_TAG_BRANCH_ROOT, branch_root, TC_HASH_SIZE);
 }
 
-/* Contribution区块哈希计算函数 */
-TEE_Result calculate_contribution_block_hash(const struct contribution_block *block, char *hash) {
-    if (block == NULL || hash == NULL) {
-        return TEE_ERROR_BAD_PARAMETERS;
-    }
-    
-    char data_buffer[1024];
-    
-    /* 序列化Contribution区块的所有字段 */
-    snprintf(data_buffer, sizeof(data_buffer),
-             "%u:%.64s:%u:%.256s:%.256s:%u:%u:%.64s", 
-             block->base.block_height, 
-             block->base.parent_hash, 
-             block->base.op, 
-             block->base.sigkey, 
-             block->base.signature,
-             block->base.trust_timestamp.seconds,
-             block->base.trust_timestamp.millis,
-             block->commit_hash);
-    
-    /* 计算哈希 */
-    return hash_data(data_buffer, strlen(data_buffer), hash);
-} 
\ No newline at end of file
+/* ACL检查点区块初始化函数，ACL_STATE记录成员计数和成员稀疏Merkle树的根，见trust_chain_abi.h */
+void init_acl_checkpoint_block(struct block_builder *b, void *buf, size_t cap,
+                               uint32_t block_height,
+                               const uint8_t *parent_hash,
+                               const struct tc_acl_state *state) {
+    block_begin(b, buf, cap, TC_BLOCK_ACL_CHECKPOINT, block_height, parent_hash,
+                OP_ACL_CHECKPOINT, 0);
+
+    block_put_field(b, TC_TAG_ACL_STATE, state, sizeof(*state));
+}
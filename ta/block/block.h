@@ -11,62 +11,92 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
-// #include "trust_chain_constants.h"
-#include "trust_chain_ta.h"
+#include "trust_chain_abi.h"
 
-/* 基础区块结构体 */
-struct base_block {
-    uint32_t block_height;           //！删除该字段！ // 区块高度
-    char parent_hash[MAX_HASH_LENGTH]; // 父区块哈希
-    uint32_t op;                     // 操作类型
-    char sigkey[MAX_KEY_LENGTH];     // 签名密钥
-    char signature[MAX_SIGNATURE_LENGTH]; //！删除该字段！ // 签名 
-    TEE_Time trust_timestamp;        // 可信时间戳
-    char tee_sig[MAX_SIGNATURE_LENGTH];   // TEE签名
+/*
+ * 区块构造器：在TA私有缓冲区中直接按线格式(trust_chain_abi.h)序列化区块。
+ * 缓冲区必须是TA私有内存，不能是共享内存，否则普通世界可以在哈希与签名
+ * 之间篡改区块内容。
+ */
+struct block_builder {
+    struct tc_block_hdr hdr;         // 区块头，封口时写入缓冲区头部
+    struct tc_writer w;              // 缓冲区写指针
+    bool sealed;                     // 是否已计算哈希
 };
 
-/* Access区块结构体 */
-struct access_block {
-    struct base_block base;          // 继承基础区块
-    uint32_t role;                   // 角色类型
-    char pubkey[MAX_KEY_LENGTH];     // 公钥
-};
+/* 开始构造区块，为区块头预留空间 */
+void block_begin(struct block_builder *b, void *buf, size_t cap,
+                 uint16_t block_type,
+                 uint32_t block_height,
+                 const uint8_t *parent_hash,
+                 uint32_t op,
+                 uint32_t role);
 
-/* Contribution区块结构体 */
-struct contribution_block {
-    struct base_block base;          // 继承基础区块
-    char commit_hash[MAX_HASH_LENGTH]; // 提交哈希
-};
+/* 追加一个参与哈希的TLV字段 */
+void block_put_field(struct block_builder *b, uint16_t tag, const void *val, size_t len);
 
-/* 通用区块初始化函数 */
-void init_base_block(struct base_block *base, 
-                     uint32_t block_height,
-                     const char *parent_hash,
-                     uint32_t op,
-                     const char *sigkey,
-                     const char *signature);
+/* 追加签名算法字段、写入区块头并计算区块哈希（覆盖区块头与全部字段） */
+TEE_Result block_seal(struct block_builder *b, uint8_t *block_hash);
+
+/* 追加TEE签名字段，区块构造完成 */
+TEE_Result block_append_tee_sig(struct block_builder *b, const uint8_t *sig, size_t sig_len);
+
+/*
+ * 封口、用TEE私钥签名区块哈希并追加签名；启用聚合签名时改为追加证明
+ * 占位字段并把区块哈希记入当前窗口。失败时区块不计入窗口。
+ */
+TEE_Result block_finish(struct block_builder *b, uint8_t *block_hash);
+
+/* 已构造区块的字节数 */
+size_t block_len(const struct block_builder *b);
 
-/* Access区块初始化函数 */
-void init_access_block(struct access_block *block,
+/* Access区块初始化函数，acl_root为区块生效后的成员树根，墓碑区块为NULL */
+void init_access_block(struct block_builder *b, void *buf, size_t cap,
                       uint32_t block_height,
-                      const char *parent_hash,
+                      const uint8_t *parent_hash,
                       uint32_t op,
                       uint32_t role,
-                      const char *pubkey,
-                      const char *sigkey,
-                      const char *signature);
+                      const void *pubkey, size_t pubkey_len,
+                      const void *sigkey, size_t sigkey_len,
+                      const void *signature, size_t signature_len,
+                      const uint8_t *acl_root);
 
 /* Contribution区块初始化函数 */
-void init_contribution_block(struct contribution_block *block,
+void init_contribution_block(struct block_builder *b, void *buf, size_t cap,
                            uint32_t block_height,
-                           const char *parent_hash,
+                           const uint8_t *parent_hash,
                            uint32_t op,
-                           const char *commit_hash,
-                           const char *sigkey,
-                           const char *signature);
+                           const void *commit_hash, size_t commit_hash_len,
+                           const void *branch, size_t branch_len,
+                           const void *sigkey, size_t sigkey_len,
+                           const void *signature, size_t signature_len);
+
+/*
+ * 推送区块：Contribution区块的变体，以commit列表的Merkle根、commit数和
+ * ref推送前后的tip代替单个commit哈希（格式见trust_chain_abi.h）。
+ * 新建ref时old_tip_len为0。
+ */
+void init_push_block(struct block_builder *b, void *buf, size_t cap,
+                     uint32_t block_height,
+                     const uint8_t *parent_hash,
+                     uint32_t op,
+                     const uint8_t *push_root, uint32_t push_count,
+                     const void *old_tip, size_t old_tip_len,
+                     const void *new_tip, size_t new_tip_len,
+                     const void *branch, size_t branch_len,
+                     const void *sigkey, size_t sigkey_len,
+                     const void *signature, size_t signature_len);
+
+/* Checkpoint区块初始化函数 */
+void init_checkpoint_block(struct block_builder *b, void *buf, size_t cap,
+                           uint32_t block_height,
+                           const uint8_t *parent_hash,
+                           const uint8_t *branch_root);
 
-/* 哈希计算函数 */
-TEE_Result calculate_access_block_hash(const struct access_block *block, char *hash);
-TEE_Result calculate_contribution_block_hash(const struct contribution_block *block, char *hash);
+/* ACL检查点区块初始化函数 */
+void init_acl_checkpoint_block(struct block_builder *b, void *buf, size_t cap,
+                               uint32_t block_height,
+                               const uint8_t *parent_hash,
+                               const struct tc_acl_state *state);
 
-#endif /* BLOCK_H */ 
\ No newline at end of file
+#endif /* BLOCK_H */
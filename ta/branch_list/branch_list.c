@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#include "branch_list.h"
+#include "../slab/slab.h"
+#include <string.h>
+#include <tee_internal_api.h>
+#include <tee_internal_api_extensions.h>
+
+/* 分支节点的slab缓存 */
+static struct slab_cache branch_node_cache =
+	SLAB_CACHE_INITIALIZER("branch_node", sizeof(struct branch_node), 32);
+
+/* Memory management functions for branch_list */
+
+void init_branch_list(struct branch_list *list) {
+	list->head = NULL;
+	list->count = 0;
+	list->dirty_count = 0;
+}
+
+void cleanup_branch_list(struct branch_list *list) {
+	struct branch_node *current = list->head;
+	struct branch_node *next;
+	
+	while (current != NULL) {
+		next = current->next;
+		free_branch_node(current);
+		current = next;
+	}
+	
+	list->head = NULL;
+	list->count = 0;
+	list->dirty_count = 0;
+}
+
+struct branch_node *create_branch_node(const uint8_t *name_fp) {
+	struct branch_node *node = slab_alloc(&branch_node_cache);
+	if (node == NULL) {
+		return NULL;
+	}
+	
+	/* slab_alloc已清零：新分支高度为0、链头全零 */
+	memcpy(node->branch.name_fp, name_fp, TC_HASH_SIZE);
+	return node;
+}
+
+void free_branch_node(struct branch_node *node) {
+	if (node != NULL) {
+		slab_free(&branch_node_cache, node);
+	}
+}
+
+/* Branch list operations */
+
+struct branch_node *find_branch(const struct branch_list *list, const uint8_t *name_fp) {
+	struct branch_node *current = list->head;
+	
+	while (current != NULL) {
+		int cmp = memcmp(current->branch.name_fp, name_fp, TC_HASH_SIZE);
+		if (cmp == 0) {
+			return current;
+		}
+		if (cmp > 0) {
+			break;  /* 链表有序，后面不会再出现 */
+		}
+		current = current->next;
+	}
+	return NULL;
+}
+
+void insert_branch(struct branch_list *list, struct branch_node *node) {
+	struct branch_node **link = &list->head;
+	
+	while (*link != NULL &&
+	       memcmp((*link)->branch.name_fp, node->branch.name_fp, TC_HASH_SIZE) < 0) {
+		link = &(*link)->next;
+	}
+	node->next = *link;
+	*link = node;
+	list->count++;
+}
+
+void advance_branch(struct branch_list *list, struct branch_node *node,
+                    const uint8_t *block_hash) {
+	memcpy(node->branch.head, block_hash, TC_HASH_SIZE);
+	node->branch.height++;
+	if (!node->dirty) {
+		node->dirty = true;
+		list->dirty_count++;
+	}
+}
+
+TEE_Result branch_list_root(const struct branch_list *list, uint8_t *root) {
+	TEE_OperationHandle hash_op = TEE_HANDLE_NULL;
+	struct branch_node *current;
+	size_t root_len = TC_HASH_SIZE;
+	TEE_Result res;
+	
+	res = TEE_AllocateOperation(&hash_op, TEE_ALG_SHA256, TEE_MODE_DIGEST, 0);
+	if (res != TEE_SUCCESS) {
+		EMSG("Failed to allocate hash operation: %x", res);
+		return res;
+	}
+	
+	for (current = list->head; current != NULL; current = current->next) {
+		TEE_DigestUpdate(hash_op, &current->branch, sizeof(current->branch));
+	}
+	res = TEE_DigestDoFinal(hash_op, NULL, 0, root, &root_len);
+	TEE_FreeOperation(hash_op);
+	return res;
+}
+
+void clear_branch_dirty(struct branch_list *list, uint32_t max) {
+	struct branch_node *current;
+	
+	for (current = list->head; current != NULL && max > 0; current = current->next) {
+		if (current->dirty) {
+			current->dirty = false;
+			list->dirty_count--;
+			max--;
+		}
+	}
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#ifndef BRANCH_LIST_H
+#define BRANCH_LIST_H
+
+#include <tee_api_types.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "trust_chain_abi.h"
+
+/*
+ * 每个仓库按分支维护各自的链头，不同分支的推送互不影响彼此的父哈希。
+ * 分支以名称的SHA256指纹表示，链表按指纹升序排列，检查点区块据此计算
+ * 确定的分支根哈希。
+ */
+struct branch_node {
+	struct tc_branch_head branch;    /* 分支指纹、链头与分支高度 */
+	bool dirty;                      /* 上次检查点之后是否有新区块 */
+	struct branch_node *next;        /* 指向下一个节点的指针 */
+};
+
+/* Branch list structure - sorted linked list, embedded in repo_metadata */
+struct branch_list {
+	struct branch_node *head;        /* 链表头指针 */
+	uint32_t count;                  /* 分支数量 */
+	uint32_t dirty_count;            /* 待检查点汇总的分支数量 */
+};
+
+/* Memory management functions for branch_list (nodes backed by a slab cache) */
+void init_branch_list(struct branch_list *list);
+void cleanup_branch_list(struct branch_list *list);
+struct branch_node *create_branch_node(const uint8_t *name_fp);
+void free_branch_node(struct branch_node *node);
+
+/* Branch list operations */
+struct branch_node *find_branch(const struct branch_list *list, const uint8_t *name_fp);
+
+/* 按指纹顺序插入新分支节点，节点由create_branch_node创建 */
+void insert_branch(struct branch_list *list, struct branch_node *node);
+
+/* 分支上生成新区块：更新链头、分支高度并标记待汇总 */
+void advance_branch(struct branch_list *list, struct branch_node *node,
+                    const uint8_t *block_hash);
+
+/* 计算全部分支链头的根哈希：按指纹顺序对tc_branch_head依次求SHA256 */
+TEE_Result branch_list_root(const struct branch_list *list, uint8_t *root);
+
+/* 检查点生成后按链表顺序清除前max个分支的待汇总标记 */
+void clear_branch_dirty(struct branch_list *list, uint32_t max);
+
+#endif /* BRANCH_LIST_H */
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#include "head_tree.h"
+#include "../utils/utils.h"
+#include <string.h>
+
+static TEE_Result merkle_node(const uint8_t *left, const uint8_t *right, uint8_t *out) {
+    uint8_t buf[1 + 2 * TC_HASH_SIZE];
+    size_t hash_len = TC_HASH_SIZE;
+
+    buf[0] = TC_MERKLE_NODE_PREFIX;
+    memcpy(buf + 1, left, TC_HASH_SIZE);
+    memcpy(buf + 1 + TC_HASH_SIZE, right, TC_HASH_SIZE);
+    return compute_sha256_hash(buf, sizeof(buf), out, &hash_len);
+}
+
+void head_tree_init(struct head_tree *t) {
+    memset(t, 0, sizeof(*t));
+}
+
+/* 新叶子入栈后，与栈顶大小相同的子树合并，栈中子树大小始终严格递减 */
+TEE_Result head_tree_add(struct head_tree *t, const struct tc_head_leaf *leaf) {
+    uint8_t buf[1 + sizeof(*leaf)];
+    size_t hash_len = TC_HASH_SIZE;
+    TEE_Result res;
+
+    if (t->leaf_count >= MAX_REPO_ID) {
+        return TEE_ERROR_OVERFLOW;
+    }
+    buf[0] = TC_MERKLE_LEAF_PREFIX;
+    memcpy(buf + 1, leaf, sizeof(*leaf));
+    res = compute_sha256_hash(buf, sizeof(buf), t->hash[t->depth], &hash_len);
+    if (res != TEE_SUCCESS) {
+        return res;
+    }
+    t->size[t->depth++] = 1;
+    t->leaf_count++;
+
+    while (t->depth >= 2 && t->size[t->depth - 2] == t->size[t->depth - 1]) {
+        res = merkle_node(t->hash[t->depth - 2], t->hash[t->depth - 1], t->hash[t->depth - 2]);
+        if (res != TEE_SUCCESS) {
+            return res;
+        }
+        t->size[t->depth - 2] *= 2;
+        t->depth--;
+    }
+    return TEE_SUCCESS;
+}
+
+/*
+ * 剩余的子树自右向左合并：逐层合并时右侧不完整的部分总是先在
+ * 内部合成一个节点，再与左侧的完整子树相遇
+ */
+TEE_Result head_tree_root(const struct head_tree *t, uint8_t *root) {
+    uint8_t acc[TC_HASH_SIZE];
+    TEE_Result res;
+
+    if (t->depth == 0) {
+        memset(root, 0, TC_HASH_SIZE);
+        return TEE_SUCCESS;
+    }
+    memcpy(acc, t->hash[t->depth - 1], TC_HASH_SIZE);
+    for (uint32_t i = t->depth - 1; i > 0; i--) {
+        res = merkle_node(t->hash[i - 1], acc, acc);
+        if (res != TEE_SUCCESS) {
+            return res;
+        }
+    }
+    memcpy(root, acc, TC_HASH_SIZE);
+    return TEE_SUCCESS;
+}
@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#ifndef HEAD_TREE_H
+#define HEAD_TREE_H
+
+#include <tee_api_types.h>
+#include <stdint.h>
+#include "trust_chain_abi.h"
+
+/*
+ * 链头树（格式见trust_chain_abi.h）的增量构造：叶子按顺序逐个加入，
+ * 栈里只保留各完整子树的根，内存与仓库数的对数成正比，不必在TA里
+ * 保存全部叶子。结果与逐层合并、奇数个时最后一个原样上移的树相同。
+ */
+struct head_tree {
+    uint8_t hash[TC_MAX_HEAD_TREE_DEPTH + 1][TC_HASH_SIZE];
+    uint32_t size[TC_MAX_HEAD_TREE_DEPTH + 1];   /* 各子树的叶子数，自底向上递减 */
+    uint32_t depth;                              /* 栈中的子树数 */
+    uint32_t leaf_count;
+};
+
+void head_tree_init(struct head_tree *t);
+
+/* 加入一个叶子，超过MAX_REPO_ID个时返回TEE_ERROR_OVERFLOW */
+TEE_Result head_tree_add(struct head_tree *t, const struct tc_head_leaf *leaf);
+
+/* 计算根，没有叶子时为全0 */
+TEE_Result head_tree_root(const struct head_tree *t, uint8_t *root);
+
+#endif /* HEAD_TREE_H */
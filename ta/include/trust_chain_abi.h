@@ -0,0 +1,480 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+/*
+ * Wire format shared by the TA and the host.
+ *
+ * Every request is a struct tc_msg_hdr followed by hdr.body_len bytes of
+ * TLV fields. Every block the TA emits is a struct tc_block_hdr followed by
+ * hdr.body_len bytes of TLV fields and one trailing TC_TAG_TEE_SIG or
+ * TC_TAG_TEE_BATCH_SIG field. The block hash is SHA256 over the header and
+ * the body, i.e. everything before the TEE signature, so the emitted bytes
+ * are exactly what the TEE signed and can be stored or forwarded without
+ * re-marshalling.
+ *
+ * All integers are little-endian as laid out by the compiler on both sides
+ * (OP-TEE host and TA always share endianness). TLV values are raw bytes:
+ * keys are text without a terminating NUL, signatures and hashes are binary.
+ */
+
+#ifndef TA_TRUST_CHAIN_ABI_H
+#define TA_TRUST_CHAIN_ABI_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "trust_chain_ta.h"
+
+#define TC_ABI_VERSION 1
+
+/* SHA256 size in bytes */
+#define TC_HASH_SIZE 32
+
+/* Upper bounds for a single request message and a single encoded block */
+#define TC_MAX_MSG_SIZE   4096
+#define TC_MAX_BLOCK_SIZE 4096
+
+/*
+ * Membership sparse Merkle tree, one per repo. The TA keeps only its root;
+ * the host keeps the nodes and attaches proofs to requests.
+ *   - Keys are canonical key fingerprints. Bit i of a key (byte i / 8,
+ *     most significant bit first) picks the right child when set on the
+ *     way from depth i to depth i + 1; leaves sit at depth 256.
+ *   - A member's leaf is SHA256(0x00 || fp || role) with role ROLE_ADMIN
+ *     or ROLE_WRITER (uint8_t). An empty subtree is 32 zero bytes, and a
+ *     subtree holding a single member is that member's leaf, at any
+ *     height. Any other node is SHA256(0x01 || left || right), so a
+ *     lookup hashes once per level where fp's subtree holds two or more
+ *     members, about log2(members) levels instead of 256.
+ *   - A proof for fp is role (uint8_t, 0 if fp is not a member) ||
+ *     bitmap[32] || siblings [|| leaf]. Bitmap bit i (byte i / 8, most
+ *     significant bit first) is set when the sibling at depth i + 1 on
+ *     fp's path is not empty; those siblings follow, deepest first. Let d
+ *     be the deepest set bit (-1 if none): fp's path ends at depth d + 1.
+ *     The optional leaf is another member's fp[32] || role, TC_SMT_LEAF_SIZE
+ *     bytes:
+ *       member: the sibling at depth d + 1 is that member alone. The host
+ *         includes it whenever this holds, so the root after removing fp
+ *         can be computed.
+ *       non-member: the subtree where fp's path ends holds only that
+ *         member (it shares bits 0 .. d with fp); without it the subtree
+ *         is empty.
+ *     To verify:
+ *       h = role ? leaf(fp, role) : leaf present ? leaf(other) : empty
+ *       for i = d down to 0:
+ *         s = bit i of bitmap ? next sibling : empty
+ *         h = bit i of fp ? node(s, h) : node(h, s)
+ *     h must equal the root, and a member's leaf must equal the sibling at
+ *     depth d + 1. The same siblings give the root after fp is added,
+ *     changed or removed (ta/smt/smt.c).
+ */
+#define TC_SMT_DEPTH          256
+#define TC_SMT_BITMAP_SIZE    (TC_SMT_DEPTH / 8)
+#define TC_SMT_LEAF_SIZE      (TC_HASH_SIZE + 1)
+#define TC_SMT_MAX_PROOF_SIZE (1 + TC_SMT_BITMAP_SIZE + TC_SMT_DEPTH * TC_HASH_SIZE + TC_SMT_LEAF_SIZE)
+
+/*
+ * A request as the TA receives it: the client's message plus the signer's
+ * and the target key's membership proofs, which the host appends.
+ */
+#define TC_MAX_PROVEN_MSG_SIZE (TC_MAX_MSG_SIZE + 2 * (4 + TC_SMT_MAX_PROOF_SIZE))
+
+/*
+ * A commit may be followed by a repo checkpoint block, and an access block
+ * by an ACL checkpoint block, in the same reply, so commit and access
+ * control output buffers must hold two blocks.
+ */
+#define TC_MAX_COMMIT_OUTPUT (2 * TC_MAX_BLOCK_SIZE)
+
+/* Request message types, one per command taking a message */
+#define TC_MSG_INIT_REPO       1
+#define TC_MSG_ACCESS_CONTROL  2
+#define TC_MSG_COMMIT          3
+#define TC_MSG_DELETE_REPO     4
+#define TC_MSG_ACL_CHECKPOINT  5
+
+/* Block types */
+#define TC_BLOCK_ACCESS        1
+#define TC_BLOCK_CONTRIBUTION  2
+#define TC_BLOCK_CHECKPOINT    3
+#define TC_BLOCK_ACL_CHECKPOINT 4
+
+/* TLV tags */
+#define TC_TAG_PUBKEY       1   /* key text, no NUL */
+#define TC_TAG_SIGKEY       2   /* key text, no NUL */
+#define TC_TAG_SIGNATURE    3   /* raw client signature */
+#define TC_TAG_COMMIT_HASH  4   /* raw commit object id (20 or 32 bytes) */
+#define TC_TAG_ENC_KEY      5   /* raw RSA ciphertext of the content key */
+#define TC_TAG_BRANCH       6   /* branch name text, no NUL */
+#define TC_TAG_BRANCH_ROOT  7   /* SHA256 over all branch heads, sorted by name_fp */
+#define TC_TAG_BRANCH_HEAD  8   /* struct tc_branch_head, repeated */
+#define TC_TAG_EXPECTED_PARENT 9 /* request only: head the client expects to extend */
+#define TC_TAG_SIG_ALG      10  /* uint8_t TC_SIG_ALG_* of the TEE signature */
+#define TC_TAG_KEY_SESSION  11  /* request only: uint64_t content key session id */
+#define TC_TAG_WRAPPED_KEY  12  /* request only: AES-GCM wrapped content key */
+#define TC_TAG_PUSH_ROOT    13  /* Merkle root over the commit ids of a push */
+#define TC_TAG_PUSH_COUNT   14  /* uint32_t number of commits under PUSH_ROOT */
+#define TC_TAG_OLD_TIP      15  /* raw commit id the ref pointed to, absent for a new ref */
+#define TC_TAG_NEW_TIP      18  /* raw commit id the ref points to after the push */
+#define TC_TAG_ACL_STATE    19  /* struct tc_acl_state */
+#define TC_TAG_ACL_ROOT     20  /* membership tree root after an access block */
+#define TC_TAG_SIGKEY_PROOF 21  /* request only: membership proof of the signer */
+#define TC_TAG_PUBKEY_PROOF 22  /* request only: membership proof of PUBKEY */
+#define TC_TAG_TEE_SIG      16  /* raw TEE signature, always last in a block */
+#define TC_TAG_TEE_BATCH_SIG 17 /* tc_batch_proof_hdr + path + root signature, last */
+
+/*
+ * TEE signature algorithms. The algorithm is fixed when the TEE key is
+ * generated; every block records it in a signed TC_TAG_SIG_ALG field.
+ * Blocks without the field predate it and are RSA.
+ *   RSA_PKCS1_SHA256: RSASSA-PKCS1-v1_5 over the block hash, 256 bytes
+ *   ECDSA_P256_SHA256: ECDSA P-256 over the block hash, raw r || s, 64 bytes
+ *   ED25519: pure Ed25519 with the 32-byte block hash as message, 64 bytes
+ * Signed replies use the same key and algorithm over the SHA256 of the reply.
+ */
+#define TC_SIG_ALG_RSA_PKCS1_SHA256   1
+#define TC_SIG_ALG_ECDSA_P256_SHA256  2
+#define TC_SIG_ALG_ED25519            3
+
+/* Upper bound of a raw TEE signature (RSA-2048) */
+#define TC_MAX_TEE_SIG_SIZE 256
+
+/*
+ * Aggregated signing. When the host opens a session with a batch window,
+ * the TA does not sign blocks one by one: it remembers the hash of every
+ * block it emits and TA_TRUST_CHAIN_CMD_SEAL_BATCH later signs one Merkle
+ * root over all of them, across repos. Until then each block ends in an
+ * empty TC_TAG_TEE_BATCH_SIG placeholder; the host fills in the inclusion
+ * proof before anyone sees the block.
+ *
+ * Tree: leaf = SHA256(0x00 || block_hash), node = SHA256(0x01 || left ||
+ * right). Nodes are paired left to right on each level and an odd last node
+ * moves up unchanged. To verify a block:
+ *   h = leaf; idx = leaf_index; width = leaf_count; k = 0
+ *   while width > 1:
+ *     if idx is odd:             h = node(path[k++], h)
+ *     else if idx + 1 < width:   h = node(h, path[k++])
+ *     idx /= 2; width = (width + 1) / 2
+ *   h must equal root.root, and the signature must verify over
+ *   SHA256(struct tc_batch_root) with the TEE key and the block's SIG_ALG.
+ */
+#define TC_MAX_BATCH_LEAVES 64
+#define TC_MAX_BATCH_DEPTH  6     /* ceil(log2(TC_MAX_BATCH_LEAVES)) */
+
+#define TC_MERKLE_LEAF_PREFIX 0x00
+#define TC_MERKLE_NODE_PREFIX 0x01
+
+/* Signed by SEAL_BATCH; seq counts windows of one TA instance */
+struct tc_batch_root {
+	uint32_t shard;
+	uint32_t seq;
+	uint32_t leaf_count;
+	uint8_t root[TC_HASH_SIZE];
+};
+
+/* Value of TC_TAG_TEE_BATCH_SIG, followed by path_len hashes and the signature */
+struct tc_batch_proof_hdr {
+	struct tc_batch_root root;
+	uint32_t leaf_index;
+	uint16_t path_len;
+	uint16_t sig_len;
+};
+
+#define TC_MAX_BATCH_PROOF (sizeof(struct tc_batch_proof_hdr) + \
+			    TC_MAX_BATCH_DEPTH * TC_HASH_SIZE + TC_MAX_TEE_SIG_SIZE)
+
+/*
+ * Content key sessions. TA_TRUST_CHAIN_CMD_OPEN_KEY_SESSION takes an AES
+ * key (16, 24 or 32 bytes) encrypted like TC_TAG_ENC_KEY and caches it
+ * under a session id for a limited time. A commit may then carry
+ * TC_TAG_KEY_SESSION and TC_TAG_WRAPPED_KEY instead of TC_TAG_ENC_KEY:
+ *   wrapped = nonce (12 bytes) || AES-GCM ciphertext || tag (16 bytes)
+ *   AAD     = rep_id (uint32_t, little-endian) || raw commit hash
+ * The nonce must be fresh for every wrapped key. Sessions live in the TA
+ * instance of one shard.
+ */
+#define TC_WRAP_NONCE_SIZE 12
+#define TC_WRAP_TAG_SIZE   16
+
+/*
+ * Push blocks. A contribution block may register a whole push instead of
+ * one commit: it then carries PUSH_ROOT, PUSH_COUNT, NEW_TIP and, unless
+ * the ref is new, OLD_TIP in place of COMMIT_HASH; the ref is the block's
+ * BRANCH (the main chain when absent). PUSH_ROOT is a Merkle tree over the
+ * pushed commit ids in push order (oldest first, the last one is NEW_TIP),
+ * built like the batch tree: leaf = SHA256(0x00 || commit id), node =
+ * SHA256(0x01 || left || right), odd last node moves up unchanged. A
+ * commit's inclusion proof is its leaf index and sibling path, verified
+ * with the loop above against PUSH_ROOT and PUSH_COUNT.
+ */
+#define TC_MAX_PUSH_COMMITS 65536
+
+/*
+ * Head tree. TA_TRUST_CHAIN_CMD_SIGN_HEAD_TREE signs the heads of all repos
+ * of one TA instance (shard) at once, so a head can be proven without a TEE
+ * call per request. Leaves are struct tc_head_leaf in slot order, hashed as
+ * leaf = SHA256(0x00 || struct tc_head_leaf) and combined like the batch
+ * tree; the proof of one repo is its leaf index and sibling path, verified
+ * with the loop above against root.root and root.leaf_count. The signature
+ * covers SHA256(struct tc_head_tree_root). The host picks the epoch, the
+ * same for every shard in one round, and a TA instance never signs an epoch
+ * that is not larger than its previous one. ts_seconds is the trusted time
+ * of signing and bounds how stale a proven head may be.
+ */
+#define TC_MAX_HEAD_TREE_DEPTH 10  /* ceil(log2(MAX_REPO_ID)) */
+
+struct tc_head_leaf {
+	uint32_t rep_id;
+	uint32_t block_height;
+	uint8_t head[TC_HASH_SIZE];
+};
+
+struct tc_head_tree_root {
+	uint32_t shard;
+	uint32_t epoch;
+	uint32_t ts_seconds;
+	uint32_t leaf_count;
+	uint8_t root[TC_HASH_SIZE];
+};
+
+/*
+ * ACL checkpoints. After every ACL_CHECKPOINT_INTERVAL access blocks, and
+ * on demand through TA_TRUST_CHAIN_CMD_ACL_CHECKPOINT, the TA appends a
+ * TC_BLOCK_ACL_CHECKPOINT block to the main chain. Its only field is
+ * TC_TAG_ACL_STATE: the member counts and the membership tree root, the
+ * same root the latest access block carries in TC_TAG_ACL_ROOT. A verifier
+ * holding the member keys rebuilds the tree, checks the root against a
+ * checkpoint block, and replays only the blocks after it.
+ */
+struct tc_acl_state {
+	uint32_t admin_count;
+	uint32_t writer_count;
+	uint8_t root[TC_HASH_SIZE];
+};
+
+/*
+ * TA statistics, returned by TA_TRUST_CHAIN_CMD_GET_STATS: a tc_stats_hdr,
+ * entry_count tc_stats_entry (one per command and phase recorded since the
+ * last reset) and slab_count tc_stats_slab. Durations are counter ticks,
+ * ticks_per_sec converts them to time. Bucket 0 counts durations of 0
+ * ticks, bucket i those in [2^(i-1), 2^i), and the last bucket also takes
+ * everything longer. TC_STATS_PHASE_COMMAND times the whole command; the
+ * other phases nest inside it and may run several times per command.
+ *
+ * When the TA has no fine-grained clock (ticks_per_sec of 1000, the TEE
+ * system time) it sets TC_STATS_HDR_COARSE: most phases finish within one
+ * tick, so only TC_STATS_PHASE_COMMAND entries carry durations and the
+ * other phase entries carry a count with zero sum, max and buckets.
+ */
+#define TC_STATS_BUCKETS 32
+#define TC_STATS_MAX_CMDS 16       /* command ids 0 .. TC_STATS_MAX_CMDS - 1 */
+#define TC_STATS_MAX_SLABS 8
+
+#define TC_STATS_FLAG_RESET 1      /* value a of GET_STATS param 0 */
+#define TC_STATS_HDR_COARSE 1      /* tc_stats_hdr.flags: phases other than COMMAND are count-only */
+
+#define TC_STATS_PHASE_COMMAND    0  /* TA_InvokeCommandEntryPoint */
+#define TC_STATS_PHASE_PUBKEY     1  /* parse a client key, import it */
+#define TC_STATS_PHASE_VERIFY     2  /* verify a client signature */
+#define TC_STATS_PHASE_BLOCK_HASH 3  /* hash a sealed block */
+#define TC_STATS_PHASE_KEY_LOAD   4  /* open or generate a persistent TEE key */
+#define TC_STATS_PHASE_SIGN       5  /* TEE signature over a hash */
+#define TC_STATS_PHASE_DECRYPT    6  /* decrypt with the TEE key */
+#define TC_STATS_PHASES           7
+
+struct tc_stats_hdr {
+	uint64_t ticks_per_sec;
+	uint32_t shard;
+	uint32_t entry_count;
+	uint32_t slab_count;
+	uint32_t flags;            /* TC_STATS_HDR_* */
+};
+
+struct tc_stats_entry {
+	uint32_t cmd_id;
+	uint32_t phase;            /* TC_STATS_PHASE_* */
+	uint64_t count;
+	uint64_t sum_ticks;
+	uint64_t max_ticks;
+	uint32_t buckets[TC_STATS_BUCKETS];
+};
+
+struct tc_stats_slab {
+	char name[16];
+	uint32_t obj_size;
+	uint32_t page_count;
+	uint32_t total_objs;
+	uint32_t in_use;
+	uint32_t peak_in_use;
+	uint32_t alloc_fail;
+};
+
+#define TC_MAX_STATS_SIZE (sizeof(struct tc_stats_hdr) + \
+			   TC_STATS_MAX_CMDS * TC_STATS_PHASES * sizeof(struct tc_stats_entry) + \
+			   TC_STATS_MAX_SLABS * sizeof(struct tc_stats_slab))
+
+/* Returned when a commit names a key session that expired or was evicted */
+#define TC_ERROR_KEY_SESSION_EXPIRED 0x80000002
+
+/*
+ * Returned by COMMIT and ACCESS_CONTROL when the request carries
+ * TC_TAG_EXPECTED_PARENT and the chain head has already moved on. Lies in
+ * the range GlobalPlatform leaves to TA-specific codes.
+ */
+#define TC_ERROR_STALE_PARENT 0x80000001
+
+struct tc_msg_hdr {
+	uint16_t version;      /* TC_ABI_VERSION */
+	uint16_t msg_type;     /* TC_MSG_* */
+	uint32_t rep_id;
+	uint32_t op;           /* OP_* */
+	uint32_t role;         /* ROLE_*, 0 if unused */
+	uint32_t body_len;     /* bytes of TLV fields after the header */
+};
+
+struct tc_block_hdr {
+	uint16_t version;      /* TC_ABI_VERSION */
+	uint16_t block_type;   /* TC_BLOCK_* */
+	uint32_t block_height;
+	uint32_t op;
+	uint32_t role;         /* ROLE_* for access blocks, 0 otherwise */
+	uint32_t ts_seconds;   /* trusted time */
+	uint32_t ts_millis;
+	uint32_t body_len;     /* bytes of signed TLV fields after the header */
+	uint8_t parent_hash[TC_HASH_SIZE];
+};
+
+struct tc_tlv_hdr {
+	uint16_t tag;
+	uint16_t len;
+};
+
+/* Reply of TA_TRUST_CHAIN_CMD_GET_LATEST_HASH, signed as SHA256 of the struct */
+struct tc_latest_hash_msg {
+	uint32_t nonce;
+	uint32_t block_height;
+	uint8_t latest_hash[TC_HASH_SIZE];
+};
+
+/*
+ * One branch head as committed to by a checkpoint block. name_fp is the
+ * SHA256 of the branch name, height counts blocks on that branch.
+ */
+struct tc_branch_head {
+	uint8_t name_fp[TC_HASH_SIZE];
+	uint8_t head[TC_HASH_SIZE];
+	uint32_t height;
+};
+
+/*
+ * Reply of TA_TRUST_CHAIN_CMD_GET_BRANCH_HEAD, signed as SHA256 of the
+ * struct. A branch without blocks reports height 0 and the repo head it
+ * would fork from.
+ */
+struct tc_branch_head_msg {
+	uint32_t nonce;
+	struct tc_branch_head branch;
+};
+
+/* TLV writer over a caller-provided buffer */
+struct tc_writer {
+	uint8_t *buf;
+	size_t cap;
+	size_t len;
+	int overflow;
+};
+
+static inline void tc_writer_init(struct tc_writer *w, void *buf, size_t cap)
+{
+	w->buf = buf;
+	w->cap = cap;
+	w->len = 0;
+	w->overflow = 0;
+}
+
+static inline void tc_put_bytes(struct tc_writer *w, const void *data, size_t len)
+{
+	if (w->overflow || len > w->cap - w->len) {
+		w->overflow = 1;
+		return;
+	}
+	memcpy(w->buf + w->len, data, len);
+	w->len += len;
+}
+
+static inline void tc_put_tlv(struct tc_writer *w, uint16_t tag,
+			      const void *val, size_t len)
+{
+	struct tc_tlv_hdr tlv = { .tag = tag, .len = (uint16_t)len };
+
+	if (len > 0xFFFF) {
+		w->overflow = 1;
+		return;
+	}
+	tc_put_bytes(w, &tlv, sizeof(tlv));
+	if (len)
+		tc_put_bytes(w, val, len);
+}
+
+/*
+ * Iterate TLV fields of a body.
+ * Returns 1 and fills tag/val/len for each field, 0 at the end of the body,
+ * -1 if the body is truncated.
+ */
+struct tc_reader {
+	const uint8_t *p;
+	size_t remaining;
+};
+
+static inline void tc_reader_init(struct tc_reader *r, const void *body, size_t len)
+{
+	r->p = body;
+	r->remaining = len;
+}
+
+static inline int tc_next_tlv(struct tc_reader *r, uint16_t *tag,
+			      const uint8_t **val, uint16_t *len)
+{
+	struct tc_tlv_hdr tlv;
+
+	if (r->remaining == 0)
+		return 0;
+	if (r->remaining < sizeof(tlv))
+		return -1;
+	memcpy(&tlv, r->p, sizeof(tlv));
+	if (tlv.len > r->remaining - sizeof(tlv))
+		return -1;
+	*tag = tlv.tag;
+	*len = tlv.len;
+	*val = r->p + sizeof(tlv);
+	r->p += sizeof(tlv) + tlv.len;
+	r->remaining -= sizeof(tlv) + tlv.len;
+	return 1;
+}
+
+/*
+ * Size of the encoded block starting at blk, including the TEE signature
+ * trailer (an unfilled batch placeholder counts as a trailer), or 0 if fewer than avail bytes hold a complete block.
+ */
+static inline size_t tc_block_total_len(const uint8_t *blk, size_t avail)
+{
+	struct tc_block_hdr hdr;
+	struct tc_tlv_hdr tlv;
+	size_t off;
+
+	if (avail < sizeof(hdr))
+		return 0;
+	memcpy(&hdr, blk, sizeof(hdr));
+	off = sizeof(hdr) + hdr.body_len;
+	if (hdr.body_len > avail || off + sizeof(tlv) > avail)
+		return 0;
+	memcpy(&tlv, blk + off, sizeof(tlv));
+	if ((tlv.tag != TC_TAG_TEE_SIG && tlv.tag != TC_TAG_TEE_BATCH_SIG) ||
+	    tlv.len > avail - off - sizeof(tlv))
+		return 0;
+	return off + sizeof(tlv) + tlv.len;
+}
+
+#endif /* TA_TRUST_CHAIN_ABI_H */
@@ -16,16 +16,27 @@
 
 /* Trust Chain TA commands */
 #define TA_TRUST_CHAIN_CMD_INIT_REPO             0
+#define TA_TRUST_CHAIN_CMD_DELETE_REPO           1
 #define TA_TRUST_CHAIN_CMD_ACCESS_CONTROL        2
 #define TA_TRUST_CHAIN_CMD_GET_LATEST_HASH       3
 #define TA_TRUST_CHAIN_CMD_COMMIT                4
 #define TA_TRUST_CHAIN_CMD_GET_TEE_PUBKEY        5
+#define TA_TRUST_CHAIN_CMD_GET_BRANCH_HEAD       6
+#define TA_TRUST_CHAIN_CMD_BENCH_SIGN            7  /* only with CFG_TC_BENCH=y */
+#define TA_TRUST_CHAIN_CMD_SEAL_BATCH            8
+#define TA_TRUST_CHAIN_CMD_OPEN_KEY_SESSION      9
+#define TA_TRUST_CHAIN_CMD_SIGN_HEAD_TREE        10
+#define TA_TRUST_CHAIN_CMD_ACL_CHECKPOINT        11
+#define TA_TRUST_CHAIN_CMD_GET_STATS             12
 
 /* Operation types */
 #define OP_ADD     0
 #define OP_DELETE  1
 #define OP_PUSH    2
 #define OP_PR      3
+#define OP_DELETE_REPO 4  /* 仓库删除，对应墓碑区块 */
+#define OP_CHECKPOINT  5  /* 仓库检查点，汇总各分支链头 */
+#define OP_ACL_CHECKPOINT 6  /* 成员集合检查点 */
 
 /* Role types */
 #define ROLE_ADMIN  1
@@ -34,8 +45,35 @@
 /* Maximum repository ID */
 #define MAX_REPO_ID 1000
 
-/* Maximum key length */
-#define MAX_KEY_LENGTH 512
+/*
+ * Repository ID layout: low 16 bits select the slot, the next 4 bits the
+ * shard (TA instance) owning the repository, the high 12 bits carry the
+ * slot generation. A deleted slot is reused with a bumped generation, so
+ * stale IDs of deleted repositories never resolve to the new owner. Client
+ * signatures bind only the ID, so the generation must never wrap: a slot
+ * whose generation reaches REPO_ID_GEN_MASK is retired when deleted and
+ * never handed out again. The host routes every request to the session of
+ * REPO_ID_SHARD(id).
+ */
+#define REPO_ID_SLOT_BITS      16
+#define REPO_ID_SHARD_BITS     4
+#define REPO_ID_SLOT_MASK      0xFFFF
+#define REPO_ID_SHARD_MASK     0xF
+#define REPO_ID_GEN_MASK       0xFFF
+#define REPO_ID_SLOT(id)       ((id) & REPO_ID_SLOT_MASK)
+#define REPO_ID_SHARD(id)      (((id) >> REPO_ID_SLOT_BITS) & REPO_ID_SHARD_MASK)
+#define REPO_ID_GEN(id) \
+	(((id) >> (REPO_ID_SLOT_BITS + REPO_ID_SHARD_BITS)) & REPO_ID_GEN_MASK)
+#define MAKE_REPO_ID(gen, shard, slot) \
+	((((uint32_t)(gen) & REPO_ID_GEN_MASK) << (REPO_ID_SLOT_BITS + REPO_ID_SHARD_BITS)) | \
+	 (((uint32_t)(shard) & REPO_ID_SHARD_MASK) << REPO_ID_SLOT_BITS) | \
+	 ((uint32_t)(slot) & REPO_ID_SLOT_MASK))
+
+/* Maximum number of shards, i.e. TA instances the host may open */
+#define TC_MAX_SHARDS (REPO_ID_SHARD_MASK + 1)
+
+/* Maximum key length: a 4096-bit RSA key in OpenSSH or PEM form */
+#define MAX_KEY_LENGTH 1024
 
 /* Maximum hash length */
 #define MAX_HASH_LENGTH 64
@@ -46,4 +84,13 @@
 /* Maximum branch name length */
 #define MAX_BRANCH_LENGTH 128
 
+/* Maximum number of branches tracked per repository */
+#define MAX_BRANCH_NUM 256
+
+/* A repo checkpoint block is emitted after this many branch blocks */
+#define CHECKPOINT_INTERVAL 16
+
+/* An ACL checkpoint block is emitted after this many access blocks */
+#define ACL_CHECKPOINT_INTERVAL 16
+
 #endif /* TA_TRUST_CHAIN_H */ 
\ No newline at end of file
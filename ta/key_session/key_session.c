@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#include <tee_internal_api.h>
+#include <tee_internal_api_extensions.h>
+#include <stdbool.h>
+#include <string.h>
+#include "key_session.h"
+#include "../tee_key_manager/tee_key_manager.h"
+
+struct key_session {
+    uint64_t id;
+    uint32_t expires;               /* TEE系统时间（秒） */
+    bool used;
+    TEE_OperationHandle op;         /* 已设置会话密钥的AES-GCM解密操作 */
+};
+
+static struct key_session sessions[KEY_SESSION_MAX];
+
+static uint32_t now_seconds(void) {
+    TEE_Time now;
+    TEE_GetSystemTime(&now);
+    return now.seconds;
+}
+
+static void session_free(struct key_session *s) {
+    if (s->op != TEE_HANDLE_NULL) {
+        TEE_FreeOperation(s->op);
+    }
+    memset(s, 0, sizeof(*s));
+    s->op = TEE_HANDLE_NULL;
+}
+
+/* 查找未过期的会话，顺带释放已过期的 */
+static struct key_session *session_find(uint64_t id, uint32_t now) {
+    for (size_t i = 0; i < KEY_SESSION_MAX; i++) {
+        struct key_session *s = &sessions[i];
+        if (!s->used || s->id != id) {
+            continue;
+        }
+        if ((int32_t)(s->expires - now) <= 0) {
+            session_free(s);
+            return NULL;
+        }
+        return s;
+    }
+    return NULL;
+}
+
+/* 空槽或已过期的槽，都没有时挤出最早到期的会话 */
+static struct key_session *session_slot(uint32_t now) {
+    struct key_session *victim = &sessions[0];
+
+    for (size_t i = 0; i < KEY_SESSION_MAX; i++) {
+        struct key_session *s = &sessions[i];
+        if (!s->used || (int32_t)(s->expires - now) <= 0) {
+            session_free(s);
+            return s;
+        }
+        if ((int32_t)(s->expires - victim->expires) < 0) {
+            victim = s;
+        }
+    }
+    session_free(victim);
+    return victim;
+}
+
+static TEE_Result gcm_operation(const uint8_t *key, size_t key_len, TEE_OperationHandle *op) {
+    TEE_ObjectHandle obj = TEE_HANDLE_NULL;
+    TEE_Attribute attr;
+    TEE_Result res;
+
+    res = TEE_AllocateTransientObject(TEE_TYPE_AES, key_len * 8, &obj);
+    if (res != TEE_SUCCESS) {
+        return res;
+    }
+    TEE_InitRefAttribute(&attr, TEE_ATTR_SECRET_VALUE, key, key_len);
+    res = TEE_PopulateTransientObject(obj, &attr, 1);
+    if (res == TEE_SUCCESS) {
+        res = TEE_AllocateOperation(op, TEE_ALG_AES_GCM, TEE_MODE_DECRYPT, key_len * 8);
+    }
+    if (res == TEE_SUCCESS) {
+        res = TEE_SetOperationKey(*op, obj);
+        if (res != TEE_SUCCESS) {
+            TEE_FreeOperation(*op);
+            *op = TEE_HANDLE_NULL;
+        }
+    }
+    /* 操作持有密钥副本，临时对象不再需要 */
+    TEE_FreeTransientObject(obj);
+    return res;
+}
+
+TEE_Result key_session_open(uint64_t id, const uint8_t *enc_key, size_t enc_len,
+                            uint32_t *ttl) {
+    uint8_t key[TEE_KEY_SIZE_BITS / 8];
+    size_t key_len = sizeof(key);
+    uint32_t now = now_seconds();
+    struct key_session *s;
+    TEE_Result res;
+
+    if (session_find(id, now) != NULL) {
+        return TEE_ERROR_ACCESS_CONFLICT;
+    }
+    if (*ttl == 0) {
+        *ttl = KEY_SESSION_DEFAULT_TTL;
+    } else if (*ttl > KEY_SESSION_MAX_TTL) {
+        *ttl = KEY_SESSION_MAX_TTL;
+    }
+
+    /* 每个会话只做这一次RSA私钥解密 */
+    res = tee_decrypt_data(enc_key, enc_len, key, &key_len);
+    if (res != TEE_SUCCESS) {
+        return res;
+    }
+    if (key_len != 16 && key_len != 24 && key_len != 32) {
+        TEE_MemFill(key, 0, sizeof(key));
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    s = session_slot(now);
+    res = gcm_operation(key, key_len, &s->op);
+    TEE_MemFill(key, 0, sizeof(key));
+    if (res != TEE_SUCCESS) {
+        s->op = TEE_HANDLE_NULL;
+        return res;
+    }
+    s->id = id;
+    s->expires = now + *ttl;
+    s->used = true;
+    return TEE_SUCCESS;
+}
+
+TEE_Result key_session_unwrap(uint64_t id, const uint8_t *wrapped, size_t wrapped_len,
+                              const void *aad, size_t aad_len,
+                              uint8_t *key, size_t *key_len) {
+    struct key_session *s = session_find(id, now_seconds());
+    size_t ct_len;
+    TEE_Result res;
+
+    if (s == NULL) {
+        return TC_ERROR_KEY_SESSION_EXPIRED;
+    }
+    if (wrapped_len <= TC_WRAP_NONCE_SIZE + TC_WRAP_TAG_SIZE) {
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+    ct_len = wrapped_len - TC_WRAP_NONCE_SIZE - TC_WRAP_TAG_SIZE;
+    if (*key_len < ct_len) {
+        return TEE_ERROR_SHORT_BUFFER;
+    }
+
+    /* 每次解封重新初始化操作，nonce由客户端为每个内容密钥随机生成 */
+    res = TEE_AEInit(s->op, wrapped, TC_WRAP_NONCE_SIZE, TC_WRAP_TAG_SIZE * 8, aad_len, ct_len);
+    if (res != TEE_SUCCESS) {
+        return res;
+    }
+    TEE_AEUpdateAAD(s->op, aad, aad_len);
+    res = TEE_AEDecryptFinal(s->op, wrapped + TC_WRAP_NONCE_SIZE, ct_len, key, key_len,
+                             (void *)(wrapped + TC_WRAP_NONCE_SIZE + ct_len), TC_WRAP_TAG_SIZE);
+    if (res == TEE_ERROR_MAC_INVALID) {
+        return TEE_ERROR_SECURITY;
+    }
+    return res;
+}
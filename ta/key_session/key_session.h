@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#ifndef KEY_SESSION_H
+#define KEY_SESSION_H
+
+#include <tee_api_types.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "trust_chain_abi.h"
+
+/*
+ * 内容密钥会话：客户端用TEE加密公钥（RSA）加密一个AES会话密钥，握手时
+ * TA解密一次并缓存AES-GCM解密操作；之后的commit用会话密钥以AES-GCM封装
+ * 内容密钥，解封只需一次对称解密。会话属于本TA实例，到期或被挤出缓存后
+ * 返回TC_ERROR_KEY_SESSION_EXPIRED，客户端重新握手。
+ */
+
+#define KEY_SESSION_MAX          64      /* 每个TA实例缓存的会话数 */
+#define KEY_SESSION_DEFAULT_TTL  3600    /* 秒 */
+#define KEY_SESSION_MAX_TTL      86400
+
+/*
+ * 解密RSA密文得到AES会话密钥（16、24或32字节）并以id缓存，*ttl为请求的
+ * 有效期（0取默认值），返回时为实际有效期。id已存在时返回
+ * TEE_ERROR_ACCESS_CONFLICT。
+ */
+TEE_Result key_session_open(uint64_t id, const uint8_t *enc_key, size_t enc_len,
+                            uint32_t *ttl);
+
+/*
+ * 用会话密钥解封内容密钥，wrapped为nonce || 密文 || tag（见trust_chain_abi.h），
+ * aad为附加认证数据。认证失败返回TEE_ERROR_SECURITY。
+ */
+TEE_Result key_session_unwrap(uint64_t id, const uint8_t *wrapped, size_t wrapped_len,
+                              const void *aad, size_t aad_len,
+                              uint8_t *key, size_t *key_len);
+
+#endif /* KEY_SESSION_H */
@@ -0,0 +1,314 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#include <tee_internal_api.h>
+#include <tee_internal_api_extensions.h>
+#include <stdbool.h>
+#include <string.h>
+#include <mbedtls/pk.h>
+#include <mbedtls/rsa.h>
+#include "rsa_pubkey.h"
+#include "trust_chain_ta.h"
+#include "../utils/utils.h"
+
+#define SSH_RSA_NAME     "ssh-rsa"
+#define SSH_RSA_NAME_LEN 7
+/* string "ssh-rsa" + mpint e + mpint n，mpint可能多一个0x00前缀 */
+#define SSH_BLOB_MAX     (4 + SSH_RSA_NAME_LEN + 4 + 1 + 8 + 4 + 1 + RSA_PUBKEY_MAX_BITS / 8)
+
+/* 最近一次解析的公钥：同一请求先算指纹、再验签，两次用的是同一段文本 */
+static struct {
+    bool valid;
+    size_t len;
+    char text[MAX_KEY_LENGTH];
+    struct rsa_pubkey key;
+} last_key;
+
+/* mbedtls解析PEM要求以NUL结尾；TA栈很小，放在静态区 */
+static char pem_buf[MAX_KEY_LENGTH + 1];
+
+/* base64字符到6位值，非法字符为0x80 */
+static const uint8_t b64_table[256] = {
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x3e, 0x80, 0x80, 0x80, 0x3f,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
+    0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30, 0x31, 0x32, 0x33, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+};
+
+/*
+ * 每次取4个字符查表，4个值或在一起只判断一次非法位，再拼成24位写出
+ * 3个字节；只有最后一组可以带'='填充。
+ */
+static TEE_Result base64_decode(const char *in, size_t in_len,
+                                uint8_t *out, size_t cap, size_t *out_len) {
+    const uint8_t *s = (const uint8_t *)in;
+    size_t i = 0;
+    size_t o = 0;
+
+    if (in_len == 0 || in_len % 4 != 0 || in_len / 4 * 3 > cap + 2) {
+        return TEE_ERROR_BAD_FORMAT;
+    }
+    for (; i + 4 <= in_len; i += 4) {
+        uint32_t a = b64_table[s[i]];
+        uint32_t b = b64_table[s[i + 1]];
+        uint32_t c = b64_table[s[i + 2]];
+        uint32_t d = b64_table[s[i + 3]];
+        uint32_t v;
+
+        if ((a | b | c | d) & 0x80) {
+            break;
+        }
+        if (o + 3 > cap) {
+            return TEE_ERROR_BAD_FORMAT;
+        }
+        v = a << 18 | b << 12 | c << 6 | d;
+        out[o] = (uint8_t)(v >> 16);
+        out[o + 1] = (uint8_t)(v >> 8);
+        out[o + 2] = (uint8_t)v;
+        o += 3;
+    }
+
+    if (i < in_len) {
+        uint32_t a = b64_table[s[i]];
+        uint32_t b = b64_table[s[i + 1]];
+        uint32_t c = b64_table[s[i + 2]];
+
+        if (i + 4 != in_len || ((a | b) & 0x80) || s[i + 3] != '=') {
+            return TEE_ERROR_BAD_FORMAT;
+        }
+        if (s[i + 2] == '=') {
+            if (o + 1 > cap) {
+                return TEE_ERROR_BAD_FORMAT;
+            }
+            out[o++] = (uint8_t)(a << 2 | b >> 4);
+        } else {
+            if ((c & 0x80) || o + 2 > cap) {
+                return TEE_ERROR_BAD_FORMAT;
+            }
+            out[o++] = (uint8_t)(a << 2 | b >> 4);
+            out[o++] = (uint8_t)(b << 4 | c >> 2);
+        }
+    }
+    *out_len = o;
+    return TEE_SUCCESS;
+}
+
+/* SSH线格式的string：4字节大端长度 + 内容 */
+static bool ssh_read_string(const uint8_t **p, const uint8_t *end,
+                            const uint8_t **val, size_t *len) {
+    uint32_t n;
+
+    if (end - *p < 4) {
+        return false;
+    }
+    n = (uint32_t)(*p)[0] << 24 | (uint32_t)(*p)[1] << 16 | (uint32_t)(*p)[2] << 8 | (*p)[3];
+    *p += 4;
+    if ((size_t)(end - *p) < n) {
+        return false;
+    }
+    *val = *p;
+    *len = n;
+    *p += n;
+    return true;
+}
+
+/* 非负mpint，去掉前导0后拷贝 */
+static bool ssh_read_mpint(const uint8_t **p, const uint8_t *end,
+                           uint8_t *out, size_t cap, size_t *out_len) {
+    const uint8_t *val;
+    size_t len;
+
+    if (!ssh_read_string(p, end, &val, &len) || (len > 0 && (val[0] & 0x80))) {
+        return false;
+    }
+    while (len > 0 && val[0] == 0) {
+        val++;
+        len--;
+    }
+    if (len == 0 || len > cap) {
+        return false;
+    }
+    memcpy(out, val, len);
+    *out_len = len;
+    return true;
+}
+
+/* ssh-rsa AAAA... [注释]，只解码第二个字段 */
+static TEE_Result parse_openssh(const char *key, size_t key_len, struct rsa_pubkey *pk) {
+    uint8_t blob[SSH_BLOB_MAX];
+    size_t blob_len;
+    size_t b64_start = SSH_RSA_NAME_LEN + 1;
+    size_t b64_end = b64_start;
+    const uint8_t *p = blob;
+    const uint8_t *end;
+    const uint8_t *name;
+    size_t name_len;
+    TEE_Result res;
+
+    while (b64_end < key_len && key[b64_end] != ' ' && key[b64_end] != '\t' &&
+           key[b64_end] != '\r' && key[b64_end] != '\n') {
+        b64_end++;
+    }
+    res = base64_decode(key + b64_start, b64_end - b64_start, blob, sizeof(blob), &blob_len);
+    if (res != TEE_SUCCESS) {
+        return res;
+    }
+
+    end = blob + blob_len;
+    if (!ssh_read_string(&p, end, &name, &name_len) ||
+        name_len != SSH_RSA_NAME_LEN || memcmp(name, SSH_RSA_NAME, SSH_RSA_NAME_LEN) != 0 ||
+        !ssh_read_mpint(&p, end, pk->e, sizeof(pk->e), &pk->e_len) ||
+        !ssh_read_mpint(&p, end, pk->n, sizeof(pk->n), &pk->n_len) ||
+        p != end) {
+        return TEE_ERROR_BAD_FORMAT;
+    }
+    return TEE_SUCCESS;
+}
+
+/* PEM交给mbedtls解析，再导出模数和指数 */
+static TEE_Result parse_pem(const char *key, size_t key_len, struct rsa_pubkey *pk) {
+    mbedtls_pk_context pk_ctx;
+    mbedtls_mpi N, E;
+    TEE_Result res = TEE_ERROR_BAD_FORMAT;
+    int mbedtls_res;
+
+    memcpy(pem_buf, key, key_len);
+    pem_buf[key_len] = '\0';
+
+    mbedtls_pk_init(&pk_ctx);
+    mbedtls_mpi_init(&N);
+    mbedtls_mpi_init(&E);
+
+    mbedtls_res = mbedtls_pk_parse_public_key(&pk_ctx, (const unsigned char *)pem_buf, key_len + 1);
+    if (mbedtls_res != 0) {
+        EMSG("mbedtls_pk_parse_public_key failed: -0x%x", -mbedtls_res);
+        goto cleanup;
+    }
+    if (mbedtls_pk_get_type(&pk_ctx) != MBEDTLS_PK_RSA) {
+        EMSG("Public key is not RSA type");
+        res = TEE_ERROR_BAD_PARAMETERS;
+        goto cleanup;
+    }
+    if (mbedtls_rsa_export(mbedtls_pk_rsa(pk_ctx), &N, NULL, NULL, NULL, &E) != 0) {
+        goto cleanup;
+    }
+    pk->n_len = mbedtls_mpi_size(&N);
+    pk->e_len = mbedtls_mpi_size(&E);
+    if (pk->n_len == 0 || pk->n_len > sizeof(pk->n) ||
+        pk->e_len == 0 || pk->e_len > sizeof(pk->e)) {
+        res = TEE_ERROR_BAD_PARAMETERS;
+        goto cleanup;
+    }
+    if (mbedtls_mpi_write_binary(&N, pk->n, pk->n_len) != 0 ||
+        mbedtls_mpi_write_binary(&E, pk->e, pk->e_len) != 0) {
+        goto cleanup;
+    }
+    res = TEE_SUCCESS;
+
+cleanup:
+    mbedtls_pk_free(&pk_ctx);
+    mbedtls_mpi_free(&N);
+    mbedtls_mpi_free(&E);
+    return res;
+}
+
+TEE_Result rsa_pubkey_parse(const char *key, size_t key_len, const struct rsa_pubkey **out) {
+    struct rsa_pubkey *pk = &last_key.key;
+    TEE_Result res;
+    uint32_t bits;
+
+    if (!key || !out || key_len == 0 || key_len > MAX_KEY_LENGTH) {
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+    if (last_key.valid && last_key.len == key_len && memcmp(last_key.text, key, key_len) == 0) {
+        *out = pk;
+        return TEE_SUCCESS;
+    }
+
+    last_key.valid = false;
+    memset(pk, 0, sizeof(*pk));
+    if (key_len > SSH_RSA_NAME_LEN &&
+        memcmp(key, SSH_RSA_NAME " ", SSH_RSA_NAME_LEN + 1) == 0) {
+        res = parse_openssh(key, key_len, pk);
+    } else {
+        res = parse_pem(key, key_len, pk);
+    }
+    if (res != TEE_SUCCESS) {
+        return res;
+    }
+
+    /* 模数位数：字节数减去最高字节的前导0位 */
+    bits = (uint32_t)pk->n_len * 8;
+    for (uint8_t top = pk->n[0]; !(top & 0x80); top <<= 1) {
+        bits--;
+    }
+    if (bits < RSA_PUBKEY_MIN_BITS || bits > RSA_PUBKEY_MAX_BITS) {
+        EMSG("Unsupported RSA key length: %u, must be between 2048 and 4096", bits);
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+    pk->bits = bits;
+
+    last_key.valid = true;
+    last_key.len = key_len;
+    memcpy(last_key.text, key, key_len);
+    *out = pk;
+    return TEE_SUCCESS;
+}
+
+static size_t put_ssh_string(uint8_t *out, const uint8_t *val, size_t len, bool mpint) {
+    size_t pad = mpint && (val[0] & 0x80) ? 1 : 0;
+    uint32_t n = (uint32_t)(len + pad);
+
+    out[0] = (uint8_t)(n >> 24);
+    out[1] = (uint8_t)(n >> 16);
+    out[2] = (uint8_t)(n >> 8);
+    out[3] = (uint8_t)n;
+    out[4] = 0;
+    memcpy(out + 4 + pad, val, len);
+    return 4 + pad + len;
+}
+
+TEE_Result rsa_pubkey_fingerprint(const struct rsa_pubkey *pk, uint8_t *fp) {
+    uint8_t blob[SSH_BLOB_MAX];
+    size_t len = 0;
+    size_t fp_len = TC_HASH_SIZE;
+
+    len += put_ssh_string(blob + len, (const uint8_t *)SSH_RSA_NAME, SSH_RSA_NAME_LEN, false);
+    len += put_ssh_string(blob + len, pk->e, pk->e_len, true);
+    len += put_ssh_string(blob + len, pk->n, pk->n_len, true);
+    return compute_sha256_hash(blob, len, fp, &fp_len);
+}
+
+TEE_Result rsa_pubkey_to_obj(const struct rsa_pubkey *pk, TEE_ObjectHandle *key_obj) {
+    TEE_Attribute attrs[2];
+    TEE_Result res;
+
+    res = TEE_AllocateTransientObject(TEE_TYPE_RSA_PUBLIC_KEY, pk->bits, key_obj);
+    if (res != TEE_SUCCESS) {
+        EMSG("Failed to allocate RSA public key object");
+        return res;
+    }
+    TEE_InitRefAttribute(&attrs[0], TEE_ATTR_RSA_MODULUS, pk->n, pk->n_len);
+    TEE_InitRefAttribute(&attrs[1], TEE_ATTR_RSA_PUBLIC_EXPONENT, pk->e, pk->e_len);
+    res = TEE_PopulateTransientObject(*key_obj, attrs, 2);
+    if (res != TEE_SUCCESS) {
+        EMSG("Failed to populate transient object with RSA public key attributes");
+        TEE_FreeTransientObject(*key_obj);
+        *key_obj = TEE_HANDLE_NULL;
+    }
+    return res;
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#ifndef RSA_PUBKEY_H
+#define RSA_PUBKEY_H
+
+#include <tee_api_types.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "trust_chain_abi.h"
+
+/*
+ * 客户端RSA公钥：接受OpenSSH单行格式（ssh-rsa AAAA... 注释）和PEM
+ * （SubjectPublicKeyInfo或PKCS#1）。OpenSSH格式直接按SSH线格式解码出
+ * 模数和指数，不经过mbedtls；PEM仍由mbedtls解析。
+ *
+ * 公钥指纹与输入格式无关：SHA256(SSH线格式的公钥)，即string "ssh-rsa" ||
+ * mpint e || mpint n，与ssh-keygen -l -E sha256显示的指纹相同，同一把
+ * 钥匙的两种格式在成员集合中是同一个成员。
+ */
+
+#define RSA_PUBKEY_MIN_BITS 2048
+#define RSA_PUBKEY_MAX_BITS 4096
+
+struct rsa_pubkey {
+    uint8_t n[RSA_PUBKEY_MAX_BITS / 8];   /* 大端，无前导0 */
+    size_t n_len;
+    uint8_t e[8];
+    size_t e_len;
+    uint32_t bits;
+};
+
+/*
+ * 解析公钥文本，格式错误返回TEE_ERROR_BAD_FORMAT，模数长度不在
+ * 2048到4096位之间返回TEE_ERROR_BAD_PARAMETERS。结果缓存在模块内，
+ * *pk在下一次解析前有效；同一请求里先算指纹再验签时只解析一次。
+ */
+TEE_Result rsa_pubkey_parse(const char *key, size_t key_len, const struct rsa_pubkey **pk);
+
+/* 规范指纹，输出TC_HASH_SIZE字节 */
+TEE_Result rsa_pubkey_fingerprint(const struct rsa_pubkey *pk, uint8_t *fp);
+
+/* 创建TEE_TYPE_RSA_PUBLIC_KEY临时对象，由调用者关闭 */
+TEE_Result rsa_pubkey_to_obj(const struct rsa_pubkey *pk, TEE_ObjectHandle *key_obj);
+
+#endif /* RSA_PUBKEY_H */
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#include "sign_batch.h"
+#include "../utils/utils.h"
+#include <string.h>
+
+static uint32_t max_leaves = 0;          /* 0表示逐块签名 */
+static uint32_t leaf_count = 0;
+static uint32_t window_seq = 0;
+static uint8_t leaves[TC_MAX_BATCH_LEAVES][TC_HASH_SIZE];
+
+void sign_batch_enable(uint32_t max) {
+    max_leaves = max > TC_MAX_BATCH_LEAVES ? TC_MAX_BATCH_LEAVES : max;
+}
+
+bool sign_batch_enabled(void) {
+    return max_leaves > 0;
+}
+
+/* 叶子节点为SHA256(0x00 || 区块哈希)，与内部节点区分 */
+TEE_Result sign_batch_add(const uint8_t *block_hash) {
+    uint8_t buf[1 + TC_HASH_SIZE];
+    size_t hash_len = TC_HASH_SIZE;
+
+    if (leaf_count >= max_leaves) {
+        return TEE_ERROR_OVERFLOW;
+    }
+    buf[0] = TC_MERKLE_LEAF_PREFIX;
+    memcpy(buf + 1, block_hash, TC_HASH_SIZE);
+    if (compute_sha256_hash(buf, sizeof(buf), leaves[leaf_count], &hash_len) != TEE_SUCCESS) {
+        return TEE_ERROR_GENERIC;
+    }
+    leaf_count++;
+    return TEE_SUCCESS;
+}
+
+/* 逐层两两合并，奇数个时最后一个节点原样上移 */
+TEE_Result sign_batch_root(uint32_t shard, struct tc_batch_root *root) {
+    uint8_t level[TC_MAX_BATCH_LEAVES][TC_HASH_SIZE];
+    uint8_t buf[1 + 2 * TC_HASH_SIZE];
+    uint32_t width = leaf_count;
+
+    if (leaf_count == 0) {
+        return TEE_ERROR_ITEM_NOT_FOUND;
+    }
+    memcpy(level, leaves, (size_t)leaf_count * TC_HASH_SIZE);
+    while (width > 1) {
+        uint32_t next = 0;
+        for (uint32_t i = 0; i + 1 < width; i += 2) {
+            size_t hash_len = TC_HASH_SIZE;
+            buf[0] = TC_MERKLE_NODE_PREFIX;
+            memcpy(buf + 1, level[i], TC_HASH_SIZE);
+            memcpy(buf + 1 + TC_HASH_SIZE, level[i + 1], TC_HASH_SIZE);
+            if (compute_sha256_hash(buf, sizeof(buf), level[next++], &hash_len) != TEE_SUCCESS) {
+                return TEE_ERROR_GENERIC;
+            }
+        }
+        if (width % 2) {
+            memcpy(level[next++], level[width - 1], TC_HASH_SIZE);
+        }
+        width = next;
+    }
+
+    memset(root, 0, sizeof(*root));
+    root->shard = shard;
+    root->seq = window_seq;
+    root->leaf_count = leaf_count;
+    memcpy(root->root, level[0], TC_HASH_SIZE);
+    return TEE_SUCCESS;
+}
+
+void sign_batch_reset(void) {
+    leaf_count = 0;
+    window_seq++;
+}
@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#ifndef SIGN_BATCH_H
+#define SIGN_BATCH_H
+
+#include <tee_api_types.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "trust_chain_abi.h"
+
+/*
+ * 聚合签名窗口（格式见trust_chain_abi.h）：启用后区块不再逐个签名，
+ * 只记录区块哈希，由CA在窗口结束时调用SEAL_BATCH对全部区块哈希的
+ * Merkle根签名一次。窗口属于本TA实例，跨仓库。
+ */
+
+/* 启用聚合签名，max_leaves为每个窗口的区块数上限（不超过TC_MAX_BATCH_LEAVES） */
+void sign_batch_enable(uint32_t max_leaves);
+
+bool sign_batch_enabled(void);
+
+/* 记录一个待签名区块的哈希，窗口已满时返回TEE_ERROR_OVERFLOW */
+TEE_Result sign_batch_add(const uint8_t *block_hash);
+
+/* 计算当前窗口的Merkle根，窗口为空时返回TEE_ERROR_ITEM_NOT_FOUND */
+TEE_Result sign_batch_root(uint32_t shard, struct tc_batch_root *root);
+
+/* 结束当前窗口，开始下一个 */
+void sign_batch_reset(void);
+
+#endif /* SIGN_BATCH_H */
@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#include "slab.h"
+#include <string.h>
+#include <tee_internal_api.h>
+#include <tee_internal_api_extensions.h>
+
+/* 已登记的缓存，用于统计导出 */
+static struct slab_cache *registered_caches[SLAB_MAX_CACHES];
+static uint32_t registered_count = 0;
+
+static void slab_register(struct slab_cache *cache) {
+	if (cache->registered) {
+		return;
+	}
+	if (registered_count < SLAB_MAX_CACHES) {
+		registered_caches[registered_count++] = cache;
+	} else {
+		EMSG("Too many slab caches, %s not registered for stats", cache->name);
+	}
+	cache->registered = true;
+}
+
+/* 申请新的一页对象并全部挂入空闲链表 */
+static TEE_Result slab_grow(struct slab_cache *cache) {
+	size_t page_size = sizeof(struct slab_page) + cache->obj_size * cache->objs_per_page;
+	struct slab_page *page = TEE_Malloc(page_size, TEE_MALLOC_FILL_ZERO);
+	if (page == NULL) {
+		return TEE_ERROR_OUT_OF_MEMORY;
+	}
+
+	page->next = cache->pages;
+	cache->pages = page;
+
+	uint8_t *objs = (uint8_t *)(page + 1);
+	for (uint32_t i = cache->objs_per_page; i > 0; i--) {
+		struct slab_free_obj *obj = (struct slab_free_obj *)(objs + (i - 1) * cache->obj_size);
+		obj->next = cache->free_list;
+		cache->free_list = obj;
+	}
+
+	cache->page_count++;
+	cache->total_objs += cache->objs_per_page;
+	DMSG("slab %s grown to %u pages", cache->name, cache->page_count);
+	return TEE_SUCCESS;
+}
+
+void *slab_alloc(struct slab_cache *cache) {
+	if (cache == NULL || cache->obj_size < sizeof(struct slab_free_obj) ||
+	    cache->obj_size > SLAB_MAX_OBJ_SIZE || cache->objs_per_page == 0) {
+		return NULL;
+	}
+
+	slab_register(cache);
+
+	if (cache->free_list == NULL && slab_grow(cache) != TEE_SUCCESS) {
+		cache->alloc_fail++;
+		EMSG("slab %s allocation failed, in_use %u/%u",
+		     cache->name, cache->in_use, cache->total_objs);
+		return NULL;
+	}
+
+	struct slab_free_obj *obj = cache->free_list;
+	cache->free_list = obj->next;
+
+	cache->in_use++;
+	if (cache->in_use > cache->peak_in_use) {
+		cache->peak_in_use = cache->in_use;
+	}
+
+	memset(obj, 0, cache->obj_size);
+	return obj;
+}
+
+void slab_free(struct slab_cache *cache, void *obj) {
+	if (cache == NULL || obj == NULL) {
+		return;
+	}
+
+	/* 清零后再挂回，避免释放的密钥等内容残留 */
+	memset(obj, 0, cache->obj_size);
+
+	struct slab_free_obj *free_obj = obj;
+	free_obj->next = cache->free_list;
+	cache->free_list = free_obj;
+	cache->in_use--;
+}
+
+uint32_t slab_collect_stats(struct slab_stats *stats, uint32_t max_stats) {
+	uint32_t n = 0;
+
+	for (uint32_t i = 0; i < registered_count && n < max_stats; i++, n++) {
+		const struct slab_cache *cache = registered_caches[i];
+		memset(&stats[n], 0, sizeof(stats[n]));
+		strncpy(stats[n].name, cache->name, sizeof(stats[n].name) - 1);
+		stats[n].obj_size = cache->obj_size;
+		stats[n].page_count = cache->page_count;
+		stats[n].total_objs = cache->total_objs;
+		stats[n].in_use = cache->in_use;
+		stats[n].peak_in_use = cache->peak_in_use;
+		stats[n].alloc_fail = cache->alloc_fail;
+	}
+	return n;
+}
+
+void slab_log_stats(void) {
+	for (uint32_t i = 0; i < registered_count; i++) {
+		const struct slab_cache *cache = registered_caches[i];
+		IMSG("slab %-12s size %4zu pages %3u in_use %4u/%4u peak %4u fail %u",
+		     cache->name, cache->obj_size, cache->page_count,
+		     cache->in_use, cache->total_objs, cache->peak_in_use,
+		     cache->alloc_fail);
+	}
+}
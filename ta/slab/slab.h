@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <tee_api_types.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* 单个size class允许的最大对象尺寸 */
+#define SLAB_MAX_OBJ_SIZE 1024
+
+/* 全局登记的slab缓存数量上限 */
+#define SLAB_MAX_CACHES 8
+
+/* 空闲对象链表节点，复用空闲对象自身的内存 */
+struct slab_free_obj {
+	struct slab_free_obj *next;
+};
+
+/* 一次向TEE堆申请的一整页对象 */
+struct slab_page {
+	struct slab_page *next;
+	/* 紧跟objs_per_page个对象 */
+};
+
+/*
+ * 定长对象缓存（size class）。
+ * 对象按页批量从TEE堆申请，释放后挂回空闲链表而不归还堆，
+ * 因此分配/释放均为O(1)，堆上只存在整页的大块，碎片有界。
+ */
+struct slab_cache {
+	const char *name;
+	size_t obj_size;                 /* 对齐后的对象尺寸 */
+	uint32_t objs_per_page;
+	struct slab_free_obj *free_list;
+	struct slab_page *pages;
+	bool registered;
+
+	/* 占用统计 */
+	uint32_t page_count;
+	uint32_t total_objs;
+	uint32_t in_use;
+	uint32_t peak_in_use;
+	uint32_t alloc_fail;
+};
+
+/* 对外导出的占用统计 */
+struct slab_stats {
+	char name[16];
+	uint32_t obj_size;
+	uint32_t page_count;
+	uint32_t total_objs;
+	uint32_t in_use;
+	uint32_t peak_in_use;
+	uint32_t alloc_fail;
+};
+
+/* 静态定义一个缓存，首次分配时自动登记 */
+#define SLAB_CACHE_INITIALIZER(_name, _size, _per_page) \
+	{ .name = (_name), \
+	  .obj_size = (((_size) + sizeof(void *) - 1) & ~(sizeof(void *) - 1)), \
+	  .objs_per_page = (_per_page) }
+
+/* 分配一个清零的对象，失败返回NULL */
+void *slab_alloc(struct slab_cache *cache);
+
+/* 将对象归还到所属缓存 */
+void slab_free(struct slab_cache *cache, void *obj);
+
+/* 导出所有已登记缓存的统计信息，返回写入条数 */
+uint32_t slab_collect_stats(struct slab_stats *stats, uint32_t max_stats);
+
+/* 将所有缓存的占用情况输出到日志 */
+void slab_log_stats(void);
+
+#endif /* SLAB_H */
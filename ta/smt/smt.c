@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#include "smt.h"
+#include <string.h>
+#include <tee_internal_api.h>
+
+static const uint8_t empty_hash[TC_HASH_SIZE];
+static const uint8_t empty_bitmap[TC_SMT_BITMAP_SIZE];
+
+static int bit_at(const uint8_t *bits, uint32_t i) {
+    return (bits[i / 8] >> (7 - i % 8)) & 1;
+}
+
+static bool valid_role(uint8_t role) {
+    return role == ROLE_ADMIN || role == ROLE_WRITER;
+}
+
+/* a与b在[0, n)内的位是否全部相同 */
+static bool same_prefix(const uint8_t *a, const uint8_t *b, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) {
+        if (bit_at(a, i) != bit_at(b, i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+TEE_Result smt_proof_parse(const uint8_t *buf, size_t len, struct smt_proof *proof) {
+    size_t siblings = 0;
+    size_t base;
+
+    if (len < 1 + TC_SMT_BITMAP_SIZE) {
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+    if (buf[0] != 0 && !valid_role(buf[0])) {
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+    proof->deepest = -1;
+    for (uint32_t i = 0; i < TC_SMT_DEPTH; i++) {
+        if (bit_at(buf + 1, i)) {
+            siblings++;
+            proof->deepest = (int)i;
+        }
+    }
+    base = 1 + TC_SMT_BITMAP_SIZE + siblings * TC_HASH_SIZE;
+    if (len != base && len != base + TC_SMT_LEAF_SIZE) {
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+    proof->role = buf[0];
+    proof->bitmap = buf + 1;
+    proof->siblings = buf + 1 + TC_SMT_BITMAP_SIZE;
+    proof->leaf = len == base ? NULL : buf + base;
+    /* 成员的相邻成员是最深的兄弟，必须存在 */
+    if (proof->leaf != NULL &&
+        (!valid_role(proof->leaf[TC_HASH_SIZE]) || (proof->role != 0 && proof->deepest < 0))) {
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+    return TEE_SUCCESS;
+}
+
+static TEE_Result leaf_hash(TEE_OperationHandle op, const uint8_t *fp, uint8_t role,
+                            uint8_t *out) {
+    const uint8_t prefix = TC_MERKLE_LEAF_PREFIX;
+    size_t hash_len = TC_HASH_SIZE;
+
+    TEE_DigestUpdate(op, &prefix, 1);
+    TEE_DigestUpdate(op, fp, KEY_FP_SIZE);
+    return TEE_DigestDoFinal(op, &role, 1, out, &hash_len);
+}
+
+/* out可以与left或right相同 */
+static TEE_Result node_hash(TEE_OperationHandle op, const uint8_t *left, const uint8_t *right,
+                            uint8_t *out) {
+    const uint8_t prefix = TC_MERKLE_NODE_PREFIX;
+    uint8_t next[TC_HASH_SIZE];
+    size_t hash_len = TC_HASH_SIZE;
+    TEE_Result res;
+
+    TEE_DigestUpdate(op, &prefix, 1);
+    TEE_DigestUpdate(op, left, TC_HASH_SIZE);
+    res = TEE_DigestDoFinal(op, right, TC_HASH_SIZE, next, &hash_len);
+    if (res == TEE_SUCCESS) {
+        memcpy(out, next, TC_HASH_SIZE);
+    }
+    return res;
+}
+
+/*
+ * 把深度from + 1处的子树h逐层合并到根。single为真时h为空或只有一个成员，
+ * 兄弟为空的层原样上移，直到遇到第一个非空兄弟；from比最深的兄弟更深时，
+ * 其间各层的兄弟都为空。
+ */
+static TEE_Result climb(TEE_OperationHandle op, const struct smt_proof *proof,
+                        const uint8_t *fp, int from, bool single, uint8_t *h) {
+    const uint8_t *sibling = proof->siblings;
+    int top = from > proof->deepest ? from : proof->deepest;
+    TEE_Result res = TEE_SUCCESS;
+
+    for (int i = top; i >= 0 && res == TEE_SUCCESS; i--) {
+        const uint8_t *s = empty_hash;
+
+        if (bit_at(proof->bitmap, i)) {
+            s = sibling;
+            sibling += TC_HASH_SIZE;
+        }
+        if (i > from || (single && s == empty_hash)) {
+            continue;
+        }
+        single = false;
+        if (bit_at(fp, i)) {
+            res = node_hash(op, s, h, h);
+        } else {
+            res = node_hash(op, h, s, h);
+        }
+    }
+    return res;
+}
+
+TEE_Result smt_root_with(const struct smt_proof *proof, const uint8_t *fp, uint8_t role,
+                         uint8_t *root) {
+    TEE_OperationHandle hash_op = TEE_HANDLE_NULL;
+    const uint8_t *other = proof->leaf;
+    uint8_t h[TC_HASH_SIZE], h2[TC_HASH_SIZE];
+    int from = proof->deepest;
+    bool single = false;
+    TEE_Result res;
+
+    res = TEE_AllocateOperation(&hash_op, TEE_ALG_SHA256, TEE_MODE_DIGEST, 0);
+    if (res != TEE_SUCCESS) {
+        return res;
+    }
+    memset(h, 0, sizeof(h));
+    if (role != 0 && (proof->role != 0 || other == NULL)) {
+        /* 修改角色，或加入到空的位置 */
+        res = leaf_hash(hash_op, fp, role, h);
+    } else if (role != 0) {
+        /* 加入到另一成员独占的子树：两者在第一个不同的位处分开 */
+        uint32_t k = proof->deepest + 1;
+
+        while (k < TC_SMT_DEPTH && bit_at(fp, k) == bit_at(other, k)) {
+            k++;
+        }
+        res = leaf_hash(hash_op, fp, role, h);
+        if (res == TEE_SUCCESS) {
+            res = leaf_hash(hash_op, other, other[TC_HASH_SIZE], h2);
+        }
+        if (res == TEE_SUCCESS) {
+            res = bit_at(fp, k) ? node_hash(hash_op, h2, h, h) : node_hash(hash_op, h, h2, h);
+        }
+        from = (int)k - 1;
+    } else if (other != NULL) {
+        /*
+         * 非成员的证明：子树只有相邻成员；移除成员：只剩最深的兄弟，
+         * 即相邻成员，上移到下一个非空兄弟处
+         */
+        res = leaf_hash(hash_op, other, other[TC_HASH_SIZE], h);
+        if (proof->role != 0) {
+            from = proof->deepest - 1;
+            single = true;
+        }
+    }
+    if (res == TEE_SUCCESS) {
+        res = climb(hash_op, proof, fp, from, single, h);
+    }
+    TEE_FreeOperation(hash_op);
+    if (res == TEE_SUCCESS) {
+        memcpy(root, h, TC_HASH_SIZE);
+    }
+    return res;
+}
+
+TEE_Result smt_verify(const struct smt_proof *proof, const uint8_t *fp, const uint8_t *root) {
+    uint8_t computed[TC_HASH_SIZE];
+    TEE_Result res;
+
+    if (proof->leaf != NULL) {
+        if (proof->role != 0) {
+            /* 成员的相邻成员：与fp在最深的兄弟处分开，叶子即该兄弟 */
+            TEE_OperationHandle op = TEE_HANDLE_NULL;
+
+            if (!same_prefix(proof->leaf, fp, proof->deepest) ||
+                bit_at(proof->leaf, proof->deepest) == bit_at(fp, proof->deepest)) {
+                return TEE_ERROR_SECURITY;
+            }
+            res = TEE_AllocateOperation(&op, TEE_ALG_SHA256, TEE_MODE_DIGEST, 0);
+            if (res != TEE_SUCCESS) {
+                return res;
+            }
+            res = leaf_hash(op, proof->leaf, proof->leaf[TC_HASH_SIZE], computed);
+            TEE_FreeOperation(op);
+            if (res != TEE_SUCCESS) {
+                return res;
+            }
+            if (memcmp(computed, proof->siblings, TC_HASH_SIZE) != 0) {
+                return TEE_ERROR_SECURITY;
+            }
+        } else if (!same_prefix(proof->leaf, fp, proof->deepest + 1) ||
+                   memcmp(proof->leaf, fp, KEY_FP_SIZE) == 0) {
+            /* 非成员的相邻成员：与fp同在路径终点的子树中，且不是fp */
+            return TEE_ERROR_SECURITY;
+        }
+    }
+    res = smt_root_with(proof, fp, proof->role, computed);
+    if (res != TEE_SUCCESS) {
+        return res;
+    }
+    if (memcmp(computed, root, TC_HASH_SIZE) != 0) {
+        return TEE_ERROR_SECURITY;
+    }
+    return TEE_SUCCESS;
+}
+
+TEE_Result smt_single_root(const uint8_t *fp, uint8_t role, uint8_t *root) {
+    struct smt_proof empty = { 0, empty_bitmap, NULL, NULL, -1 };
+
+    return smt_root_with(&empty, fp, role, root);
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#ifndef SMT_H
+#define SMT_H
+
+#include <tee_api_types.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "trust_chain_abi.h"
+
+/* 公钥规范指纹的长度，也是成员树的键长 */
+#define KEY_FP_SIZE TC_HASH_SIZE
+
+/*
+ * 成员集合的稀疏Merkle树（格式见trust_chain_abi.h）。TA只保存每个仓库的
+ * 根，树的节点由CA保存；请求携带签名者与被授权者的成员证明，TA用证明中的
+ * 兄弟节点重算根来确认角色，换上新角色再算一次即得变更后的根。
+ * TA内存与成员数无关；只有一个成员的子树即为该成员的叶子，每次计算的
+ * 哈希次数约为log2(成员数)。
+ */
+struct smt_proof {
+    uint8_t role;                   /* 证明所声称的角色，0为非成员 */
+    const uint8_t *bitmap;          /* TC_SMT_BITMAP_SIZE字节 */
+    const uint8_t *siblings;        /* 非空兄弟节点，自叶向根 */
+    const uint8_t *leaf;            /* 可选的相邻成员fp || role，没有为NULL */
+    int deepest;                    /* 位图中最深的置位，没有为-1 */
+};
+
+/* 解析请求中的成员证明，长度与位图不符或角色非法时返回TEE_ERROR_BAD_PARAMETERS */
+TEE_Result smt_proof_parse(const uint8_t *buf, size_t len, struct smt_proof *proof);
+
+/* 以证明中的兄弟节点、fp处的角色role（0为移除）计算根，证明须已通过smt_verify */
+TEE_Result smt_root_with(const struct smt_proof *proof, const uint8_t *fp, uint8_t role,
+                         uint8_t *root);
+
+/* 确认证明在root下成立、相邻成员的位置与fp相符，不成立返回TEE_ERROR_SECURITY */
+TEE_Result smt_verify(const struct smt_proof *proof, const uint8_t *fp, const uint8_t *root);
+
+/* 只有一个成员的树的根，用于创世区块 */
+TEE_Result smt_single_root(const uint8_t *fp, uint8_t role, uint8_t *root);
+
+#endif /* SMT_H */
@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#include "stats.h"
+#include "../slab/slab.h"
+#include <tee_internal_api.h>
+#include <string.h>
+#ifdef CFG_TC_STATS_CNTPCT
+#include <arm_user_sysreg.h>
+#endif
+
+struct phase_hist {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint32_t buckets[TC_STATS_BUCKETS];
+};
+
+static struct phase_hist hists[TC_STATS_MAX_CMDS][TC_STATS_PHASES];
+/* 正在执行的命令，打开会话等命令之外的计时不记录 */
+static uint32_t current_cmd = TC_STATS_MAX_CMDS;
+
+uint64_t stats_now(void) {
+#ifdef CFG_TC_STATS_CNTPCT
+    return read_cntpct();
+#else
+    TEE_Time t;
+
+    TEE_GetSystemTime(&t);
+    return (uint64_t)t.seconds * 1000 + t.millis;
+#endif
+}
+
+static uint64_t ticks_per_sec(void) {
+#ifdef CFG_TC_STATS_CNTPCT
+    return read_cntfrq();
+#else
+    return 1000;
+#endif
+}
+
+/* 毫秒时钟下验签、哈希等阶段几乎都落在0号桶，只计次数，不记耗时 */
+#ifdef CFG_TC_STATS_CNTPCT
+#define STATS_COARSE 0
+#else
+#define STATS_COARSE 1
+#endif
+
+void stats_command_begin(uint32_t cmd_id) {
+    current_cmd = cmd_id;
+}
+
+/* 0个周期进0号桶，[2^(i-1), 2^i)进i号桶 */
+static uint32_t bucket_of(uint64_t ticks) {
+    uint32_t bucket = ticks == 0 ? 0 : 64 - (uint32_t)__builtin_clzll(ticks);
+
+    return bucket < TC_STATS_BUCKETS ? bucket : TC_STATS_BUCKETS - 1;
+}
+
+void stats_record(uint32_t phase, uint64_t start) {
+    uint64_t now = stats_now();
+    uint64_t ticks = now > start ? now - start : 0;
+    struct phase_hist *h;
+
+    if (current_cmd >= TC_STATS_MAX_CMDS || phase >= TC_STATS_PHASES) {
+        return;
+    }
+    h = &hists[current_cmd][phase];
+    h->count++;
+    if (STATS_COARSE && phase != TC_STATS_PHASE_COMMAND) {
+        return;
+    }
+    h->sum += ticks;
+    if (ticks > h->max) {
+        h->max = ticks;
+    }
+    h->buckets[bucket_of(ticks)]++;
+}
+
+TEE_Result stats_export(uint32_t shard, void *buf, size_t *len, bool reset) {
+    struct slab_stats slabs[TC_STATS_MAX_SLABS];
+    struct tc_stats_hdr hdr;
+    struct tc_stats_entry entry;
+    struct tc_stats_slab slab;
+    uint8_t *out = buf;
+    size_t need, off;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.ticks_per_sec = ticks_per_sec();
+    hdr.shard = shard;
+    hdr.flags = STATS_COARSE ? TC_STATS_HDR_COARSE : 0;
+    for (uint32_t cmd = 0; cmd < TC_STATS_MAX_CMDS; cmd++) {
+        for (uint32_t phase = 0; phase < TC_STATS_PHASES; phase++) {
+            if (hists[cmd][phase].count > 0) {
+                hdr.entry_count++;
+            }
+        }
+    }
+    hdr.slab_count = slab_collect_stats(slabs, TC_STATS_MAX_SLABS);
+    need = sizeof(hdr) + hdr.entry_count * sizeof(entry) + hdr.slab_count * sizeof(slab);
+    if (*len < need) {
+        *len = need;
+        return TEE_ERROR_SHORT_BUFFER;
+    }
+
+    TEE_MemMove(out, &hdr, sizeof(hdr));
+    off = sizeof(hdr);
+    for (uint32_t cmd = 0; cmd < TC_STATS_MAX_CMDS; cmd++) {
+        for (uint32_t phase = 0; phase < TC_STATS_PHASES; phase++) {
+            const struct phase_hist *h = &hists[cmd][phase];
+
+            if (h->count == 0) {
+                continue;
+            }
+            entry.cmd_id = cmd;
+            entry.phase = phase;
+            entry.count = h->count;
+            entry.sum_ticks = h->sum;
+            entry.max_ticks = h->max;
+            memcpy(entry.buckets, h->buckets, sizeof(entry.buckets));
+            TEE_MemMove(out + off, &entry, sizeof(entry));
+            off += sizeof(entry);
+        }
+    }
+    for (uint32_t i = 0; i < hdr.slab_count; i++) {
+        memset(&slab, 0, sizeof(slab));
+        memcpy(slab.name, slabs[i].name, sizeof(slab.name));
+        slab.obj_size = slabs[i].obj_size;
+        slab.page_count = slabs[i].page_count;
+        slab.total_objs = slabs[i].total_objs;
+        slab.in_use = slabs[i].in_use;
+        slab.peak_in_use = slabs[i].peak_in_use;
+        slab.alloc_fail = slabs[i].alloc_fail;
+        TEE_MemMove(out + off, &slab, sizeof(slab));
+        off += sizeof(slab);
+    }
+    *len = off;
+
+    if (reset) {
+        memset(hists, 0, sizeof(hists));
+    }
+    return TEE_SUCCESS;
+}
@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <tee_api_types.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "trust_chain_abi.h"
+
+/*
+ * 命令分阶段计时（导出格式见trust_chain_abi.h）：本TA实例按（命令，阶段）
+ * 累计耗时的对数分桶直方图，由GET_STATS导出。以CFG_TC_STATS_CNTPCT=y编译
+ * 时直接读ARM物理计数器，按周期计时，要求OP-TEE允许TA读取该计数器
+ * （OP-TEE以CFG_FTRACE_SUPPORT=y编译），否则读取会触发异常，sub.mk在
+ * 这种OP-TEE上默认打开它。没有计数器时用TEE_GetSystemTime，精度只有
+ * 毫秒：整条命令照常计时，其余阶段只计次数（TC_STATS_HDR_COARSE）。
+ */
+
+/* 当前计数器值，作为stats_record的起点 */
+uint64_t stats_now(void);
+
+/* 开始执行一条命令，之后的阶段都记在它名下；命令号超出范围时不记录 */
+void stats_command_begin(uint32_t cmd_id);
+
+/* 记录一个阶段从start到现在的耗时，不在命令内时忽略 */
+void stats_record(uint32_t phase, uint64_t start);
+
+/*
+ * 把统计和slab占用写入buf，*len为容量，返回时为写入的长度。容量不足时
+ * 返回TEE_ERROR_SHORT_BUFFER并在*len中给出所需长度。reset为真时写出后清零。
+ */
+TEE_Result stats_export(uint32_t shard, void *buf, size_t *len, bool reset);
+
+#endif /* STATS_H */
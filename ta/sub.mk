@@ -6,10 +6,30 @@ global-incdirs-y += include
 # global-incdirs-y += /home/lele/optee-qemu/optee_os/lib/libutils/ext/include 
 
 srcs-y += trust_chain_ta.c
-srcs-y += key_list/key_list.c
+srcs-y += smt/smt.c
+srcs-y += branch_list/branch_list.c
 srcs-y += utils/utils.c
 srcs-y += tee_key_manager/tee_key_manager.c
 srcs-y += block/block.c
+srcs-y += slab/slab.c
+srcs-y += sign_batch/sign_batch.c
+srcs-y += key_session/key_session.c
+srcs-y += rsa_pubkey/rsa_pubkey.c
+srcs-y += head_tree/head_tree.c
+srcs-y += stats/stats.c
+
+# 命令分阶段计时：OP-TEE以CFG_FTRACE_SUPPORT=y编译时TA可以读物理计数器，
+# 默认按计数器周期计时；否则用TEE_GetSystemTime（毫秒），阶段只计次数。
+# 可用CFG_TC_STATS_CNTPCT=y/n显式指定
+CFG_TC_STATS_CNTPCT ?= $(CFG_FTRACE_SUPPORT)
+ifeq ($(CFG_TC_STATS_CNTPCT),y)
+cflags-y += -DCFG_TC_STATS_CNTPCT
+endif
+
+# 签名性能测试命令（TA_TRUST_CHAIN_CMD_BENCH_SIGN），默认不编译
+ifeq ($(CFG_TC_BENCH),y)
+cflags-y += -DCFG_TC_BENCH
+endif
 
 # To remove a certain compiler flag, add a line like this
 #cflags-template_ta.c-y += -Wno-strict-prototypes
@@ -5,6 +5,8 @@
 
 #include "tee_key_manager.h"
 #include "../utils/utils.h"
+#include "../stats/stats.h"
+#include "trust_chain_abi.h"
 #include <tee_internal_api.h>
 #include <tee_internal_api_extensions.h>
 #include <string.h>
@@ -15,212 +17,396 @@
 // };
 
 const char tee_key_pair_uuid[] = "mykey#0";
+const char tee_enc_key_uuid[] = "mykey#enc";
+
+/* 签名器：瞬态密钥对加上已设置好密钥的签名操作，可反复签名 */
+struct tee_signer {
+    uint8_t alg;
+    TEE_ObjectHandle key;
+    TEE_OperationHandle op;
+};
+
+/* 首次生成签名密钥时使用的算法 */
+static uint8_t preferred_alg = TC_SIG_ALG_RSA_PKCS1_SHA256;
+/* 本实例的TEE签名器，首次签名时从持久化密钥建立 */
+static struct tee_signer *instance_signer;
+
+/* 公钥编码缓存，密钥在其生命周期内不变，每个TA实例只构造一次 */
+static uint8_t pubkey_der[TEE_PUBKEY_DER_MAX];
+static size_t pubkey_der_len;
+static char pubkey_pem[TEE_PUBKEY_PEM_MAX];
+static size_t pubkey_pem_len;
+static bool pubkey_cached = false;
+static uint8_t enc_pubkey_der[TEE_PUBKEY_DER_MAX];
+static size_t enc_pubkey_der_len;
+static bool enc_pubkey_cached = false;
 
 /* 内部辅助函数 */
 
+/* 算法对应的GP对象类型、密钥长度与签名算法 */
+static TEE_Result alg_params(uint8_t alg, uint32_t *obj_type, uint32_t *key_bits,
+                             uint32_t *tee_alg) {
+    switch (alg) {
+    case TC_SIG_ALG_RSA_PKCS1_SHA256:
+        *obj_type = TEE_TYPE_RSA_KEYPAIR;
+        *key_bits = TEE_KEY_SIZE_BITS;
+        *tee_alg = TEE_ALG_RSASSA_PKCS1_V1_5_SHA256;
+        return TEE_SUCCESS;
+    case TC_SIG_ALG_ECDSA_P256_SHA256:
+        *obj_type = TEE_TYPE_ECDSA_KEYPAIR;
+        *key_bits = 256;
+        *tee_alg = TEE_ALG_ECDSA_P256;
+        return TEE_SUCCESS;
+#ifdef TEE_TYPE_ED25519_KEYPAIR
+    case TC_SIG_ALG_ED25519:
+        *obj_type = TEE_TYPE_ED25519_KEYPAIR;
+        *key_bits = 256;
+        *tee_alg = TEE_ALG_ED25519;
+        return TEE_SUCCESS;
+#endif
+    default:
+        return TEE_ERROR_NOT_SUPPORTED;
+    }
+}
+
+/* 由已保存密钥的对象类型得到算法 */
+static uint8_t object_type_alg(uint32_t obj_type) {
+    switch (obj_type) {
+    case TEE_TYPE_RSA_KEYPAIR:
+        return TC_SIG_ALG_RSA_PKCS1_SHA256;
+    case TEE_TYPE_ECDSA_KEYPAIR:
+        return TC_SIG_ALG_ECDSA_P256_SHA256;
+#ifdef TEE_TYPE_ED25519_KEYPAIR
+    case TEE_TYPE_ED25519_KEYPAIR:
+        return TC_SIG_ALG_ED25519;
+#endif
+    default:
+        return 0;
+    }
+}
+
+/* 生成指定算法的瞬态密钥对 */
+static TEE_Result generate_key(uint8_t alg, TEE_ObjectHandle *key) {
+    uint32_t obj_type, key_bits, tee_alg;
+    TEE_Attribute curve;
+    TEE_Result res;
+
+    res = alg_params(alg, &obj_type, &key_bits, &tee_alg);
+    if (res != TEE_SUCCESS) {
+        return res;
+    }
+    res = TEE_AllocateTransientObject(obj_type, key_bits, key);
+    if (res != TEE_SUCCESS) {
+        EMSG("Failed to allocate transient key object: %x", res);
+        return res;
+    }
+    if (alg == TC_SIG_ALG_ECDSA_P256_SHA256) {
+        TEE_InitValueAttribute(&curve, TEE_ATTR_ECC_CURVE, TEE_ECC_CURVE_NIST_P256, 0);
+        res = TEE_GenerateKey(*key, key_bits, &curve, 1);
+    } else {
+        res = TEE_GenerateKey(*key, key_bits, NULL, 0);
+    }
+    if (res != TEE_SUCCESS) {
+        EMSG("Failed to generate key pair (alg %u): %x", alg, res);
+        TEE_FreeTransientObject(*key);
+        *key = TEE_HANDLE_NULL;
+    }
+    return res;
+}
+
 /**
- * 加载密钥对，如果不存在则生成新的
+ * 加载密钥对，如果不存在则按alg生成新的
  */
-static TEE_Result load_or_generate_key_pair(TEE_ObjectHandle *key_pair) {
+static TEE_Result load_or_generate_key_pair(const char *obj_id, uint8_t alg,
+                                            TEE_ObjectHandle *key_pair) {
     TEE_Result res = TEE_SUCCESS;
     
     if (!key_pair) {
         return TEE_ERROR_BAD_PARAMETERS;
     }
     
-    /* 尝试加载现有密钥对 */
-    res = TEE_OpenPersistentObject(TEE_STORAGE_PRIVATE, tee_key_pair_uuid, 
-                                   strlen(tee_key_pair_uuid),
-                                   TEE_DATA_FLAG_ACCESS_READ, key_pair);
+    /* 尝试加载现有密钥对，各分片实例可能同时读取 */
+    res = TEE_OpenPersistentObject(TEE_STORAGE_PRIVATE, obj_id, strlen(obj_id),
+                                   TEE_DATA_FLAG_ACCESS_READ | TEE_DATA_FLAG_SHARE_READ,
+                                   key_pair);
     if (res == TEE_SUCCESS) {
-        IMSG("TEE key pair loaded successfully");
         return TEE_SUCCESS;
     }
 
-
-    IMSG("Key not found, generating new RSA key pair...");
-    IMSG("tee_key_pair_uuid = %s", tee_key_pair_uuid);
-    IMSG("res = %#x", res);
+    IMSG("Key %s not found (res = %#x), generating new key pair, alg %u", obj_id, res, alg);
     
     /* 密钥不存在，生成新的密钥对 */
-    TEE_ObjectHandle rsa_keypair = TEE_HANDLE_NULL;
-    // TEE_ObjectHandle persistent_key_pair = TEE_HANDLE_NULL;
+    TEE_ObjectHandle transient_key = TEE_HANDLE_NULL;
 
-    // 分配一个临时的 RSA 密钥对对象
-    res = TEE_AllocateTransientObject(TEE_TYPE_RSA_KEYPAIR, TEE_KEY_SIZE_BITS, &rsa_keypair);
+    res = generate_key(alg, &transient_key);
     if (res != TEE_SUCCESS) {
-        EMSG("Failed to allocate transient key object: %x", res);
         return res;
     }
     
-    /* 在该对象上生成密钥对 */
-    res = TEE_GenerateKey(rsa_keypair, TEE_KEY_SIZE_BITS, NULL, 0);
-    if (res != TEE_SUCCESS) {
-        EMSG("Failed to generate RSA key pair: %x", res);
-        TEE_FreeTransientObject(rsa_keypair);
-        return res;
+    /*
+     * 创建一个持久化对象用于存储密钥对。不使用OVERWRITE：多个分片实例可能
+     * 同时首次生成密钥，后到者发现对象已存在时改为加载已保存的密钥，
+     * 保证所有实例使用同一把TEE密钥。
+     */
+    res = TEE_CreatePersistentObject(TEE_STORAGE_PRIVATE, obj_id, strlen(obj_id),
+                                     TEE_DATA_FLAG_ACCESS_READ | TEE_DATA_FLAG_SHARE_READ |
+                                     TEE_DATA_FLAG_ACCESS_WRITE |
+                                     TEE_DATA_FLAG_ACCESS_WRITE_META,
+                                     transient_key, NULL, 0, key_pair);
+    TEE_FreeTransientObject(transient_key);
+    if (res == TEE_ERROR_ACCESS_CONFLICT) {
+        IMSG("Key pair created by another instance, loading it");
+        return TEE_OpenPersistentObject(TEE_STORAGE_PRIVATE, obj_id, strlen(obj_id),
+                                        TEE_DATA_FLAG_ACCESS_READ | TEE_DATA_FLAG_SHARE_READ,
+                                        key_pair);
     }
-    
-    /* 创建一个持久化对象用于存储密钥对 */
-    res = TEE_CreatePersistentObject(TEE_STORAGE_PRIVATE, tee_key_pair_uuid, 
-                                     strlen(tee_key_pair_uuid),
-                                     TEE_DATA_FLAG_ACCESS_READ | TEE_DATA_FLAG_ACCESS_WRITE | 
-                                     TEE_DATA_FLAG_ACCESS_WRITE_META | TEE_DATA_FLAG_OVERWRITE,
-                                     rsa_keypair, NULL, 0, key_pair);
     if (res != TEE_SUCCESS) {
         EMSG("Failed to allocate persistent object: %x", res);
-        TEE_FreeTransientObject(rsa_keypair);
         return res;
     }
     
     IMSG("TEE key pair generated and saved successfully");
-    
-    /* 释放临时对象引用 */
-    TEE_FreeTransientObject(rsa_keypair);
     return TEE_SUCCESS;
 }
 
+/* 把密钥复制到签名器私有的瞬态对象中，并分配好签名操作 */
+static TEE_Result signer_from_key(uint8_t alg, TEE_ObjectHandle key, struct tee_signer **out) {
+    uint32_t obj_type, key_bits, tee_alg;
+    struct tee_signer *signer;
+    TEE_Result res;
 
+    res = alg_params(alg, &obj_type, &key_bits, &tee_alg);
+    if (res != TEE_SUCCESS) {
+        return res;
+    }
+    signer = TEE_Malloc(sizeof(*signer), TEE_MALLOC_FILL_ZERO);
+    if (!signer) {
+        return TEE_ERROR_OUT_OF_MEMORY;
+    }
+    signer->alg = alg;
 
-/* 简化的公共接口实现 */
-
-TEE_Result tee_sign_data(const char *data, char *signature) {
-    if (!data || !signature) {
-        return TEE_ERROR_BAD_PARAMETERS;
+    res = TEE_AllocateTransientObject(obj_type, key_bits, &signer->key);
+    if (res == TEE_SUCCESS) {
+        res = TEE_CopyObjectAttributes1(signer->key, key);
+    }
+    if (res == TEE_SUCCESS) {
+        res = TEE_AllocateOperation(&signer->op, tee_alg, TEE_MODE_SIGN, key_bits);
+    }
+    if (res == TEE_SUCCESS) {
+        res = TEE_SetOperationKey(signer->op, signer->key);
     }
-    char hash_string[65] = {0}; // 32字节SHA256哈希，十六进制字符串+结尾符
-    TEE_Result res = hash_data(data, strlen(data), hash_string);
     if (res != TEE_SUCCESS) {
+        EMSG("Failed to prepare signer (alg %u): %x", alg, res);
+        tee_signer_free(signer);
         return res;
     }
-    return tee_sign_hash(hash_string, signature);
+    *out = signer;
+    return TEE_SUCCESS;
 }
 
-/* 签名哈希值（不重复计算哈希） */
-TEE_Result tee_sign_hash(const char *hash_string, char *signature) {
+/* 建立本实例的TEE签名器：加载或生成持久化签名密钥，算法以已保存的密钥为准 */
+static TEE_Result get_instance_signer(struct tee_signer **signer) {
     TEE_ObjectHandle key_pair = TEE_HANDLE_NULL;
-    TEE_OperationHandle op = TEE_HANDLE_NULL;
+    TEE_ObjectInfo info;
+    uint64_t start;
     TEE_Result res;
-    uint8_t sig_buffer[TEE_SIGNATURE_SIZE_BYTES];
-    size_t actual_sig_len = sizeof(sig_buffer);
-    uint8_t hash_bytes[32]; /* SHA256 hash size */
-    size_t hash_len = sizeof(hash_bytes);
-    
-    if (!hash_string || !signature) {
-        return TEE_ERROR_BAD_PARAMETERS;
+
+    if (instance_signer) {
+        *signer = instance_signer;
+        return TEE_SUCCESS;
     }
-    
-    /* 将十六进制哈希字符串转换为字节数组 */
-    res = hex_string_to_bytes(hash_string, strlen(hash_string), hash_bytes, &hash_len);
+
+    start = stats_now();
+    res = load_or_generate_key_pair(tee_key_pair_uuid, preferred_alg, &key_pair);
+    stats_record(TC_STATS_PHASE_KEY_LOAD, start);
     if (res != TEE_SUCCESS) {
         return res;
     }
-    
-    /* 加载或生成密钥对 */
-    res = load_or_generate_key_pair(&key_pair);
+    res = TEE_GetObjectInfo1(key_pair, &info);
+    if (res == TEE_SUCCESS) {
+        uint8_t alg = object_type_alg(info.objectType);
+        if (alg == 0) {
+            EMSG("Unsupported TEE key type 0x%x", info.objectType);
+            res = TEE_ERROR_NOT_SUPPORTED;
+        } else {
+            if (alg != preferred_alg) {
+                IMSG("Using existing TEE key with alg %u instead of preferred %u",
+                     alg, preferred_alg);
+            }
+            res = signer_from_key(alg, key_pair, &instance_signer);
+        }
+    }
+    TEE_CloseObject(key_pair);
+    if (res == TEE_SUCCESS) {
+        *signer = instance_signer;
+    }
+    return res;
+}
+
+/* 解密内容密钥用的RSA密钥：签名密钥是RSA时复用它 */
+static TEE_Result load_encryption_key(TEE_ObjectHandle *key_pair) {
+    struct tee_signer *signer;
+    TEE_Result res = get_instance_signer(&signer);
+    uint64_t start;
+
     if (res != TEE_SUCCESS) {
-        goto cleanup;
+        return res;
     }
-    
-    IMSG("load_or_generate_key_pair return successfully");
-    IMSG("key_pair handle = 0x%x", key_pair);
+    start = stats_now();
+    res = load_or_generate_key_pair(signer->alg == TC_SIG_ALG_RSA_PKCS1_SHA256 ?
+                                    tee_key_pair_uuid : tee_enc_key_uuid,
+                                    TC_SIG_ALG_RSA_PKCS1_SHA256, key_pair);
+    stats_record(TC_STATS_PHASE_KEY_LOAD, start);
+    return res;
+}
 
-    
-    /* 创建签名操作 */
-    res = TEE_AllocateOperation(&op, TEE_ALG_RSASSA_PKCS1_V1_5_SHA256, 
-                               TEE_MODE_SIGN, TEE_KEY_SIZE_BITS);
+TEE_Result tee_set_preferred_sign_alg(uint8_t alg) {
+    uint32_t obj_type, key_bits, tee_alg;
+    TEE_Result res = alg_params(alg, &obj_type, &key_bits, &tee_alg);
+
+    if (res == TEE_SUCCESS) {
+        preferred_alg = alg;
+    }
+    return res;
+}
+
+uint8_t tee_sign_alg(void) {
+    struct tee_signer *signer;
+
+    if (get_instance_signer(&signer) != TEE_SUCCESS) {
+        return 0;
+    }
+    return signer->alg;
+}
+
+TEE_Result tee_signer_create(uint8_t alg, struct tee_signer **signer) {
+    TEE_ObjectHandle key = TEE_HANDLE_NULL;
+    TEE_Result res;
+
+    if (!signer) {
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+    res = generate_key(alg, &key);
     if (res != TEE_SUCCESS) {
-        EMSG("Failed to allocate signature operation: %x", res);
-        goto cleanup;
+        return res;
     }
-    
-    /* 设置密钥对并执行签名 */
-    res = TEE_SetOperationKey(op, key_pair);
+    res = signer_from_key(alg, key, signer);
+    TEE_FreeTransientObject(key);
+    return res;
+}
+
+TEE_Result tee_signer_sign(struct tee_signer *signer, const uint8_t *hash, size_t hash_len,
+                           uint8_t *signature, size_t *sig_len) {
+    if (!signer || !hash || !signature || !sig_len) {
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+    /* Ed25519签名的是消息本身，这里的消息就是哈希 */
+    return TEE_AsymmetricSignDigest(signer->op, NULL, 0, hash, hash_len,
+                                    signature, sig_len);
+}
+
+void tee_signer_free(struct tee_signer *signer) {
+    if (!signer) {
+        return;
+    }
+    if (signer->op != TEE_HANDLE_NULL)
+        TEE_FreeOperation(signer->op);
+    if (signer->key != TEE_HANDLE_NULL)
+        TEE_FreeTransientObject(signer->key);
+    TEE_Free(signer);
+}
+
+
+
+/* 简化的公共接口实现 */
+
+TEE_Result tee_sign_data(const void *data, size_t data_len,
+                         uint8_t *signature, size_t *sig_len) {
+    if (!data || !signature || !sig_len) {
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+    uint8_t hash[32]; /* SHA256 hash size */
+    size_t hash_len = sizeof(hash);
+    TEE_Result res = compute_sha256_hash(data, data_len, hash, &hash_len);
     if (res != TEE_SUCCESS) {
-        EMSG("Failed to set operation key: %x", res);
-        goto cleanup;
+        return res;
     }
+    return tee_sign_hash(hash, hash_len, signature, sig_len);
+}
+
+/* 签名哈希值（不重复计算哈希） */
+TEE_Result tee_sign_hash(const uint8_t *hash, size_t hash_len,
+                         uint8_t *signature, size_t *sig_len) {
+    struct tee_signer *signer;
+    uint64_t start;
+    TEE_Result res;
     
-    res = TEE_AsymmetricSignDigest(op, NULL, 0, hash_bytes, hash_len,
-                                   sig_buffer, &actual_sig_len);
-    if (res == TEE_SUCCESS) {
-        /* 转换为十六进制字符串 */
-        bytes_to_hex_string(sig_buffer, actual_sig_len, signature);
+    if (!hash || !signature || !sig_len) {
+        return TEE_ERROR_BAD_PARAMETERS;
     }
     
-cleanup:
-    if (op != TEE_HANDLE_NULL)
-        TEE_FreeOperation(op);
-    if (key_pair != TEE_HANDLE_NULL)
-        TEE_CloseObject(key_pair);
+    /* 首次调用时加载或生成密钥对并准备签名操作 */
+    res = get_instance_signer(&signer);
+    if (res != TEE_SUCCESS) {
+        return res;
+    }
+    start = stats_now();
+    res = tee_signer_sign(signer, hash, hash_len, signature, sig_len);
+    stats_record(TC_STATS_PHASE_SIGN, start);
     return res;
 }
 
 TEE_Result tee_verify_signature(const void *data, size_t data_len,
-                                const char *signature) {
-    TEE_ObjectHandle key_pair = TEE_HANDLE_NULL;
-    TEE_ObjectHandle public_key = TEE_HANDLE_NULL;
+                                const uint8_t *signature, size_t sig_len) {
+    struct tee_signer *signer;
+    TEE_OperationHandle op = TEE_HANDLE_NULL;
+    uint32_t obj_type, key_bits, tee_alg;
+    uint8_t hash[32]; /* SHA256 hash size */
+    size_t hash_len = sizeof(hash);
     TEE_Result res;
     
     if (!data || !signature) {
         return TEE_ERROR_BAD_PARAMETERS;
     }
     
-    /* 加载TEE密钥对 */
-    res = load_or_generate_key_pair(&key_pair);
+    res = get_instance_signer(&signer);
     if (res != TEE_SUCCESS) {
         return res;
     }
-    
-    /* 从密钥对中提取公钥 */
-    res = TEE_AllocateTransientObject(TEE_TYPE_RSA_PUBLIC_KEY, TEE_KEY_SIZE_BITS, &public_key);
+    res = compute_sha256_hash(data, data_len, hash, &hash_len);
     if (res != TEE_SUCCESS) {
-        EMSG("Failed to allocate public key object: %x", res);
-        goto cleanup;
+        return res;
     }
     
-    /* 复制公钥属性 */
-    res = TEE_CopyObjectAttributes1(public_key, key_pair);
+    /* 签名器中的密钥对同样可用于验证 */
+    alg_params(signer->alg, &obj_type, &key_bits, &tee_alg);
+    res = TEE_AllocateOperation(&op, tee_alg, TEE_MODE_VERIFY, key_bits);
     if (res != TEE_SUCCESS) {
-        EMSG("Failed to copy public key attributes: %x", res);
-        goto cleanup;
+        EMSG("Failed to allocate verify operation: %x", res);
+        return res;
     }
-    
-    /* 调用通用验证函数，使用公钥 */
-    res = verify_signature_common(data, data_len, public_key, signature);
-    
-cleanup:
-    /* 清理资源 */
-    if (public_key != TEE_HANDLE_NULL)
-        TEE_FreeTransientObject(public_key);
-    if (key_pair != TEE_HANDLE_NULL)
-        TEE_CloseObject(key_pair);
-    
+    res = TEE_SetOperationKey(op, signer->key);
+    if (res == TEE_SUCCESS) {
+        res = TEE_AsymmetricVerifyDigest(op, NULL, 0, hash, hash_len,
+                                         signature, sig_len);
+    }
+    TEE_FreeOperation(op);
     return res;
 }
 
-TEE_Result tee_decrypt_data(const char *encrypted_data, size_t encrypted_len,
-                           char *decrypted_data, size_t *decrypted_len) {
+TEE_Result tee_decrypt_data(const uint8_t *encrypted_data, size_t encrypted_len,
+                           uint8_t *decrypted_data, size_t *decrypted_len) {
     TEE_ObjectHandle key_pair = TEE_HANDLE_NULL;
     TEE_OperationHandle op = TEE_HANDLE_NULL;
+    uint64_t start = stats_now();
     TEE_Result res;
-    uint8_t encrypted_bytes[TEE_KEY_SIZE_BITS / 8];
-    size_t encrypted_bytes_len = sizeof(encrypted_bytes);
-    uint8_t decrypted_bytes[TEE_KEY_SIZE_BITS / 8];
-    size_t decrypted_bytes_len = sizeof(decrypted_bytes);
     
     if (!encrypted_data || !decrypted_data || !decrypted_len) {
         return TEE_ERROR_BAD_PARAMETERS;
     }
     
-    /* 将十六进制加密数据转换为字节数组 */
-    res = hex_string_to_bytes(encrypted_data, encrypted_len, encrypted_bytes, &encrypted_bytes_len);
-    if (res != TEE_SUCCESS) {
-        return res;
-    }
-    
-    /* 加载或生成密钥对 */
-    res = load_or_generate_key_pair(&key_pair);
+    /* 加载或生成RSA密钥对 */
+    res = load_encryption_key(&key_pair);
     if (res != TEE_SUCCESS) {
         goto cleanup;
     }
@@ -240,18 +426,88 @@ TEE_Result tee_decrypt_data(const char *encrypted_data, size_t encrypted_len,
         goto cleanup;
     }
     
-    res = TEE_AsymmetricDecrypt(op, NULL, 0, encrypted_bytes, encrypted_bytes_len,
-                                decrypted_bytes, &decrypted_bytes_len);
-    if (res == TEE_SUCCESS) {
-        /* 将解密后的字节转换为十六进制字符串，保持与加密时的一致性 */
-        bytes_to_hex_string(decrypted_bytes, decrypted_bytes_len, decrypted_data);
-        *decrypted_len = decrypted_bytes_len * 2; /* 十六进制字符串长度是字节数的2倍 */
-    }
+    res = TEE_AsymmetricDecrypt(op, NULL, 0, encrypted_data, encrypted_len,
+                                decrypted_data, decrypted_len);
     
 cleanup:
     if (op != TEE_HANDLE_NULL)
         TEE_FreeOperation(op);
     if (key_pair != TEE_HANDLE_NULL)
         TEE_CloseObject(key_pair);
+    stats_record(TC_STATS_PHASE_DECRYPT, start);
     return res;
-} 
\ No newline at end of file
+}
+
+/* 获取公钥编码，首次调用时从持久化密钥导出并缓存 */
+TEE_Result tee_get_public_key(const uint8_t **der, size_t *der_len,
+                              const char **pem, size_t *pem_len) {
+    if (!pubkey_cached) {
+        struct tee_signer *signer;
+        size_t der_size = sizeof(pubkey_der);
+        size_t pem_size = sizeof(pubkey_pem);
+        TEE_Result res;
+
+        /* 密钥尚未生成时先生成，保证首次取公钥与首次签名使用同一把密钥 */
+        res = get_instance_signer(&signer);
+        if (res != TEE_SUCCESS) {
+            return res;
+        }
+        res = public_key_obj_to_der(signer->key, pubkey_der, &der_size);
+        if (res != TEE_SUCCESS) {
+            EMSG("Failed to export TEE public key: 0x%x", res);
+            return res;
+        }
+        res = der_to_pem(pubkey_der, der_size, pubkey_pem, &pem_size);
+        if (res != TEE_SUCCESS) {
+            EMSG("Failed to convert public key to PEM format: 0x%x", res);
+            return res;
+        }
+        pubkey_der_len = der_size;
+        pubkey_pem_len = pem_size;
+        pubkey_cached = true;
+    }
+
+    if (der) {
+        *der = pubkey_der;
+    }
+    if (der_len) {
+        *der_len = pubkey_der_len;
+    }
+    if (pem) {
+        *pem = pubkey_pem;
+    }
+    if (pem_len) {
+        *pem_len = pubkey_pem_len;
+    }
+    return TEE_SUCCESS;
+}
+
+/* 获取解密用RSA公钥的DER编码，首次调用时导出并缓存 */
+TEE_Result tee_get_encryption_public_key(const uint8_t **der, size_t *der_len) {
+    if (!enc_pubkey_cached) {
+        TEE_ObjectHandle key_pair = TEE_HANDLE_NULL;
+        size_t der_size = sizeof(enc_pubkey_der);
+        TEE_Result res;
+
+        res = load_encryption_key(&key_pair);
+        if (res != TEE_SUCCESS) {
+            return res;
+        }
+        res = public_key_obj_to_der(key_pair, enc_pubkey_der, &der_size);
+        TEE_CloseObject(key_pair);
+        if (res != TEE_SUCCESS) {
+            EMSG("Failed to export TEE encryption key: 0x%x", res);
+            return res;
+        }
+        enc_pubkey_der_len = der_size;
+        enc_pubkey_cached = true;
+    }
+
+    if (der) {
+        *der = enc_pubkey_der;
+    }
+    if (der_len) {
+        *der_len = enc_pubkey_der_len;
+    }
+    return TEE_SUCCESS;
+}
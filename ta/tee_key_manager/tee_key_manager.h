@@ -8,52 +8,106 @@
 
 #include <tee_api_types.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
 
 /* TEE密钥管理相关常量 */
 #define TEE_KEY_SIZE_BITS 2048
-#define TEE_SIGNATURE_SIZE_BYTES 256
+#define TEE_SIGNATURE_SIZE_BYTES 256   /* 各算法签名长度的上限（RSA-2048） */
+
+/* 公钥DER（SubjectPublicKeyInfo）与PEM缓存的容量 */
+#define TEE_PUBKEY_DER_MAX 512
+#define TEE_PUBKEY_PEM_MAX 1024
 
 /* TEE密钥UUID */
 extern const char tee_key_pair_uuid[];
+/* 签名密钥不是RSA时，解密内容密钥用的RSA密钥 */
+extern const char tee_enc_key_uuid[];
 /* 简化的TEE密钥管理函数 */
 
+/**
+ * 设置生成TEE签名密钥时使用的算法（TC_SIG_ALG_*），由打开会话时的参数决定。
+ * 只影响密钥的首次生成，已保存的密钥沿用其原有算法。
+ * @return 平台不支持该算法时返回TEE_ERROR_NOT_SUPPORTED
+ */
+TEE_Result tee_set_preferred_sign_alg(uint8_t alg);
+
+/**
+ * TEE签名密钥的算法（TC_SIG_ALG_*），密钥尚未加载时先加载或生成
+ * @return 算法ID，密钥不可用时返回0
+ */
+uint8_t tee_sign_alg(void);
+
+/* 独立的签名器，用于性能测试，与TEE密钥无关 */
+struct tee_signer;
+
+/* 生成指定算法的瞬态密钥并准备好签名操作 */
+TEE_Result tee_signer_create(uint8_t alg, struct tee_signer **signer);
+TEE_Result tee_signer_sign(struct tee_signer *signer, const uint8_t *hash, size_t hash_len,
+                           uint8_t *signature, size_t *sig_len);
+void tee_signer_free(struct tee_signer *signer);
+
 /**
  * 使用TEE私钥对数据进行签名
  * @param data 要签名的数据
- * @param signature 输出参数，签名结果（十六进制字符串）
+ * @param data_len 数据长度
+ * @param signature 输出参数，签名结果（原始字节）
+ * @param sig_len 输入为签名缓冲区大小，输出为签名长度
  * @return TEE_SUCCESS 成功，其他值表示错误
  */
-TEE_Result tee_sign_data(const char *data, char *signature);
+TEE_Result tee_sign_data(const void *data, size_t data_len,
+                         uint8_t *signature, size_t *sig_len);
 
 /**
  * 使用TEE私钥对哈希值进行签名（不重复计算哈希）
- * 或者命名为 tee_encrypt_data 更合适
- * @param hash_string 十六进制哈希字符串
- * @param signature 输出参数，签名结果（十六进制字符串）
+ * 密钥与签名操作在本实例首次签名时准备好，之后每次只做一次私钥运算
+ * @param hash SHA256哈希（原始字节）
+ * @param hash_len 哈希长度
+ * @param signature 输出参数，签名结果（原始字节）
+ * @param sig_len 输入为签名缓冲区大小，输出为签名长度
  * @return TEE_SUCCESS 成功，其他值表示错误
  */
-TEE_Result tee_sign_hash(const char *hash_string, char *signature);
+TEE_Result tee_sign_hash(const uint8_t *hash, size_t hash_len,
+                         uint8_t *signature, size_t *sig_len);
 
 /**
  * 使用TEE公钥验证签名
  * @param data 原始数据
  * @param data_len 数据长度
- * @param signature 签名（十六进制字符串）
+ * @param signature 签名（原始字节）
  * @param sig_len 签名长度
  * @return TEE_SUCCESS 验证成功，其他值表示验证失败
  */
 TEE_Result tee_verify_signature(const void *data, size_t data_len,
-                                const char *signature);
+                                const uint8_t *signature, size_t sig_len);
 
 /**
- * 使用TEE私钥解密数据
- * @param encrypted_data 加密的数据
+ * 使用TEE的RSA私钥解密数据：签名密钥是RSA时即为签名密钥，否则为tee_enc_key_uuid
+ * @param encrypted_data 加密的数据（原始字节）
  * @param encrypted_len 加密数据长度
- * @param decrypted_data 输出参数，解密后的数据
- * @param decrypted_len 输出参数，解密后数据长度
+ * @param decrypted_data 输出参数，解密后的数据（原始字节）
+ * @param decrypted_len 输入为输出缓冲区大小，输出为解密后数据长度
+ * @return TEE_SUCCESS 成功，其他值表示错误
+ */
+TEE_Result tee_decrypt_data(const uint8_t *encrypted_data, size_t encrypted_len,
+                           uint8_t *decrypted_data, size_t *decrypted_len);
+
+/**
+ * 获取TEE公钥的DER与PEM编码
+ * 密钥生成后不再变化，编码只在本实例首次调用时构造，之后直接返回缓存
+ * @param der 输出参数，指向缓存的DER编码
+ * @param der_len 输出参数，DER长度
+ * @param pem 输出参数，指向缓存的PEM编码（以NUL结尾）
+ * @param pem_len 输出参数，PEM长度（不含NUL）
  * @return TEE_SUCCESS 成功，其他值表示错误
  */
-TEE_Result tee_decrypt_data(const char *encrypted_data, size_t encrypted_len,
-                           char *decrypted_data, size_t *decrypted_len);
+TEE_Result tee_get_public_key(const uint8_t **der, size_t *der_len,
+                              const char **pem, size_t *pem_len);
+
+/**
+ * 获取解密内容密钥所用RSA公钥的DER编码（客户端用它加密内容密钥），
+ * 签名密钥是RSA时与tee_get_public_key相同。编码在实例内缓存。
+ */
+TEE_Result tee_get_encryption_public_key(const uint8_t **der, size_t *der_len);
 
 #endif /* TEE_KEY_MANAGER_H */ 
\ No newline at end of file
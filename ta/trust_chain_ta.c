@@ -9,52 +9,114 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include "trust_chain_ta.h"
-#include "key_list/key_list.h"
+#include "trust_chain_abi.h"
+#include "smt/smt.h"
+#include "branch_list/branch_list.h"
 #include "utils/utils.h"
 #include "block/block.h"
 #include "tee_key_manager/tee_key_manager.h"
+#include "slab/slab.h"
+#include "sign_batch/sign_batch.h"
+#include "key_session/key_session.h"
+#include "head_tree/head_tree.h"
+#include "stats/stats.h"
 
 /* Internal data structures used only in TA */
+/*
+ * 常驻内存的仓库元数据只保存二进制链头、创始人指纹和成员树的根，
+ * 完整的公钥PEM只在构造区块时由请求携带。
+ * head是仓库主链的链头，承载Access区块、未指定分支的提交和检查点区块；
+ * 指定分支的提交只推进该分支自己的链头，由检查点区块定期汇总到主链。
+ */
 struct repo_metadata {
 	uint32_t block_height;
-	char latest_hash[MAX_HASH_LENGTH];
-	char founder_key[MAX_KEY_LENGTH];  /* 创始人公钥 */
-	struct key_list *admin_keys;
-	struct key_list *writer_keys;
-};
-
-struct access_control_message {
-	uint32_t rep_id;
-	uint32_t op;
-	uint32_t role;
-	char pubkey[MAX_KEY_LENGTH];
-	char sigkey[MAX_KEY_LENGTH];
-	char signature[MAX_SIGNATURE_LENGTH];
+	uint8_t head[TC_HASH_SIZE];        /* 主链最新区块哈希（二进制） */
+	uint8_t founder_fp[KEY_FP_SIZE];   /* 创始人公钥指纹 */
+	uint32_t branch_blocks;            /* 上次检查点之后的分支区块数 */
+	uint32_t acl_changes;              /* 上次ACL检查点之后的Access区块数 */
+	uint8_t acl_root[TC_HASH_SIZE];    /* 成员集合稀疏Merkle树的根 */
+	uint32_t admin_count;
+	uint32_t writer_count;
+	/* 上次验证过成员证明的签名者，成员树变化时失效，连续提交只验一次证明 */
+	uint8_t signer_fp[KEY_FP_SIZE];
+	uint8_t signer_role;
+	bool signer_cached;
+	struct branch_list branches;
 };
 
-struct commit_message {
-	uint32_t rep_id;
-	uint32_t op;
-	char commit_hash[MAX_HASH_LENGTH];
-	char sigkey[MAX_KEY_LENGTH];
-	char signature[MAX_SIGNATURE_LENGTH];
+/* 请求消息中的一个字段，指向TA私有的消息副本 */
+struct tc_field {
+	const uint8_t *ptr;
+	uint32_t len;
 };
 
-struct latesthash_msg {
-	uint32_t nonce;
-	char latest_hash[MAX_HASH_LENGTH];
+/* 解析后的请求消息（线格式见trust_chain_abi.h） */
+struct tc_request {
+	struct tc_msg_hdr hdr;
+	struct tc_field pubkey;
+	struct tc_field sigkey;
+	struct tc_field signature;
+	struct tc_field commit_hash;
+	struct tc_field enc_key;
+	struct tc_field branch;
+	struct tc_field expected_parent;
+	struct tc_field key_session;
+	struct tc_field wrapped_key;
+	struct tc_field push_root;
+	struct tc_field push_count;
+	struct tc_field old_tip;
+	struct tc_field new_tip;
+	struct tc_field sigkey_proof;
+	struct tc_field pubkey_proof;
 };
 
 /* Global variables */
 static uint32_t repo_num = 0;
 struct repo_metadata *repositories[MAX_REPO_ID];
+static uint16_t repo_generation[MAX_REPO_ID];  /* 槽位代数，每次删除后递增 */
+static uint32_t free_slots[MAX_REPO_ID];       /* 已删除仓库释放出的槽位栈 */
+static uint32_t free_slot_count = 0;
+
+/*
+ * 本TA实例的分片号，由CA打开会话时传入。TA为多实例，每个会话都是独立实例，
+ * 各自持有一部分仓库，仓库ID中记录分片号供CA路由。
+ */
+static uint32_t shard_id = 0;
+
+/* 本实例上次签名的链头树纪元，只增不减 */
+static uint32_t head_tree_epoch = 0;
+
+/*
+ * 请求消息与区块的TA私有缓冲区。请求先整体拷贝进来再解析，区块在这里
+ * 构造、哈希和签名后才拷贝到共享内存，避免普通世界在校验/签名期间篡改。
+ * TA实例内命令串行执行，可安全复用。
+ */
+static uint8_t msg_buf[TC_MAX_PROVEN_MSG_SIZE];
+static uint8_t block_buf[TC_MAX_COMMIT_OUTPUT];
+
+/* 单个检查点区块最多列出的分支链头数，保证检查点不超过TC_MAX_BLOCK_SIZE */
+#define CHECKPOINT_MAX_HEADS 32
+
+/* 仓库元数据的slab缓存 */
+static struct slab_cache repo_cache =
+	SLAB_CACHE_INITIALIZER("repo_meta", sizeof(struct repo_metadata), 4);
 
 /* Function declarations */
 static TEE_Result init_repo(uint32_t param_types, TEE_Param params[4]);
+static TEE_Result delete_repo(uint32_t param_types, TEE_Param params[4]);
 static TEE_Result access_control(uint32_t param_types, TEE_Param params[4]);
 static TEE_Result get_latest_hash(uint32_t param_types, TEE_Param params[4]);
 static TEE_Result commit(uint32_t param_types, TEE_Param params[4]);
 static TEE_Result get_tee_public_key(uint32_t param_types, TEE_Param params[4]);
+static TEE_Result get_branch_head(uint32_t param_types, TEE_Param params[4]);
+static TEE_Result seal_batch(uint32_t param_types, TEE_Param params[4]);
+static TEE_Result open_key_session(uint32_t param_types, TEE_Param params[4]);
+static TEE_Result sign_head_tree(uint32_t param_types, TEE_Param params[4]);
+static TEE_Result acl_checkpoint(uint32_t param_types, TEE_Param params[4]);
+static TEE_Result get_stats(uint32_t param_types, TEE_Param params[4]);
+#ifdef CFG_TC_BENCH
+static TEE_Result bench_sign(uint32_t param_types, TEE_Param params[4]);
+#endif
 static TEE_Result validate_and_get_repo(uint32_t rep_id, struct repo_metadata **repo);
 static void cleanup_repo_resources(uint32_t rep_id);
 
@@ -73,23 +135,55 @@ void TA_DestroyEntryPoint(void) {
 	
 	/* TA销毁时不需要清理仓库信息，这些信息应该持久化保存 */
 	/* 仓库信息会在下次TA启动时从持久化存储中恢复 */
+	slab_log_stats();
 }
 
 TEE_Result TA_OpenSessionEntryPoint(uint32_t param_types,
                                    TEE_Param params[4],
                                    void **sess_ctx) {
-	uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_NONE,
+	uint32_t no_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_NONE,
+										TEE_PARAM_TYPE_NONE,
+										TEE_PARAM_TYPE_NONE,
+										TEE_PARAM_TYPE_NONE);
+	uint32_t shard_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+										TEE_PARAM_TYPE_NONE,
 										TEE_PARAM_TYPE_NONE,
+										TEE_PARAM_TYPE_NONE);
+	uint32_t batch_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+										TEE_PARAM_TYPE_VALUE_INPUT,
 										TEE_PARAM_TYPE_NONE,
 										TEE_PARAM_TYPE_NONE);
 			 
 	DMSG("TA_OpenSessionEntryPoint has been called");
 			 
-	if (param_types != exp_param_types)
+	/*
+	 * 不带参数时为0号分片，兼容单会话的CA。
+	 * value.b为TEE签名密钥的算法（TC_SIG_ALG_*，0为默认RSA），只在密钥首次生成时生效。
+	 * params[1].value.a非0时启用聚合签名，为每个窗口的区块数上限
+	 */
+	if (param_types == shard_param_types || param_types == batch_param_types) {
+		if (params[0].value.a >= TC_MAX_SHARDS)
+			return TEE_ERROR_BAD_PARAMETERS;
+		shard_id = params[0].value.a;
+		if (params[0].value.b != 0) {
+			if (params[0].value.b > UINT8_MAX ||
+			    tee_set_preferred_sign_alg((uint8_t)params[0].value.b) != TEE_SUCCESS) {
+				EMSG("Unsupported TEE signature algorithm %u", params[0].value.b);
+				return TEE_ERROR_NOT_SUPPORTED;
+			}
+		}
+		if (param_types == batch_param_types && params[1].value.a != 0) {
+			/* 一次commit可能产生两个区块，窗口至少容纳两个 */
+			if (params[1].value.a < 2)
+				return TEE_ERROR_BAD_PARAMETERS;
+			sign_batch_enable(params[1].value.a);
+		}
+	} else if (param_types != no_param_types) {
 		return TEE_ERROR_BAD_PARAMETERS;
+	}
 
-	(void)params;
 	(void)sess_ctx;
+	IMSG("Trust Chain TA instance serves shard %u", shard_id);
 
 	IMSG("Trust Chain TA has been called!\n");
 	return TEE_SUCCESS;
@@ -100,13 +194,12 @@ void TA_CloseSessionEntryPoint(void *sess_ctx) {
 	IMSG("Goodbye!\n");
 }
 
-TEE_Result TA_InvokeCommandEntryPoint(void *sess_ctx, uint32_t cmd_id,
-                                     uint32_t param_types, TEE_Param params[4]) {
-	(void)sess_ctx;
-	
+static TEE_Result dispatch_command(uint32_t cmd_id, uint32_t param_types, TEE_Param params[4]) {
 	switch (cmd_id) {
 	case TA_TRUST_CHAIN_CMD_INIT_REPO:
 		return init_repo(param_types, params);
+	case TA_TRUST_CHAIN_CMD_DELETE_REPO:
+		return delete_repo(param_types, params);
 	case TA_TRUST_CHAIN_CMD_ACCESS_CONTROL:
 		return access_control(param_types, params);
 	case TA_TRUST_CHAIN_CMD_GET_LATEST_HASH:
@@ -115,39 +208,499 @@ TEE_Result TA_InvokeCommandEntryPoint(void *sess_ctx, uint32_t cmd_id,
 		return commit(param_types, params);
 	case TA_TRUST_CHAIN_CMD_GET_TEE_PUBKEY:
 		return get_tee_public_key(param_types, params);
+#ifdef CFG_TC_BENCH
+	case TA_TRUST_CHAIN_CMD_BENCH_SIGN:
+		return bench_sign(param_types, params);
+#endif
+	case TA_TRUST_CHAIN_CMD_GET_BRANCH_HEAD:
+		return get_branch_head(param_types, params);
+	case TA_TRUST_CHAIN_CMD_SEAL_BATCH:
+		return seal_batch(param_types, params);
+	case TA_TRUST_CHAIN_CMD_OPEN_KEY_SESSION:
+		return open_key_session(param_types, params);
+	case TA_TRUST_CHAIN_CMD_SIGN_HEAD_TREE:
+		return sign_head_tree(param_types, params);
+	case TA_TRUST_CHAIN_CMD_ACL_CHECKPOINT:
+		return acl_checkpoint(param_types, params);
+	case TA_TRUST_CHAIN_CMD_GET_STATS:
+		return get_stats(param_types, params);
 	default:
 		return TEE_ERROR_BAD_PARAMETERS;
 	}
 }
 
+/* 每条命令整体计时，命令内各阶段的计时记在该命令名下 */
+TEE_Result TA_InvokeCommandEntryPoint(void *sess_ctx, uint32_t cmd_id,
+                                     uint32_t param_types, TEE_Param params[4]) {
+	uint64_t start = stats_now();
+	TEE_Result res;
+
+	(void)sess_ctx;
+	stats_command_begin(cmd_id);
+	res = dispatch_command(cmd_id, param_types, params);
+	stats_record(TC_STATS_PHASE_COMMAND, start);
+	stats_command_begin(TC_STATS_MAX_CMDS);
+	return res;
+}
+
 /* Command implementations */
 
 /* 通用的仓库验证和获取函数 */
 static TEE_Result validate_and_get_repo(uint32_t rep_id, struct repo_metadata **repo) {
-	if (rep_id >= MAX_REPO_ID || repositories[rep_id] == NULL) {
+	uint32_t slot = REPO_ID_SLOT(rep_id);
+
+	if (slot >= MAX_REPO_ID || repositories[slot] == NULL) {
+		return TEE_ERROR_ITEM_NOT_FOUND;
+	}
+	/* 分片号不符说明请求被路由到了错误的TA实例 */
+	if (REPO_ID_SHARD(rep_id) != shard_id) {
+		return TEE_ERROR_ITEM_NOT_FOUND;
+	}
+	/* 代数不匹配说明该ID对应的仓库已被删除，槽位已被复用 */
+	if (REPO_ID_GEN(rep_id) != repo_generation[slot]) {
 		return TEE_ERROR_ITEM_NOT_FOUND;
 	}
-	*repo = repositories[rep_id];
+	*repo = repositories[slot];
+	return TEE_SUCCESS;
+}
+
+/* 通用的仓库资源清理函数，参数为槽位号 */
+static void cleanup_repo_resources(uint32_t slot) {
+	if (slot >= MAX_REPO_ID || repositories[slot] == NULL) {
+		DMSG("slot out of range or repository is NULL!");
+		return;
+	}
+	struct repo_metadata *repo = repositories[slot];
+	cleanup_branch_list(&repo->branches);
+	/* slab_free会清零对象，释放后的内存不会残留仓库信息 */
+	slab_free(&repo_cache, repo);
+	repositories[slot] = NULL;
+}
+
+/* 新区块生效：更新链头和区块高度 */
+static void repo_advance_head(struct repo_metadata *repo, const uint8_t *block_hash) {
+	memcpy(repo->head, block_hash, TC_HASH_SIZE);
+	repo->block_height++;
+}
+
+/* 选取新仓库的槽位：优先复用已删除仓库的槽位 */
+static TEE_Result peek_free_slot(uint32_t *slot) {
+	if (free_slot_count > 0) {
+		*slot = free_slots[free_slot_count - 1];
+		return TEE_SUCCESS;
+	}
+	if (repo_num >= MAX_REPO_ID) {
+		//之后实现扩展仓库的逻辑
+		return TEE_ERROR_OUT_OF_MEMORY;
+	}
+	*slot = repo_num;
 	return TEE_SUCCESS;
 }
 
-/* 通用的仓库资源清理函数 */
-static void cleanup_repo_resources(uint32_t rep_id) {
-	if (rep_id >= MAX_REPO_ID || repositories[rep_id] == NULL) {
-		DMSG("rep_id out of range or repository is NULL!");
+/* 仓库创建成功后正式占用槽位 */
+static void claim_slot(uint32_t slot) {
+	if (free_slot_count > 0 && free_slots[free_slot_count - 1] == slot) {
+		free_slot_count--;
+	} else {
+		repo_num++;
+	}
+}
+
+/*
+ * 仓库删除后归还槽位，代数递增使旧ID失效。代数用尽的槽位不再复用：
+ * 回绕后旧ID会重新指向新仓库，而客户端签名只绑定rep_id，旧签名可以重放。
+ */
+static void release_slot(uint32_t slot) {
+	if (repo_generation[slot] >= REPO_ID_GEN_MASK) {
+		DMSG("slot %u retired after %u generations", slot, REPO_ID_GEN_MASK + 1);
 		return;
 	}
-	struct repo_metadata *repo = repositories[rep_id];
-	if (repo->admin_keys) {
-		cleanup_key_list(repo->admin_keys);
-		TEE_Free(repo->admin_keys);
+	repo_generation[slot]++;
+	free_slots[free_slot_count++] = slot;
+}
+
+/* 解析单个TLV字段到请求结构中，重复字段或超长字段视为非法 */
+static TEE_Result set_request_field(struct tc_field *field, const uint8_t *val,
+                                    uint16_t len, uint32_t max_len) {
+	if (field->ptr != NULL || len > max_len) {
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+	field->ptr = val;
+	field->len = len;
+	return TEE_SUCCESS;
+}
+
+/* 将请求消息拷贝到TA私有缓冲区并解析 */
+static TEE_Result parse_request(const TEE_Param *param, uint16_t msg_type,
+                                struct tc_request *req) {
+	size_t size = param->memref.size;
+	struct tc_reader reader;
+	const uint8_t *val;
+	uint16_t tag, len;
+	TEE_Result res = TEE_SUCCESS;
+	int ret;
+
+	if (size < sizeof(req->hdr) || size > sizeof(msg_buf)) {
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+	TEE_MemMove(msg_buf, param->memref.buffer, size);
+
+	memset(req, 0, sizeof(*req));
+	memcpy(&req->hdr, msg_buf, sizeof(req->hdr));
+	if (req->hdr.version != TC_ABI_VERSION || req->hdr.msg_type != msg_type ||
+	    req->hdr.body_len != size - sizeof(req->hdr)) {
+		IMSG("Bad message header: version %u type %u body_len %u",
+		     req->hdr.version, req->hdr.msg_type, req->hdr.body_len);
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	tc_reader_init(&reader, msg_buf + sizeof(req->hdr), req->hdr.body_len);
+	while (res == TEE_SUCCESS && (ret = tc_next_tlv(&reader, &tag, &val, &len)) > 0) {
+		switch (tag) {
+		case TC_TAG_PUBKEY:
+			res = set_request_field(&req->pubkey, val, len, MAX_KEY_LENGTH);
+			break;
+		case TC_TAG_SIGKEY:
+			res = set_request_field(&req->sigkey, val, len, MAX_KEY_LENGTH);
+			break;
+		case TC_TAG_SIGNATURE:
+			res = set_request_field(&req->signature, val, len, MAX_SIGNATURE_LENGTH);
+			break;
+		case TC_TAG_COMMIT_HASH:
+			res = set_request_field(&req->commit_hash, val, len, TC_HASH_SIZE);
+			break;
+		case TC_TAG_ENC_KEY:
+			res = set_request_field(&req->enc_key, val, len, TEE_KEY_SIZE_BITS / 8);
+			break;
+		case TC_TAG_BRANCH:
+			res = set_request_field(&req->branch, val, len, MAX_BRANCH_LENGTH);
+			break;
+		case TC_TAG_EXPECTED_PARENT:
+			res = set_request_field(&req->expected_parent, val, len, TC_HASH_SIZE);
+			break;
+		case TC_TAG_KEY_SESSION:
+			res = set_request_field(&req->key_session, val, len, sizeof(uint64_t));
+			break;
+		case TC_TAG_WRAPPED_KEY:
+			res = set_request_field(&req->wrapped_key, val, len,
+			                        TC_WRAP_NONCE_SIZE + TEE_KEY_SIZE_BITS / 8 + TC_WRAP_TAG_SIZE);
+			break;
+		case TC_TAG_PUSH_ROOT:
+			res = set_request_field(&req->push_root, val, len, TC_HASH_SIZE);
+			break;
+		case TC_TAG_PUSH_COUNT:
+			res = set_request_field(&req->push_count, val, len, sizeof(uint32_t));
+			break;
+		case TC_TAG_OLD_TIP:
+			res = set_request_field(&req->old_tip, val, len, TC_HASH_SIZE);
+			break;
+		case TC_TAG_NEW_TIP:
+			res = set_request_field(&req->new_tip, val, len, TC_HASH_SIZE);
+			break;
+		case TC_TAG_SIGKEY_PROOF:
+			res = set_request_field(&req->sigkey_proof, val, len, TC_SMT_MAX_PROOF_SIZE);
+			break;
+		case TC_TAG_PUBKEY_PROOF:
+			res = set_request_field(&req->pubkey_proof, val, len, TC_SMT_MAX_PROOF_SIZE);
+			break;
+		default:
+			/* 未知字段跳过，便于向后兼容 */
+			DMSG("Skipping unknown tag %u", tag);
+			break;
+		}
+	}
+	if (res != TEE_SUCCESS || ret < 0) {
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+	if (req->expected_parent.ptr != NULL && req->expected_parent.len != TC_HASH_SIZE) {
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+	/* 会话封装的内容密钥需同时给出会话ID，且不能与RSA加密的enc_key并用 */
+	if ((req->key_session.ptr != NULL) != (req->wrapped_key.ptr != NULL) ||
+	    (req->key_session.ptr != NULL && req->key_session.len != sizeof(uint64_t)) ||
+	    (req->wrapped_key.ptr != NULL && req->enc_key.ptr != NULL)) {
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+	/* 推送区块以PUSH_ROOT代替单个commit_hash，不与代码加密同用 */
+	if (req->push_root.ptr != NULL) {
+		uint32_t count = 0;
+		if (req->push_count.len == sizeof(count)) {
+			memcpy(&count, req->push_count.ptr, sizeof(count));
+		}
+		if (req->push_root.len != TC_HASH_SIZE || count == 0 || count > TC_MAX_PUSH_COMMITS ||
+		    req->new_tip.len == 0 || (req->old_tip.ptr != NULL && req->old_tip.len == 0) ||
+		    req->commit_hash.ptr != NULL || req->enc_key.ptr != NULL ||
+		    req->wrapped_key.ptr != NULL) {
+			return TEE_ERROR_BAD_PARAMETERS;
+		}
+	} else if (req->push_count.ptr != NULL || req->old_tip.ptr != NULL ||
+	           req->new_tip.ptr != NULL) {
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+	return TEE_SUCCESS;
+}
+
+/*
+ * 推送区块的签名内容："rep_id:op:push:根:commit数:旧tip:新tip"，哈希为十六进制，
+ * 新建ref时旧tip为空。返回写入的长度。
+ */
+static size_t push_verify_data(const struct tc_request *req, char *buf, size_t cap) {
+	char root_hex[TC_HASH_SIZE * 2 + 1] = { 0 };
+	char old_hex[TC_HASH_SIZE * 2 + 1] = { 0 };
+	char new_hex[TC_HASH_SIZE * 2 + 1] = { 0 };
+	uint32_t count;
+	int len;
+
+	memcpy(&count, req->push_count.ptr, sizeof(count));
+	bytes_to_hex_string(req->push_root.ptr, req->push_root.len, root_hex);
+	bytes_to_hex_string(req->old_tip.ptr, req->old_tip.len, old_hex);
+	bytes_to_hex_string(req->new_tip.ptr, req->new_tip.len, new_hex);
+	len = snprintf(buf, cap, "%u:%u:push:%s:%u:%s:%s", req->hdr.rep_id, req->hdr.op,
+	               root_hex, count, old_hex, new_hex);
+	return len > 0 && (size_t)len < cap ? (size_t)len : 0;
+}
+
+/*
+ * 比较并追加：请求携带期望父哈希时，必须与新区块将要接续的链头一致。
+ * 检查紧接在取得仓库之后、公钥指纹与角色检查之前，只是一次比较；链头
+ * 已被并发请求推进时以独立错误码快速失败。
+ */
+static TEE_Result check_expected_parent(const struct tc_request *req,
+                                        const uint8_t *parent_hash) {
+	if (req->expected_parent.ptr != NULL &&
+	    memcmp(req->expected_parent.ptr, parent_hash, TC_HASH_SIZE) != 0) {
+		IMSG("Stale parent hash for repo %u", req->hdr.rep_id);
+		return TC_ERROR_STALE_PARENT;
+	}
+	return TEE_SUCCESS;
+}
+
+/*
+ * 带期望父哈希的请求在签名内容末尾追加":期望父哈希十六进制"，CA不能去掉或
+ * 改写这一前置条件。len为已写入的长度，返回新长度，缓冲区不足时返回0。
+ */
+static size_t append_expected_parent(const struct tc_request *req, char *buf,
+                                     size_t cap, size_t len) {
+	char parent_hex[TC_HASH_SIZE * 2 + 1] = { 0 };
+	int n;
+
+	if (req->expected_parent.ptr == NULL) {
+		return len;
+	}
+	bytes_to_hex_string(req->expected_parent.ptr, req->expected_parent.len, parent_hex);
+	n = snprintf(buf + len, cap - len, ":%s", parent_hex);
+	return n > 0 && (size_t)n < cap - len ? len + (size_t)n : 0;
+}
+
+/* 输出区块前检查缓冲区能容纳最大输出，避免状态已更新却无法返回区块 */
+static TEE_Result check_block_output(TEE_Param *param, size_t max_len) {
+	if (param->memref.size < max_len) {
+		param->memref.size = max_len;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+	return TEE_SUCCESS;
+}
+
+/* 将block_buf中构造好的区块拷贝到输出参数，只拷贝实际长度 */
+static void emit_blocks(TEE_Param *param, size_t len) {
+	TEE_MemMove(param->memref.buffer, block_buf, len);
+	param->memref.size = len;
+}
+
+static void emit_block(TEE_Param *param, const struct block_builder *b) {
+	emit_blocks(param, block_len(b));
+}
+
+/* 校验请求签名 */
+static TEE_Result verify_request(const struct tc_request *req,
+                                 const char *data_to_verify) {
+	TEE_Result res = verify_signature(data_to_verify, strlen(data_to_verify),
+	                                  (const char *)req->sigkey.ptr, req->sigkey.len,
+	                                  req->signature.ptr, req->signature.len);
+	return res == TEE_SUCCESS ? TEE_SUCCESS : TEE_ERROR_SECURITY;
+}
+
+/* 用TEE私钥签名应答消息，消息与签名分别写入两个输出参数 */
+static TEE_Result emit_signed_reply(TEE_Param *msg_param, TEE_Param *sig_param,
+                                    const void *msg, size_t msg_len) {
+	uint8_t signature[TEE_SIGNATURE_SIZE_BYTES];
+	size_t sig_len = sizeof(signature);
+	TEE_Result res;
+	
+	if (msg_param->memref.size < msg_len || sig_param->memref.size < sizeof(signature)) {
+		msg_param->memref.size = msg_len;
+		sig_param->memref.size = sizeof(signature);
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+	
+	/* 生成TEE签名，签名对象为整个消息结构 */
+	res = tee_sign_data(msg, msg_len, signature, &sig_len);
+	if (res != TEE_SUCCESS) {
+		return res;
+	}
+	
+	TEE_MemMove(msg_param->memref.buffer, msg, msg_len);
+	msg_param->memref.size = msg_len;
+	TEE_MemMove(sig_param->memref.buffer, signature, sig_len);
+	sig_param->memref.size = sig_len;
+	return TEE_SUCCESS;
+}
+
+/* 分支名指纹：分支名的SHA256 */
+static TEE_Result branch_fingerprint(const uint8_t *name, size_t name_len, uint8_t *fp) {
+	size_t fp_len = TC_HASH_SIZE;
+	return compute_sha256_hash(name, name_len, fp, &fp_len);
+}
+
+/*
+ * 查找请求中的分支。分支不存在时创建节点但不插入，由调用者在区块生成成功后
+ * 插入（*new_branch非NULL），失败时释放。
+ */
+static TEE_Result find_or_create_branch(struct repo_metadata *repo,
+                                        const struct tc_field *name,
+                                        struct branch_node **branch,
+                                        struct branch_node **new_branch) {
+	uint8_t name_fp[TC_HASH_SIZE];
+	TEE_Result res;
+	
+	res = branch_fingerprint(name->ptr, name->len, name_fp);
+	if (res != TEE_SUCCESS) {
+		return res;
+	}
+	*new_branch = NULL;
+	*branch = find_branch(&repo->branches, name_fp);
+	if (*branch != NULL) {
+		return TEE_SUCCESS;
+	}
+	if (repo->branches.count >= MAX_BRANCH_NUM) {
+		IMSG("Too many branches in repo");
+		return TEE_ERROR_OUT_OF_MEMORY;
+	}
+	*new_branch = create_branch_node(name_fp);
+	if (*new_branch == NULL) {
+		return TEE_ERROR_OUT_OF_MEMORY;
+	}
+	*branch = *new_branch;
+	return TEE_SUCCESS;
+}
+
+/*
+ * 在buf中生成主链检查点区块：记录全部分支链头的根哈希，并列出上次检查点
+ * 之后有新区块的分支链头（每个检查点最多CHECKPOINT_MAX_HEADS个，其余留给
+ * 下一个检查点）。返回区块长度，失败返回0，下次分支提交时重试。
+ */
+static size_t append_checkpoint(struct repo_metadata *repo, uint8_t *buf, size_t cap) {
+	struct block_builder checkpoint;
+	uint8_t branch_root[TC_HASH_SIZE];
+	uint8_t checkpoint_hash[TC_HASH_SIZE];
+	struct branch_node *node;
+	uint32_t listed = 0;
+	
+	if (branch_list_root(&repo->branches, branch_root) != TEE_SUCCESS) {
+		return 0;
+	}
+	
+	init_checkpoint_block(&checkpoint, buf, cap,
+	                      repo->block_height + 1, repo->head, branch_root);
+	for (node = repo->branches.head; node != NULL && listed < CHECKPOINT_MAX_HEADS;
+	     node = node->next) {
+		if (node->dirty) {
+			block_put_field(&checkpoint, TC_TAG_BRANCH_HEAD,
+			                &node->branch, sizeof(node->branch));
+			listed++;
+		}
+	}
+	
+	if (block_finish(&checkpoint, checkpoint_hash) != TEE_SUCCESS) {
+		IMSG("Failed to build checkpoint block, retry on next branch commit");
+		return 0;
+	}
+	
+	repo_advance_head(repo, checkpoint_hash);
+	clear_branch_dirty(&repo->branches, listed);
+	repo->branch_blocks = 0;
+	return block_len(&checkpoint);
+}
+
+/*
+ * 用请求中的成员证明确认fp在仓库当前成员树中的角色（0为非成员），
+ * 解析出的证明留给调用者计算变更后的根。缺少证明返回TEE_ERROR_BAD_PARAMETERS，
+ * 证明与根不符（CA的树与TA不一致）返回TEE_ERROR_SECURITY。
+ */
+static TEE_Result member_role(const struct repo_metadata *repo, const struct tc_field *field,
+                              const uint8_t *fp, struct smt_proof *proof, uint8_t *role) {
+	TEE_Result res;
+	
+	if (field->ptr == NULL) {
+		IMSG("Missing membership proof");
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+	res = smt_proof_parse(field->ptr, field->len, proof);
+	if (res != TEE_SUCCESS) {
+		return res;
+	}
+	res = smt_verify(proof, fp, repo->acl_root);
+	if (res != TEE_SUCCESS) {
+		IMSG("Membership proof does not match the repository root");
+		return res;
+	}
+	*role = proof->role;
+	return TEE_SUCCESS;
+}
+
+/* 签名者的角色：与上次验证过的签名者相同且成员树未变时不再验证证明 */
+static TEE_Result signer_role(struct repo_metadata *repo, const struct tc_request *req,
+                              const uint8_t *fp, uint8_t *role) {
+	struct smt_proof proof;
+	TEE_Result res;
+	
+	if (repo->signer_cached && memcmp(repo->signer_fp, fp, KEY_FP_SIZE) == 0) {
+		*role = repo->signer_role;
+		return TEE_SUCCESS;
+	}
+	res = member_role(repo, &req->sigkey_proof, fp, &proof, role);
+	if (res != TEE_SUCCESS) {
+		return res;
 	}
-	if (repo->writer_keys) {
-		cleanup_key_list(repo->writer_keys);
-		TEE_Free(repo->writer_keys);
+	memcpy(repo->signer_fp, fp, KEY_FP_SIZE);
+	repo->signer_role = *role;
+	repo->signer_cached = true;
+	return TEE_SUCCESS;
+}
+
+/* 成员树变更生效 */
+static void repo_set_acl_root(struct repo_metadata *repo, const uint8_t *root) {
+	memcpy(repo->acl_root, root, TC_HASH_SIZE);
+	repo->signer_cached = false;
+}
+
+static void acl_state(const struct repo_metadata *repo, struct tc_acl_state *state) {
+	memset(state, 0, sizeof(*state));
+	state->admin_count = repo->admin_count;
+	state->writer_count = repo->writer_count;
+	memcpy(state->root, repo->acl_root, TC_HASH_SIZE);
+}
+
+/*
+ * 在buf中生成主链上的ACL检查点区块，记录成员计数和成员稀疏Merkle树的根（tc_acl_state）。
+ * 返回区块长度，失败返回0，下次权限变更时重试。
+ */
+static size_t append_acl_checkpoint(struct repo_metadata *repo, uint8_t *buf, size_t cap) {
+	struct block_builder checkpoint;
+	struct tc_acl_state state;
+	uint8_t checkpoint_hash[TC_HASH_SIZE];
+	
+	acl_state(repo, &state);
+	init_acl_checkpoint_block(&checkpoint, buf, cap,
+	                          repo->block_height + 1, repo->head, &state);
+	if (block_finish(&checkpoint, checkpoint_hash) != TEE_SUCCESS) {
+		IMSG("Failed to build ACL checkpoint block, retry on next access change");
+		return 0;
 	}
-	TEE_Free(repo);
-	repositories[rep_id] = NULL;
+	
+	repo_advance_head(repo, checkpoint_hash);
+	repo->acl_changes = 0;
+	return block_len(&checkpoint);
 }
 
 static TEE_Result init_repo(uint32_t param_types, TEE_Param params[4]) {
@@ -158,64 +711,141 @@ static TEE_Result init_repo(uint32_t param_types, TEE_Param params[4]) {
 		return TEE_ERROR_BAD_PARAMETERS;
 	}
 	
-	char *admin_key = (char *)params[0].memref.buffer;
-	uint32_t rep_id = repo_num;
-	struct access_block genesis_block;
+	struct tc_request req;
+	struct block_builder genesis_block;
+	uint8_t genesis_hash[TC_HASH_SIZE];
+	uint32_t slot;
 	TEE_Result res;
 	
-	if (rep_id >= MAX_REPO_ID) {
-		//之后实现扩展仓库的逻辑
-		return TEE_ERROR_OUT_OF_MEMORY;
+	if ((res = parse_request(&params[0], TC_MSG_INIT_REPO, &req)) != TEE_SUCCESS ||
+	    (res = check_block_output(&params[2], TC_MAX_BLOCK_SIZE)) != TEE_SUCCESS) {
+		return res;
 	}
-	
-	/* 分配repository结构 */
-	repositories[rep_id] = TEE_Malloc(sizeof(struct repo_metadata), TEE_MALLOC_FILL_ZERO);
-	if (repositories[rep_id] == NULL) {
-		return TEE_ERROR_OUT_OF_MEMORY;
+	if (req.pubkey.ptr == NULL || req.pubkey.len == 0) {
+		return TEE_ERROR_BAD_PARAMETERS;
 	}
 	
-	/* 初始化repository */
-	repositories[rep_id]->block_height = 0;
-	strcpy(repositories[rep_id]->latest_hash, "0000000000000000000000000000000000000000000000000000000000000000");
-	strcpy(repositories[rep_id]->founder_key, admin_key);  /* 保存创始人公钥 */
-	
-	/* 分配并初始化key lists */
-	repositories[rep_id]->admin_keys = TEE_Malloc(sizeof(struct key_list), TEE_MALLOC_FILL_ZERO);
-	repositories[rep_id]->writer_keys = TEE_Malloc(sizeof(struct key_list), TEE_MALLOC_FILL_ZERO);
+	res = peek_free_slot(&slot);
+	if (res != TEE_SUCCESS) {
+		return res;
+	}
 	
-	if (repositories[rep_id]->admin_keys == NULL || repositories[rep_id]->writer_keys == NULL) {
-		cleanup_repo_resources(rep_id);
+	/* 分配repository结构 */
+	repositories[slot] = slab_alloc(&repo_cache);
+	if (repositories[slot] == NULL) {
 		return TEE_ERROR_OUT_OF_MEMORY;
 	}
 	
-	init_key_list(repositories[rep_id]->admin_keys);
-	init_key_list(repositories[rep_id]->writer_keys);
+	/* 初始化repository：链头全零，只保存创始人公钥指纹 */
+	struct repo_metadata *repo = repositories[slot];
+	init_branch_list(&repo->branches);
+	res = key_fingerprint((const char *)req.pubkey.ptr, req.pubkey.len, repo->founder_fp);
+	if (res != TEE_SUCCESS) {
+		cleanup_repo_resources(slot);
+		return res;
+	}
 	
-	/* 添加创始人公钥到管理员集合 */
-	res = add_key_to_set(repositories[rep_id]->admin_keys, admin_key);
+	/* 成员树中只有创始人一个管理员 */
+	res = smt_single_root(repo->founder_fp, ROLE_ADMIN, repo->acl_root);
 	if (res != TEE_SUCCESS) {
-		cleanup_repo_resources(rep_id);      
+		cleanup_repo_resources(slot);
 		return res;
 	}
+	repo->admin_count = 1;
 	
-	/* 生成Access创世区块 - 使用初始化函数 */
-	init_access_block(&genesis_block, 1, repositories[rep_id]->latest_hash, 
-	                  OP_ADD, ROLE_ADMIN, admin_key, admin_key, "");
+	/* 生成Access创世区块，授权者与被授权者都是创始人 */
+	init_access_block(&genesis_block, block_buf, sizeof(block_buf),
+	                  1, repo->head, OP_ADD, ROLE_ADMIN,
+	                  req.pubkey.ptr, req.pubkey.len,
+	                  req.pubkey.ptr, req.pubkey.len,
+	                  NULL, 0, repo->acl_root);
 	
 	/* 计算创世区块哈希并生成TEE签名 */
-	char genesis_hash[MAX_HASH_LENGTH];
-	if ((res = calculate_access_block_hash(&genesis_block, genesis_hash)) != TEE_SUCCESS ||
-	    (res = tee_sign_hash(genesis_hash, genesis_block.base.tee_sig)) != TEE_SUCCESS) {
-		cleanup_repo_resources(rep_id);
+	res = block_finish(&genesis_block, genesis_hash);
+	if (res != TEE_SUCCESS) {
+		cleanup_repo_resources(slot);
 		return res;
 	}
+	repo_advance_head(repo, genesis_hash);
 	
-	strcpy(repositories[rep_id]->latest_hash, genesis_hash);
-	
-	/* 返回计算出的仓库ID和创世区块 */
-	params[1].value.a = rep_id;
-	memcpy(params[2].memref.buffer, &genesis_block, sizeof(struct access_block));
-	repo_num++;
+	/* 返回计算出的仓库ID（含槽位代数）和创世区块 */
+	params[1].value.a = MAKE_REPO_ID(repo_generation[slot], shard_id, slot);
+	emit_block(&params[2], &genesis_block);
+	claim_slot(slot);
+	return TEE_SUCCESS;
+}
+
+static TEE_Result delete_repo(uint32_t param_types, TEE_Param params[4]) {
+	if (param_types != TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+	                                   TEE_PARAM_TYPE_MEMREF_OUTPUT,
+	                                   TEE_PARAM_TYPE_NONE,
+	                                   TEE_PARAM_TYPE_NONE)) {
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	struct tc_request req;
+	struct block_builder block;
+	uint8_t block_hash[TC_HASH_SIZE];
+	struct repo_metadata *repo;
+	TEE_Result res;
+
+	if ((res = parse_request(&params[0], TC_MSG_DELETE_REPO, &req)) != TEE_SUCCESS ||
+	    (res = check_block_output(&params[1], TC_MAX_BLOCK_SIZE)) != TEE_SUCCESS) {
+		return res;
+	}
+
+	res = validate_and_get_repo(req.hdr.rep_id, &repo);
+	if (res != TEE_SUCCESS) {
+		return res;
+	}
+
+	/* 只有管理员可以删除仓库 */
+	uint8_t sig_fp[KEY_FP_SIZE];
+	res = key_fingerprint((const char *)req.sigkey.ptr, req.sigkey.len, sig_fp);
+	if (res != TEE_SUCCESS) {
+		return res;
+	}
+	uint8_t role;
+	res = signer_role(repo, &req, sig_fp, &role);
+	if (res != TEE_SUCCESS) {
+		return res;
+	}
+	if (role != ROLE_ADMIN) {
+		IMSG("Not Admin, not allowed to delete repo %u", req.hdr.rep_id);
+		return TEE_ERROR_ACCESS_DENIED;
+	}
+
+	/* 构造验证数据 */
+	char data_to_verify[64];
+	snprintf(data_to_verify, sizeof(data_to_verify),
+	         "%u:%u", req.hdr.rep_id, OP_DELETE_REPO);
+
+	/* 验证签名 */
+	res = verify_request(&req, data_to_verify);
+	if (res != TEE_SUCCESS) {
+		return res;
+	}
+
+	/* 生成墓碑区块，作为该仓库链上的最后一个区块 */
+	init_access_block(&block, block_buf, sizeof(block_buf),
+	                  repo->block_height + 1, repo->head, OP_DELETE_REPO, 0,
+	                  NULL, 0,
+	                  req.sigkey.ptr, req.sigkey.len,
+	                  req.signature.ptr, req.signature.len, NULL);
+
+	res = block_finish(&block, block_hash);
+	if (res != TEE_SUCCESS) {
+		return res;
+	}
+
+	emit_block(&params[1], &block);
+
+	/* 释放成员集合与仓库状态，槽位进入空闲栈等待复用 */
+	uint32_t slot = REPO_ID_SLOT(req.hdr.rep_id);
+	cleanup_repo_resources(slot);
+	release_slot(slot);
+	IMSG("Repository %u deleted, slot %u released", req.hdr.rep_id, slot);
+
 	return TEE_SUCCESS;
 }
 
@@ -227,120 +857,184 @@ static TEE_Result access_control(uint32_t param_types, TEE_Param params[4]) {
 		return TEE_ERROR_BAD_PARAMETERS;
 	}
 	
-	struct access_control_message *ac_msg = (struct access_control_message *)params[0].memref.buffer;
-	struct access_block block;
+	struct tc_request req;
+	struct block_builder block;
+	uint8_t block_hash[TC_HASH_SIZE];
 	struct repo_metadata *repo;
 	TEE_Result res;
 
+	if ((res = parse_request(&params[0], TC_MSG_ACCESS_CONTROL, &req)) != TEE_SUCCESS ||
+	    (res = check_block_output(&params[1], TC_MAX_COMMIT_OUTPUT)) != TEE_SUCCESS) {
+		return res;
+	}
+	struct tc_msg_hdr *ac_msg = &req.hdr;
+
 	/* 对于PUSH和PR操作，检查写权限 */
 	if (ac_msg->op != OP_ADD && ac_msg->op != OP_DELETE){
 		IMSG("Invalid operation: %u, support only ADD and DELETE", ac_msg->op);
 		return TEE_ERROR_BAD_PARAMETERS;
 	}
+	if (ac_msg->role != ROLE_ADMIN && ac_msg->role != ROLE_WRITER) {
+		IMSG("Invalid role: %u", ac_msg->role);
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
 	
 	res = validate_and_get_repo(ac_msg->rep_id, &repo);
 	if (res != TEE_SUCCESS) {
 		return res;
 	}
 	
-	/* 检查授权者是否有管理员权限 */
-	if (!key_exists_in_set(repo->admin_keys, ac_msg->sigkey)) {
-		IMSG("Not Admin, not allowed to access, sigkey: %s", ac_msg->sigkey);
+	/* 比较并追加：Access区块接在主链之后，先于指纹、角色和签名检查 */
+	res = check_expected_parent(&req, repo->head);
+	if (res != TEE_SUCCESS) {
+		return res;
+	}
+	
+	/* 计算授权者与被授权者的公钥指纹，成员集合按指纹比较 */
+	uint8_t sig_fp[KEY_FP_SIZE];
+	uint8_t pub_fp[KEY_FP_SIZE];
+	if ((res = key_fingerprint((const char *)req.sigkey.ptr, req.sigkey.len, sig_fp)) != TEE_SUCCESS ||
+	    (res = key_fingerprint((const char *)req.pubkey.ptr, req.pubkey.len, pub_fp)) != TEE_SUCCESS) {
+		return res;
+	}
+	
+	/* 检查授权者是否有管理员权限，并取得被授权者当前的角色 */
+	struct smt_proof pub_proof;
+	uint8_t sig_role, pub_role, new_role;
+	res = signer_role(repo, &req, sig_fp, &sig_role);
+	if (res != TEE_SUCCESS) {
+		return res;
+	}
+	if (sig_role != ROLE_ADMIN) {
+		IMSG("Not Admin, not allowed to access repo %u", ac_msg->rep_id);
 		return TEE_ERROR_ACCESS_DENIED;
 	}
+	res = member_role(repo, &req.pubkey_proof, pub_fp, &pub_proof, &pub_role);
+	if (res != TEE_SUCCESS) {
+		return res;
+	}
 	
-	/* 构造验证数据 */
-	char data_to_verify[1024];
-	snprintf(data_to_verify, sizeof(data_to_verify), 
-	         "%u:%u:%u:%s", ac_msg->rep_id, ac_msg->op, ac_msg->role, ac_msg->pubkey);
+	/* 构造验证数据，带期望父哈希时追加在末尾 */
+	char data_to_verify[MAX_KEY_LENGTH + 128];
+	int verify_len = snprintf(data_to_verify, sizeof(data_to_verify),
+	                          "%u:%u:%u:%.*s", ac_msg->rep_id, ac_msg->op, ac_msg->role,
+	                          (int)req.pubkey.len, (const char *)req.pubkey.ptr);
+	if (verify_len < 0 || (size_t)verify_len >= sizeof(data_to_verify) ||
+	    append_expected_parent(&req, data_to_verify, sizeof(data_to_verify), verify_len) == 0) {
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
 	
 	/* 验证签名 */
-	res = verify_signature(data_to_verify, strlen(data_to_verify), ac_msg->sigkey, ac_msg->signature);
+	res = verify_request(&req, data_to_verify);
 	if (res != TEE_SUCCESS) {
-		return TEE_ERROR_SECURITY;
+		return res;
 	}
 	
-	/* 根据操作类型更新密钥集合 */
+	/* 根据操作类型确定被授权者的新角色，区块生效后才更新成员树 */
 	if (ac_msg->op == OP_ADD) {
 		if (ac_msg->role == ROLE_ADMIN) {
-			/* 检查是否已在管理员列表中 */
-			if (key_exists_in_set(repo->admin_keys, ac_msg->pubkey)) {
-				IMSG("Already in admin list: %s", ac_msg->pubkey);
+			if (pub_role == ROLE_ADMIN) {
+				IMSG("Already in admin list");
 				return TEE_ERROR_BAD_PARAMETERS; /* 用户已在授权列表中 */
 			}
-			/* 如果用户是Writer，先删除Writer权限 */
-			bool was_writer = false;
-			res = find_and_remove_key(repo->writer_keys, ac_msg->pubkey, &was_writer);
-			if (res != TEE_SUCCESS) {
-				return res;
-			}
-			if (was_writer) {
-				IMSG("From writer to admin: %s", ac_msg->pubkey);
+			/* 如果用户是Writer，改为Admin */
+			if (pub_role == ROLE_WRITER) {
+				IMSG("From writer to admin");
 			}
-			res = add_key_to_set(repo->admin_keys, ac_msg->pubkey);
-			if (res != TEE_SUCCESS) {
-				return res;
-			}
-		} else if (ac_msg->role == ROLE_WRITER) {
-			/* 检查是否已在Writer列表中 */
-			if (key_exists_in_set(repo->writer_keys, ac_msg->pubkey)) {
-				IMSG("Already in writer list: %s", ac_msg->pubkey);
+			new_role = ROLE_ADMIN;
+		} else {
+			if (pub_role == ROLE_WRITER) {
+				IMSG("Already in writer list");
 				return TEE_ERROR_BAD_PARAMETERS; /* 用户已在授权列表中 */
 			}
 			/* 如果用户是Admin，不需要添加Writer权限 */
-			if (key_exists_in_set(repo->admin_keys, ac_msg->pubkey)) {
-				IMSG("Already in admin list, has writer permission: %s", ac_msg->pubkey);
+			if (pub_role == ROLE_ADMIN) {
+				IMSG("Already in admin list, has writer permission");
 				return TEE_ERROR_BAD_PARAMETERS; /* 用户是Admin，具有Writer权限 */
 			}
-			res = add_key_to_set(repo->writer_keys, ac_msg->pubkey);
-			if (res != TEE_SUCCESS) {
-				return res;
-			}
+			new_role = ROLE_WRITER;
 		}
-	} else if (ac_msg->op == OP_DELETE) {
-		if (ac_msg->role == ROLE_ADMIN) {
-			bool was_found = false;
-			res = find_and_remove_key(repo->admin_keys, ac_msg->pubkey, &was_found);
-			if (res != TEE_SUCCESS) {
-				return res;
-			}
-			if (!was_found) {
-				IMSG("Not in Admin list: %s", ac_msg->pubkey);
-				return TEE_ERROR_BAD_PARAMETERS; /* 用户不在列表中 */
-			}
-		} else if (ac_msg->role == ROLE_WRITER) {
-			bool was_found = false;
-			res = find_and_remove_key(repo->writer_keys, ac_msg->pubkey, &was_found);
-			if (res != TEE_SUCCESS) {
-				return res;
-			}
-			if (!was_found) {
-				IMSG("Not in Writer list: %s", ac_msg->pubkey);
-				return TEE_ERROR_BAD_PARAMETERS; /* 用户不在列表中 */
-			}
+	} else {
+		if (pub_role != ac_msg->role) {
+			IMSG("Not in %s list", ac_msg->role == ROLE_ADMIN ? "Admin" : "Writer");
+			return TEE_ERROR_BAD_PARAMETERS; /* 用户不在列表中 */
 		}
+		new_role = 0;
+	}
+	
+	uint8_t new_root[TC_HASH_SIZE];
+	res = smt_root_with(&pub_proof, pub_fp, new_role, new_root);
+	if (res != TEE_SUCCESS) {
+		return res;
 	}
 	
 	/* 生成Access区块 - 使用初始化函数 */
-	init_access_block(&block, repo->block_height + 1,
-	                  repo->latest_hash, ac_msg->op,
-	                  ac_msg->role, ac_msg->pubkey, ac_msg->sigkey, ac_msg->signature);
+	init_access_block(&block, block_buf, sizeof(block_buf),
+	                  repo->block_height + 1, repo->head,
+	                  ac_msg->op, ac_msg->role,
+	                  req.pubkey.ptr, req.pubkey.len,
+	                  req.sigkey.ptr, req.sigkey.len,
+	                  req.signature.ptr, req.signature.len, new_root);
 	
 	/* 计算区块哈希并生成TEE签名 */
-	char block_hash[MAX_HASH_LENGTH];
-	if ((res = calculate_access_block_hash(&block, block_hash)) != TEE_SUCCESS ||
-	    (res = tee_sign_hash(block_hash, block.base.tee_sig)) != TEE_SUCCESS) {
+	res = block_finish(&block, block_hash);
+	if (res != TEE_SUCCESS) {
 		return res;
 	}
 
-	memcpy(params[1].memref.buffer, &block, sizeof(struct access_block));
+	/* 成员计数随角色变化调整 */
+	repo->admin_count += (new_role == ROLE_ADMIN) - (pub_role == ROLE_ADMIN);
+	repo->writer_count += (new_role == ROLE_WRITER) - (pub_role == ROLE_WRITER);
+	repo_set_acl_root(repo, new_root);
 	
-	strcpy(repo->latest_hash, block_hash);
-	repo->block_height++;
+	/* 权限变更累计到阈值后，在Access区块之后追加ACL检查点区块 */
+	size_t out_len = block_len(&block);
+	repo_advance_head(repo, block_hash);
+	if (++repo->acl_changes >= ACL_CHECKPOINT_INTERVAL) {
+		out_len += append_acl_checkpoint(repo, block_buf + out_len,
+		                                 sizeof(block_buf) - out_len);
+	}
+	emit_blocks(&params[1], out_len);
 
 	return TEE_SUCCESS;
 }
 
+/*
+ * 按需生成ACL检查点区块，请求消息只有消息头（仓库ID）。上次检查点之后
+ * 没有权限变更时返回TEE_ERROR_BAD_STATE，最新的检查点仍然有效。
+ */
+static TEE_Result acl_checkpoint(uint32_t param_types, TEE_Param params[4]) {
+	if (param_types != TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+	                                   TEE_PARAM_TYPE_MEMREF_OUTPUT,
+	                                   TEE_PARAM_TYPE_NONE,
+	                                   TEE_PARAM_TYPE_NONE)) {
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+	
+	struct tc_request req;
+	struct repo_metadata *repo;
+	size_t out_len;
+	TEE_Result res;
+	
+	if ((res = parse_request(&params[0], TC_MSG_ACL_CHECKPOINT, &req)) != TEE_SUCCESS ||
+	    (res = check_block_output(&params[1], TC_MAX_BLOCK_SIZE)) != TEE_SUCCESS) {
+		return res;
+	}
+	res = validate_and_get_repo(req.hdr.rep_id, &repo);
+	if (res != TEE_SUCCESS) {
+		return res;
+	}
+	if (repo->acl_changes == 0) {
+		return TEE_ERROR_BAD_STATE;
+	}
+	out_len = append_acl_checkpoint(repo, block_buf, sizeof(block_buf));
+	if (out_len == 0) {
+		return TEE_ERROR_GENERIC;
+	}
+	emit_blocks(&params[1], out_len);
+	return TEE_SUCCESS;
+}
+
 static TEE_Result get_latest_hash(uint32_t param_types, TEE_Param params[4]) {
 	if (param_types != TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
 	                                   TEE_PARAM_TYPE_VALUE_INPUT,
@@ -351,8 +1045,7 @@ static TEE_Result get_latest_hash(uint32_t param_types, TEE_Param params[4]) {
 	
 	uint32_t rep_id = params[0].value.a;
 	uint32_t nonce = params[1].value.a;
-	struct latesthash_msg *msg_out = (struct latesthash_msg *)params[2].memref.buffer;
-	char *signature_out = (char *)params[3].memref.buffer;
+	struct tc_latest_hash_msg msg;
 	struct repo_metadata *repo;
 	TEE_Result res;
 	
@@ -362,37 +1055,55 @@ static TEE_Result get_latest_hash(uint32_t param_types, TEE_Param params[4]) {
 	}
 	
 	/* 构造返回消息 */
-	msg_out->nonce = nonce;
-	strcpy(msg_out->latest_hash, repo->latest_hash);
+	memset(&msg, 0, sizeof(msg));
+	msg.nonce = nonce;
+	msg.block_height = repo->block_height;
+	memcpy(msg.latest_hash, repo->head, TC_HASH_SIZE);
 	
-	/* 生成TEE签名 */
-	res = tee_sign_data((char *)msg_out, signature_out);
-	if (res != TEE_SUCCESS) {
-		return res;
-	}
+	return emit_signed_reply(&params[2], &params[3], &msg, sizeof(msg));
+}
+
+/* 用会话密钥解封内容密钥，AAD为仓库ID与commit哈希，封装结果不能挪作他用 */
+static TEE_Result unwrap_content_key(const struct tc_request *req,
+                                     uint8_t *key, size_t *key_len) {
+	uint8_t aad[sizeof(uint32_t) + TC_HASH_SIZE];
+	uint64_t session_id;
 	
-	return TEE_SUCCESS;
+	memcpy(&session_id, req->key_session.ptr, sizeof(session_id));
+	memcpy(aad, &req->hdr.rep_id, sizeof(uint32_t));
+	memcpy(aad + sizeof(uint32_t), req->commit_hash.ptr, req->commit_hash.len);
+	return key_session_unwrap(session_id, req->wrapped_key.ptr, req->wrapped_key.len,
+	                          aad, sizeof(uint32_t) + req->commit_hash.len, key, key_len);
 }
 
 static TEE_Result commit(uint32_t param_types, TEE_Param params[4]) {
 	if (param_types != TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
-	                                   TEE_PARAM_TYPE_MEMREF_INOUT,
-									   TEE_PARAM_TYPE_MEMREF_OUTPUT,
+	                                   TEE_PARAM_TYPE_MEMREF_OUTPUT,
+	                                   TEE_PARAM_TYPE_MEMREF_OUTPUT,
 	                                   TEE_PARAM_TYPE_NONE)) {
 		return TEE_ERROR_BAD_PARAMETERS;
 	}
 	
-	struct commit_message *cm_msg = (struct commit_message *)params[0].memref.buffer;
-	char *encrypted_key = (char *)params[1].memref.buffer;
-	struct contribution_block block;
+	struct tc_request req;
+	struct block_builder block;
+	uint8_t block_hash[TC_HASH_SIZE];
 	struct repo_metadata *repo;
 	TEE_Result res;
 
+	if ((res = parse_request(&params[0], TC_MSG_COMMIT, &req)) != TEE_SUCCESS ||
+	    (res = check_block_output(&params[2], TC_MAX_COMMIT_OUTPUT)) != TEE_SUCCESS) {
+		return res;
+	}
+	struct tc_msg_hdr *cm_msg = &req.hdr;
+
 	/* 对于PUSH和PR操作，检查写权限 */
 	if (cm_msg->op != OP_PUSH && cm_msg->op != OP_PR){
 		IMSG("Invalid operation: %u, support only PUSH and PR", cm_msg->op);
 		return TEE_ERROR_BAD_PARAMETERS;
 	}
+	if (req.commit_hash.len == 0 && req.push_root.len == 0) {
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
 
 	/* 获取并验证仓库 */
 	res = validate_and_get_repo(cm_msg->rep_id, &repo);
@@ -400,97 +1111,479 @@ static TEE_Result commit(uint32_t param_types, TEE_Param params[4]) {
 		return res;
 	}
 	
-	if (!key_exists_in_set(repo->admin_keys, cm_msg->sigkey) && !key_exists_in_set(repo->writer_keys, cm_msg->sigkey)) {
-		IMSG("Not Admin or Writer, not allowed to commit, sigkey: %s", cm_msg->sigkey);
-		return TEE_ERROR_ACCESS_DENIED;	
+	/* 确定父区块：未指定分支时接在主链之后，指定分支时接在该分支链头之后 */
+	struct branch_node *branch = NULL;
+	struct branch_node *new_branch = NULL;
+	const uint8_t *parent_hash = repo->head;
+	uint32_t block_height = repo->block_height + 1;
+	if (req.branch.len > 0) {
+		res = find_or_create_branch(repo, &req.branch, &branch, &new_branch);
+		if (res != TEE_SUCCESS) {
+			return res;
+		}
+		/* 新分支从主链当前链头分叉，分支高度从1开始 */
+		parent_hash = new_branch ? repo->head : branch->branch.head;
+		block_height = branch->branch.height + 1;
 	}
 	
-	/* 构造验证数据 */
-	char data_to_verify[1024];
-	snprintf(data_to_verify, sizeof(data_to_verify), 
-	         "%u:%u:%s", cm_msg->rep_id, cm_msg->op, cm_msg->commit_hash);
+	/* 比较并追加：只比较链头，先于指纹、角色和签名检查，冲突时快速失败 */
+	res = check_expected_parent(&req, parent_hash);
+	if (res != TEE_SUCCESS) {
+		free_branch_node(new_branch);
+		return res;
+	}
 	
-	/* 验证签名 */
-	res = verify_signature(data_to_verify, strlen(data_to_verify), cm_msg->sigkey, cm_msg->signature);
+	uint8_t sig_fp[KEY_FP_SIZE];
+	res = key_fingerprint((const char *)req.sigkey.ptr, req.sigkey.len, sig_fp);
 	if (res != TEE_SUCCESS) {
-		return TEE_ERROR_SECURITY;
+		free_branch_node(new_branch);
+		return res;
 	}
 	
-	/* 生成Contribution区块 - 使用初始化函数 */
-	init_contribution_block(&block, repo->block_height + 1,
-	                       repo->latest_hash, cm_msg->op, cm_msg->commit_hash,
-	                       cm_msg->sigkey, cm_msg->signature);
+	uint8_t role;
+	res = signer_role(repo, &req, sig_fp, &role);
+	if (res != TEE_SUCCESS) {
+		free_branch_node(new_branch);
+		return res;
+	}
+	if (role == 0) {
+		IMSG("Not Admin or Writer, not allowed to commit to repo %u", cm_msg->rep_id);
+		free_branch_node(new_branch);
+		return TEE_ERROR_ACCESS_DENIED;	
+	}
 	
-	/* 计算区块哈希并生成TEE签名 */
-	char block_hash[MAX_HASH_LENGTH];
-	if ((res = calculate_contribution_block_hash(&block, block_hash)) != TEE_SUCCESS ||
-	    (res = tee_sign_hash(block_hash, block.base.tee_sig)) != TEE_SUCCESS) {
+	/*
+	 * 构造验证数据，签名内容中的哈希均为十六进制字符串，指定分支时追加分支名，
+	 * 带期望父哈希时再追加期望父哈希
+	 */
+	char data_to_verify[512];
+	size_t verify_len;
+	if (req.push_root.len > 0) {
+		verify_len = push_verify_data(&req, data_to_verify, sizeof(data_to_verify));
+	} else {
+		char commit_hash_hex[TC_HASH_SIZE * 2 + 1] = { 0 };
+		bytes_to_hex_string(req.commit_hash.ptr, req.commit_hash.len, commit_hash_hex);
+		verify_len = snprintf(data_to_verify, sizeof(data_to_verify),
+		                      "%u:%u:%s", cm_msg->rep_id, cm_msg->op, commit_hash_hex);
+	}
+	if (req.branch.len > 0) {
+		verify_len += snprintf(data_to_verify + verify_len, sizeof(data_to_verify) - verify_len,
+		                       ":%.*s", (int)req.branch.len, (const char *)req.branch.ptr);
+	}
+	verify_len = append_expected_parent(&req, data_to_verify, sizeof(data_to_verify), verify_len);
+	if (verify_len == 0) {
+		free_branch_node(new_branch);
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+	
+	/* 验证签名 */
+	res = verify_request(&req, data_to_verify);
+	if (res != TEE_SUCCESS) {
+		free_branch_node(new_branch);
 		return res;
 	}
 	
-	/* 用TEE私钥解密encrypted_key并返回 */
-	char decrypted_key[256];
-	size_t decrypted_len = sizeof(decrypted_key);
-	res = tee_decrypt_data(encrypted_key, strlen(encrypted_key), 
-	                      decrypted_key, &decrypted_len);
+	/*
+	 * 代码加密版本的commit：用会话密钥解封wrapped_key，或用TEE私钥解密enc_key，
+	 * 区块生成后返回原始密钥字节。先于生成区块解密，聚合签名窗口中不会留下
+	 * 未返回的区块
+	 */
+	uint8_t decrypted_key[TEE_KEY_SIZE_BITS / 8];
+	size_t decrypted_len = 0;
+	if (req.wrapped_key.len > 0 || req.enc_key.len > 0) {
+		decrypted_len = sizeof(decrypted_key);
+		if (req.wrapped_key.len > 0) {
+			res = unwrap_content_key(&req, decrypted_key, &decrypted_len);
+		} else {
+			res = tee_decrypt_data(req.enc_key.ptr, req.enc_key.len,
+			                      decrypted_key, &decrypted_len);
+		}
+		if (res == TEE_SUCCESS && params[1].memref.size < decrypted_len) {
+			params[1].memref.size = decrypted_len;
+			res = TEE_ERROR_SHORT_BUFFER;
+		}
+		if (res != TEE_SUCCESS) {
+			free_branch_node(new_branch);
+			return res;
+		}
+	}
+
+	/* 生成Contribution区块 - 使用初始化函数，推送区块记录整个推送 */
+	if (req.push_root.len > 0) {
+		uint32_t push_count;
+		memcpy(&push_count, req.push_count.ptr, sizeof(push_count));
+		init_push_block(&block, block_buf, TC_MAX_BLOCK_SIZE,
+		                block_height, parent_hash, cm_msg->op,
+		                req.push_root.ptr, push_count,
+		                req.old_tip.ptr, req.old_tip.len,
+		                req.new_tip.ptr, req.new_tip.len,
+		                req.branch.ptr, req.branch.len,
+		                req.sigkey.ptr, req.sigkey.len,
+		                req.signature.ptr, req.signature.len);
+	} else {
+		init_contribution_block(&block, block_buf, TC_MAX_BLOCK_SIZE,
+		                       block_height, parent_hash, cm_msg->op,
+		                       req.commit_hash.ptr, req.commit_hash.len,
+		                       req.branch.ptr, req.branch.len,
+		                       req.sigkey.ptr, req.sigkey.len,
+		                       req.signature.ptr, req.signature.len);
+	}
+	
+	/* 计算区块哈希并生成TEE签名 */
+	res = block_finish(&block, block_hash);
 	if (res != TEE_SUCCESS) {
+		free_branch_node(new_branch);
 		return res;
 	}
+	TEE_MemMove(params[1].memref.buffer, decrypted_key, decrypted_len);
+	params[1].memref.size = decrypted_len;
 	
-	/* 将解密后的密钥复制回原缓冲区 */
-	memcpy(encrypted_key, decrypted_key, decrypted_len);
-	encrypted_key[decrypted_len] = '\0'; /* 确保字符串结尾 */
+	/* 区块生效：推进主链或分支链头，分支区块累计到阈值后在其后追加检查点区块 */
+	size_t out_len = block_len(&block);
+	if (branch == NULL) {
+		repo_advance_head(repo, block_hash);
+	} else {
+		if (new_branch != NULL) {
+			insert_branch(&repo->branches, new_branch);
+		}
+		advance_branch(&repo->branches, branch, block_hash);
+		if (++repo->branch_blocks >= CHECKPOINT_INTERVAL) {
+			out_len += append_checkpoint(repo, block_buf + out_len,
+			                             sizeof(block_buf) - out_len);
+		}
+	}
 
 	/* 将区块复制到输出缓冲区 */
-	memcpy(params[2].memref.buffer, &block, sizeof(struct contribution_block));
-
-	strcpy(repo->latest_hash, block_hash);
-	repo->block_height++;
+	emit_blocks(&params[2], out_len);
 	
 	return TEE_SUCCESS;
 } 
 
+static TEE_Result get_branch_head(uint32_t param_types, TEE_Param params[4]) {
+	if (param_types != TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+	                                   TEE_PARAM_TYPE_MEMREF_INPUT,
+	                                   TEE_PARAM_TYPE_MEMREF_OUTPUT,
+	                                   TEE_PARAM_TYPE_MEMREF_OUTPUT)) {
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+	
+	uint32_t rep_id = params[0].value.a;
+	struct tc_branch_head_msg msg;
+	uint8_t name[MAX_BRANCH_LENGTH];
+	size_t name_len = params[1].memref.size;
+	struct repo_metadata *repo;
+	struct branch_node *branch;
+	TEE_Result res;
+	
+	if (name_len == 0 || name_len > sizeof(name)) {
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+	TEE_MemMove(name, params[1].memref.buffer, name_len);
+	
+	res = validate_and_get_repo(rep_id, &repo);
+	if (res != TEE_SUCCESS) {
+		return res;
+	}
+	
+	/* 构造返回消息，尚无区块的分支返回高度0和将要分叉的主链链头 */
+	memset(&msg, 0, sizeof(msg));
+	msg.nonce = params[0].value.b;
+	res = branch_fingerprint(name, name_len, msg.branch.name_fp);
+	if (res != TEE_SUCCESS) {
+		return res;
+	}
+	branch = find_branch(&repo->branches, msg.branch.name_fp);
+	if (branch != NULL) {
+		msg.branch = branch->branch;
+	} else {
+		memcpy(msg.branch.head, repo->head, TC_HASH_SIZE);
+	}
+	
+	return emit_signed_reply(&params[2], &params[3], &msg, sizeof(msg));
+}
+
+/*
+ * 返回TEE签名公钥：[0]输出PEM（含结尾NUL），[1].a为PEM长度（不含NUL），
+ * [1].b为签名算法（TC_SIG_ALG_*），可选的[2]输出DER（SubjectPublicKeyInfo），
+ * 可选的[3]输出解密内容密钥所用RSA公钥的DER（签名密钥是RSA时与[2]相同）。
+ * 编码在实例内缓存，只构造一次。
+ */
 static TEE_Result get_tee_public_key(uint32_t param_types, TEE_Param params[4]) {
-	if (param_types != TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_OUTPUT,
+	bool want_der;
+	bool want_enc;
+	
+	if (param_types == TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_OUTPUT,
 	                                   TEE_PARAM_TYPE_VALUE_OUTPUT,
 	                                   TEE_PARAM_TYPE_NONE,
 	                                   TEE_PARAM_TYPE_NONE)) {
+		want_der = false;
+		want_enc = false;
+	} else if (param_types == TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_OUTPUT,
+	                                          TEE_PARAM_TYPE_VALUE_OUTPUT,
+	                                          TEE_PARAM_TYPE_MEMREF_OUTPUT,
+	                                          TEE_PARAM_TYPE_NONE)) {
+		want_der = true;
+		want_enc = false;
+	} else if (param_types == TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_OUTPUT,
+	                                          TEE_PARAM_TYPE_VALUE_OUTPUT,
+	                                          TEE_PARAM_TYPE_MEMREF_OUTPUT,
+	                                          TEE_PARAM_TYPE_MEMREF_OUTPUT)) {
+		want_der = true;
+		want_enc = true;
+	} else {
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+	
+	const uint8_t *der;
+	const uint8_t *enc_der = NULL;
+	const char *pem;
+	size_t der_len, pem_len, enc_der_len = 0;
+	TEE_Result res;
+	
+	res = tee_get_public_key(&der, &der_len, &pem, &pem_len);
+	if (res == TEE_SUCCESS && want_enc) {
+		res = tee_get_encryption_public_key(&enc_der, &enc_der_len);
+	}
+	if (res != TEE_SUCCESS) {
+		return res;
+	}
+	
+	if (params[0].memref.size < pem_len + 1 ||
+	    (want_der && params[2].memref.size < der_len) ||
+	    (want_enc && params[3].memref.size < enc_der_len)) {
+		params[0].memref.size = pem_len + 1;
+		if (want_der) {
+			params[2].memref.size = der_len;
+		}
+		if (want_enc) {
+			params[3].memref.size = enc_der_len;
+		}
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+	
+	TEE_MemMove(params[0].memref.buffer, pem, pem_len + 1);
+	params[0].memref.size = pem_len + 1;
+	params[1].value.a = (uint32_t)pem_len;
+	params[1].value.b = tee_sign_alg();
+	if (want_der) {
+		TEE_MemMove(params[2].memref.buffer, der, der_len);
+		params[2].memref.size = der_len;
+	}
+	if (want_enc) {
+		TEE_MemMove(params[3].memref.buffer, enc_der, enc_der_len);
+		params[3].memref.size = enc_der_len;
+	}
+	return TEE_SUCCESS;
+}
+
+/*
+ * 内容密钥会话握手：[0]为用TEE加密公钥加密的AES会话密钥，[1]为CA生成的
+ * 64位会话ID（a为低32位），[2].a输入请求的有效期（秒，0取默认），输出
+ * 实际有效期。
+ */
+static TEE_Result open_key_session(uint32_t param_types, TEE_Param params[4]) {
+	if (param_types != TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+	                                   TEE_PARAM_TYPE_VALUE_INPUT,
+	                                   TEE_PARAM_TYPE_VALUE_INOUT,
+	                                   TEE_PARAM_TYPE_NONE)) {
 		return TEE_ERROR_BAD_PARAMETERS;
 	}
 	
-	char *public_key_pem = (char *)params[0].memref.buffer;
-	size_t pem_buf_size = params[0].memref.size;
-	size_t pem_len = 0;
+	uint8_t enc_key[TEE_KEY_SIZE_BITS / 8];
+	uint64_t session_id = ((uint64_t)params[1].value.b << 32) | params[1].value.a;
+	uint32_t ttl = params[2].value.a;
+	size_t enc_len = params[0].memref.size;
+	TEE_Result res;
+	
+	/* 密文先拷贝到TA私有内存再解密 */
+	if (enc_len == 0 || enc_len > sizeof(enc_key)) {
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+	TEE_MemMove(enc_key, params[0].memref.buffer, enc_len);
 	
-	if (!public_key_pem || pem_buf_size == 0) {
-        return TEE_ERROR_BAD_PARAMETERS;
-    }
+	res = key_session_open(session_id, enc_key, enc_len, &ttl);
+	if (res != TEE_SUCCESS) {
+		return res;
+	}
+	params[2].value.a = ttl;
+	return TEE_SUCCESS;
+}
+
+/*
+ * 结束聚合签名窗口：计算窗口内全部区块哈希的Merkle根，签名
+ * SHA256(tc_batch_root)，根与签名分别写入两个输出参数。缓冲区不足时
+ * 窗口保留，CA可重试；其他情况下窗口都会结束。
+ */
+static TEE_Result seal_batch(uint32_t param_types, TEE_Param params[4]) {
+	if (param_types != TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_OUTPUT,
+	                                   TEE_PARAM_TYPE_MEMREF_OUTPUT,
+	                                   TEE_PARAM_TYPE_NONE,
+	                                   TEE_PARAM_TYPE_NONE)) {
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
 	
-	/* 从 TEE 获取真实的公钥 */
-	TEE_ObjectHandle key_obj = TEE_HANDLE_NULL;
+	struct tc_batch_root root;
 	TEE_Result res;
 	
-    // 示例用 UUID 打开持久化密钥，确保该 UUID 存在于 Secure Storage 中
-    res = TEE_OpenPersistentObject(TEE_STORAGE_PRIVATE,
-									tee_key_pair_uuid,
-									strlen(tee_key_pair_uuid),
-									TEE_DATA_FLAG_ACCESS_READ,
-									&key_obj);
+	if (!sign_batch_enabled()) {
+		return TEE_ERROR_BAD_STATE;
+	}
+	res = sign_batch_root(shard_id, &root);
 	if (res != TEE_SUCCESS) {
-		EMSG("Failed to open TEE public key: 0x%x", res);
 		return res;
 	}
+	res = emit_signed_reply(&params[0], &params[1], &root, sizeof(root));
+	if (res != TEE_ERROR_SHORT_BUFFER) {
+		sign_batch_reset();
+	}
+	return res;
+}
+
+/*
+ * 链头树：按槽位顺序对本实例全部仓库的(仓库ID, 高度, 链头)建Merkle树，
+ * 签名SHA256(tc_head_tree_root)。[0].a为CA指定的纪元，必须大于上次；
+ * 根与签名写入[1]、[2]，叶子依次写入[3]，供CA计算各仓库的包含证明。
+ * 任一缓冲区不足时返回TEE_ERROR_SHORT_BUFFER，纪元不变。
+ */
+static TEE_Result sign_head_tree(uint32_t param_types, TEE_Param params[4]) {
+	if (param_types != TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+	                                   TEE_PARAM_TYPE_MEMREF_OUTPUT,
+	                                   TEE_PARAM_TYPE_MEMREF_OUTPUT,
+	                                   TEE_PARAM_TYPE_MEMREF_OUTPUT)) {
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+	
+	uint32_t epoch = params[0].value.a;
+	struct tc_head_tree_root root;
+	struct tc_head_leaf leaf;
+	struct head_tree tree;
+	uint8_t *out = params[3].memref.buffer;
+	uint32_t count = 0;
+	TEE_Result res;
+	
+	if (epoch <= head_tree_epoch) {
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+	for (uint32_t slot = 0; slot < MAX_REPO_ID; slot++) {
+		if (repositories[slot] != NULL) {
+			count++;
+		}
+	}
+	if (params[3].memref.size < count * sizeof(leaf)) {
+		params[3].memref.size = count * sizeof(leaf);
+		return TEE_ERROR_SHORT_BUFFER;
+	}
 	
-	/* 使用工具函数转换为 PEM 格式 */
-	res = public_key_obj_to_pem(key_obj, public_key_pem, &pem_len);
+	head_tree_init(&tree);
+	for (uint32_t slot = 0; slot < MAX_REPO_ID; slot++) {
+		struct repo_metadata *repo = repositories[slot];
+		if (repo == NULL) {
+			continue;
+		}
+		memset(&leaf, 0, sizeof(leaf));
+		leaf.rep_id = MAKE_REPO_ID(repo_generation[slot], shard_id, slot);
+		leaf.block_height = repo->block_height;
+		memcpy(leaf.head, repo->head, TC_HASH_SIZE);
+		res = head_tree_add(&tree, &leaf);
+		if (res != TEE_SUCCESS) {
+			return res;
+		}
+		TEE_MemMove(out + (size_t)(tree.leaf_count - 1) * sizeof(leaf), &leaf, sizeof(leaf));
+	}
+	
+	memset(&root, 0, sizeof(root));
+	root.shard = shard_id;
+	root.epoch = epoch;
+	root.ts_seconds = get_trust_time().seconds;
+	root.leaf_count = tree.leaf_count;
+	res = head_tree_root(&tree, root.root);
 	if (res != TEE_SUCCESS) {
-		EMSG("Failed to convert public key to PEM format: 0x%x", res);
-		TEE_CloseObject(key_obj);
 		return res;
 	}
+	res = emit_signed_reply(&params[1], &params[2], &root, sizeof(root));
+	if (res != TEE_SUCCESS) {
+		return res;
+	}
+	params[3].memref.size = tree.leaf_count * sizeof(leaf);
+	head_tree_epoch = epoch;
+	return TEE_SUCCESS;
+}
+
+/*
+ * 统计：[0].a含TC_STATS_FLAG_RESET时导出后清零，统计与slab占用写入[1]
+ * （格式见trust_chain_abi.h）。本条命令自身的耗时在清零之后记录。
+ */
+static TEE_Result get_stats(uint32_t param_types, TEE_Param params[4]) {
+	size_t len;
+	TEE_Result res;
+
+	if (param_types != TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+	                                   TEE_PARAM_TYPE_MEMREF_OUTPUT,
+	                                   TEE_PARAM_TYPE_NONE,
+	                                   TEE_PARAM_TYPE_NONE)) {
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+	len = params[1].memref.size;
+	res = stats_export(shard_id, params[1].memref.buffer, &len,
+	                   (params[0].value.a & TC_STATS_FLAG_RESET) != 0);
+	params[1].memref.size = len;
+	return res;
+}
 
-	params[1].value.a = (uint32_t)pem_len;
+#ifdef CFG_TC_BENCH
+/*
+ * 签名性能测试：用指定算法的临时密钥构造并签名count个commit区块，
+ * 与TEE密钥无关。[0].a为算法（TC_SIG_ALG_*），[0].b为区块数；
+ * [1].a返回耗时（毫秒），[1].b返回签名长度。
+ */
+static TEE_Result bench_sign(uint32_t param_types, TEE_Param params[4]) {
+	uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+	                                           TEE_PARAM_TYPE_VALUE_OUTPUT,
+	                                           TEE_PARAM_TYPE_NONE,
+	                                           TEE_PARAM_TYPE_NONE);
+	static const char sigkey[] = "-----BEGIN PUBLIC KEY-----bench-----END PUBLIC KEY-----";
+	uint8_t commit_hash[20] = { 0 };
+	uint8_t client_sig[256] = { 0 };
+	uint8_t parent[TC_HASH_SIZE] = { 0 };
+	uint8_t block_hash[TC_HASH_SIZE];
+	uint8_t tee_sig[TEE_SIGNATURE_SIZE_BYTES];
+	size_t tee_sig_len = 0;
+	struct tee_signer *signer = NULL;
+	struct block_builder block;
+	TEE_Time start, end;
+	TEE_Result res;
+	
+	if (param_types != exp_param_types || params[0].value.b == 0) {
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+	res = tee_signer_create((uint8_t)params[0].value.a, &signer);
+	if (res != TEE_SUCCESS) {
+		return res;
+	}
 	
-	TEE_CloseObject(key_obj);
+	TEE_GetSystemTime(&start);
+	for (uint32_t i = 0; i < params[0].value.b; i++) {
+		commit_hash[0] = (uint8_t)i;
+		init_contribution_block(&block, block_buf, TC_MAX_BLOCK_SIZE, i + 1, parent, OP_PUSH,
+		                        commit_hash, sizeof(commit_hash), NULL, 0,
+		                        sigkey, sizeof(sigkey) - 1, client_sig, sizeof(client_sig));
+		tee_sig_len = sizeof(tee_sig);
+		if ((res = block_seal(&block, block_hash)) != TEE_SUCCESS ||
+		    (res = tee_signer_sign(signer, block_hash, TC_HASH_SIZE,
+		                           tee_sig, &tee_sig_len)) != TEE_SUCCESS ||
+		    (res = block_append_tee_sig(&block, tee_sig, tee_sig_len)) != TEE_SUCCESS) {
+			break;
+		}
+		memcpy(parent, block_hash, TC_HASH_SIZE);
+	}
+	TEE_GetSystemTime(&end);
+	tee_signer_free(signer);
+	if (res != TEE_SUCCESS) {
+		return res;
+	}
+	
+	params[1].value.a = (end.seconds - start.seconds) * 1000 + end.millis - start.millis;
+	params[1].value.b = (uint32_t)tee_sig_len;
 	return TEE_SUCCESS;
-} 
\ No newline at end of file
+}
+#endif
@@ -6,8 +6,10 @@
 #include "utils.h"
 #include <stdio.h>
 #include <string.h>
-#include "key_list/key_list.h"
+#include "trust_chain_ta.h"
 #include "../tee_key_manager/tee_key_manager.h"
+#include "../rsa_pubkey/rsa_pubkey.h"
+#include "../stats/stats.h"
 #include <tee_internal_api.h>
 #include <tee_internal_api_extensions.h>
 #include <mbedtls/pk.h>
@@ -15,9 +17,6 @@
 #include <mbedtls/base64.h>
 #include <mbedtls/platform_util.h>
 
-/* 将 PEM 格式的公钥字符串转换为 TEE 公钥对象 */
-static TEE_Result public_key_pem_to_obj(const char *key_str, TEE_ObjectHandle *key_obj);
-
 /* 通用工具函数 */
 
 /* 辅助函数：将字节数组转换为十六进制字符串 */
@@ -103,14 +102,29 @@ TEE_Result hash_data(const void *data, size_t data_len, char *hash) {
 	return res;
 }
 
+/* 公钥指纹计算函数：按解析出的RSA公钥计算，与公钥文本格式无关 */
+TEE_Result key_fingerprint(const char *key, size_t key_len, uint8_t *fp) {
+	const struct rsa_pubkey *pk;
+	uint64_t start = stats_now();
+	TEE_Result res;
+
+	if (!key || !fp) {
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+	res = rsa_pubkey_parse(key, key_len, &pk);
+	if (res == TEE_SUCCESS) {
+		res = rsa_pubkey_fingerprint(pk, fp);
+	}
+	stats_record(TC_STATS_PHASE_PUBKEY, start);
+	return res;
+}
+
 /* 通用验证函数，接受任何类型的密钥对象 */
 TEE_Result verify_signature_common(const void *data, size_t data_len,
                                   TEE_ObjectHandle key_obj, 
-                                  const char *signature) {
+                                  const uint8_t *signature, size_t sig_len) {
     TEE_OperationHandle op = TEE_HANDLE_NULL;
     TEE_Result res;
-    uint8_t sig_bytes[TEE_SIGNATURE_SIZE_BYTES];
-    size_t sig_bytes_len;
     uint8_t data_hash[32]; /* SHA256 hash size */
     size_t hash_len = sizeof(data_hash);
     
@@ -125,16 +139,14 @@ TEE_Result verify_signature_common(const void *data, size_t data_len,
         return res;
     }
     
-    /* 将十六进制签名转换为字节数组 */
-    res = hex_string_to_bytes(signature, strlen(signature), sig_bytes, &sig_bytes_len);
+    /* 创建验证操作，最大密钥长度取自客户端公钥本身 */
+    TEE_ObjectInfo info;
+    res = TEE_GetObjectInfo1(key_obj, &info);
     if (res != TEE_SUCCESS) {
-        EMSG("Failed to convert signature from hex: %x", res);
         return res;
     }
-    
-    /* 创建验证操作 */
     res = TEE_AllocateOperation(&op, TEE_ALG_RSASSA_PKCS1_V1_5_SHA256, 
-                               TEE_MODE_VERIFY, TEE_KEY_SIZE_BITS);
+                               TEE_MODE_VERIFY, info.objectSize);
     if (res != TEE_SUCCESS) {
         EMSG("Failed to allocate verify operation: %x", res);
         goto cleanup;
@@ -149,7 +161,7 @@ TEE_Result verify_signature_common(const void *data, size_t data_len,
     
     res = TEE_AsymmetricVerifyDigest(op, NULL, 0, 
                                      data_hash, hash_len,
-                                     sig_bytes, sig_bytes_len);
+                                     signature, sig_len);
     if (res != TEE_SUCCESS) {
         EMSG("Signature verification failed: %x", res);
     }
@@ -163,8 +175,11 @@ cleanup:
 
 /* 签名验证函数 */
 TEE_Result verify_signature(const void *data, size_t data_len, 
-                           const char *sigkey, const char *signature) {
+                           const char *sigkey, size_t sigkey_len,
+                           const uint8_t *signature, size_t sig_len) {
     TEE_ObjectHandle key_obj = TEE_HANDLE_NULL;
+    const struct rsa_pubkey *pk;
+    uint64_t start;
     TEE_Result res;
     
     /* 参数检查 */
@@ -172,15 +187,22 @@ TEE_Result verify_signature(const void *data, size_t data_len,
         return TEE_ERROR_BAD_PARAMETERS;
     }
     
-    /* 尝试从sigkey加载公钥 */
-    res = public_key_pem_to_obj(sigkey, &key_obj);
+    /* 解析sigkey（OpenSSH或PEM），同一请求内通常已在计算指纹时解析过 */
+    start = stats_now();
+    res = rsa_pubkey_parse(sigkey, sigkey_len, &pk);
+    if (res == TEE_SUCCESS) {
+        res = rsa_pubkey_to_obj(pk, &key_obj);
+    }
+    stats_record(TC_STATS_PHASE_PUBKEY, start);
     if (res != TEE_SUCCESS) {
         EMSG("Failed to load public key: %x", res);
         return res;
     }
     
     /* 调用通用验证函数 */
-    res = verify_signature_common(data, data_len, key_obj, signature);
+    start = stats_now();
+    res = verify_signature_common(data, data_len, key_obj, signature, sig_len);
+    stats_record(TC_STATS_PHASE_VERIFY, start);
     
     /* 清理资源 */
     if (key_obj != TEE_HANDLE_NULL)
@@ -189,151 +211,95 @@ TEE_Result verify_signature(const void *data, size_t data_len,
     return res;
 }
 
+/* SubjectPublicKeyInfo前缀：id-ecPublicKey + prime256v1，其后为65字节的未压缩点 */
+static const uint8_t p256_spki_prefix[] = {
+    0x30, 0x59, 0x30, 0x13, 0x06, 0x07, 0x2a, 0x86, 0x48, 0xce, 0x3d, 0x02, 0x01,
+    0x06, 0x08, 0x2a, 0x86, 0x48, 0xce, 0x3d, 0x03, 0x01, 0x07, 0x03, 0x42, 0x00,
+};
+/* SubjectPublicKeyInfo前缀：id-Ed25519，其后为32字节公钥 */
+static const uint8_t ed25519_spki_prefix[] = {
+    0x30, 0x2a, 0x30, 0x05, 0x06, 0x03, 0x2b, 0x65, 0x70, 0x03, 0x21, 0x00,
+};
+
+/* 读取定长的公钥坐标，属性去掉了前导0时在左侧补0 */
+static TEE_Result get_fixed_attr(TEE_ObjectHandle key_obj, uint32_t attr,
+                                 uint8_t *out, size_t out_len) {
+    uint8_t buf[32];
+    size_t len = sizeof(buf);
+    TEE_Result res = TEE_GetObjectBufferAttribute(key_obj, attr, buf, &len);
 
-
-
-
-/* 将 PEM 格式的公钥字符串转换为 TEE 公钥对象 */
-static TEE_Result public_key_pem_to_obj(const char *key_str, TEE_ObjectHandle *key_obj) {
-    TEE_Result res = TEE_SUCCESS;
-    int mbedtls_res;
-
-    // unsigned char der_buf[4096];
-    // size_t der_len = 0;
-
-    mbedtls_pk_context pk_ctx;
-    mbedtls_pk_init(&pk_ctx);
-
-    uint8_t *modulus_buf = NULL;
-    uint8_t *exponent_buf = NULL;
-
-    /* 使用 mbedtls_rsa_export 安全地导出 RSA 参数 */
-    mbedtls_mpi N, E;
-    mbedtls_mpi_init(&N);
-    mbedtls_mpi_init(&E);
-    
-    /* 使用 mbedtls_pem_read_buffer 解析 PEM -> DER */
-    // mbedtls_pem_context pem_ctx;
-    // mbedtls_pem_init(&pem_ctx);
-
-    /* 解析 PEM -> DER */
-    // mbedtls_res = mbedtls_pem_read_buffer(&pem_ctx, 
-    //                                       "-----BEGIN PUBLIC KEY-----", 
-    //                                       "-----END PUBLIC KEY-----",
-    //                                       (const unsigned char *)key_str, 
-    //                                       strlen(key_str), 
-    //                                       der_buf, 
-    //                                       sizeof(der_buf),
-    //                                       &der_len);
-    // if (mbedtls_res != 0) {
-    //     EMSG("mbedtls_pem_read_buffer failed: -0x%x", -mbedtls_res);
-    //     res = TEE_ERROR_BAD_FORMAT;
-    //     goto cleanup;
-    // }
-    
-    // /* 解析 DER 数据为公钥结构 */
-    // mbedtls_res = mbedtls_pk_parse_public_key(&pk_ctx, der_buf, der_len);
-    /* 解析 PEM 数据为公钥结构 */
-    mbedtls_res = mbedtls_pk_parse_public_key(&pk_ctx, (const unsigned char *)key_str, strlen(key_str));
-    if (mbedtls_res != 0) {
-        EMSG("mbedtls_pk_parse_public_key failed: -0x%x", -mbedtls_res);
-        res =  TEE_ERROR_BAD_FORMAT;
-        goto cleanup;
-    }
-    
-    /* 检查是否为 RSA 公钥 */
-    if (mbedtls_pk_get_type(&pk_ctx) != MBEDTLS_PK_RSA) {
-        EMSG("Public key is not RSA type");
-        res =  TEE_ERROR_BAD_PARAMETERS;
-        goto cleanup;
+    if (res != TEE_SUCCESS) {
+        return res;
     }
-    
-    mbedtls_rsa_context *rsa_ctx = mbedtls_pk_rsa(pk_ctx);
-    if (rsa_ctx == NULL) {
-        EMSG("Failed to extract RSA context from public key");
-        res = TEE_ERROR_BAD_PARAMETERS;
-        goto cleanup;
+    if (len > out_len) {
+        return TEE_ERROR_BAD_FORMAT;
     }
+    memset(out, 0, out_len - len);
+    memcpy(out + out_len - len, buf, len);
+    return TEE_SUCCESS;
+}
 
-    size_t key_bits = mbedtls_pk_get_bitlen(&pk_ctx);
+/* 椭圆曲线公钥的SPKI是固定前缀加定长公钥，直接拼接 */
+static TEE_Result ec_public_key_to_der(TEE_ObjectHandle key_obj, uint32_t obj_type,
+                                       uint8_t *der, size_t *der_len) {
+    TEE_Result res;
 
-    
-    /* 验证模数长度 */
-    if (key_bits < 2048 || key_bits > 4096) {
-        EMSG("Unsupported RSA key length: %zu, must be between 2048 and 4096", key_bits);
-        res = TEE_ERROR_BAD_PARAMETERS;
-        goto cleanup;
-    }
-    
-    /* 创建公钥对象 */
-    res = TEE_AllocateTransientObject(TEE_TYPE_RSA_PUBLIC_KEY, key_bits, key_obj);
-    if (res != TEE_SUCCESS) {
-        EMSG("Failed to allocate RSA public key object");
-        goto cleanup;
-    }
-    
-    int export_res = mbedtls_rsa_export(rsa_ctx, &N, NULL, NULL, NULL, &E);
-    if (export_res != 0) {
-        EMSG("mbedtls_rsa_export failed: -0x%x", -export_res);
-        res = TEE_ERROR_BAD_FORMAT;
-        goto cleanup;
-    }
-    
-    /* 获取模数和指数长度 */
-    size_t modulus_len = mbedtls_mpi_size(&N);
-    size_t exponent_len = mbedtls_mpi_size(&E);
-    
-    /* 分配缓冲区并导出模数和指数 */
-    modulus_buf = TEE_Malloc(modulus_len, TEE_MALLOC_FILL_ZERO);
-    exponent_buf = TEE_Malloc(exponent_len, TEE_MALLOC_FILL_ZERO);
-    if (!modulus_buf || !exponent_buf) {
-        res = TEE_ERROR_OUT_OF_MEMORY;
-        goto cleanup;
+    if (obj_type == TEE_TYPE_ECDSA_KEYPAIR || obj_type == TEE_TYPE_ECDSA_PUBLIC_KEY) {
+        size_t total = sizeof(p256_spki_prefix) + 65;
+        if (*der_len < total) {
+            *der_len = total;
+            return TEE_ERROR_SHORT_BUFFER;
+        }
+        memcpy(der, p256_spki_prefix, sizeof(p256_spki_prefix));
+        der[sizeof(p256_spki_prefix)] = 0x04;
+        res = get_fixed_attr(key_obj, TEE_ATTR_ECC_PUBLIC_VALUE_X,
+                             der + sizeof(p256_spki_prefix) + 1, 32);
+        if (res == TEE_SUCCESS) {
+            res = get_fixed_attr(key_obj, TEE_ATTR_ECC_PUBLIC_VALUE_Y,
+                                 der + sizeof(p256_spki_prefix) + 33, 32);
+        }
+        *der_len = total;
+        return res;
     }
-    
-
-    if ((mbedtls_res = mbedtls_mpi_write_binary(&N, modulus_buf, modulus_len)) != 0 ||
-    (mbedtls_res = mbedtls_mpi_write_binary(&E, exponent_buf, exponent_len)) != 0) {
-    EMSG("Failed to write RSA modulus or exponent: -0x%x", -mbedtls_res);
-    res = TEE_ERROR_GENERIC;
-    goto cleanup;
-}
-    
-    /* 设置公钥属性 */
-    TEE_Attribute attrs[2];
-    TEE_InitRefAttribute(&attrs[0], TEE_ATTR_RSA_MODULUS, modulus_buf, modulus_len);
-    TEE_InitRefAttribute(&attrs[1], TEE_ATTR_RSA_PUBLIC_EXPONENT, exponent_buf, exponent_len);
-    
-    res = TEE_PopulateTransientObject(*key_obj, attrs, 2);
-    if (res != TEE_SUCCESS) {
-        EMSG("Failed to populate transient object with RSA public key attributes");
-        TEE_FreeTransientObject(*key_obj);
-        *key_obj = TEE_HANDLE_NULL;
+#ifdef TEE_TYPE_ED25519_KEYPAIR
+    if (obj_type == TEE_TYPE_ED25519_KEYPAIR || obj_type == TEE_TYPE_ED25519_PUBLIC_KEY) {
+        size_t total = sizeof(ed25519_spki_prefix) + 32;
+        if (*der_len < total) {
+            *der_len = total;
+            return TEE_ERROR_SHORT_BUFFER;
+        }
+        memcpy(der, ed25519_spki_prefix, sizeof(ed25519_spki_prefix));
+        res = get_fixed_attr(key_obj, TEE_ATTR_ED25519_PUBLIC_VALUE,
+                             der + sizeof(ed25519_spki_prefix), 32);
+        *der_len = total;
+        return res;
     }
-    
-cleanup:
-    if (modulus_buf) TEE_Free(modulus_buf);
-    if (exponent_buf) TEE_Free(exponent_buf);
-    mbedtls_pk_free(&pk_ctx);
-    /* 清理 MPI 对象 */
-    mbedtls_mpi_free(&N);
-    mbedtls_mpi_free(&E);
-    // mbedtls_pem_free(&pem_ctx);
-    return res;
+#endif
+    return TEE_ERROR_NOT_SUPPORTED;
 }
 
-/* 将 TEE 公钥对象转换为标准 PEM 格式（SubjectPublicKeyInfo） */
-TEE_Result public_key_obj_to_pem(TEE_ObjectHandle key_obj, char *pem_buffer, size_t *pem_len) {
+/* 将 TEE 公钥对象转换为 DER 格式（SubjectPublicKeyInfo） */
+TEE_Result public_key_obj_to_der(TEE_ObjectHandle key_obj, uint8_t *der, size_t *der_len) {
     TEE_Result res;
+    TEE_ObjectInfo info;
     uint8_t modulus[512];
     size_t mod_len = sizeof(modulus);
     uint8_t exponent[8];
     size_t exp_len = sizeof(exponent);
 
-    if (!key_obj || !pem_buffer || !pem_len) {
+    if (!key_obj || !der || !der_len) {
         return TEE_ERROR_BAD_PARAMETERS;
     }
 
+    res = TEE_GetObjectInfo1(key_obj, &info);
+    if (res != TEE_SUCCESS) {
+        return res;
+    }
+    if (info.objectType != TEE_TYPE_RSA_KEYPAIR &&
+        info.objectType != TEE_TYPE_RSA_PUBLIC_KEY) {
+        return ec_public_key_to_der(key_obj, info.objectType, der, der_len);
+    }
+
     /* 导出 modulus 和 exponent */
     res = TEE_GetObjectBufferAttribute(key_obj, TEE_ATTR_RSA_MODULUS, modulus, &mod_len);
     if (res != TEE_SUCCESS) {
@@ -377,26 +343,36 @@ TEE_Result public_key_obj_to_pem(TEE_ObjectHandle key_obj, char *pem_buffer, siz
 
     /* DER encode 到临时缓冲区（逆序写入） */
     uint8_t der_buf[1024];
-    int der_len = mbedtls_pk_write_pubkey_der(&pk, der_buf, sizeof(der_buf));
-    if (der_len <= 0) {
-        mbedtls_rsa_free(&rsa);
-        mbedtls_pk_free(&pk);
+    int len = mbedtls_pk_write_pubkey_der(&pk, der_buf, sizeof(der_buf));
+    mbedtls_rsa_free(&rsa);
+    mbedtls_pk_free(&pk);
+    if (len <= 0) {
         return TEE_ERROR_GENERIC;
     }
+    if (*der_len < (size_t)len) {
+        *der_len = len;
+        return TEE_ERROR_SHORT_BUFFER;
+    }
 
-    /* 指向有效数据的起始地址 */
-    uint8_t *der_start = der_buf + sizeof(der_buf) - der_len;
+    /* 有效数据位于缓冲区末尾 */
+    memcpy(der, der_buf + sizeof(der_buf) - len, len);
+    *der_len = len;
+    return TEE_SUCCESS;
+}
 
+/* 将 DER 格式的公钥封装为标准 PEM 格式 */
+TEE_Result der_to_pem(const uint8_t *der, size_t der_len, char *pem_buffer, size_t *pem_len) {
     /* Base64 编码 + PEM 封装 */
     const char *pem_header = "-----BEGIN PUBLIC KEY-----\n";
     const char *pem_footer = "-----END PUBLIC KEY-----\n";
     size_t b64_len = 0;
     size_t estimated_len = ((der_len + 2) / 3) * 4 + strlen(pem_header) + strlen(pem_footer) + 32;
 
+    if (!der || !pem_buffer || !pem_len) {
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
     if (*pem_len < estimated_len) {
         *pem_len = estimated_len;
-        mbedtls_rsa_free(&rsa);
-        mbedtls_pk_free(&pk);
         return TEE_ERROR_SHORT_BUFFER;
     }
 
@@ -405,9 +381,7 @@ TEE_Result public_key_obj_to_pem(TEE_ObjectHandle key_obj, char *pem_buffer, siz
     out += strlen(pem_header);
 
     unsigned char b64_buf[1600];
-    if (mbedtls_base64_encode(b64_buf, sizeof(b64_buf), &b64_len, der_start, der_len) != 0) {
-        mbedtls_rsa_free(&rsa);
-        mbedtls_pk_free(&pk);
+    if (mbedtls_base64_encode(b64_buf, sizeof(b64_buf), &b64_len, der, der_len) != 0) {
         return TEE_ERROR_GENERIC;
     }
 
@@ -424,8 +398,5 @@ TEE_Result public_key_obj_to_pem(TEE_ObjectHandle key_obj, char *pem_buffer, siz
     *out = '\0';
 
     *pem_len = out - pem_buffer;
-
-    mbedtls_rsa_free(&rsa);
-    mbedtls_pk_free(&pk);
     return TEE_SUCCESS;
 }
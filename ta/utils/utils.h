@@ -27,12 +27,13 @@ struct repo_metadata;
 
 /* 签名验证函数 */
 TEE_Result verify_signature(const void *data, size_t data_len, 
-                           const char *sigkey, const char *signature);
+                           const char *sigkey, size_t sigkey_len,
+                           const uint8_t *signature, size_t sig_len);
 
 /* 通用验证函数，接受任何类型的密钥对象 */
 TEE_Result verify_signature_common(const void *data, size_t data_len,
                                   TEE_ObjectHandle key_obj, 
-                                  const char *signature);
+                                  const uint8_t *signature, size_t sig_len);
 
 /* 时间相关函数 */
 TEE_Time get_trust_time(void);
@@ -40,6 +41,9 @@ TEE_Time get_trust_time(void);
 /* 哈希计算函数 */
 TEE_Result hash_data(const void *data, size_t data_len, char *hash);
 
+/* 公钥指纹：SSH线格式公钥的SHA256，OpenSSH与PEM格式得到相同指纹，输出32字节 */
+TEE_Result key_fingerprint(const char *key, size_t key_len, uint8_t *fp);
+
 /* 字节数组与十六进制字符串转换函数 */
 void bytes_to_hex_string(const uint8_t *bytes, size_t len, char *hex_string);
 TEE_Result hex_string_to_bytes(const char *hex_string, size_t hex_len, 
@@ -49,8 +53,11 @@ TEE_Result hex_string_to_bytes(const char *hex_string, size_t hex_len,
 TEE_Result compute_sha256_hash(const void *data, size_t data_len, 
                                uint8_t *hash_buffer, size_t *hash_len);
 
-/* 将 TEE 公钥对象转换为 PEM 格式 */
-TEE_Result public_key_obj_to_pem(TEE_ObjectHandle key_obj, char *pem_buffer, size_t *pem_len);
+/* 将 TEE 公钥对象转换为 DER 格式（SubjectPublicKeyInfo） */
+TEE_Result public_key_obj_to_der(TEE_ObjectHandle key_obj, uint8_t *der, size_t *der_len);
+
+/* 将 DER 格式的公钥封装为 PEM 格式，输出以NUL结尾，*pem_len不含NUL */
+TEE_Result der_to_pem(const uint8_t *der, size_t der_len, char *pem_buffer, size_t *pem_len);
 
 
 
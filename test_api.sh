@@ -51,8 +51,14 @@ curl -X GET "http://localhost:8080/latest-hash/0?nonce=12345"
 
 echo -e "\n\n"
 
-# 5. 测试访问控制 - 删除写作者 (AccessControl DELETE)
-echo "5. 测试访问控制 - 删除写作者 (AccessControl DELETE)"
+# 5. 测试成员证明 (MemberProof) - 写作者new_writer_key_123应为writer
+echo "5. 测试成员证明 (MemberProof)"
+curl -X GET "http://localhost:8080/repos/0/member-proof?key=new_writer_key_123"
+
+echo -e "\n\n"
+
+# 6. 测试访问控制 - 删除写作者 (AccessControl DELETE)
+echo "6. 测试访问控制 - 删除写作者 (AccessControl DELETE)"
 curl -X POST http://localhost:8080/access-control \
   -H "Content-Type: application/json" \
   -d '{
@@ -66,8 +72,132 @@ curl -X POST http://localhost:8080/access-control \
 
 echo -e "\n\n"
 
-# 6. 测试删除仓库 (Delete)
-echo "6. 测试删除仓库 (Delete)"
+# 7. 测试链头证明 (HeadProof) - 链头树纪元默认每秒签发一次，新区块要等下一个纪元
+echo "7. 测试链头证明 (HeadProof)"
+sleep 1
+curl -X GET "http://localhost:8080/repos/0/head-proof"
+
+echo -e "\n\n"
+
+# 8. 测试比较并追加 (expected_parent) - 期望的父哈希不是当前链头，TA取得仓库后先比较链头（早于公钥、角色和签名检查），应返回409
+echo "8. 测试比较并追加 (expected_parent)"
+curl -X POST http://localhost:8080/commit \
+  -H "Content-Type: application/json" \
+  -d '{
+    "repo_id": 0,
+    "operation": "PUSH",
+    "branch": "main",
+    "commit_hash": "abc123def789",
+    "expected_parent": "0000000000000000000000000000000000000000000000000000000000000000",
+    "signature_key": "writer_public_key_456",
+    "signature": "deadbeef"
+  }'
+
+echo -e "\n\n"
+
+# 9. 测试仓库视图 (RepoView) - 由CA侧的视图直接返回，不进入TEE
+echo "9. 测试仓库视图 (RepoView)"
+curl -X GET "http://localhost:8080/repos/0"
+echo
+curl -X GET "http://localhost:8080/repos/0/members"
+echo
+curl -X GET "http://localhost:8080/repos/0/height"
+echo
+curl -X GET "http://localhost:8080/repos/0/role?key=founder_public_key_123"
+
+echo -e "\n\n"
+
+# 10. 测试TEE公钥 (TeePubkey) - 响应带ETag，公钥不变时可用If-None-Match得到304
+echo "10. 测试TEE公钥 (TeePubkey)"
+curl -i -X GET "http://localhost:8080/tee-pubkey?format=pem"
+echo
+curl -X GET "http://localhost:8080/tee-pubkey?format=json"
+
+echo -e "\n\n"
+
+# 11. 测试区块事件流 (Events) - SSE连接不会自行结束，2秒后断开
+echo "11. 测试区块事件流 (Events)"
+curl -N --max-time 2 -X GET "http://localhost:8080/repos/0/events"
+
+echo -e "\n\n"
+
+# 12. 测试区块导出 (Blocks) - 原始区块首尾相接，只显示响应头和字节数
+echo "12. 测试区块导出 (Blocks)"
+curl -s -D - -o /dev/null -w "%{size_download} bytes\n" "http://localhost:8080/repos/0/blocks?from=1&to=2"
+
+echo -e "\n\n"
+
+# 13. 测试审计查询 (Audit) - 索引由后台线程建立，新区块通常几毫秒内可查
+echo "13. 测试审计查询 (Audit)"
+curl -X GET "http://localhost:8080/audit/commits/abc123def456"
+echo
+curl -X GET "http://localhost:8080/audit/identities?key=writer_public_key_456&since=0&limit=10"
+
+echo -e "\n\n"
+
+# 14. 测试内容密钥会话 (KeySession) - 先握手取得session_id，之后的commit用wrapped_key代替enc_key
+#    会话未知、过期或被挤出时返回401，客户端重新握手
+echo "14. 测试内容密钥会话 (KeySession)"
+curl -X POST http://localhost:8080/key-session \
+  -H "Content-Type: application/json" \
+  -d '{
+    "enc_session_key": "00112233445566778899aabbccddeeff",
+    "ttl": 600
+  }'
+echo
+curl -X POST http://localhost:8080/commit \
+  -H "Content-Type: application/json" \
+  -d '{
+    "repo_id": 0,
+    "operation": "PUSH",
+    "commit_hash": "abc123def790",
+    "key_session": "0123456789abcdef",
+    "wrapped_key": "000102030405060708090a0b00112233445566778899aabbccddeeff00112233445566778899aabbccddeeff",
+    "signature_key": "writer_public_key_456",
+    "signature": "deadbeef"
+  }'
+
+echo -e "\n\n"
+
+# 15. 测试推送区块 (Push) - 一个区块登记整次推送，commits按推送顺序，最早的在前
+#    三个commit的推送根为48f0966f...；TA接受后列表才落盘，之后可逐个取回包含证明，被拒绝时/push-proof返回404
+echo "15. 测试推送区块 (Push)"
+curl -X POST http://localhost:8080/commit \
+  -H "Content-Type: application/json" \
+  -d '{
+    "repo_id": 0,
+    "operation": "PUSH",
+    "branch": "main",
+    "commits": ["1111111111111111111111111111111111111111", "2222222222222222222222222222222222222222", "3333333333333333333333333333333333333333"],
+    "old_tip": "1010101010101010101010101010101010101010",
+    "signature_key": "writer_public_key_456",
+    "signature": "deadbeef"
+  }'
+echo
+curl -X GET "http://localhost:8080/push-proof?root=48f0966fd90b359a47eb81f2b712b9818058706aa59dc2ad9dbbc1bc29126f24&commit=2222222222222222222222222222222222222222"
+
+echo -e "\n\n"
+
+# 16. 测试ACL检查点 (AclCheckpoint) - 按需生成检查点区块，上次检查点之后没有权限变更时返回409
+echo "16. 测试ACL检查点 (AclCheckpoint)"
+curl -X POST http://localhost:8080/acl-checkpoint \
+  -H "Content-Type: application/json" \
+  -d '{
+    "repo_id": 0
+  }'
+echo
+curl -X GET "http://localhost:8080/repos/0/acl-checkpoint"
+
+echo -e "\n\n"
+
+# 17. 测试性能指标 (Metrics) - Prometheus文本格式，只读，直方图自TA启动起单调累加
+echo "17. 测试性能指标 (Metrics)"
+curl -s -X GET "http://localhost:8080/metrics" | head -n 20
+
+echo -e "\n\n"
+
+# 18. 测试删除仓库 (Delete)
+echo "18. 测试删除仓库 (Delete)"
 curl -X POST http://localhost:8080/delete-repo \
   -H "Content-Type: application/json" \
   -d '{
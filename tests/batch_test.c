@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+/*
+ * 聚合签名窗口：TA的sign_batch与CA的tc_batch必须建出同一棵树。对1到
+ * TC_MAX_BATCH_LEAVES个区块的窗口（部分请求一次带两个区块），比较两侧的
+ * 根，填入证明后按trust_chain_abi.h中的校验循环逐块验证；另以固定向量
+ * 锁定叶子与内部节点的前缀和奇数节点上移的规则。
+ */
+
+#include "tc_test.h"
+#include "tc_batch.h"
+#include "tc_sha256.h"
+#include "sign_batch.h"
+
+#define BLOCK_CAP 1024
+#define SHARD 3
+
+static uint8_t bufs[TC_MAX_BATCH_LEAVES][2 * BLOCK_CAP + 2 * TC_MAX_BATCH_PROOF];
+static size_t lens[TC_MAX_BATCH_LEAVES];
+static uint32_t counts[TC_MAX_BATCH_LEAVES];
+static struct tc_batch batch;
+
+/* 带空占位字段的区块，即TA在聚合签名窗口内返回的形式 */
+static size_t make_block(uint8_t *out, uint32_t height, uint32_t *seed) {
+    struct tc_block_hdr hdr;
+    struct tc_writer w;
+    uint8_t body[64];
+    size_t body_len = 1 + test_rand(seed) % sizeof(body);
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.version = TC_ABI_VERSION;
+    hdr.block_type = TC_BLOCK_CONTRIBUTION;
+    hdr.block_height = height;
+    test_fill(seed, hdr.parent_hash, sizeof(hdr.parent_hash));
+    test_fill(seed, body, body_len);
+
+    tc_writer_init(&w, out, BLOCK_CAP);
+    w.len = sizeof(hdr);
+    tc_put_tlv(&w, TC_TAG_COMMIT_HASH, body, body_len);
+    hdr.body_len = (uint32_t)(w.len - sizeof(hdr));
+    memcpy(out, &hdr, sizeof(hdr));
+    tc_put_tlv(&w, TC_TAG_TEE_BATCH_SIG, NULL, 0);
+    CHECK(!w.overflow);
+    return w.len;
+}
+
+static void node(const uint8_t *left, const uint8_t *right, uint8_t *out) {
+    uint8_t buf[1 + 2 * TC_HASH_SIZE];
+    buf[0] = TC_MERKLE_NODE_PREFIX;
+    memcpy(buf + 1, left, TC_HASH_SIZE);
+    memcpy(buf + 1 + TC_HASH_SIZE, right, TC_HASH_SIZE);
+    tc_sha256(buf, sizeof(buf), out);
+}
+
+/* 按trust_chain_abi.h给出的步骤验证一个已填入证明的区块 */
+static void verify_block(const uint8_t *blk, size_t len, uint32_t leaf,
+                         const struct tc_batch_root *root) {
+    struct tc_block_hdr hdr;
+    struct tc_tlv_hdr tlv;
+    struct tc_batch_proof_hdr proof;
+    uint8_t leaf_buf[1 + TC_HASH_SIZE], h[TC_HASH_SIZE];
+    const uint8_t *path;
+    uint32_t idx, width, k = 0;
+    size_t off;
+
+    memcpy(&hdr, blk, sizeof(hdr));
+    off = sizeof(hdr) + hdr.body_len;
+    CHECK(tc_block_total_len(blk, len) == len);
+    memcpy(&tlv, blk + off, sizeof(tlv));
+    CHECK(tlv.tag == TC_TAG_TEE_BATCH_SIG);
+    memcpy(&proof, blk + off + sizeof(tlv), sizeof(proof));
+    CHECK(tlv.len == sizeof(proof) + (size_t)proof.path_len * TC_HASH_SIZE + proof.sig_len);
+    CHECK(proof.leaf_index == leaf);
+    CHECK(memcmp(&proof.root, root, sizeof(*root)) == 0);
+
+    leaf_buf[0] = TC_MERKLE_LEAF_PREFIX;
+    tc_sha256(blk, off, leaf_buf + 1);
+    tc_sha256(leaf_buf, sizeof(leaf_buf), h);
+    path = blk + off + sizeof(tlv) + sizeof(proof);
+    idx = proof.leaf_index;
+    width = proof.root.leaf_count;
+    while (width > 1) {
+        if (idx & 1) {
+            node(path + (size_t)k++ * TC_HASH_SIZE, h, h);
+        } else if (idx + 1 < width) {
+            node(h, path + (size_t)k++ * TC_HASH_SIZE, h);
+        }
+        idx /= 2;
+        width = (width + 1) / 2;
+    }
+    CHECK(k == proof.path_len);
+    CHECK(memcmp(h, proof.root.root, TC_HASH_SIZE) == 0);
+}
+
+/* TA侧的根只取决于区块哈希的序列 */
+static void test_fixed_vectors(void) {
+    static const struct {
+        uint32_t leaves;
+        const char *root;
+    } vectors[] = {
+        { 1, "dcffe786ded16d283c663846ad0c4ff26558fccde36ca9d30b2ea19eade9fc0e" },
+        { 3, "df896896c799531f1fd1e556cea26a6989ab06853bcbfdd3e4f5097a611f658f" },
+        { 5, "c51042bb8b9d81dfc115ef99d0e2cecf1954cfc078d70032d187b46615f01b90" },
+    };
+
+    for (size_t v = 0; v < sizeof(vectors) / sizeof(vectors[0]); v++) {
+        struct tc_batch_root root;
+        uint8_t want[TC_HASH_SIZE];
+
+        /* 第i个区块哈希为32个字节i + 1 */
+        for (uint32_t i = 0; i < vectors[v].leaves; i++) {
+            uint8_t block_hash[TC_HASH_SIZE];
+            memset(block_hash, (int)(i + 1), sizeof(block_hash));
+            CHECK(sign_batch_add(block_hash) == TEE_SUCCESS);
+        }
+        CHECK(sign_batch_root(SHARD, &root) == TEE_SUCCESS);
+        test_unhex(vectors[v].root, want, sizeof(want));
+        CHECK(root.leaf_count == vectors[v].leaves);
+        CHECK(memcmp(root.root, want, sizeof(want)) == 0);
+        sign_batch_reset();
+    }
+}
+
+static void test_window(uint32_t leaves, uint32_t *seed) {
+    struct tc_batch_root root;
+    uint8_t sig[TC_MAX_TEE_SIG_SIZE];
+    uint32_t added = 0, jobs = 0, leaf = 0;
+
+    tc_batch_reset(&batch);
+    /* 每三个请求中有一个带两个区块，如成员变更后紧跟ACL检查点 */
+    while (added < leaves) {
+        size_t len = make_block(bufs[jobs], added, seed);
+        counts[jobs] = 1;
+        if (added + 2 <= leaves && jobs % 3 == 1) {
+            len += make_block(bufs[jobs] + len, added + 1, seed);
+            counts[jobs] = 2;
+        }
+        lens[jobs] = len;
+        CHECK(tc_batch_pending_blocks(bufs[jobs], len) == counts[jobs]);
+        CHECK(tc_batch_add_blocks(&batch, bufs[jobs], len) == 0);
+
+        for (size_t off = 0; off < len;) {
+            struct tc_block_hdr hdr;
+            uint8_t block_hash[TC_HASH_SIZE];
+            memcpy(&hdr, bufs[jobs] + off, sizeof(hdr));
+            tc_sha256(bufs[jobs] + off, sizeof(hdr) + hdr.body_len, block_hash);
+            CHECK(sign_batch_add(block_hash) == TEE_SUCCESS);
+            off += tc_block_total_len(bufs[jobs] + off, len - off);
+        }
+        added += counts[jobs++];
+    }
+    CHECK(sign_batch_root(SHARD, &root) == TEE_SUCCESS);
+    CHECK(tc_batch_build(&batch, &root) == 0);
+
+    test_fill(seed, sig, sizeof(sig));
+    for (uint32_t j = 0; j < jobs; j++) {
+        size_t len = lens[j], off = 0;
+        CHECK(tc_batch_fill(&batch, leaf, &root, sig, sizeof(sig),
+                            bufs[j], &len, sizeof(bufs[j])) == 0);
+        CHECK(tc_batch_pending_blocks(bufs[j], len) == 0);
+        for (uint32_t q = 0; q < counts[j]; q++) {
+            size_t total = tc_block_total_len(bufs[j] + off, len - off);
+            CHECK(total > 0);
+            verify_block(bufs[j] + off, total, leaf++, &root);
+            off += total;
+        }
+        CHECK(off == len);
+    }
+
+    /* TA签名的根与CA重建的不符时拒绝填入 */
+    root.root[0] ^= 1;
+    CHECK(tc_batch_build(&batch, &root) != 0);
+    sign_batch_reset();
+}
+
+int main(void) {
+    uint32_t seed = 0x42;
+
+    sign_batch_enable(TC_MAX_BATCH_LEAVES);
+    test_fixed_vectors();
+    for (uint32_t leaves = 1; leaves <= TC_MAX_BATCH_LEAVES; leaves++) {
+        test_window(leaves, &seed);
+    }
+    printf("batch: ok\n");
+    return 0;
+}
@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+/*
+ * 链头树：TA的head_tree逐个加入叶子、只保留各完整子树的根，CA的
+ * tc_head_tree逐层建树，两者必须得到同一个根。对0到MAX_REPO_ID个叶子
+ * 比较两侧的根，并按trust_chain_abi.h中的校验循环验证CA生成的证明；
+ * 另以固定向量锁定叶子编码与合并规则。
+ */
+
+#include "tc_test.h"
+#include "tc_head_tree.h"
+#include "tc_sha256.h"
+#include "head_tree.h"
+
+static struct tc_head_leaf leaves[MAX_REPO_ID];
+
+static void node(const uint8_t *left, const uint8_t *right, uint8_t *out) {
+    uint8_t buf[1 + 2 * TC_HASH_SIZE];
+    buf[0] = TC_MERKLE_NODE_PREFIX;
+    memcpy(buf + 1, left, TC_HASH_SIZE);
+    memcpy(buf + 1 + TC_HASH_SIZE, right, TC_HASH_SIZE);
+    tc_sha256(buf, sizeof(buf), out);
+}
+
+static void verify_proof(const struct tc_head_tree *t, uint32_t index, const uint8_t *root) {
+    uint8_t path[TC_MAX_HEAD_TREE_DEPTH * TC_HASH_SIZE];
+    uint8_t buf[1 + sizeof(struct tc_head_leaf)], h[TC_HASH_SIZE];
+    uint32_t path_len = tc_head_tree_path(t, index, path);
+    uint32_t idx = index, width = t->leaf_count, k = 0;
+
+    buf[0] = TC_MERKLE_LEAF_PREFIX;
+    memcpy(buf + 1, &leaves[index], sizeof(leaves[index]));
+    tc_sha256(buf, sizeof(buf), h);
+    while (width > 1) {
+        if (idx & 1) {
+            node(path + (size_t)k++ * TC_HASH_SIZE, h, h);
+        } else if (idx + 1 < width) {
+            node(h, path + (size_t)k++ * TC_HASH_SIZE, h);
+        }
+        idx /= 2;
+        width = (width + 1) / 2;
+    }
+    CHECK(k == path_len);
+    CHECK(memcmp(h, root, TC_HASH_SIZE) == 0);
+}
+
+static void ta_root(uint32_t count, uint8_t *root) {
+    struct head_tree t;
+
+    head_tree_init(&t);
+    for (uint32_t i = 0; i < count; i++) {
+        CHECK(head_tree_add(&t, &leaves[i]) == TEE_SUCCESS);
+    }
+    CHECK(head_tree_root(&t, root) == TEE_SUCCESS);
+}
+
+/* 第i个叶子为{i + 1, 10 * (i + 1), 32个字节0xa0 + i} */
+static void test_fixed_vectors(void) {
+    static const struct {
+        uint32_t leaves;
+        const char *root;
+    } vectors[] = {
+        { 1, "9f00c0da5b19d0fcd2d521f6ba8108c3c52fe8a3b5829db851e6af947d076373" },
+        { 3, "d179c5e631a7b178b9aa7d2d81f70117198530a7e05921705bb65a305ea14423" },
+        { 5, "4f76ad4838699eda5f239a706b5a9382fcd0ab2e3e6b33239647a766a1b173de" },
+    };
+
+    for (uint32_t i = 0; i < 5; i++) {
+        leaves[i].rep_id = i + 1;
+        leaves[i].block_height = 10 * (i + 1);
+        memset(leaves[i].head, 0xa0 + (int)i, TC_HASH_SIZE);
+    }
+    for (size_t v = 0; v < sizeof(vectors) / sizeof(vectors[0]); v++) {
+        struct tc_head_tree t;
+        uint8_t want[TC_HASH_SIZE], root[TC_HASH_SIZE];
+
+        test_unhex(vectors[v].root, want, sizeof(want));
+        ta_root(vectors[v].leaves, root);
+        CHECK(memcmp(root, want, sizeof(want)) == 0);
+        CHECK(tc_head_tree_build(&t, leaves, vectors[v].leaves, want) == 0);
+        tc_head_tree_free(&t);
+    }
+}
+
+int main(void) {
+    uint32_t seed = 0x46;
+    uint8_t root[TC_HASH_SIZE];
+    struct tc_head_tree t;
+
+    test_fixed_vectors();
+
+    /* 没有仓库时根为全0 */
+    ta_root(0, root);
+    CHECK(tc_head_tree_build(&t, leaves, 0, root) == 0);
+    tc_head_tree_free(&t);
+    root[0] = 1;
+    CHECK(tc_head_tree_build(&t, leaves, 0, root) != 0);
+    tc_head_tree_free(&t);
+
+    for (uint32_t i = 0; i < MAX_REPO_ID; i++) {
+        leaves[i].rep_id = MAKE_REPO_ID(test_rand(&seed) % 16, 3, i);
+        leaves[i].block_height = test_rand(&seed);
+        test_fill(&seed, leaves[i].head, TC_HASH_SIZE);
+    }
+    for (uint32_t count = 1; count <= MAX_REPO_ID; count++) {
+        ta_root(count, root);
+        CHECK(tc_head_tree_build(&t, leaves, count, root) == 0);
+        CHECK(t.depth <= TC_MAX_HEAD_TREE_DEPTH);
+        /* 全部证明只验证一部分规模，其余只核对首尾叶子 */
+        if (count <= 64 || count % 97 == 0 || count == MAX_REPO_ID) {
+            for (uint32_t i = 0; i < count; i++) {
+                verify_proof(&t, i, root);
+            }
+        } else {
+            verify_proof(&t, 0, root);
+            verify_proof(&t, count - 1, root);
+        }
+        /* 签名的根与CA重建的不符时拒绝 */
+        tc_head_tree_free(&t);
+        root[TC_HASH_SIZE - 1] ^= 1;
+        CHECK(tc_head_tree_build(&t, leaves, count, root) != 0);
+        tc_head_tree_free(&t);
+    }
+    printf("head tree: ok\n");
+    return 0;
+}
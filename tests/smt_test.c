@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+/*
+ * 成员稀疏Merkle树：CA的tc_smt保存节点并生成证明，TA的smt只凭证明确认
+ * 角色并计算变更后的根，两侧必须遵守同一套规则。随机增删改成员（一部分
+ * 键与已有的键共享很长的前缀），每一步都要求TA接受CA的证明、由证明算出
+ * 的新根与CA树更新后的根相同，并拒绝篡改过或去掉相邻成员的证明；另以
+ * 固定向量锁定叶子、空子树、单成员子树与内部节点的哈希规则和证明格式。
+ */
+
+#include "tc_test.h"
+#include "tc_smt.h"
+#include "smt.h"
+
+#define POOL 3000
+#define OPS 20000
+
+static uint8_t keys[POOL][KEY_FP_SIZE];
+static uint8_t roles[POOL];
+static uint8_t proof[TC_SMT_MAX_PROOF_SIZE];
+
+/* 证明须能解析、声称的角色正确，且在root下通过TA的校验 */
+static void check_proof(const struct tc_smt *t, const uint8_t *fp, uint8_t role,
+                        struct smt_proof *p, size_t *len) {
+    uint8_t root[TC_HASH_SIZE];
+
+    tc_smt_root(t, root);
+    *len = tc_smt_prove(t, fp, proof);
+    CHECK(smt_proof_parse(proof, *len, p) == TEE_SUCCESS);
+    CHECK(p->role == role);
+    CHECK(smt_verify(p, fp, root) == TEE_SUCCESS);
+}
+
+static void test_fixed_vectors(void) {
+    uint8_t a[KEY_FP_SIZE], b[KEY_FP_SIZE], c[KEY_FP_SIZE], root[TC_HASH_SIZE];
+    struct tc_smt *t = tc_smt_new();
+    struct smt_proof p;
+    size_t len;
+
+    /* a与b在第0位分开，c与a在第6位分开 */
+    memset(a, 0x11, sizeof(a));
+    memset(b, 0x91, sizeof(b));
+    memcpy(c, a, sizeof(c));
+    c[0] = 0x13;
+    CHECK(t != NULL);
+
+    tc_smt_root(t, root);
+    CHECK_HEX(root, "0000000000000000000000000000000000000000000000000000000000000000");
+
+    /* 只有一个成员的树，根即为该成员的叶子SHA256(0x00 || fp || role) */
+    CHECK(tc_smt_set(t, a, ROLE_ADMIN) == 0);
+    tc_smt_root(t, root);
+    CHECK_HEX(root, "7484efba43243071e765e01e8a5e122fabd43169bbb641c98826d5133b385e45");
+    CHECK(smt_single_root(a, ROLE_ADMIN, root) == TEE_SUCCESS);
+    CHECK_HEX(root, "7484efba43243071e765e01e8a5e122fabd43169bbb641c98826d5133b385e45");
+    check_proof(t, a, ROLE_ADMIN, &p, &len);
+    CHECK(len == 1 + TC_SMT_BITMAP_SIZE);
+
+    CHECK(tc_smt_set(t, b, ROLE_WRITER) == 0);
+    tc_smt_root(t, root);
+    CHECK_HEX(root, "ba73782daa9ef698cc80285f7c6202721d0e1744749782721db57becc3a83bef");
+
+    /* 兄弟是单成员子树时附带该成员，成员证明与非成员证明都是如此 */
+    check_proof(t, a, ROLE_ADMIN, &p, &len);
+    CHECK(len == 1 + TC_SMT_BITMAP_SIZE + TC_HASH_SIZE + TC_SMT_LEAF_SIZE);
+    CHECK(p.deepest == 0 && memcmp(p.leaf, b, KEY_FP_SIZE) == 0 && p.leaf[KEY_FP_SIZE] == ROLE_WRITER);
+    check_proof(t, c, 0, &p, &len);
+    CHECK(len == 1 + TC_SMT_BITMAP_SIZE + TC_HASH_SIZE + TC_SMT_LEAF_SIZE);
+    CHECK(memcmp(p.leaf, a, KEY_FP_SIZE) == 0 && p.leaf[KEY_FP_SIZE] == ROLE_ADMIN);
+
+    /* 在单成员旁插入：TA由非成员证明算出分叉后的根 */
+    CHECK(smt_root_with(&p, c, ROLE_WRITER, root) == TEE_SUCCESS);
+    CHECK_HEX(root, "7dbdf7ac22ad45b7acada8b20887cfa99ea76b79eef9ad0d4a824ec240ffd733");
+    CHECK(tc_smt_set(t, c, ROLE_WRITER) == 0);
+    tc_smt_root(t, root);
+    CHECK_HEX(root, "7dbdf7ac22ad45b7acada8b20887cfa99ea76b79eef9ad0d4a824ec240ffd733");
+
+    /* 删除后回到上一个根 */
+    check_proof(t, c, ROLE_WRITER, &p, &len);
+    CHECK(smt_root_with(&p, c, 0, root) == TEE_SUCCESS);
+    CHECK_HEX(root, "ba73782daa9ef698cc80285f7c6202721d0e1744749782721db57becc3a83bef");
+    tc_smt_free(t);
+}
+
+/* 新键：随机，或与已有的键共享前bits位、第bits位相反 */
+static void new_key(uint8_t *key, int count, uint32_t *seed) {
+    test_fill(seed, key, KEY_FP_SIZE);
+    if (count > 0 && test_rand(seed) % 2) {
+        const uint8_t *other = keys[test_rand(seed) % count];
+        int bits = test_rand(seed) % TC_SMT_DEPTH;
+        for (int i = 0; i < bits; i++) {
+            uint8_t mask = 0x80 >> (i % 8);
+            key[i / 8] = (key[i / 8] & ~mask) | (other[i / 8] & mask);
+        }
+        uint8_t mask = 0x80 >> (bits % 8);
+        key[bits / 8] = (key[bits / 8] & ~mask) | (~other[bits / 8] & mask);
+    }
+}
+
+static void test_random_ops(void) {
+    struct tc_smt *t = tc_smt_new();
+    uint32_t seed = 0x48;
+    int count = 0;
+
+    CHECK(t != NULL);
+    for (int op = 0; op < OPS; op++) {
+        uint8_t root[TC_HASH_SIZE], got[TC_HASH_SIZE], want[TC_HASH_SIZE];
+        uint8_t tampered[TC_SMT_MAX_PROOF_SIZE];
+        struct smt_proof p, q;
+        uint8_t role = test_rand(&seed) % 3;
+        size_t len;
+        int k;
+
+        if (count < POOL && (count < 2 || test_rand(&seed) % 3 == 0)) {
+            k = count++;
+            new_key(keys[k], k, &seed);
+        } else {
+            k = test_rand(&seed) % count;
+        }
+        tc_smt_root(t, root);
+        check_proof(t, keys[k], roles[k], &p, &len);
+
+        CHECK(smt_root_with(&p, keys[k], role, got) == TEE_SUCCESS);
+        CHECK(tc_smt_set(t, keys[k], role) == 0);
+        roles[k] = role;
+        tc_smt_root(t, want);
+        CHECK(memcmp(got, want, TC_HASH_SIZE) == 0);
+
+        /* 改动最后一个字节（兄弟节点或相邻成员）后TA必须拒绝 */
+        if (len > 1 + TC_SMT_BITMAP_SIZE) {
+            memcpy(tampered, proof, len);
+            tampered[len - 1] ^= 1;
+            CHECK(smt_proof_parse(tampered, len, &q) != TEE_SUCCESS ||
+                  smt_verify(&q, keys[k], root) != TEE_SUCCESS);
+        }
+        /* 非成员证明去掉路径末端的成员后，不能借空子树冒充非成员 */
+        if (p.leaf != NULL && p.role == 0) {
+            CHECK(smt_proof_parse(proof, len - TC_SMT_LEAF_SIZE, &q) != TEE_SUCCESS ||
+                  smt_verify(&q, keys[k], root) != TEE_SUCCESS);
+        }
+    }
+    tc_smt_free(t);
+}
+
+int main(void) {
+    test_fixed_vectors();
+    test_random_ops();
+    printf("smt: ok\n");
+    return 0;
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#ifndef TC_TEST_H
+#define TC_TEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+/* 条件不成立时打印位置并以失败退出，ctest据此判定 */
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            exit(1); \
+        } \
+    } while (0)
+
+/* 十六进制常量转字节，用于固定向量 */
+static inline void test_unhex(const char *hex, uint8_t *out, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        unsigned int byte;
+        CHECK(sscanf(hex + 2 * i, "%2x", &byte) == 1);
+        out[i] = (uint8_t)byte;
+    }
+}
+
+#define CHECK_HEX(bytes, hex) do { \
+        uint8_t want_[sizeof(hex) / 2]; \
+        test_unhex(hex, want_, sizeof(want_)); \
+        CHECK(memcmp((bytes), want_, sizeof(want_)) == 0); \
+    } while (0)
+
+/* 可复现的伪随机数（xorshift32），各测试结果与平台的rand()无关 */
+static inline uint32_t test_rand(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+static inline void test_fill(uint32_t *state, uint8_t *out, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        out[i] = (uint8_t)test_rand(state);
+    }
+}
+
+#endif /* TC_TEST_H */
@@ -0,0 +1,6 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+/* ta/utils/utils.h会包含此头文件，测试中的TA模块不使用mbedTLS */
@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+/*
+ * 单元测试用的最小TEE内部API：只提供TA中与密钥无关的模块（Merkle树、
+ * 成员树）用到的类型和摘要接口，摘要由tc_sha256实现，数值与OP-TEE一致。
+ */
+
+#ifndef TEE_SHIM_API_TYPES_H
+#define TEE_SHIM_API_TYPES_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef uint32_t TEE_Result;
+
+#define TEE_SUCCESS                 0x00000000
+#define TEE_ERROR_GENERIC           0xFFFF0000
+#define TEE_ERROR_BAD_PARAMETERS    0xFFFF0006
+#define TEE_ERROR_ITEM_NOT_FOUND    0xFFFF0008
+#define TEE_ERROR_OUT_OF_MEMORY     0xFFFF000C
+#define TEE_ERROR_SECURITY          0xFFFF000F
+#define TEE_ERROR_SHORT_BUFFER      0xFFFF0010
+#define TEE_ERROR_OVERFLOW          0xFFFF300F
+
+#define TEE_ALG_SHA256              0x50000004
+#define TEE_MODE_DIGEST             3
+
+typedef struct tee_shim_object *TEE_ObjectHandle;
+typedef struct tee_shim_operation *TEE_OperationHandle;
+
+#define TEE_HANDLE_NULL NULL
+
+typedef struct {
+    uint32_t seconds;
+    uint32_t millis;
+} TEE_Time;
+
+#endif /* TEE_SHIM_API_TYPES_H */
@@ -0,0 +1,21 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#ifndef TEE_SHIM_INTERNAL_API_H
+#define TEE_SHIM_INTERNAL_API_H
+
+#include "tee_api_types.h"
+
+TEE_Result TEE_AllocateOperation(TEE_OperationHandle *op, uint32_t algorithm,
+                                 uint32_t mode, uint32_t max_key_size);
+void TEE_FreeOperation(TEE_OperationHandle op);
+void TEE_DigestUpdate(TEE_OperationHandle op, const void *chunk, size_t chunk_len);
+TEE_Result TEE_DigestDoFinal(TEE_OperationHandle op, const void *chunk, size_t chunk_len,
+                             void *hash, size_t *hash_len);
+
+/* 测试中统计TA侧的摘要次数 */
+extern unsigned long tee_shim_digests;
+
+#endif /* TEE_SHIM_INTERNAL_API_H */
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2024, Trust Chain Project
+ * All rights reserved.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "tee_internal_api.h"
+#include "tc_sha256.h"
+#include "../../ta/utils/utils.h"
+
+struct tee_shim_operation {
+    struct tc_sha256_ctx ctx;
+};
+
+unsigned long tee_shim_digests = 0;
+
+TEE_Result TEE_AllocateOperation(TEE_OperationHandle *op, uint32_t algorithm,
+                                 uint32_t mode, uint32_t max_key_size) {
+    (void)max_key_size;
+    if (algorithm != TEE_ALG_SHA256 || mode != TEE_MODE_DIGEST) {
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+    *op = malloc(sizeof(**op));
+    if (*op == NULL) {
+        return TEE_ERROR_OUT_OF_MEMORY;
+    }
+    tc_sha256_init(&(*op)->ctx);
+    return TEE_SUCCESS;
+}
+
+void TEE_FreeOperation(TEE_OperationHandle op) {
+    free(op);
+}
+
+void TEE_DigestUpdate(TEE_OperationHandle op, const void *chunk, size_t chunk_len) {
+    tc_sha256_update(&op->ctx, chunk, chunk_len);
+}
+
+/* 与GlobalPlatform一致：结束后操作回到初始状态，可以继续计算下一个摘要 */
+TEE_Result TEE_DigestDoFinal(TEE_OperationHandle op, const void *chunk, size_t chunk_len,
+                             void *hash, size_t *hash_len) {
+    if (*hash_len < TC_SHA256_DIGEST_SIZE) {
+        return TEE_ERROR_SHORT_BUFFER;
+    }
+    tc_sha256_update(&op->ctx, chunk, chunk_len);
+    tc_sha256_final(&op->ctx, hash);
+    tc_sha256_init(&op->ctx);
+    *hash_len = TC_SHA256_DIGEST_SIZE;
+    tee_shim_digests++;
+    return TEE_SUCCESS;
+}
+
+TEE_Result compute_sha256_hash(const void *data, size_t data_len,
+                               uint8_t *hash_buffer, size_t *hash_len) {
+    if (*hash_len < TC_SHA256_DIGEST_SIZE) {
+        return TEE_ERROR_SHORT_BUFFER;
+    }
+    tc_sha256(data, data_len, hash_buffer);
+    *hash_len = TC_SHA256_DIGEST_SIZE;
+    tee_shim_digests++;
+    return TEE_SUCCESS;
+}